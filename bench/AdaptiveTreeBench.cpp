@@ -0,0 +1,149 @@
+/**
+ * @file AdaptiveTreeBench.cpp
+ * @brief Benchmark: uniform vs variance-driven (adaptive) quadtree subdivision
+ *
+ * Builds a synthetic scene whose top half is replaced by open water (a flat
+ * level plus faint noise) with small bright ships on it, then builds the
+ * region tree with increasing variance tolerances. For each it reports the
+ * node count, memory, build / detection / top-K times and how many ships
+ * still overlap an anomalous leaf, next to the uniform tree. Detection uses
+ * the local baseline: against the global one the dark water itself stands
+ * out more than most ships do.
+ *
+ * USAGE:
+ *   ./build/bench/AdaptiveTreeBench [size]   (default: 4096)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "BenchUtil.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int WATER_LEVEL = 40;
+constexpr double WATER_NOISE = 3.0;     // Stddev: water variance ~9
+constexpr int SHIP_SIZE = 24;
+constexpr int SHIP_VALUE = 255;
+constexpr int SHIPS = 24;
+
+/**
+ * @brief Ships that overlap at least one anomalous leaf
+ */
+int shipsFound(const RegionTree& tree, const std::vector<Region>& ships) {
+    int found = 0;
+    for (const Region& ship : ships) {
+        for (const RegionTreeNode* leaf : tree.queryRegion(ship)) {
+            if (leaf->isAnomaly) {
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    if (size < 256) {
+        std::cerr << "Error: size must be at least 256\n";
+        return 1;
+    }
+
+    printHeader("ADAPTIVE SUBDIVISION BENCHMARK");
+
+    // Land from the synthetic generator, open water with ships on the top half
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 16, 42);
+    Matrix image = loader.getImage();
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0.0, WATER_NOISE);
+    for (int r = 0; r < size / 2; r++) {
+        for (int c = 0; c < size; c++) {
+            image[r][c] = static_cast<Pixel>(std::clamp(
+                static_cast<int>(WATER_LEVEL + noise(rng) + 0.5), 0, 255));
+        }
+    }
+    std::vector<Region> ships;
+    std::uniform_int_distribution<int> shipRow(0, size / 2 - SHIP_SIZE);
+    std::uniform_int_distribution<int> shipCol(0, size - SHIP_SIZE);
+    for (int s = 0; s < SHIPS; s++) {
+        const int r = shipRow(rng);
+        const int c = shipCol(rng);
+        ships.emplace_back(r, c, r + SHIP_SIZE - 1, c + SHIP_SIZE - 1);
+        for (int i = r; i < r + SHIP_SIZE; i++) {
+            for (int j = c; j < c + SHIP_SIZE; j++) image[i][j] = SHIP_VALUE;
+        }
+    }
+
+    PrefixSum prefixSum;
+    prefixSum.build(image);
+
+    std::cout << "Scene: " << size << "x" << size << ", top half water (variance ~"
+              << WATER_NOISE * WATER_NOISE << ") with " << SHIPS << " ships of "
+              << SHIP_SIZE << "x" << SHIP_SIZE << ", best of " << Bench::REPETITIONS << " runs\n\n";
+    std::cout << std::left
+              << std::setw(11) << "Tolerance"
+              << std::setw(11) << "Nodes"
+              << std::setw(11) << "Leaves"
+              << std::setw(12) << "Memory MB"
+              << std::setw(11) << "Build ms"
+              << std::setw(12) << "Detect ms"
+              << std::setw(11) << "TopK ms"
+              << "Ships\n";
+    std::cout << std::string(86, '-') << "\n";
+
+    int uniformShips = -1;
+    bool keepsShips = true;
+    for (double tolerance : {0.0, 20.0, 100.0, 400.0}) {
+        RegionTree tree;
+        const double buildMs = Bench::timeBest([&] {
+            tree.build(&prefixSum, Config::MIN_REGION_SIZE, TreeLayout::DepthFirst, tolerance);
+        });
+
+        AnomalyDetector detector(Config::DEFAULT_ANOMALY_THRESHOLD);
+        detector.initialize(&prefixSum);
+        detector.setBaseline(ScoreBaseline::Local);
+        const double detectMs = Bench::timeBest([&] { detector.detectInTree(tree); });
+
+        QueryEngine engine;
+        engine.initialize(&tree, &prefixSum, &detector);
+        QueryResult result;
+        const double topKMs = Bench::timeBest([&] { engine.topKAnomalies(Config::DEFAULT_TOP_K, true, result); });
+
+        const int found = shipsFound(tree, ships);
+        if (uniformShips < 0) uniformShips = found;
+        keepsShips = keepsShips && found >= uniformShips;
+
+        std::cout << std::left << std::fixed
+                  << std::setw(11) << (tolerance > 0 ? std::to_string(static_cast<int>(tolerance))
+                                                     : std::string("uniform"))
+                  << std::setw(11) << tree.getNodeCount()
+                  << std::setw(11) << tree.getLeafCount()
+                  << std::setw(12) << std::setprecision(2) << tree.getMemoryBytes() / (1024.0 * 1024.0)
+                  << std::setw(11) << std::setprecision(2) << buildMs
+                  << std::setw(12) << std::setprecision(3) << detectMs
+                  << std::setw(11) << topKMs
+                  << found << "/" << SHIPS << "\n";
+    }
+
+    std::cout << "\n" << (keepsShips ? "Every adaptive tree finds the ships the uniform tree finds"
+                                     : "WARNING: an adaptive tree lost ships the uniform tree finds")
+              << "\n";
+    return 0;
+}
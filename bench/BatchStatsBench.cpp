@@ -0,0 +1,194 @@
+/**
+ * @file BatchStatsBench.cpp
+ * @brief Benchmark: batched vs one-at-a-time rectangle statistics
+ *
+ * Builds prefix tables for synthetic scenes of increasing size (full and
+ * compact storage), then answers the same list of random areas of interest
+ * with a PrefixSum::queryStats() loop and with one queryStatsBatch() call.
+ * Reports throughput in queries per second and checks that both paths
+ * return identical statistics.
+ *
+ * Two AOI workloads are used: "random" mixes small and large rectangles at
+ * random positions (a few extend past the image edge, as they do in real
+ * request lists); "tiled" is a grid of tiles covering the scene, submitted
+ * in shuffled order, so neighbouring queries share table corners.
+ *
+ * USAGE:
+ *   ./build/bench/BatchStatsBench [queries [size ...]]
+ *   (default: 50000 queries, sizes 1024 4096 8192)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "ThreadPool.h"
+#include "BenchUtil.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int MAX_AOI_SIDE = 512;
+
+/**
+ * @brief Random AOIs, about 2% of them partly outside the image
+ */
+std::vector<Region> makeQueries(int size, int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> side(1, std::min(MAX_AOI_SIDE, size));
+    std::uniform_int_distribution<int> position(0, size - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::vector<Region> queries(count);
+    for (Region& q : queries) {
+        int r1 = position(rng);
+        int c1 = position(rng);
+        int r2 = r1 + side(rng) - 1;
+        int c2 = c1 + side(rng) - 1;
+        if (percent(rng) >= 2) {
+            r2 = std::min(r2, size - 1);
+            c2 = std::min(c2, size - 1);
+        }
+        q = Region(r1, c1, r2, c2);
+    }
+    return queries;
+}
+
+/**
+ * @brief A grid of side x side tiles covering the image, in shuffled order
+ * 
+ * Neighbouring tiles share corners, so this is the case where visiting the
+ * queries in spatial order can turn cache misses into hits.
+ */
+std::vector<Region> makeTiledQueries(int size, int side, unsigned seed) {
+    std::vector<Region> queries;
+    for (int r = 0; r < size; r += side) {
+        for (int c = 0; c < size; c += side) {
+            queries.emplace_back(r, c, std::min(size, r + side) - 1, std::min(size, c + side) - 1);
+        }
+    }
+    std::shuffle(queries.begin(), queries.end(), std::mt19937(seed));
+    return queries;
+}
+
+bool sameStats(const RegionStats& a, const RegionStats& b) {
+    return a.sum == b.sum && a.area == b.area && a.mean == b.mean &&
+           a.variance == b.variance && a.stdDev == b.stdDev;
+}
+
+std::string formatRate(int queries, double ms) {
+    double perSecond = ms > 0 ? queries / (ms / 1000.0) : 0;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << perSecond / 1e6 << " M/s";
+    return out.str();
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int numQueries = 50000;
+    std::vector<int> sizes;
+    if (argc > 1) {
+        numQueries = std::atoi(argv[1]);
+        if (numQueries <= 0) {
+            std::cerr << "Error: invalid query count '" << argv[1] << "'\n";
+            return 1;
+        }
+    }
+    for (int i = 2; i < argc; i++) {
+        int size = std::atoi(argv[i]);
+        if (size <= 0) {
+            std::cerr << "Error: invalid image size '" << argv[i] << "'\n";
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty()) sizes = {1024, 4096, 8192};
+
+    printHeader("BATCHED RECTANGLE STATISTICS BENCHMARK");
+    std::cout << "Queries per batch: " << formatNumber(numQueries)
+              << ", AOI side 1.." << MAX_AOI_SIDE << ", best of " << Bench::REPETITIONS << " runs\n";
+    std::cout << "Threads: " << ThreadPool::shared().getThreadCount() << "\n\n";
+
+    std::cout << std::left
+              << std::setw(8) << "Size"
+              << std::setw(9) << "AOIs"
+              << std::setw(10) << "Storage"
+              << std::setw(12) << "Tables"
+              << std::setw(11) << "Loop ms"
+              << std::setw(11) << "Batch ms"
+              << std::setw(13) << "Loop rate"
+              << std::setw(13) << "Batch rate"
+              << "Speedup\n";
+    std::cout << std::string(96, '-') << "\n";
+
+    bool allMatch = true;
+    for (int size : sizes) {
+        ImageLoader loader;
+        loader.generateSyntheticImage(size, 12, 42);
+
+        // Tile side chosen so the grid has about numQueries tiles
+        int tileSide = std::max(1, static_cast<int>(size / std::sqrt(static_cast<double>(numQueries))));
+        const std::vector<std::pair<const char*, std::vector<Region>>> workloads = {
+            {"random", makeQueries(size, numQueries, 7)},
+            {"tiled", makeTiledQueries(size, tileSide, 7)},
+        };
+
+        for (PrefixStorage mode : {PrefixStorage::Full, PrefixStorage::Compact}) {
+            PrefixSum prefixSum;
+            prefixSum.build(loader.getImage(), mode);
+
+            for (const auto& workload : workloads) {
+                const std::vector<Region>& queries = workload.second;
+                const int count = static_cast<int>(queries.size());
+                std::vector<RegionStats> loopStats(queries.size());
+                std::vector<RegionStats> batchStats(queries.size());
+
+                double loopMs = Bench::timeBest([&]() {
+                    for (size_t i = 0; i < queries.size(); i++) {
+                        loopStats[i] = prefixSum.queryStats(queries[i]);
+                    }
+                });
+                double batchMs = Bench::timeBest([&]() {
+                    prefixSum.queryStatsBatch(queries.data(), queries.size(), batchStats.data());
+                });
+
+                bool match = true;
+                for (size_t i = 0; i < queries.size() && match; i++) {
+                    match = sameStats(loopStats[i], batchStats[i]);
+                }
+                allMatch = allMatch && match;
+
+                std::ostringstream speedup;
+                speedup << std::fixed << std::setprecision(2)
+                        << (batchMs > 0 ? loopMs / batchMs : 0) << "x";
+
+                std::cout << std::left
+                          << std::setw(8) << size
+                          << std::setw(9) << workload.first
+                          << std::setw(10) << (prefixSum.getStorage() == PrefixStorage::Full ? "full" : "compact")
+                          << std::setw(12) << formatBytes(prefixSum.getMemoryBytes())
+                          << std::setw(11) << std::fixed << std::setprecision(2) << loopMs
+                          << std::setw(11) << batchMs
+                          << std::setw(13) << formatRate(count, loopMs)
+                          << std::setw(13) << formatRate(count, batchMs)
+                          << speedup.str() << (match ? "" : "  MISMATCH") << "\n";
+            }
+        }
+    }
+
+    std::cout << "\n" << (allMatch ? "Batch results identical to queryStats()"
+                                   : "ERROR: batch results differ from queryStats()") << "\n";
+    return allMatch ? 0 : 1;
+}
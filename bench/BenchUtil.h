@@ -0,0 +1,76 @@
+/**
+ * @file BenchUtil.h
+ * @brief Helpers shared by the benchmarks in bench/
+ *
+ *   - timeBest():     best-of-N wall time of a callable
+ *   - makeRequests(): a reproducible random query mix over one scene
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include "Utils.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace SatelliteAnalytics {
+namespace Bench {
+
+constexpr int REPETITIONS = 3;
+
+/**
+ * @brief Best-of-N wall time of a callable, in milliseconds
+ */
+template <typename Work>
+double timeBest(Work work, int repetitions = REPETITIONS) {
+    double best = 0;
+    for (int rep = 0; rep < repetitions; rep++) {
+        Timer timer;
+        timer.start();
+        work();
+        timer.stop();
+        if (rep == 0 || timer.elapsedMs() < best) best = timer.elapsedMs();
+    }
+    return best;
+}
+
+/**
+ * @struct Request
+ * @brief One query of a benchmark mix; what kind means is up to the bench
+ */
+struct Request {
+    int kind;
+    int k;                              // 1..50, for top-K style kinds
+    Region region;                      // Random rectangle, sides 16..size/4
+};
+
+/**
+ * @brief Fixed, seeded request list over a size x size scene
+ * @param pickKind int(int i, std::mt19937& rng): kind of the i-th request,
+ *                 drawn before its k and rectangle
+ */
+template <typename PickKind>
+std::vector<Request> makeRequests(int size, int count, unsigned seed, PickKind pickKind) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> k(1, 50);
+    std::uniform_int_distribution<int> position(0, size - 1);
+    std::uniform_int_distribution<int> side(16, std::max(16, size / 4));
+
+    std::vector<Request> requests(count);
+    for (int i = 0; i < count; i++) {
+        Request& req = requests[i];
+        req.kind = pickKind(i, rng);
+        req.k = k(rng);
+        int r1 = position(rng);
+        int c1 = position(rng);
+        req.region = Region(r1, c1, std::min(size - 1, r1 + side(rng)),
+                            std::min(size - 1, c1 + side(rng)));
+    }
+    return requests;
+}
+
+} // namespace Bench
+} // namespace SatelliteAnalytics
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,118 @@
+/**
+ * @file ComponentBench.cpp
+ * @brief Benchmark: edge-index vs pairwise adjacency for connected components
+ *
+ * Builds synthetic scenes of increasing size with a low anomaly threshold,
+ * so large parts of the image are flagged (the flood / burn-scar case),
+ * then times findConnectedComponents() and findConnectedComponentsDFS()
+ * with both AdjacencyMethod values and checks that they agree.
+ *
+ * USAGE:
+ *   ./build/bench/ComponentBench [size ...]   (default: 256 512 1024 2048)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "BenchUtil.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr double FLOOD_THRESHOLD = 0.5;
+constexpr int MIN_REGION = 8;
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++) {
+        int size = std::atoi(argv[i]);
+        if (size <= 0) {
+            std::cerr << "Error: invalid image size '" << argv[i] << "'\n";
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty()) sizes = {256, 512, 1024, 2048};
+
+    printHeader("CONNECTED COMPONENT ADJACENCY BENCHMARK");
+    std::cout << "Threshold: " << FLOOD_THRESHOLD << " std devs, min region: "
+              << MIN_REGION << ", best of " << Bench::REPETITIONS << " runs\n\n";
+
+    std::cout << std::left
+              << std::setw(8) << "Size"
+              << std::setw(12) << "Anomalous"
+              << std::setw(12) << "Components"
+              << std::setw(14) << "UF pair ms"
+              << std::setw(14) << "UF index ms"
+              << std::setw(14) << "DFS pair ms"
+              << std::setw(14) << "DFS index ms"
+              << "Speedup\n";
+    std::cout << std::string(96, '-') << "\n";
+
+    bool allMatch = true;
+
+    for (int size : sizes) {
+        ImageLoader loader;
+        loader.generateSyntheticImage(size, std::max(8, size / 64));
+
+        PrefixSum prefixSum;
+        prefixSum.build(loader.getImage());
+
+        RegionTree tree;
+        tree.build(&prefixSum, MIN_REGION);
+
+        AnomalyDetector detector(FLOOD_THRESHOLD);
+        detector.initialize(&prefixSum);
+        detector.detectInTree(tree);
+
+        QueryEngine engine;
+        engine.initialize(&tree, &prefixSum, &detector);
+
+        size_t ufPairCount = 0, ufIndexCount = 0, dfsPairCount = 0, dfsIndexCount = 0;
+        double ufPair = Bench::timeBest([&] {
+            ufPairCount = engine.findConnectedComponents(AdjacencyMethod::Pairwise).size();
+        });
+        double ufIndex = Bench::timeBest([&] {
+            ufIndexCount = engine.findConnectedComponents(AdjacencyMethod::EdgeIndex).size();
+        });
+        double dfsPair = Bench::timeBest([&] {
+            dfsPairCount = engine.findConnectedComponentsDFS(AdjacencyMethod::Pairwise).size();
+        });
+        double dfsIndex = Bench::timeBest([&] {
+            dfsIndexCount = engine.findConnectedComponentsDFS(AdjacencyMethod::EdgeIndex).size();
+        });
+
+        bool match = ufPairCount == ufIndexCount && ufPairCount == dfsPairCount &&
+                     ufPairCount == dfsIndexCount;
+        allMatch = allMatch && match;
+
+        std::cout << std::left << std::fixed << std::setprecision(3)
+                  << std::setw(8) << size
+                  << std::setw(12) << engine.countAnomalousRegions()
+                  << std::setw(12) << (match ? std::to_string(ufIndexCount) : "MISMATCH")
+                  << std::setw(14) << ufPair
+                  << std::setw(14) << ufIndex
+                  << std::setw(14) << dfsPair
+                  << std::setw(14) << dfsIndex
+                  << std::setprecision(1) << (ufPair / std::max(ufIndex, 1e-3)) << "x\n";
+    }
+
+    if (!allMatch) {
+        std::cerr << "\nError: adjacency methods disagree on component count\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file ConcurrentQueryBench.cpp
+ * @brief Benchmark: many threads querying one shared QueryEngine
+ *
+ * Builds and scores one synthetic scene, then runs a read-only query mix
+ * (pruned top-K, rectangle search, region statistics and, less often,
+ * connected components) from 1, 2, 4, ... threads at once against the same
+ * const engine. Reports total query throughput and scaling relative to one
+ * thread, and checks every answer against a single-threaded reference run.
+ *
+ * USAGE:
+ *   ./build/bench/ConcurrentQueryBench [size [queries-per-thread [max-threads]]]
+ *   (default: 2048, 2000 queries, hardware concurrency)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "BenchUtil.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int COMPONENT_EVERY = 64;     // One component query per this many requests
+
+// Request kinds: 0 top-K, 1 rectangle, 2 stats, 3 components
+using Bench::Request;
+
+/**
+ * @brief Fixed request list; every thread replays it from its own offset
+ */
+std::vector<Request> makeRequests(int size, int count, unsigned seed) {
+    return Bench::makeRequests(size, count, seed, [](int i, std::mt19937& rng) {
+        if (i % COMPONENT_EVERY == COMPONENT_EVERY - 1) return 3;
+        return std::uniform_int_distribution<int>(0, 2)(rng);
+    });
+}
+
+/**
+ * @brief Order-sensitive digest of one answer, for comparing runs
+ */
+uint64_t answer(const QueryEngine& engine, const Request& req) {
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&h](uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+
+    switch (req.kind) {
+        case 0:
+            for (const AnomalyRegion& r : engine.topKWithPruning(req.k).regions) mix(r.nodeId);
+            break;
+        case 1:
+            for (const AnomalyRegion& r : engine.queryRectangle(req.region).regions) mix(r.nodeId);
+            break;
+        case 2: {
+            RegionStats stats = engine.queryRegionStats(req.region);
+            mix(static_cast<uint64_t>(stats.sum));
+            mix(static_cast<uint64_t>(stats.area));
+            break;
+        }
+        default:
+            for (const ConnectedComponent& comp : engine.findConnectedComponents()) {
+                mix(static_cast<uint64_t>(comp.totalArea));
+                mix(comp.nodeIndices.size());
+            }
+            break;
+    }
+    return h;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 2048;
+    int perThread = argc > 2 ? std::atoi(argv[2]) : 2000;
+    int maxThreads = argc > 3 ? std::atoi(argv[3])
+                              : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (size <= 0 || perThread <= 0 || maxThreads <= 0) {
+        std::cerr << "Error: arguments must be positive\n";
+        return 1;
+    }
+
+    printHeader("CONCURRENT QUERY BENCHMARK");
+
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 16, 42);
+    PrefixSum prefixSum;
+    prefixSum.build(loader.getImage());
+    RegionTree tree;
+    tree.build(&prefixSum);
+    AnomalyDetector detector(1.0);
+    detector.initialize(&prefixSum);
+    detector.detectInTree(tree);
+
+    QueryEngine engine;
+    engine.initialize(&tree, &prefixSum, &detector);
+
+    const std::vector<Request> requests = makeRequests(size, perThread, 7);
+    std::vector<uint64_t> reference(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) reference[i] = answer(engine, requests[i]);
+
+    std::cout << "Scene: " << size << "x" << size << ", " << formatNumber(tree.getNodeCount())
+              << " nodes, " << formatNumber(engine.countAnomalousRegions()) << " anomalous\n";
+    std::cout << "Queries per thread: " << formatNumber(perThread)
+              << " (top-K / rectangle / stats, components every " << COMPONENT_EVERY << ")\n";
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+
+    std::cout << std::left
+              << std::setw(10) << "Threads"
+              << std::setw(12) << "Wall ms"
+              << std::setw(16) << "Queries/s"
+              << "Scaling\n";
+    std::cout << std::string(48, '-') << "\n";
+
+    std::atomic<int> mismatches(0);
+    double singleRate = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        Timer timer;
+        timer.start();
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                // Start each thread at a different point so they do not run in lockstep
+                const size_t n = requests.size();
+                size_t offset = (n * t) / threads;
+                for (size_t q = 0; q < n; q++) {
+                    size_t i = (q + offset) % n;
+                    if (answer(engine, requests[i]) != reference[i]) mismatches++;
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        timer.stop();
+        double rate = timer.elapsedMs() > 0
+                          ? static_cast<double>(threads) * perThread / (timer.elapsedMs() / 1000.0)
+                          : 0;
+        if (threads == 1) singleRate = rate;
+
+        std::cout << std::left
+                  << std::setw(10) << threads
+                  << std::setw(12) << std::fixed << std::setprecision(2) << timer.elapsedMs()
+                  << std::setw(16) << std::setprecision(0) << rate
+                  << std::setprecision(2) << (singleRate > 0 ? rate / singleRate : 0) << "x\n";
+    }
+
+    std::cout << "\n" << (mismatches == 0 ? "All concurrent answers match the single-threaded run"
+                                          : "ERROR: " + std::to_string(mismatches.load()) +
+                                                " concurrent answers differ")
+              << "\n";
+    return mismatches == 0 ? 0 : 1;
+}
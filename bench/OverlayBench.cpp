@@ -0,0 +1,246 @@
+/**
+ * @file OverlayBench.cpp
+ * @brief Benchmark: output stage (overlay, ASCII map, previews, PGM write)
+ *
+ * Analyses one synthetic scene, then times each output step against the
+ * approach it replaced:
+ *   - overlay:  per-leaf pixel loops over a Matrix copy and the full leaf
+ *               list vs Visualizer::createAnomalyOverlay()
+ *   - ASCII map: full-resolution anomaly mask plus scale² reads per
+ *               character vs Visualizer::renderAnomalyMap() (output discarded)
+ *   - previews: per-pixel block averages from the image vs
+ *               Visualizer::buildPreviewPyramid() from the prefix sums
+ *   - PGM:      one write per row vs Visualizer::savePGM()
+ * and checks that the overlay, the map and the first preview level match
+ * the old output exactly.
+ *
+ * USAGE:
+ *   ./build/bench/OverlayBench [size [levels]]   (default: 8192, 4)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "Visualizer.h"
+#include "BenchUtil.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr double THRESHOLD = 1.0;       // Many anomalous leaves to draw
+constexpr int CONSOLE_WIDTH = 80;
+constexpr int CONSOLE_HEIGHT = 40;
+const char* const SCRATCH_FILE = "overlay_bench.pgm";
+
+// The overlay as it was drawn before: copy, then every leaf pixel by pixel
+Matrix legacyOverlay(const Matrix& source, const RegionTree& tree) {
+    Matrix result = source;
+    for (const RegionTreeNode* leaf : tree.getLeaves()) {
+        if (!leaf->isAnomaly) continue;
+        const Region& b = leaf->bounds;
+        for (int r = b.row1; r <= b.row2; r++) {
+            for (int c = b.col1; c <= b.col2; c++) {
+                if (r >= 0 && r < result.rows() && c >= 0 && c < result.cols()) {
+                    result[r][c] = static_cast<Pixel>(std::min(255, result[r][c] + 100));
+                }
+            }
+        }
+        for (int r = b.row1; r <= b.row2; r++) {
+            if (r < 0 || r >= result.rows()) continue;
+            if (b.col1 >= 0 && b.col1 < result.cols()) result[r][b.col1] = 255;
+            if (b.col2 >= 0 && b.col2 < result.cols()) result[r][b.col2] = 255;
+        }
+        for (int c = b.col1; c <= b.col2; c++) {
+            if (c < 0 || c >= result.cols()) continue;
+            if (b.row1 >= 0 && b.row1 < result.rows()) result[b.row1][c] = 255;
+            if (b.row2 >= 0 && b.row2 < result.rows()) result[b.row2][c] = 255;
+        }
+    }
+    return result;
+}
+
+// The ASCII anomaly map as it was built before, into a string
+std::string legacyAnomalyMap(const Matrix& image, const RegionTree& tree, int scale) {
+    static const char gradient[] = " .:-=+*#%@";
+    const int height = image.rows();
+    const int width = image.cols();
+    Buffer2D<uint8_t> mask(height, width, 0);
+    for (const RegionTreeNode* leaf : tree.getLeaves()) {
+        if (!leaf->isAnomaly) continue;
+        for (int r = leaf->bounds.row1; r <= leaf->bounds.row2 && r < height; r++) {
+            for (int c = leaf->bounds.col1; c <= leaf->bounds.col2 && c < width; c++) mask[r][c] = 1;
+        }
+    }
+    std::string out = "\n";
+    const int outHeight = std::min(CONSOLE_HEIGHT, height / scale);
+    const int outWidth = std::min(CONSOLE_WIDTH, width / scale);
+    for (int r = 0; r < outHeight; r++) {
+        for (int c = 0; c < outWidth; c++) {
+            bool anomalous = false;
+            int sum = 0;
+            int count = 0;
+            for (int dr = 0; dr < scale && r * scale + dr < height; dr++) {
+                for (int dc = 0; dc < scale && c * scale + dc < width; dc++) {
+                    sum += image[r * scale + dr][c * scale + dc];
+                    count++;
+                    if (mask[r * scale + dr][c * scale + dc]) anomalous = true;
+                }
+            }
+            const int avg = count > 0 ? sum / count : 0;
+            out += anomalous ? 'X' : gradient[std::max(0, std::min(9, static_cast<int>(avg / 255.0 * 9)))];
+        }
+        out += "\n";
+    }
+    out += "\nLegend: 'X' = Anomalous region\n";
+    return out;
+}
+
+// Box-filtered preview by reading every pixel
+Matrix legacyPreview(const Matrix& image, int factor) {
+    const int outHeight = (image.rows() + factor - 1) / factor;
+    const int outWidth = (image.cols() + factor - 1) / factor;
+    Matrix preview(outHeight, outWidth);
+    for (int r = 0; r < outHeight; r++) {
+        for (int c = 0; c < outWidth; c++) {
+            int64_t sum = 0;
+            int64_t count = 0;
+            for (int i = r * factor; i < std::min(image.rows(), (r + 1) * factor); i++) {
+                for (int j = c * factor; j < std::min(image.cols(), (c + 1) * factor); j++) {
+                    sum += image[i][j];
+                    count++;
+                }
+            }
+            preview[r][c] = static_cast<Pixel>((sum + count / 2) / count);
+        }
+    }
+    return preview;
+}
+
+bool legacySavePGM(const Matrix& image, const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    file << "P5\n" << image.cols() << " " << image.rows() << "\n255\n";
+    for (int r = 0; r < image.rows(); r++) {
+        file.write(reinterpret_cast<const char*>(image[r]), image.cols());
+    }
+    return static_cast<bool>(file);
+}
+
+bool samePixels(const Matrix& a, const Matrix& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return false;
+    for (int r = 0; r < a.rows(); r++) {
+        if (!std::equal(a[r], a[r] + a.cols(), b[r])) return false;
+    }
+    return true;
+}
+
+void printRow(const std::string& step, double before, double after, bool match) {
+    std::cout << std::left << std::fixed << std::setprecision(2)
+              << std::setw(14) << step
+              << std::setw(14) << before
+              << std::setw(14) << after
+              << std::setw(10) << std::setprecision(1) << (after > 0 ? before / after : 0)
+              << (match ? "ok" : "MISMATCH") << "\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 8192;
+    int levels = argc > 2 ? std::atoi(argv[2]) : 4;
+    if (size < 256 || levels <= 0) {
+        std::cerr << "Error: size must be at least 256 and levels positive\n";
+        return 1;
+    }
+
+    printHeader("OUTPUT STAGE BENCHMARK");
+
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 64, 42);
+    const Matrix& image = loader.getImage();
+    PrefixSum prefixSum;
+    prefixSum.build(image);
+    RegionTree tree;
+    tree.build(&prefixSum, Config::MIN_REGION_SIZE);
+    AnomalyDetector detector(THRESHOLD);
+    detector.initialize(&prefixSum);
+    detector.detectInTree(tree);
+
+    Visualizer visualizer(CONSOLE_WIDTH, CONSOLE_HEIGHT);
+    const int scale = std::max(1, size / 64);
+
+    std::cout << "Scene: " << size << "x" << size << ", " << tree.getLeafCount() << " leaves, "
+              << detector.getStats().anomalousRegions << " anomalous regions, best of "
+              << Bench::REPETITIONS << " runs\n\n";
+    std::cout << std::left
+              << std::setw(14) << "Step"
+              << std::setw(14) << "Before ms"
+              << std::setw(14) << "After ms"
+              << std::setw(10) << "Speedup"
+              << "Check\n";
+    std::cout << std::string(58, '-') << "\n";
+
+    bool allMatch = true;
+
+    Matrix before, after;
+    const double overlayBefore = Bench::timeBest([&] { before = legacyOverlay(image, tree); });
+    const double overlayAfter = Bench::timeBest([&] { after = visualizer.createAnomalyOverlay(image, tree); });
+    bool match = samePixels(before, after);
+    allMatch = allMatch && match;
+    printRow("overlay", overlayBefore, overlayAfter, match);
+
+    // The new map prints to std::cout: capture it instead
+    std::string mapBefore;
+    std::ostringstream mapAfter;
+    const double mapBeforeMs = Bench::timeBest([&] { mapBefore = legacyAnomalyMap(image, tree, scale); });
+    std::streambuf* console = std::cout.rdbuf(mapAfter.rdbuf());
+    const double mapAfterMs = Bench::timeBest([&] {
+        mapAfter.str("");
+        visualizer.renderAnomalyMap(prefixSum, tree, scale);
+    });
+    std::cout.rdbuf(console);
+    match = mapBefore == mapAfter.str();
+    allMatch = allMatch && match;
+    printRow("ascii map", mapBeforeMs, mapAfterMs, match);
+
+    std::vector<Matrix> pyramidBefore, pyramidAfter;
+    const double previewBefore = Bench::timeBest([&] {
+        pyramidBefore.clear();
+        for (int level = 1; level <= levels; level++) pyramidBefore.push_back(legacyPreview(image, 1 << level));
+    });
+    const double previewAfter = Bench::timeBest([&] {
+        pyramidAfter = visualizer.buildPreviewPyramid(prefixSum, levels);
+    });
+    match = pyramidBefore.size() == pyramidAfter.size();
+    for (size_t level = 0; level < pyramidAfter.size() && match; level++) {
+        match = samePixels(pyramidBefore[level], pyramidAfter[level]);
+    }
+    allMatch = allMatch && match;
+    printRow("previews", previewBefore, previewAfter, match);
+
+    const double saveBefore = Bench::timeBest([&] { legacySavePGM(after, SCRATCH_FILE); });
+    const double saveAfter = Bench::timeBest([&] { visualizer.savePGM(after, SCRATCH_FILE); });
+    ImageLoader reloaded;
+    match = reloaded.loadFromPGM(SCRATCH_FILE) && samePixels(reloaded.getImage(), after);
+    std::remove(SCRATCH_FILE);
+    allMatch = allMatch && match;
+    printRow("save pgm", saveBefore, saveAfter, match);
+
+    std::cout << "\n" << (allMatch ? "New output path matches the old one"
+                                   : "ERROR: new and old output differ")
+              << "\n";
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file PatchUpdateBench.cpp
+ * @brief Benchmark: in-place patch updates vs a full rebuild
+ *
+ * Builds one synthetic scene per storage mode (full, compact, blocked) and
+ * replaces square patches of increasing side at random positions, timing
+ * PrefixSum::updateRegion() together with RegionTree::refreshRegion() and
+ * AnomalyDetector::detectInRegion(). The baseline is what the pipeline did
+ * before: rebuild the prefix tables and the tree and re-score everything.
+ *
+ * After the last patch of each size the updated scene is checked against a
+ * fresh build of the patched image (random rectangle sums and every node's
+ * score).
+ *
+ * USAGE:
+ *   ./build/bench/PatchUpdateBench [size [patches-per-size]]
+ *   (default: 4096, 20 patches)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int CHECK_QUERIES = 2000;
+
+const char* modeName(PrefixStorage mode) {
+    switch (mode) {
+        case PrefixStorage::Compact: return "compact";
+        case PrefixStorage::Blocked: return "blocked";
+        default: return "full";
+    }
+}
+
+/**
+ * @brief Compare an updated scene with a fresh build of the same pixels
+ */
+bool matchesRebuild(const Matrix& image, PrefixStorage mode, const PrefixSum& prefixSum,
+                    const RegionTree& tree, const AnomalyDetector& detector, std::mt19937& rng) {
+    PrefixSum fresh;
+    fresh.build(image, mode);
+    const int h = image.rows();
+    const int w = image.cols();
+    std::uniform_int_distribution<int> row(0, h - 1);
+    std::uniform_int_distribution<int> col(0, w - 1);
+    for (int q = 0; q < CHECK_QUERIES; q++) {
+        int r1 = row(rng), r2 = row(rng), c1 = col(rng), c2 = col(rng);
+        if (r1 > r2) std::swap(r1, r2);
+        if (c1 > c2) std::swap(c1, c2);
+        if (prefixSum.querySum(r1, c1, r2, c2) != fresh.querySum(r1, c1, r2, c2) ||
+            prefixSum.querySumSquares(r1, c1, r2, c2) != fresh.querySumSquares(r1, c1, r2, c2)) {
+            return false;
+        }
+    }
+
+    RegionTree freshTree;
+    freshTree.build(&fresh, tree.getMinRegionSize(), tree.getLayout());
+    AnomalyDetector freshDetector(detector.getThreshold());
+    freshDetector.initialize(&fresh);
+    freshDetector.setReferenceStats(detector.getGlobalMean(), detector.getGlobalStdDev());
+    freshDetector.detectInTree(freshTree);
+
+    const RegionTreeColumns& a = tree.getColumns();
+    const RegionTreeColumns& b = freshTree.getColumns();
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a.mean[i] != b.mean[i] || a.anomalyScore[i] != b.anomalyScore[i] ||
+            a.maxLeafScore[i] != b.maxLeafScore[i] || a.isAnomaly[i] != b.isAnomaly[i]) {
+            return false;
+        }
+    }
+    return detector.getStats().anomalousRegions == freshDetector.getStats().anomalousRegions;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    int patches = argc > 2 ? std::atoi(argv[2]) : 20;
+    if (size < 64 || patches <= 0) {
+        std::cerr << "Error: size must be at least 64 and patches positive\n";
+        return 1;
+    }
+
+    printHeader("PATCH UPDATE BENCHMARK");
+
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 16, 42);
+    const Matrix original = loader.getImage();
+
+    std::cout << "Scene: " << size << "x" << size << ", " << patches
+              << " random patches per size\n\n";
+    std::cout << std::left
+              << std::setw(10) << "Storage"
+              << std::setw(8) << "Patch"
+              << std::setw(14) << "Prefix ms"
+              << std::setw(12) << "Tree ms"
+              << std::setw(12) << "Score ms"
+              << std::setw(14) << "Rebuild ms"
+              << std::setw(10) << "Speedup"
+              << "Check\n";
+    std::cout << std::string(88, '-') << "\n";
+
+    bool allMatch = true;
+    for (PrefixStorage mode : {PrefixStorage::Full, PrefixStorage::Compact, PrefixStorage::Blocked}) {
+        Matrix image = original;
+        PrefixSum prefixSum;
+        RegionTree tree;
+        AnomalyDetector detector(Config::DEFAULT_ANOMALY_THRESHOLD);
+
+        // Baseline: everything the pipeline rebuilds for a changed scene
+        Timer timer;
+        timer.start();
+        prefixSum.build(image, mode);
+        tree.build(&prefixSum);
+        detector.initialize(&prefixSum);
+        detector.detectInTree(tree);
+        timer.stop();
+        const double rebuildMs = timer.elapsedMs();
+
+        std::mt19937 rng(11);
+        for (int side : {16, 64, 256, 1024}) {
+            if (side > size) break;
+            std::uniform_int_distribution<int> position(0, size - side);
+            std::uniform_int_distribution<int> pixel(0, 255);
+            Matrix patch(side, side);
+
+            double prefixMs = 0, treeMs = 0, scoreMs = 0;
+            for (int p = 0; p < patches; p++) {
+                const int r = position(rng);
+                const int c = position(rng);
+                for (int i = 0; i < side; i++) {
+                    for (int j = 0; j < side; j++) {
+                        patch[i][j] = static_cast<Pixel>(pixel(rng));
+                        image[r + i][c + j] = patch[i][j];
+                    }
+                }
+                const Region bounds(r, c, r + side - 1, c + side - 1);
+
+                timer.start();
+                prefixSum.updateRegion(r, c, patch);
+                timer.stop();
+                prefixMs += timer.elapsedMs();
+
+                timer.start();
+                tree.refreshRegion(bounds);
+                timer.stop();
+                treeMs += timer.elapsedMs();
+
+                timer.start();
+                detector.detectInRegion(tree, bounds);
+                timer.stop();
+                scoreMs += timer.elapsedMs();
+            }
+            prefixMs /= patches;
+            treeMs /= patches;
+            scoreMs /= patches;
+
+            bool match = matchesRebuild(image, mode, prefixSum, tree, detector, rng);
+            allMatch = allMatch && match;
+            double updateMs = prefixMs + treeMs + scoreMs;
+
+            std::cout << std::left
+                      << std::setw(10) << modeName(prefixSum.getStorage())
+                      << std::setw(8) << side
+                      << std::setw(14) << std::fixed << std::setprecision(3) << prefixMs
+                      << std::setw(12) << treeMs
+                      << std::setw(12) << scoreMs
+                      << std::setw(14) << std::setprecision(2) << rebuildMs
+                      << std::setw(10) << std::setprecision(1)
+                      << (updateMs > 0 ? rebuildMs / updateMs : 0)
+                      << (match ? "ok" : "MISMATCH") << "\n";
+        }
+    }
+
+    std::cout << "\n" << (allMatch ? "All updated scenes match a fresh build"
+                                   : "ERROR: an updated scene differs from a fresh build")
+              << "\n";
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file QueryAllocBench.cpp
+ * @brief Benchmark: heap allocations and latency of per-call vs reused query buffers
+ *
+ * Runs the same mix of pruned top-K, full-scan top-K and rectangle queries
+ * twice on one scored scene: through the value-returning API (fresh
+ * containers per call) and through the in-place overloads with one reused
+ * QueryResult and QueryScratch. Global operator new is replaced to count
+ * allocations. The reused run is measured after a warm-up pass, so it
+ * reports the steady state, which should be zero allocations per query.
+ *
+ * USAGE:
+ *   ./build/bench/QueryAllocBench [size [queries]]   (default: 2048, 20000)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "BenchUtil.h"
+
+// ============================================================================
+// ALLOCATION COUNTING
+// ============================================================================
+
+namespace {
+std::atomic<long long> allocationCount(0);
+}
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+// Request kinds: 0 pruned top-K, 1 full top-K, 2 rectangle
+using Bench::Request;
+
+std::vector<Request> makeRequests(int size, int count, unsigned seed) {
+    return Bench::makeRequests(size, count, seed, [](int, std::mt19937& rng) {
+        // Full scans are far slower than the rest; keep them rare
+        int kind = std::uniform_int_distribution<int>(0, 2)(rng);
+        if (kind == 1 && rng() % 8 != 0) kind = 0;
+        return kind;
+    });
+}
+
+uint64_t digest(const QueryResult& result) {
+    uint64_t h = 1469598103934665603ull;
+    for (const AnomalyRegion& r : result.regions) h = (h ^ static_cast<uint64_t>(r.nodeId)) * 1099511628211ull;
+    return h;
+}
+
+struct RunStats {
+    double ms;
+    long long allocations;
+    uint64_t hash;
+};
+
+RunStats runPerCall(const QueryEngine& engine, const std::vector<Request>& requests) {
+    uint64_t hash = 0;
+    long long before = allocationCount.load();
+    Timer timer;
+    timer.start();
+    for (const Request& req : requests) {
+        QueryResult result = req.kind == 0 ? engine.topKWithPruning(req.k)
+                           : req.kind == 1 ? engine.topKAnomalies(req.k, true)
+                                           : engine.queryRectangle(req.region);
+        hash = hash * 31 + digest(result);
+    }
+    timer.stop();
+    return {timer.elapsedMs(), allocationCount.load() - before, hash};
+}
+
+RunStats runReused(const QueryEngine& engine, const std::vector<Request>& requests,
+                   QueryResult& result, QueryScratch& scratch) {
+    uint64_t hash = 0;
+    long long before = allocationCount.load();
+    Timer timer;
+    timer.start();
+    for (const Request& req : requests) {
+        if (req.kind == 0) engine.topKWithPruning(req.k, result, scratch);
+        else if (req.kind == 1) engine.topKAnomalies(req.k, true, result);
+        else engine.queryRectangle(req.region, result);
+        hash = hash * 31 + digest(result);
+    }
+    timer.stop();
+    return {timer.elapsedMs(), allocationCount.load() - before, hash};
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 2048;
+    int count = argc > 2 ? std::atoi(argv[2]) : 20000;
+    if (size <= 0 || count <= 0) {
+        std::cerr << "Error: arguments must be positive\n";
+        return 1;
+    }
+
+    printHeader("QUERY ALLOCATION BENCHMARK");
+
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 16, 42);
+    PrefixSum prefixSum;
+    prefixSum.build(loader.getImage());
+    RegionTree tree;
+    tree.build(&prefixSum);
+    AnomalyDetector detector(1.0);
+    detector.initialize(&prefixSum);
+    detector.detectInTree(tree);
+
+    QueryEngine engine;
+    engine.initialize(&tree, &prefixSum, &detector);
+
+    const std::vector<Request> requests = makeRequests(size, count, 11);
+    std::cout << "Scene: " << size << "x" << size << ", " << formatNumber(tree.getNodeCount())
+              << " nodes, " << formatNumber(engine.countAnomalousRegions()) << " anomalous\n";
+    std::cout << "Queries: " << formatNumber(count) << " (pruned top-K / full top-K / rectangle)\n\n";
+
+    RunStats perCall = runPerCall(engine, requests);
+
+    QueryResult result;
+    QueryScratch scratch;
+    runReused(engine, requests, result, scratch);           // Warm-up: grow the buffers
+    RunStats reused = runReused(engine, requests, result, scratch);
+
+    std::cout << std::left
+              << std::setw(12) << "API"
+              << std::setw(12) << "Wall ms"
+              << std::setw(14) << "µs/query"
+              << "Allocations/query\n";
+    std::cout << std::string(54, '-') << "\n";
+    for (const auto& [name, run] : {std::make_pair("per-call", perCall), std::make_pair("reused", reused)}) {
+        std::cout << std::left
+                  << std::setw(12) << name
+                  << std::setw(12) << std::fixed << std::setprecision(2) << run.ms
+                  << std::setw(14) << std::setprecision(3) << run.ms * 1000.0 / count
+                  << std::setprecision(3) << static_cast<double>(run.allocations) / count << "\n";
+    }
+
+    const bool same = perCall.hash == reused.hash;
+    std::cout << "\n" << (same ? "Reused buffers return the same answers"
+                               : "ERROR: reused buffers return different answers")
+              << "\n";
+    return same ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file RectangleIndexBench.cpp
+ * @brief Benchmark: leaf-index rectangle queries vs the tree walk they replace
+ *
+ * For a uniform and an adaptive tree over the same synthetic scene, runs a
+ * fixed set of random rectangles three ways:
+ *   - tree walk: RegionTree::queryRegion() into reused buffers, filter
+ *     anomalous leaves, sort by score (what queryRectangle() used to do)
+ *   - index:     QueryEngine::queryRectangle() over the LeafIndex
+ *   - top-N:     QueryEngine::topNInRectangle() with N = 10
+ * and checks that the walk and the index agree on every rectangle, that
+ * top-N is a prefix of the full result, and that LeafIndex::neighbors()
+ * matches a brute-force adjacency test on a sample of leaves.
+ *
+ * USAGE:
+ *   ./build/bench/RectangleIndexBench [size [queries]]   (default: 4096, 20000)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int TOP_N = 10;
+constexpr int NEIGHBOR_SAMPLES = 500;
+constexpr double THRESHOLD = 1.0;       // Plenty of anomalous leaves per rectangle
+
+std::vector<int> sortedIds(const QueryResult& result) {
+    std::vector<int> ids;
+    for (const AnomalyRegion& r : result.regions) ids.push_back(r.nodeId);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+bool edgeAdjacent(const Region& a, const Region& b) {
+    const bool rowsOverlap = a.row1 <= b.row2 && b.row1 <= a.row2;
+    const bool colsOverlap = a.col1 <= b.col2 && b.col1 <= a.col2;
+    return (rowsOverlap && (a.col2 + 1 == b.col1 || b.col2 + 1 == a.col1)) ||
+           (colsOverlap && (a.row2 + 1 == b.row1 || b.row2 + 1 == a.row1));
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    int queries = argc > 2 ? std::atoi(argv[2]) : 20000;
+    if (size < 64 || queries <= 0) {
+        std::cerr << "Error: size must be at least 64 and queries positive\n";
+        return 1;
+    }
+
+    printHeader("RECTANGLE INDEX BENCHMARK");
+
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 16, 42);
+    PrefixSum prefixSum;
+    prefixSum.build(loader.getImage());
+
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> position(0, size - 1);
+    std::uniform_int_distribution<int> side(16, std::max(16, size / 4));
+    std::vector<Region> rects(queries);
+    for (Region& r : rects) {
+        const int r1 = position(rng);
+        const int c1 = position(rng);
+        r = Region(r1, c1, std::min(size - 1, r1 + side(rng)), std::min(size - 1, c1 + side(rng)));
+    }
+
+    std::cout << "Scene: " << size << "x" << size << ", " << queries
+              << " random rectangles, threshold " << THRESHOLD << "\n\n";
+    std::cout << std::left
+              << std::setw(12) << "Tree"
+              << std::setw(10) << "Leaves"
+              << std::setw(10) << "Cells"
+              << std::setw(12) << "Index KB"
+              << std::setw(12) << "Walk ms"
+              << std::setw(12) << "Index ms"
+              << std::setw(12) << "Top-N ms"
+              << std::setw(10) << "Speedup"
+              << "Check\n";
+    std::cout << std::string(98, '-') << "\n";
+
+    bool allMatch = true;
+    for (double tolerance : {0.0, 400.0}) {
+        RegionTree tree;
+        tree.build(&prefixSum, Config::MIN_REGION_SIZE, TreeLayout::DepthFirst, tolerance);
+        AnomalyDetector detector(THRESHOLD);
+        detector.initialize(&prefixSum);
+        detector.detectInTree(tree);
+        QueryEngine engine;
+        engine.initialize(&tree, &prefixSum, &detector);
+
+        // Tree walk into reused buffers, as queryRectangle() did before the index
+        std::vector<const RegionTreeNode*> leaves;
+        std::vector<int> queue;
+        QueryResult walk;
+        std::vector<std::vector<int>> walkIds(queries);
+        Timer timer;
+        timer.start();
+        for (int q = 0; q < queries; q++) {
+            walk.reset();
+            tree.queryRegion(rects[q], leaves, queue);
+            for (const RegionTreeNode* node : leaves) {
+                if (node->isAnomaly) walk.regions.emplace_back(node->bounds, node->anomalyScore, node->id);
+            }
+            std::sort(walk.regions.begin(), walk.regions.end(),
+                      [](const AnomalyRegion& a, const AnomalyRegion& b) {
+                          return a.anomalyScore > b.anomalyScore;
+                      });
+        }
+        timer.stop();
+        const double walkMs = timer.elapsedMs();
+        for (int q = 0; q < queries; q++) {
+            tree.queryRegion(rects[q], leaves, queue);
+            for (const RegionTreeNode* node : leaves) {
+                if (node->isAnomaly) walkIds[q].push_back(node->id);
+            }
+            std::sort(walkIds[q].begin(), walkIds[q].end());
+        }
+
+        QueryResult result;
+        timer.start();
+        for (int q = 0; q < queries; q++) engine.queryRectangle(rects[q], result);
+        timer.stop();
+        const double indexMs = timer.elapsedMs();
+        bool match = true;
+        for (int q = 0; q < queries && match; q++) {
+            engine.queryRectangle(rects[q], result);
+            match = sortedIds(result) == walkIds[q];
+        }
+
+        QueryResult full, top;
+        timer.start();
+        for (int q = 0; q < queries; q++) engine.topNInRectangle(rects[q], TOP_N, top);
+        timer.stop();
+        const double topMs = timer.elapsedMs();
+        for (int q = 0; q < queries && match; q += 97) {
+            engine.queryRectangle(rects[q], full);
+            engine.topNInRectangle(rects[q], TOP_N, top);
+            const size_t expect = std::min<size_t>(TOP_N, full.regions.size());
+            match = top.regions.size() == expect;
+            for (size_t r = 0; r < expect && match; r++) {
+                match = top.regions[r].anomalyScore == full.regions[r].anomalyScore;
+            }
+        }
+
+        // Neighbours against a brute-force scan of all leaves
+        const std::vector<const RegionTreeNode*> allLeaves = tree.getLeaves();
+        std::uniform_int_distribution<size_t> pick(0, allLeaves.size() - 1);
+        std::vector<int> found;
+        for (int s = 0; s < NEIGHBOR_SAMPLES && match; s++) {
+            const RegionTreeNode* leaf = allLeaves[pick(rng)];
+            engine.getLeafIndex().neighbors(leaf->id, found);
+            std::sort(found.begin(), found.end());
+            std::vector<int> expect;
+            for (const RegionTreeNode* other : allLeaves) {
+                if (edgeAdjacent(leaf->bounds, other->bounds)) expect.push_back(other->id);
+            }
+            std::sort(expect.begin(), expect.end());
+            match = found == expect;
+        }
+        allMatch = allMatch && match;
+
+        const LeafIndex& index = engine.getLeafIndex();
+        std::cout << std::left << std::fixed
+                  << std::setw(12) << (tolerance > 0 ? "adaptive" : "uniform")
+                  << std::setw(10) << tree.getLeafCount()
+                  << std::setw(10) << index.getCellCount()
+                  << std::setw(12) << std::setprecision(1) << index.getMemoryBytes() / 1024.0
+                  << std::setw(12) << std::setprecision(2) << walkMs
+                  << std::setw(12) << indexMs
+                  << std::setw(12) << topMs
+                  << std::setw(10) << std::setprecision(1)
+                  << (indexMs > 0 ? walkMs / indexMs : 0)
+                  << (match ? "ok" : "MISMATCH") << "\n";
+    }
+
+    std::cout << "\n" << (allMatch ? "Leaf index matches the tree walk on every query"
+                                   : "ERROR: leaf index and tree walk disagree")
+              << "\n";
+    return allMatch ? 0 : 1;
+}
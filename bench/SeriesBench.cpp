@@ -0,0 +1,229 @@
+/**
+ * @file SeriesBench.cpp
+ * @brief Benchmark: scene-series change detection vs reprocessing every pair
+ *
+ * Builds a synthetic day-by-day series of one area: each day brightens the
+ * whole scene a little (illumination drift) and moves a few blocks by
+ * ±CHANGE_DELTA, away from their own mean. The series is then scored two
+ * ways:
+ *   - per pair:  both scenes' tables, the difference tables, a new tree,
+ *                detector and query engine for every pair (nothing shared)
+ *   - series:    SceneSeries::addScene(), which builds each scene's tables
+ *                once and re-reads the statistics of one shared change tree
+ * and checks that both find the same top-K, the same components and every
+ * inserted block. Finally times SceneSeries::queryChange() against summing
+ * the before / after pixels of each rectangle directly.
+ *
+ * USAGE:
+ *   ./build/bench/SeriesBench [size [scenes]]   (default: 2048, 8)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "SceneSeries.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr int CHANGES_PER_SCENE = 3;
+constexpr int CHANGE_SIDE = 48;
+constexpr int CHANGE_DELTA = 80;
+constexpr int DRIFT_PER_SCENE = 4;      // Uniform brightening between acquisitions
+constexpr int RECT_QUERIES = 2000;
+
+struct PairResult {
+    std::vector<AnomalyRegion> topK;
+    int components;
+    int64_t largestArea;
+};
+
+// Everything rebuilt from scratch for one pair, as separate runs would do
+PairResult processPair(const Matrix& before, const Matrix& after, const SeriesConfig& cfg) {
+    PrefixSum beforeSum, afterSum, difference;
+    beforeSum.build(before);
+    afterSum.build(after);
+    difference.buildDifference(before, after);
+    RegionTree tree;
+    tree.build(&difference, cfg.minRegionSize, cfg.treeLayout);
+    AnomalyDetector detector(cfg.threshold);
+    detector.initialize(&difference);
+    detector.detectInTree(tree);
+    QueryEngine engine;
+    engine.initialize(&tree, &difference, &detector);
+
+    PairResult result;
+    QueryResult top;
+    QueryScratch scratch;
+    engine.topKWithPruning(cfg.topK, top, scratch);
+    result.topK = top.regions;
+    std::vector<ConnectedComponent> components = engine.findConnectedComponents();
+    result.components = static_cast<int>(components.size());
+    result.largestArea = components.empty() ? 0 : components[0].totalArea;
+    return result;
+}
+
+bool sameTopK(const std::vector<AnomalyRegion>& a, const std::vector<AnomalyRegion>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].nodeId != b[i].nodeId || a[i].anomalyScore != b[i].anomalyScore) return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? std::atoi(argv[1]) : 2048;
+    int sceneCount = argc > 2 ? std::atoi(argv[2]) : 8;
+    // Below 512 the blocks cover so much of the scene that they set stddev_d
+    if (size < 512 || sceneCount < 2) {
+        std::cerr << "Error: size must be at least 512 and scenes at least 2\n";
+        return 1;
+    }
+
+    printHeader("SCENE SERIES BENCHMARK");
+
+    // Day 0 is a synthetic scene; every later day drifts and gains new blocks
+    ImageLoader loader;
+    loader.generateSyntheticImage(size, 0, 42);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> corner(0, size - CHANGE_SIDE);
+    std::vector<Matrix> scenes(sceneCount, loader.getImage());
+    std::vector<std::vector<Region>> inserted(sceneCount);
+    for (int day = 1; day < sceneCount; day++) {
+        Matrix& scene = scenes[day];
+        scene = scenes[day - 1];
+        for (int r = 0; r < size; r++) {
+            for (int c = 0; c < size; c++) {
+                scene[r][c] = static_cast<Pixel>(std::min(255, scene[r][c] + DRIFT_PER_SCENE));
+            }
+        }
+        for (int k = 0; k < CHANGES_PER_SCENE; k++) {
+            const int row = corner(rng);
+            const int col = corner(rng);
+            const Region b(row, col, row + CHANGE_SIDE - 1, col + CHANGE_SIDE - 1);
+            // Brighten dark blocks and darken bright ones, so the change is
+            // not lost to clamping at 0 or 255
+            int64_t sum = 0;
+            for (int r = b.row1; r <= b.row2; r++) {
+                for (int c = b.col1; c <= b.col2; c++) sum += scene[r][c];
+            }
+            const int delta = sum < 128 * b.area() ? CHANGE_DELTA : -CHANGE_DELTA;
+            for (int r = b.row1; r <= b.row2; r++) {
+                for (int c = b.col1; c <= b.col2; c++) {
+                    scene[r][c] = static_cast<Pixel>(std::max(0, std::min(255, scene[r][c] + delta)));
+                }
+            }
+            inserted[day].push_back(b);
+        }
+    }
+
+    SeriesConfig cfg;
+    cfg.threshold = 3.0;
+    std::cout << "Series: " << sceneCount << " scenes of " << size << "x" << size << ", "
+              << CHANGES_PER_SCENE << " changed blocks and +" << DRIFT_PER_SCENE
+              << " drift per scene\n\n";
+
+    std::vector<PairResult> perPair(sceneCount);
+    Timer timer;
+    timer.start();
+    for (int day = 1; day < sceneCount; day++) {
+        perPair[day] = processPair(scenes[day - 1], scenes[day], cfg);
+    }
+    timer.stop();
+    const double perPairMs = timer.elapsedMs();
+
+    SceneSeries series(cfg);
+    bool match = true;
+    int found = 0;
+    int expected = 0;
+    double seriesMs = 0;
+    for (int day = 0; day < sceneCount; day++) {
+        timer.start();
+        series.addScene(scenes[day], "day" + std::to_string(day));
+        timer.stop();
+        seriesMs += timer.elapsedMs();
+        if (day == 0) continue;
+
+        const ChangeSummary& change = series.getLastChange();
+        match = match && change.ok && sameTopK(change.topK, perPair[day].topK) &&
+                change.components == perPair[day].components &&
+                change.largestComponentArea == perPair[day].largestArea;
+
+        // Recall: every inserted block scores above the threshold
+        for (const Region& block : inserted[day]) {
+            expected++;
+            if (series.queryChange(block).score > cfg.threshold) found++;
+        }
+    }
+
+    std::cout << std::left << std::fixed
+              << std::setw(18) << "Approach"
+              << std::setw(14) << "Total ms"
+              << std::setw(14) << "ms / pair"
+              << "Speedup\n";
+    std::cout << std::string(54, '-') << "\n";
+    const int pairs = sceneCount - 1;
+    std::cout << std::setprecision(2)
+              << std::setw(18) << "per pair" << std::setw(14) << perPairMs
+              << std::setw(14) << perPairMs / pairs << "1.0\n";
+    std::cout << std::setw(18) << "series" << std::setw(14) << seriesMs
+              << std::setw(14) << seriesMs / pairs << std::setprecision(1)
+              << (seriesMs > 0 ? perPairMs / seriesMs : 0) << "\n";
+    std::cout << "\nSeries memory: " << formatBytes(series.getMemoryBytes()) << "\n";
+    std::cout << "Inserted blocks detected: " << found << " / " << expected << "\n";
+
+    // Region queries on the last pair: O(1) lookups vs summing both scenes
+    const Matrix& before = scenes[sceneCount - 2];
+    const Matrix& after = scenes[sceneCount - 1];
+    std::uniform_int_distribution<int> position(0, size - 1);
+    std::vector<Region> rects(RECT_QUERIES);
+    for (Region& r : rects) {
+        const int a = position(rng), b = position(rng), c = position(rng), d = position(rng);
+        r = Region(std::min(a, b), std::min(c, d), std::max(a, b), std::max(c, d));
+    }
+    std::vector<double> direct(RECT_QUERIES);
+    timer.start();
+    for (int q = 0; q < RECT_QUERIES; q++) {
+        const Region& r = rects[q];
+        int64_t sum = 0;
+        for (int i = r.row1; i <= r.row2; i++) {
+            for (int j = r.col1; j <= r.col2; j++) sum += after[i][j] - before[i][j];
+        }
+        direct[q] = static_cast<double>(sum) / r.area();
+    }
+    timer.stop();
+    const double directMs = timer.elapsedMs();
+
+    double checksum = 0;
+    timer.start();
+    for (int q = 0; q < RECT_QUERIES; q++) checksum += series.queryChange(rects[q]).change.mean;
+    timer.stop();
+    const double lookupMs = timer.elapsedMs();
+    for (int q = 0; q < RECT_QUERIES && match; q++) {
+        match = std::fabs(series.queryChange(rects[q]).change.mean - direct[q]) < 1e-9;
+    }
+    std::cout << "Region change queries (" << RECT_QUERIES << "): direct "
+              << std::setprecision(2) << directMs << " ms, queryChange() " << lookupMs
+              << " ms (checksum " << std::setprecision(1) << checksum << ")\n";
+
+    const bool ok = match && found == expected;
+    std::cout << "\n" << (ok ? "Series results match reprocessing every pair"
+                             : "ERROR: series and per-pair results differ")
+              << "\n";
+    return ok ? 0 : 1;
+}
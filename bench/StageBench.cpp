@@ -0,0 +1,406 @@
+/**
+ * @file StageBench.cpp
+ * @brief Benchmark suite: every engine stage over a sweep of scene configurations
+ *
+ * For each combination of scene size, anomaly count and minimum region size
+ * the scene is generated, written to a temporary P5 file and loaded back,
+ * then every stage is timed:
+ *
+ *   per pixel (ns/px):  generateSyntheticImage, loadFromPGM, PrefixSum::build,
+ *                       RegionTree::build, AnomalyDetector::detectInTree
+ *   per query (q/s):    topKAnomalies, topKWithPruning, findConnectedComponents
+ *                       (Union-Find and DFS), queryStatsBatch rectangles
+ *
+ * Build stages report the median of --repeat runs. Queries repeat until
+ * QUERY_BUDGET_MS has passed (at least --repeat times).
+ *
+ * Each configuration runs in a forked child, so peak_rss_kb is that
+ * configuration's own high-water mark and a configuration that runs out of
+ * memory fails alone. The child creates the thread pool, so the parent never
+ * forks with live worker threads.
+ *
+ * OUTPUT:
+ *   A table on stdout; --out FILE also writes the results as CSV, or as
+ *   JSON when FILE ends in .json, for tracking regressions across commits.
+ *
+ * USAGE:
+ *   ./build/bench/StageBench [--sizes 256,1024,4096] [--anomalies 4,16]
+ *                            [--min-region 8,16,32] [--repeat 3] [--threads N]
+ *                            [--out FILE]
+ *   Sizes up to 16384 are accepted; 16384 needs about 6 GB.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Utils.h"
+#include "ImageLoader.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "ThreadPool.h"
+
+using namespace SatelliteAnalytics;
+
+namespace {
+
+constexpr double QUERY_BUDGET_MS = 100.0;   // Minimum measuring time per query kind
+constexpr int BATCH_RECTANGLES = 100000;    // Rectangles per queryStatsBatch call
+constexpr int BENCH_TOP_K = 10;
+constexpr double BENCH_THRESHOLD = 1.0;     // Low enough that every scene has anomalous leaves
+constexpr int MAX_BENCH_SIZE = 16384;
+
+struct Options {
+    std::vector<int> sizes = {256, 1024, 4096};
+    std::vector<int> anomalies = {4, 16};
+    std::vector<int> minRegions = {8, 16, 32};
+    int repeat = 3;
+    int threads = 0;
+    std::string out;
+};
+
+/**
+ * @brief Results of one configuration; plain data, sent from child to parent through a pipe
+ */
+struct StageResult {
+    int size;
+    int anomalies;
+    int minRegion;
+    int threads;
+    int nodes;
+    int leaves;
+    int anomalous;
+    double generateNsPx;
+    double loadNsPx;
+    double prefixNsPx;
+    double treeNsPx;
+    double detectNsPx;
+    double topKQps;
+    double topKPrunedQps;
+    double componentsQps;
+    double componentsDfsQps;
+    double rectBatchQps;
+    long peakRssKb;
+    bool ok;
+};
+
+std::vector<int> parseList(const char* text) {
+    std::vector<int> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+bool parseArgs(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && hasValue) opt.sizes = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--anomalies") == 0 && hasValue) opt.anomalies = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--min-region") == 0 && hasValue) opt.minRegions = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && hasValue) opt.repeat = std::atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue) opt.threads = std::atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && hasValue) opt.out = argv[++i];
+        else {
+            std::cerr << "Error: unknown argument " << argv[i] << "\n";
+            return false;
+        }
+    }
+
+    auto valid = [](const std::vector<int>& list, int low, int high) {
+        return !list.empty() && std::all_of(list.begin(), list.end(),
+                                            [&](int v) { return v >= low && v <= high; });
+    };
+    if (!valid(opt.sizes, 16, MAX_BENCH_SIZE) || !valid(opt.anomalies, 0, 1 << 20) ||
+        !valid(opt.minRegions, 1, MAX_BENCH_SIZE) || opt.repeat <= 0 || opt.threads < 0) {
+        std::cerr << "Error: sizes must be in [16, " << MAX_BENCH_SIZE
+                  << "], min-region and repeat positive\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Median wall time of repeat runs of fn, in milliseconds
+ */
+template <typename Fn>
+double medianMs(int repeat, Fn fn) {
+    std::vector<double> times(repeat);
+    for (double& t : times) {
+        Timer timer;
+        timer.start();
+        fn();
+        timer.stop();
+        t = timer.elapsedMs();
+    }
+    std::nth_element(times.begin(), times.begin() + repeat / 2, times.end());
+    return times[repeat / 2];
+}
+
+/**
+ * @brief Calls per second of fn (each call answering queriesPerCall queries)
+ */
+template <typename Fn>
+double queriesPerSecond(int minCalls, Fn fn, double queriesPerCall = 1.0) {
+    Timer timer;
+    timer.start();
+    int calls = 0;
+    while (calls < minCalls || timer.elapsedMs() < QUERY_BUDGET_MS) {
+        fn();
+        calls++;
+    }
+    timer.stop();
+    return timer.elapsedMs() > 0 ? calls * queriesPerCall / (timer.elapsedMs() / 1000.0) : 0;
+}
+
+/**
+ * @brief Run one configuration (in the child process)
+ */
+StageResult runConfiguration(int size, int anomalies, int minRegion, const Options& opt) {
+    StageResult res;
+    std::memset(&res, 0, sizeof(res));
+    res.size = size;
+    res.anomalies = anomalies;
+    res.minRegion = minRegion;
+    res.threads = ThreadPool::shared().getThreadCount();
+
+    const double pixels = static_cast<double>(size) * size;
+    auto nsPerPixel = [pixels](double ms) { return ms * 1e6 / pixels; };
+
+    ImageLoader loader;
+    res.generateNsPx = nsPerPixel(medianMs(opt.repeat, [&]() {
+        loader.generateSyntheticImage(size, anomalies, 42);
+    }));
+
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("stagebench_" + std::to_string(getpid()) + ".pgm")).string();
+    if (!loader.saveToPGM(path)) return res;
+    bool loaded = true;
+    res.loadNsPx = nsPerPixel(medianMs(opt.repeat, [&]() { loaded = loaded && loader.loadFromPGM(path); }));
+    std::remove(path.c_str());
+    if (!loaded) return res;
+
+    PrefixSum prefixSum;
+    res.prefixNsPx = nsPerPixel(medianMs(opt.repeat, [&]() { prefixSum.build(loader.getImage()); }));
+
+    RegionTree tree;
+    res.treeNsPx = nsPerPixel(medianMs(opt.repeat, [&]() { tree.build(&prefixSum, minRegion); }));
+
+    AnomalyDetector detector(BENCH_THRESHOLD);
+    detector.initialize(&prefixSum);
+    res.detectNsPx = nsPerPixel(medianMs(opt.repeat, [&]() { detector.detectInTree(tree); }));
+
+    res.nodes = tree.getNodeCount();
+    res.leaves = tree.getLeafCount();
+    res.anomalous = detector.getStats().anomalousRegions;
+
+    QueryEngine engine;
+    engine.initialize(&tree, &prefixSum, &detector);
+    QueryResult top;
+    QueryScratch scratch;
+    res.topKQps = queriesPerSecond(opt.repeat, [&]() { engine.topKAnomalies(BENCH_TOP_K, true, top); });
+    res.topKPrunedQps = queriesPerSecond(opt.repeat, [&]() {
+        engine.topKWithPruning(BENCH_TOP_K, top, scratch);
+    });
+    res.componentsQps = queriesPerSecond(opt.repeat, [&]() { engine.findConnectedComponents(); });
+    res.componentsDfsQps = queriesPerSecond(opt.repeat, [&]() { engine.findConnectedComponentsDFS(); });
+
+    // Random rectangles up to a quarter of the scene side
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> position(0, size - 1);
+    std::uniform_int_distribution<int> side(1, std::max(1, size / 4));
+    std::vector<Region> rects(BATCH_RECTANGLES);
+    for (Region& r : rects) {
+        int r1 = position(rng), c1 = position(rng);
+        r = Region(r1, c1, std::min(size - 1, r1 + side(rng)), std::min(size - 1, c1 + side(rng)));
+    }
+    std::vector<RegionStats> stats(rects.size());
+    res.rectBatchQps = queriesPerSecond(opt.repeat, [&]() {
+        prefixSum.queryStatsBatch(rects.data(), rects.size(), stats.data());
+    }, BATCH_RECTANGLES);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    res.peakRssKb = usage.ru_maxrss;    // Kilobytes on Linux
+    res.ok = true;
+    return res;
+}
+
+/**
+ * @brief Fork, run one configuration in the child, read its result back
+ */
+StageResult runIsolated(int size, int anomalies, int minRegion, const Options& opt) {
+    StageResult failed;
+    std::memset(&failed, 0, sizeof(failed));
+    failed.size = size;
+    failed.anomalies = anomalies;
+    failed.minRegion = minRegion;
+
+    int fds[2];
+    if (pipe(fds) != 0) return failed;
+    std::cout.flush();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return failed;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        ThreadPool::setSharedThreadCount(opt.threads);
+        StageResult res = runConfiguration(size, anomalies, minRegion, opt);
+        ssize_t written = write(fds[1], &res, sizeof(res));
+        _exit(written == static_cast<ssize_t>(sizeof(res)) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    StageResult res = failed;
+    size_t got = 0;
+    char* dst = reinterpret_cast<char*>(&res);
+    while (got < sizeof(res)) {
+        ssize_t n = read(fds[0], dst + got, sizeof(res) - got);
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(res) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return failed;
+    return res;
+}
+
+// ============================================================================
+// OUTPUT
+// ============================================================================
+
+const char* const COLUMNS[] = {
+    "size", "anomalies", "min_region", "threads", "nodes", "leaves", "anomalous",
+    "generate_ns_px", "load_ns_px", "prefix_ns_px", "tree_ns_px", "detect_ns_px",
+    "topk_qps", "topk_pruned_qps", "components_qps", "components_dfs_qps",
+    "rect_batch_qps", "peak_rss_kb", "status"
+};
+
+std::vector<std::string> fields(const StageResult& r) {
+    auto num = [](double v, int precision) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(precision) << v;
+        return out.str();
+    };
+    return {std::to_string(r.size), std::to_string(r.anomalies), std::to_string(r.minRegion),
+            std::to_string(r.threads), std::to_string(r.nodes), std::to_string(r.leaves),
+            std::to_string(r.anomalous), num(r.generateNsPx, 3), num(r.loadNsPx, 3),
+            num(r.prefixNsPx, 3), num(r.treeNsPx, 3), num(r.detectNsPx, 3), num(r.topKQps, 1),
+            num(r.topKPrunedQps, 1), num(r.componentsQps, 1), num(r.componentsDfsQps, 1),
+            num(r.rectBatchQps, 0), std::to_string(r.peakRssKb), r.ok ? "ok" : "failed"};
+}
+
+bool writeResults(const std::string& path, const std::vector<StageResult>& results) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write " << path << "\n";
+        return false;
+    }
+    const size_t numColumns = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+    const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+
+    if (json) {
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            std::vector<std::string> row = fields(results[i]);
+            out << "  {";
+            for (size_t c = 0; c < numColumns; c++) {
+                const bool text = c == numColumns - 1;
+                out << (c > 0 ? ", " : "") << "\"" << COLUMNS[c] << "\": "
+                    << (text ? "\"" + row[c] + "\"" : row[c]);
+            }
+            out << (i + 1 < results.size() ? "},\n" : "}\n");
+        }
+        out << "]\n";
+    } else {
+        for (size_t c = 0; c < numColumns; c++) out << (c > 0 ? "," : "") << COLUMNS[c];
+        out << "\n";
+        for (const StageResult& r : results) {
+            std::vector<std::string> row = fields(r);
+            for (size_t c = 0; c < numColumns; c++) out << (c > 0 ? "," : "") << row[c];
+            out << "\n";
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) return 1;
+
+    printHeader("ENGINE STAGE BENCHMARK");
+    std::cout << "Repeat: " << opt.repeat << " (median), query budget "
+              << QUERY_BUDGET_MS << " ms per kind, top-" << BENCH_TOP_K << ", "
+              << formatNumber(BATCH_RECTANGLES) << " rectangles per batch, threshold "
+              << BENCH_THRESHOLD << "\n\n";
+
+    std::cout << std::left
+              << std::setw(7) << "Size" << std::setw(6) << "Anom" << std::setw(5) << "Min"
+              << std::setw(9) << "Nodes"
+              << std::setw(8) << "gen" << std::setw(8) << "load" << std::setw(8) << "prefix"
+              << std::setw(8) << "tree" << std::setw(8) << "detect"
+              << std::setw(10) << "topK/s" << std::setw(10) << "pruned/s"
+              << std::setw(9) << "uf/s" << std::setw(9) << "dfs/s"
+              << std::setw(11) << "rects/s" << "RSS\n";
+    std::cout << std::string(7 + 6 + 5 + 9, ' ') << "(ns/pixel)" << std::string(30, ' ')
+              << "(queries/s)\n";
+    std::cout << std::string(130, '-') << "\n";
+
+    std::vector<StageResult> results;
+    int failures = 0;
+    for (int size : opt.sizes) {
+        for (int anomalies : opt.anomalies) {
+            for (int minRegion : opt.minRegions) {
+                StageResult r = runIsolated(size, anomalies, minRegion, opt);
+                results.push_back(r);
+
+                std::cout << std::left << std::fixed
+                          << std::setw(7) << size << std::setw(6) << anomalies
+                          << std::setw(5) << minRegion;
+                if (!r.ok) {
+                    std::cout << "FAILED (out of memory?)\n";
+                    failures++;
+                    continue;
+                }
+                std::cout << std::setw(9) << r.nodes << std::setprecision(2)
+                          << std::setw(8) << r.generateNsPx << std::setw(8) << r.loadNsPx
+                          << std::setw(8) << r.prefixNsPx << std::setw(8) << r.treeNsPx
+                          << std::setw(8) << r.detectNsPx << std::setprecision(0)
+                          << std::setw(10) << r.topKQps << std::setw(10) << r.topKPrunedQps
+                          << std::setw(9) << r.componentsQps << std::setw(9) << r.componentsDfsQps
+                          << std::setw(11) << r.rectBatchQps
+                          << formatBytes(static_cast<uint64_t>(r.peakRssKb) * 1024) << "\n";
+            }
+        }
+    }
+
+    if (!opt.out.empty()) {
+        if (!writeResults(opt.out, results)) return 1;
+        std::cout << "\nResults: " << opt.out << "\n";
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -16,8 +16,32 @@
  *   - Based on solid statistical foundation
  *   - O(1) computation per region using prefix sums
  * 
+ * LOCAL BASELINE (contextual scoring):
+ *   In heterogeneous scenes one global mean flags whole land-cover classes.
+ *   In local mode each region R is compared with the ring around it, as in
+ *   a CFAR detector: with G = R grown by guard × R's height / width on
+ *   every side and W = G grown by a further scale × the same (both clipped
+ *   to the image),
+ *     ring   = W \ G,  sum(ring) = sum(W) - sum(G)  (same for squares)
+ *     anomalyScore = |mean(R) - mean(ring)| / max(stddev(ring), floor)
+ *   The guard band keeps an anomaly larger than R out of its own
+ *   baseline; floor = Config::LOCAL_MIN_STDDEV_FRACTION × global_stddev
+ *   keeps a very uniform ring (open water) from inflating scores. Two O(1)
+ *   rectangle queries per region; the whole tree goes through one
+ *   queryStatsBatch().
+ * 
+ * MULTI-BAND SCORING:
+ *   With a MultiBandPrefixSum attached, a region's band means μ_R are
+ *   compared with the global band means μ_G through a whitening matrix W:
+ *     anomalyScore = |W (μ_R - μ_G)| / sqrt(N)
+ *   BandZ:       W = diag(1 / σ_b), the RMS of the per-band z-scores
+ *   Mahalanobis: W = L⁻¹ with Σ_G = L Lᵀ (band covariance from the
+ *                cross-product tables), so deviations that break the
+ *                correlation between bands count more than ones along it
+ *   For N = 1 both equal the single-band z-score.
+ * 
  * COMPLEXITY:
- *   - Per region: O(1) using prefix sums
+ *   - Per region: O(1) using prefix sums (O(N²) for N bands)
  *   - All regions: O(number of regions)
  *   - Total: O(n²/B²) where B = leaf region size
  */
@@ -28,10 +52,29 @@
 #include "Utils.h"
 #include "PrefixSum.h"
 #include "RegionTree.h"
+#include "MultiBandPrefixSum.h"
 #include <vector>
 
 namespace SatelliteAnalytics {
 
+/**
+ * @enum ScoreBaseline
+ * @brief Reference a region's mean is scored against
+ */
+enum class ScoreBaseline {
+    Global,         // Compare with the scene's mean / stddev
+    Local           // Compare with the ring around each region (see file comment)
+};
+
+/**
+ * @enum BandScoring
+ * @brief How a multi-band detector combines its bands (see file comment)
+ */
+enum class BandScoring {
+    BandZ,          // RMS of per-band z-scores (bands treated as independent)
+    Mahalanobis     // Whitened by the global band covariance
+};
+
 /**
  * @struct AnomalyStats
  * @brief Statistics about detected anomalies
@@ -45,6 +88,24 @@ struct AnomalyStats {
     double detectionTimeMs;
 };
 
+/**
+ * @struct BatchScoreSummary
+ * @brief Aggregates produced by AnomalyDetector::scoreBatch
+ * 
+ * Only elements selected by the batch's count mask contribute.
+ */
+struct BatchScoreSummary {
+    int count;          // Selected elements
+    int anomalous;      // Selected elements above threshold
+    double minScore;
+    double maxScore;
+    double sumScore;
+    
+    BatchScoreSummary() : count(0), anomalous(0), minScore(0), maxScore(0), sumScore(0) {}
+    
+    double meanScore() const { return count > 0 ? sumScore / count : 0; }
+};
+
 /**
  * @class AnomalyDetector
  * @brief Detects anomalous regions based on statistical deviation
@@ -62,9 +123,47 @@ private:
     double globalMean;
     double globalStdDev;
     
+    // Multi-band scoring (bandPrefix == nullptr: single-band z-scores)
+    const MultiBandPrefixSum* bandPrefix;
+    BandScoring bandScoring;
+    std::vector<double> bandMean;       // Global band means
+    std::vector<double> whitening;      // N x N lower-triangular W, row-major
+    
+    // Local baseline
+    ScoreBaseline baseline;
+    double guardScale;
+    double contextScale;
+    std::vector<Region> contextWindows;     // Reused by detectInTree() in local mode:
+    std::vector<RegionStats> contextStats;  // [2i] outer window, [2i+1] guard of node i
+    
     // Detection results
     AnomalyStats stats;
+    double totalScore;              // Sum of leaf scores (meanScore numerator)
     bool detectionComplete;
+    
+    friend class ThresholdSweep;    // Updates the threshold and counts incrementally
+    
+    /**
+     * @brief Batch scores |value - centre| / spread (scoreBatch's kernel)
+     */
+    BatchScoreSummary scoreAgainst(const double* values, size_t n, double centre, double spread,
+                                   double* scores, uint8_t* mask, const uint64_t* countMask) const;
+    
+    /**
+     * @brief Combined score of a region's band means
+     */
+    double bandScore(const double* means) const;
+    
+    /**
+     * @brief Region grown by scale × its own size on every side, clipped to the image
+     */
+    Region grownWindow(const Region& region, double scale) const;
+    
+    /**
+     * @brief Local-baseline score from the region's, outer window's and guard's statistics
+     */
+    double localScore(const RegionStats& region, const RegionStats& outer,
+                      const RegionStats& guard) const;
 
 public:
     /**
@@ -76,9 +175,53 @@ public:
     /**
      * @brief Initialize with prefix sum data
      * @param prefixSum Pointer to initialized prefix sum structure
+     * 
+     * Also detaches any multi-band tables from a previous initializeBands().
      */
     void initialize(const PrefixSum* prefixSum);
     
+    /**
+     * @brief Score against the bands of a multi-band image
+     * @param bands Tables built from the image whose composite prefixSum covers
+     * @param mode BandZ, or Mahalanobis (needs tables built with cross-products;
+     *             falls back to BandZ otherwise)
+     * 
+     * Call after initialize(). The tree, queries and visualizations keep
+     * working on the composite; only anomalyScore / isAnomaly change.
+     * W is precomputed here, so each region costs O(N²) after its O(N)
+     * band-mean lookup. detectInRegion() is not available in this mode
+     * (the band tables have no in-place update).
+     */
+    void initializeBands(const MultiBandPrefixSum* bands, BandScoring mode);
+    
+    bool hasBands() const { return bandPrefix != nullptr; }
+    
+    /**
+     * @brief Choose the global or the local (ring) baseline
+     * @param mode Global (default) or Local
+     * @param scale Ring width as a multiple of each region's side
+     * @param guard Gap between region and ring, same unit
+     * 
+     * Applies to single-band scoring; with bands attached the band score
+     * (against global band statistics) is used.
+     */
+    void setBaseline(ScoreBaseline mode, double scale = Config::LOCAL_CONTEXT_SCALE,
+                     double guard = Config::LOCAL_GUARD_SCALE);
+    ScoreBaseline getBaseline() const { return baseline; }
+    double getContextScale() const { return contextScale; }
+    double getGuardScale() const { return guardScale; }
+    BandScoring getBandScoring() const { return bandScoring; }
+    
+    /**
+     * @brief Score against externally supplied statistics
+     * @param mean Reference mean (e.g. of a whole scene)
+     * @param stdDev Reference standard deviation
+     * 
+     * Call after initialize(). Used when prefixSum covers only one tile of a
+     * larger scene, so scores stay comparable across tiles.
+     */
+    void setReferenceStats(double mean, double stdDev);
+    
     /**
      * @brief Compute anomaly score for a single region
      * @param region The region to score
@@ -103,16 +246,81 @@ public:
      */
     bool isAnomalous(double score) const;
     
+    /**
+     * @brief Score a batch of region means in one branch-free pass
+     * @param means Region means (n elements)
+     * @param n Number of elements
+     * @param scores Output z-scores (may alias means)
+     * @param mask Output threshold mask, 1 = anomalous
+     * @param countMask Optional bitmask (bit i of word i/64) selecting which
+     *                  elements enter the aggregates; nullptr = all
+     * @return min / max / sum / counts over the selected elements
+     * 
+     * Computes scores, the mask and the aggregates together. With AVX2 four
+     * elements are processed per step; selection is done with blend masks
+     * rather than branches.
+     * 
+     * TIME COMPLEXITY: O(n)
+     */
+    BatchScoreSummary scoreBatch(const double* means, size_t n, double* scores,
+                                 uint8_t* mask, const uint64_t* countMask = nullptr) const;
+    
+    /**
+     * @brief Score a batch of regions (means looked up through the prefix sums)
+     * @param regions Regions to score (n elements)
+     * @param n Number of regions
+     * @param scores Output z-scores
+     * @param mask Output threshold mask, 1 = anomalous
+     * @return Aggregates over all n regions
+     * 
+     * TIME COMPLEXITY: O(n)
+     */
+    BatchScoreSummary scoreRegions(const Region* regions, size_t n, double* scores,
+                                   uint8_t* mask) const;
+    
     /**
      * @brief Detect anomalies in the region tree
      * @param tree The region tree to analyze
      * 
      * Updates anomalyScore and isAnomaly fields for all nodes.
+     * Scores the tree's cached mean column with scoreBatch(), using the
+     * leaf mask so the statistics cover leaves only. Also fills
+     * maxLeafScore, the per-subtree bound used by top-K pruning.
+     * 
+     * With bands attached, node scores come from the band tables instead
+     * (nodes in parallel), then go through the same mask and statistics.
+     * With the local baseline, every node's window is queried in one
+     * PrefixSum::queryStatsBatch() and the ring scores are computed in
+     * parallel from the window and the node's cached statistics.
      * 
      * TIME COMPLEXITY: O(n²/B²) where B = leaf region size
      */
     void detectInTree(RegionTree& tree);
     
+    /**
+     * @brief Re-score only the nodes a patch can have changed
+     * @param tree A tree scored by detectInTree(), refreshed with
+     *             RegionTree::refreshRegion(patch)
+     * @param patch Image rectangle whose pixels changed
+     * 
+     * Scores are taken against the same reference mean / stddev as the last
+     * detectInTree(), so untouched nodes stay valid. The result equals a
+     * fresh detectInTree() with those reference statistics (meanScore up to
+     * rounding). To score against the patched image's own global
+     * statistics, call initialize() and detectInTree() instead.
+     * 
+     * Also fixes maxLeafScore on the path to the root and updates the leaf
+     * statistics incrementally; min / max rescan the leaves only if an old
+     * extreme moved inwards. A ThresholdSweep on the tree must be
+     * re-initialized afterwards.
+     * 
+     * With the local baseline a patch also moves the rings of nodes around
+     * it, so the whole tree is re-scored (detectInTree()).
+     * 
+     * TIME COMPLEXITY: O(intersecting nodes), plus O(leaves) for a rescan
+     */
+    void detectInRegion(RegionTree& tree, const Region& patch);
+    
     /**
      * @brief Get all anomalous regions from the tree
      * @param tree The analyzed region tree
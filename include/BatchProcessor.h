@@ -0,0 +1,169 @@
+/**
+ * @file BatchProcessor.h
+ * @brief Many-scene batch runs in one process on the shared worker pool
+ *
+ * Running the CLI once per tile pays process start-up, thread creation and
+ * every table allocation again for each file. BatchProcessor analyses a
+ * whole list of PGM scenes in one process:
+ *
+ *   PIPELINE:
+ *     Each scene is one task on ThreadPool::shared(): load -> prefix sums ->
+ *     region tree -> detection -> queries. Up to maxInFlight scenes are
+ *     queued at once, so while one worker loads a scene others are building
+ *     and querying earlier ones. Inside a worker the stages' own
+ *     parallelFor calls run inline, so the pool is never oversubscribed.
+ *
+ *   WORKSPACES:
+ *     A workspace bundles the loader, prefix tables, tree and detector of
+ *     one scene. Finished workspaces go back to a free list and the next
+ *     scene is built into them, so image buffers, prefix tables and node
+ *     arrays keep their capacity: same-sized scenes allocate nothing new.
+ *     At most maxInFlight workspaces ever exist.
+ *
+ *   OUTPUT:
+ *     One CSV row per scene, in input order (rows are released from the
+ *     front of the in-flight queue, as in QueryServer's pipelining). A scene
+ *     that fails to load gets a row with status "error" and the batch
+ *     carries on.
+ */
+
+#ifndef BATCH_PROCESSOR_H
+#define BATCH_PROCESSOR_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @struct BatchConfig
+ * @brief Analysis parameters applied to every scene of a batch
+ */
+struct BatchConfig {
+    double threshold;
+    int topK;
+    int minRegionSize;
+    PrefixStorage prefixStorage;
+    TreeLayout treeLayout;
+    int maxInFlight;            // Scenes queued at once (0 = pool threads + 1)
+
+    BatchConfig()
+        : threshold(Config::DEFAULT_ANOMALY_THRESHOLD), topK(Config::DEFAULT_TOP_K),
+          minRegionSize(Config::MIN_REGION_SIZE), prefixStorage(PrefixStorage::Full),
+          treeLayout(TreeLayout::DepthFirst), maxInFlight(0) {}
+};
+
+/**
+ * @struct SceneSummary
+ * @brief Results for one scene (one output row)
+ */
+struct SceneSummary {
+    std::string path;
+    bool ok;
+    std::string error;
+
+    int height;
+    int width;
+    double globalMean;
+    double globalStdDev;
+    int leaves;
+    int anomalousLeaves;
+    int components;
+    int64_t largestComponentArea;
+    double maxScore;
+    std::vector<AnomalyRegion> topK;    // Pruned top-K, score descending
+
+    double loadMs;
+    double buildMs;                     // Prefix sums + tree + detection
+    double queryMs;
+
+    SceneSummary()
+        : ok(false), height(0), width(0), globalMean(0), globalStdDev(0), leaves(0),
+          anomalousLeaves(0), components(0), largestComponentArea(0), maxScore(0),
+          loadMs(0), buildMs(0), queryMs(0) {}
+};
+
+/**
+ * @struct BatchResult
+ * @brief Totals over a batch run
+ */
+struct BatchResult {
+    int scenes;
+    int failed;
+    int64_t pixels;
+    double wallMs;
+    double loadMs;              // Stage times summed over scenes
+    double buildMs;
+    double queryMs;
+    int inFlight;               // Queue depth used
+    int workspacesCreated;
+    int workspaceReuses;
+
+    BatchResult()
+        : scenes(0), failed(0), pixels(0), wallMs(0), loadMs(0), buildMs(0), queryMs(0),
+          inFlight(0), workspacesCreated(0), workspaceReuses(0) {}
+};
+
+/**
+ * @class BatchProcessor
+ * @brief Runs the analysis pipeline over many scenes with pooled workspaces
+ */
+class BatchProcessor {
+private:
+    struct Workspace;
+
+    BatchConfig config;
+    BatchResult result;
+
+    std::mutex workspaceMutex;
+    std::vector<std::unique_ptr<Workspace>> freeWorkspaces;
+    int workspacesCreated;
+    int workspaceReuses;
+
+    std::unique_ptr<Workspace> acquireWorkspace();
+    void releaseWorkspace(std::unique_ptr<Workspace> workspace);
+
+    /**
+     * @brief Load, build, score and query one scene (runs on a pool worker)
+     */
+    SceneSummary processScene(const std::string& path);
+
+public:
+    explicit BatchProcessor(const BatchConfig& cfg = BatchConfig());
+    ~BatchProcessor();
+
+    BatchProcessor(const BatchProcessor&) = delete;
+    BatchProcessor& operator=(const BatchProcessor&) = delete;
+
+    /**
+     * @brief Expand a batch source into scene paths
+     * @param source A directory (every *.pgm in it, sorted by name) or a
+     *               manifest file (one path per line; blank lines and lines
+     *               starting with '#' are skipped; relative paths are taken
+     *               relative to the manifest's directory)
+     * @return false with a message on stderr if the source cannot be read
+     */
+    static bool collectInputs(const std::string& source, std::vector<std::string>& files);
+
+    /**
+     * @brief Process every scene and write the consolidated CSV to out
+     * @return false if writing the output failed
+     */
+    bool run(const std::vector<std::string>& files, std::ostream& out);
+
+    static void writeHeader(std::ostream& out);
+    static void writeRow(std::ostream& out, const SceneSummary& scene);
+
+    const BatchResult& getResult() const { return result; }
+    const BatchConfig& getConfig() const { return config; }
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // BATCH_PROCESSOR_H
@@ -3,7 +3,11 @@
  * @brief Image loading and generation for the Satellite Image Analytics Engine
  * 
  * Supports:
- * - Loading grayscale PGM (P2/P5) images
+ * - Loading grayscale PGM (P2/P5) images, 8- or 16-bit samples
+ *   (the file is memory-mapped; P5 rows are copied straight into the
+ *   image buffer and P2 text is parsed in parallel)
+ * - Loading multi-band images (PAM P7 with any DEPTH, P6 RGB, P5) with
+ *   16-bit samples kept as they are, plus an 8-bit composite of the bands
  * - Generating synthetic satellite images for testing
  * 
  * Time Complexity: O(n²) where n is the image dimension
@@ -15,10 +19,42 @@
 
 #include "Utils.h"
 #include <string>
-#include <random>
+#include <vector>
 
 namespace SatelliteAnalytics {
 
+/**
+ * @struct PGMHeader
+ * @brief Parsed PGM header fields
+ */
+struct PGMHeader {
+    bool binary;        // P5 (true) or P2 (false)
+    int width;
+    int height;
+    int maxVal;         // 1..65535; above 255 P5 samples are 2 bytes, big-endian
+    int depth;          // Samples per pixel: 1 (P2/P5), 3 (P6), DEPTH (P7)
+    size_t dataOffset;  // Byte offset of the first sample
+    
+    PGMHeader() : binary(false), width(0), height(0), maxVal(0), depth(1), dataOffset(0) {}
+};
+
+/**
+ * @struct LoadStats
+ * @brief Per-stage timing of the last loadFromPGM() call
+ */
+struct LoadStats {
+    std::string format;     // "P2" or "P5"
+    int maxVal;
+    int64_t fileBytes;
+    bool memoryMapped;      // false = file was read into memory instead
+    int decodeChunks;       // Row/text chunks decoded in parallel
+    double readMs;          // Open + map (or read)
+    double decodeMs;        // Header parse + pixel decode
+    
+    LoadStats() : maxVal(0), fileBytes(0), memoryMapped(false), decodeChunks(0),
+                  readMs(0), decodeMs(0) {}
+};
+
 /**
  * @class ImageLoader
  * @brief Handles image loading and synthetic generation
@@ -33,15 +69,27 @@ namespace SatelliteAnalytics {
 class ImageLoader {
 private:
     Matrix imageData;
+    MultiBandImage bandData;    // Empty unless a multi-band image was loaded or generated
     int height;
     int width;
-    std::mt19937 rng;  // Mersenne Twister for high-quality random numbers
+    LoadStats loadStats;
     
     /**
-     * @brief Parse PGM header and validate format
-     * @return true if valid PGM file
+     * @brief Fill imageData with the 0..255 mean of bandData's bands
      */
-    bool parsePGMHeader(std::ifstream& file, int& w, int& h, int& maxVal);
+    void buildComposite();
+    
+    /**
+     * @brief Decode P5 samples into imageData, rows in parallel
+     */
+    bool decodeBinaryPGM(const uint8_t* data, size_t size, const PGMHeader& header,
+                         const std::vector<Pixel>& scale);
+    
+    /**
+     * @brief Decode P2 text into imageData, text chunks in parallel
+     */
+    bool decodeAsciiPGM(const uint8_t* data, size_t size, const PGMHeader& header,
+                        const std::vector<Pixel>& scale);
 
 public:
     ImageLoader();
@@ -55,11 +103,57 @@ public:
      * @param filename Path to the PGM file
      * @return true if loading successful
      * 
-     * Supports both ASCII (P2) and binary (P5) PGM formats.
+     * Supports both ASCII (P2) and binary (P5) PGM formats. Samples are
+     * scaled to 0-255 by maxVal (values above maxVal saturate).
      * Time Complexity: O(n²)
      */
     bool loadFromPGM(const std::string& filename);
     
+    /**
+     * @brief Load a multi-band image, keeping its samples at full depth
+     * @param filename PAM (P7, any DEPTH up to Config::MAX_BANDS), P6 or P5 file
+     * @return true if loading successful
+     * 
+     * Samples are stored unscaled in getBands() (values above maxVal
+     * saturate). getImage() holds the 8-bit composite (mean of the bands
+     * scaled by maxVal) that the region tree, queries and visualizations
+     * run on. Rows decode in parallel as in loadFromPGM().
+     * Time Complexity: O(n² × bands)
+     */
+    bool loadMultiBand(const std::string& filename);
+    
+    /**
+     * @brief Timing and format details of the last loadFromPGM() / loadMultiBand()
+     */
+    const LoadStats& getLoadStats() const { return loadStats; }
+    
+    // ========================================================================
+    // PGM DECODING HELPERS (shared with the streaming pipeline)
+    // ========================================================================
+    
+    /**
+     * @brief Parse PGM header and validate format
+     * @return true if valid PGM file
+     */
+    static bool parsePGMHeader(const uint8_t* data, size_t size, PGMHeader& header);
+    
+    /**
+     * @brief Parse a binary P5, P6 or P7 (PAM) header
+     * @return true if valid; header.depth is the number of bands
+     */
+    static bool parseMultiBandHeader(const uint8_t* data, size_t size, PGMHeader& header);
+    
+    /**
+     * @brief Lookup table mapping raw samples to 0..255 (above maxVal saturates)
+     */
+    static std::vector<Pixel> makeScaleTable(int maxVal);
+    
+    /**
+     * @brief Decode count consecutive P5 samples starting at src
+     */
+    static void decodeBinarySamples(const uint8_t* src, Pixel* dst, int count,
+                                    const PGMHeader& header, const std::vector<Pixel>& scale);
+    
     /**
      * @brief Load image from raw grayscale buffer
      * @param data Pointer to pixel data (row-major order)
@@ -85,10 +179,34 @@ public:
      * - Normal statistical distribution for regular areas
      * - Distinct anomalous regions (bright or dark spots)
      * 
+     * Rows are generated in parallel from Philox4x32 streams keyed by seed,
+     * so the image depends only on size, numAnomalies and seed, not on the
+     * thread count.
+     * 
      * Time Complexity: O(n²)
      */
     void generateSyntheticImage(int size, int numAnomalies = 5, unsigned int seed = 42);
     
+    /**
+     * @brief Generate a synthetic multi-band (12-bit in 16-bit samples) scene
+     * @param size Image dimension
+     * @param bands Number of bands (1..Config::MAX_BANDS)
+     * @param numAnomalies Anomalies to insert; with two or more bands half
+     *                     of them are spectral (see below)
+     * @param seed Random seed for reproducibility
+     * 
+     * Every band is a gain and offset of the synthetic grayscale terrain
+     * plus independent sensor noise, so the bands are strongly correlated.
+     * A spectral anomaly raises one band and lowers another by the same
+     * amount: the composite (and so a single-band detector) cannot see it,
+     * but it breaks the correlation between bands.
+     * 
+     * Deterministic for a given seed at any thread count.
+     * Time Complexity: O(n² × bands)
+     */
+    void generateSyntheticMultiBand(int size, int bands, int numAnomalies = 5,
+                                    unsigned int seed = 42);
+    
     /**
      * @brief Generate simple gradient test image
      * @param size Image dimension
@@ -111,6 +229,8 @@ public:
     // ========================================================================
     
     const Matrix& getImage() const { return imageData; }
+    const MultiBandImage& getBands() const { return bandData; }
+    bool hasBands() const { return !bandData.empty(); }
     Matrix& getImageMutable() { return imageData; }
     int getHeight() const { return height; }
     int getWidth() const { return width; }
@@ -132,6 +252,12 @@ public:
      * @return true if saving successful
      */
     bool saveToPGM(const std::string& filename) const;
+    
+    /**
+     * @brief Save the multi-band image as PAM (P7)
+     * @return false if there is no multi-band image or the file cannot be written
+     */
+    bool saveMultiBand(const std::string& filename) const;
 };
 
 } // namespace SatelliteAnalytics
@@ -0,0 +1,210 @@
+/**
+ * @file LeafIndex.h
+ * @brief Implicit grid of region tree leaves for rectangle and neighbour lookups
+ *
+ * ALGORITHM: Implicit Cell Grid over the Leaf Partition
+ *
+ * The leaves of a RegionTree tile the image without overlap. Every leaf's
+ * top row and left column is a cut line; the sorted, distinct cut lines
+ * split the image into R x C cells, and no leaf boundary crosses a cell,
+ * so each cell lies inside exactly one leaf:
+ *
+ *   cells[i * C + j] = node index of the leaf covering cell (i, j)
+ *
+ * A uniform tree has one cell per leaf; a coarse adaptive leaf covers a
+ * block of cells.
+ *
+ * RECTANGLE LOOKUP:
+ *   Two binary searches per axis give the cell window [i0, i1] x [j0, j1];
+ *   each window row is one contiguous run of the cell array. A leaf is
+ *   reported at its first cell inside the window, i.e. where it starts
+ *   (per-cell origin flags: rowCuts[i] == row1, colCuts[j] == col1) or
+ *   where the window clips it, so big leaves come out once without any
+ *   visited set and without reading the leaf's bounds.
+ *
+ * COMPLEXITY:
+ *   - Build Time: O(leaves + R · C)
+ *   - Build Space: 5 bytes per cell (uniform tree: per leaf)
+ *   - Rectangle Query: O(log R + log C + cells in the window), no allocation
+ *   - Point Lookup: O(log R + log C)
+ */
+
+#ifndef LEAF_INDEX_H
+#define LEAF_INDEX_H
+
+#include "Utils.h"
+#include "RegionTree.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @class LeafIndex
+ * @brief Cell grid mapping image positions to the leaves of one RegionTree
+ *
+ * Holds node indices only, so it stays valid while scores change
+ * (AnomalyDetector writes the nodes in place) but must be rebuilt when the
+ * tree is rebuilt. Lookups are const and may run concurrently.
+ */
+class LeafIndex {
+private:
+    const RegionTree* tree;
+    std::vector<int> rowCuts;       // Sorted distinct leaf row1 values (rowCuts[0] = 0)
+    std::vector<int> colCuts;       // Sorted distinct leaf col1 values
+    std::vector<int> cells;         // rowCuts.size() x colCuts.size(), row-major
+    std::vector<uint8_t> origins;   // Per cell: ORIGIN_ROW / ORIGIN_COL if the leaf starts there
+    int height;
+    int width;
+
+    static constexpr uint8_t ORIGIN_ROW = 1;    // Cell is in the leaf's first band row
+    static constexpr uint8_t ORIGIN_COL = 2;    // Cell is in the leaf's first band column
+
+    /**
+     * @brief Index of the cut band containing a coordinate (clamped)
+     */
+    static int bandOf(const std::vector<int>& cuts, int coordinate) {
+        return static_cast<int>(std::upper_bound(cuts.begin(), cuts.end(), coordinate)
+                                - cuts.begin()) - 1;
+    }
+
+public:
+    LeafIndex();
+
+    /**
+     * @brief Index the leaves of a built tree
+     * TIME COMPLEXITY: O(leaves + cells)
+     */
+    void build(const RegionTree& tree);
+
+    void clear();
+
+    bool isBuilt() const { return tree != nullptr; }
+    int getRows() const { return static_cast<int>(rowCuts.size()); }
+    int getCols() const { return static_cast<int>(colCuts.size()); }
+    size_t getCellCount() const { return cells.size(); }
+
+    /**
+     * @brief Bytes held by the cut lists and the cell grid
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * @brief Node index of the leaf containing a pixel, -1 outside the image
+     * TIME COMPLEXITY: O(log R + log C)
+     */
+    int leafAt(int row, int col) const;
+
+    /**
+     * @class Iterator
+     * @brief Forward iterator over the leaves intersecting a rectangle
+     *
+     * Yields node indices in row-major order of each leaf's first cell in
+     * the window. Holds only the window and a cursor: iterating allocates
+     * nothing.
+     */
+    class Iterator {
+    private:
+        const LeafIndex* index;
+        int i, j;                   // Current cell
+        int i0, j0, i1, j1;         // Cell window, inclusive
+
+        /**
+         * @brief True if the leaf in cell (i, j) is reported here
+         */
+        bool firstCell() const {
+            const uint8_t origin = index->origins[static_cast<size_t>(i) * index->colCuts.size() + j];
+            return (i == i0 || (origin & ORIGIN_ROW)) && (j == j0 || (origin & ORIGIN_COL));
+        }
+
+        void step() {
+            if (++j > j1) {
+                j = j0;
+                ++i;
+            }
+        }
+
+        void settle() {
+            while (i <= i1 && !firstCell()) step();
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = int;
+
+        Iterator() : index(nullptr), i(0), j(0), i0(0), j0(0), i1(-1), j1(-1) {}
+        Iterator(const LeafIndex* owner, int rowBegin, int colBegin, int rowEnd, int colEnd)
+            : index(owner), i(rowBegin), j(colBegin), i0(rowBegin), j0(colBegin),
+              i1(rowEnd), j1(colEnd) {
+            settle();
+        }
+
+        int operator*() const {
+            return index->cells[static_cast<size_t>(i) * index->colCuts.size() + j];
+        }
+
+        Iterator& operator++() {
+            step();
+            settle();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator before = *this;
+            ++*this;
+            return before;
+        }
+
+        // Every exhausted iterator compares equal to end()
+        bool operator==(const Iterator& other) const {
+            const bool done = i > i1;
+            const bool otherDone = other.i > other.i1;
+            return done || otherDone ? done == otherDone : i == other.i && j == other.j;
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief The leaves intersecting a rectangle, for range-for
+     */
+    struct Range {
+        Iterator first;
+        Iterator last;
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
+    /**
+     * @brief Leaves intersecting a rectangle (clipped to the image)
+     * TIME COMPLEXITY: O(log R + log C) to start, O(cells in the window) to exhaust
+     */
+    Range leavesIn(const Region& region) const {
+        if (!tree || region.row2 < 0 || region.col2 < 0 ||
+            region.row1 >= height || region.col1 >= width ||
+            region.row1 > region.row2 || region.col1 > region.col2) {
+            return Range{Iterator(), Iterator()};
+        }
+        const int i0 = bandOf(rowCuts, std::max(0, region.row1));
+        const int i1 = bandOf(rowCuts, std::min(height - 1, region.row2));
+        const int j0 = bandOf(colCuts, std::max(0, region.col1));
+        const int j1 = bandOf(colCuts, std::min(width - 1, region.col2));
+        return Range{Iterator(this, i0, j0, i1, j1), Iterator()};
+    }
+
+    /**
+     * @brief Leaves sharing an edge with a leaf
+     * @param out Cleared, then filled with node indices (no duplicates)
+     *
+     * Scans the four one-pixel strips just outside the leaf's bounds.
+     * TIME COMPLEXITY: O(log R + log C + cells along the border)
+     */
+    void neighbors(int leaf, std::vector<int>& out) const;
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // LEAF_INDEX_H
@@ -0,0 +1,84 @@
+/**
+ * @file MappedFile.h
+ * @brief Read-only view of a whole file, memory-mapped where available
+ *
+ * On POSIX systems the file is mapped with mmap(), so reading it costs no
+ * copy and pages are faulted in on demand. Elsewhere, or if mapping fails,
+ * the file is read into memory with a single large read instead.
+ * Either way data()/size() expose the full contents.
+ *
+ * A copy-on-write mapping can also be requested: the process may then
+ * modify the bytes through writableData(), but changes stay private and
+ * never reach the file.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @class MappedFile
+ * @brief RAII owner of a read-only file mapping (or its in-memory copy)
+ */
+class MappedFile {
+private:
+    const uint8_t* mappedData;
+    size_t mappedSize;
+    bool mapped;                    // true = mmap, false = fallback buffer
+    bool writable;                  // Opened copy-on-write
+    std::vector<uint8_t> fallback;
+
+    bool readWholeFile(const std::string& filename);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Open and map a file, replacing any previous mapping
+     * @param copyOnWrite Map pages writable but private (see writableData())
+     * @return true on success (empty files fail)
+     */
+    bool open(const std::string& filename, bool copyOnWrite = false);
+
+    /**
+     * @brief Release the mapping or buffer
+     */
+    void close();
+
+    const uint8_t* data() const { return mappedData; }
+    
+    /**
+     * @brief Modifiable view of the contents, nullptr unless opened copy-on-write
+     */
+    uint8_t* writableData() const { return writable ? const_cast<uint8_t*>(mappedData) : nullptr; }
+    size_t size() const { return mappedSize; }
+    bool isOpen() const { return mappedData != nullptr; }
+
+    /**
+     * @brief True when backed by mmap rather than a read() copy
+     */
+    bool isMapped() const { return mapped; }
+
+    /**
+     * @brief Tell the OS a byte range is no longer needed
+     * 
+     * Mapped pages in the range are dropped from the process's resident set
+     * (they are re-read from the file if touched again). No-op for the
+     * read() fallback.
+     */
+    void release(size_t offset, size_t length) const;
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // MAPPED_FILE_H
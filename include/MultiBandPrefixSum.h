@@ -0,0 +1,156 @@
+/**
+ * @file MultiBandPrefixSum.h
+ * @brief Interleaved summed-area tables for multi-band (multispectral) images
+ *
+ * ALGORITHM: 2D Prefix Sums over a vector of channels
+ *
+ * For an N-band image the same integral-image recurrence as PrefixSum is
+ * applied to K channels at once:
+ *   - N band sums               Σ x_b
+ *   - N(N+1)/2 cross-products   Σ x_b · x_c   (b <= c; b == c are the squares)
+ *
+ * All K channels of one table cell are adjacent, so one build pass reads
+ * each pixel's bands once and a region query reads four contiguous runs of
+ * K values instead of touching N (or N²) separate tables.
+ *
+ * REGION MOMENTS IN O(1):
+ *   mean_b     = S_b / area
+ *   cov_bc     = S_bc / area - mean_b · mean_c
+ * where S is the inclusion-exclusion of the four corners (as in PrefixSum).
+ *
+ * Without cross-products only the N squares are kept (K = 2N): enough for
+ * per-band means and variances, not for the covariance between bands.
+ *
+ * COMPLEXITY:
+ *   - Build Time: O(n² · K), one parallel row pass + one column pass
+ *   - Build Space: 8 · K bytes per pixel (N = 4: K = 14, 112 bytes)
+ *   - Query Time: O(K)
+ */
+
+#ifndef MULTI_BAND_PREFIX_SUM_H
+#define MULTI_BAND_PREFIX_SUM_H
+
+#include "Utils.h"
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @class MultiBandPrefixSum
+ * @brief Per-band sums and band cross-products with O(1) region moments
+ */
+class MultiBandPrefixSum {
+private:
+    // Padded (height+1) x (width+1) cells of K channels: row i holds
+    // (width+1) * channels values, cell j at offset j * channels
+    Buffer2D<int64_t> table;
+
+    int bands;
+    int channels;               // N sums + N(N+1)/2 products (or N squares)
+    bool crossProducts;
+    int height;
+    int width;
+    bool built;
+
+    // Global statistics (computed during build)
+    int64_t totalPixels;
+    std::vector<double> globalMean;         // N
+    std::vector<double> globalCovariance;   // N x N, row-major
+
+    /**
+     * @brief Derive global means / covariance from the bottom-right cell
+     */
+    void computeGlobalStats();
+
+    const int64_t* cell(int i, int j) const {
+        return table[i] + static_cast<size_t>(j) * channels;
+    }
+
+public:
+    MultiBandPrefixSum();
+
+    /**
+     * @brief Build the tables from an N-band image
+     * @param image Source image (1..Config::MAX_BANDS bands)
+     * @param withCrossProducts Keep every band pair (needed for covariance
+     *                          between bands) or only the squares
+     * @return false with a message on stderr if the image is empty, has too
+     *         many bands, or is large enough for 64-bit sums to overflow
+     *
+     * PARALLEL BUILD: same split as PrefixSum::build() - a row-scan pass
+     * parallel across rows computing all K channels of a pixel together,
+     * then a column pass parallel across column blocks over the interleaved
+     * rows.
+     *
+     * TIME COMPLEXITY: O(n² · K)
+     */
+    bool build(const MultiBandImage& image, bool withCrossProducts = true);
+
+    /**
+     * @brief Channel index of the product of bands b and c
+     *
+     * Upper-triangle order after the N sums; without cross-products only
+     * b == c is stored.
+     */
+    int productChannel(int b, int c) const {
+        if (b > c) std::swap(b, c);
+        if (!crossProducts) return bands + b;
+        return bands + b * bands - b * (b - 1) / 2 + (c - b);
+    }
+
+    /**
+     * @brief Raw region sums of every channel
+     * @param out channels values (sums first, then products)
+     * TIME COMPLEXITY: O(K)
+     */
+    void queryMoments(const Region& region, int64_t* out) const;
+
+    /**
+     * @brief Mean of every band over a region
+     * @param means bands values
+     * TIME COMPLEXITY: O(N)
+     */
+    void queryMeans(const Region& region, double* means) const;
+
+    /**
+     * @brief Band means and covariance over a region
+     * @param means bands values
+     * @param covariance bands x bands values, row-major; off-diagonal
+     *                   entries are 0 when built without cross-products
+     * TIME COMPLEXITY: O(K)
+     */
+    void queryCovariance(const Region& region, double* means, double* covariance) const;
+
+    // ========================================================================
+    // GLOBAL STATISTICS (computed during build)
+    // ========================================================================
+
+    const std::vector<double>& getGlobalMean() const { return globalMean; }
+    const std::vector<double>& getGlobalCovariance() const { return globalCovariance; }
+    int64_t getTotalPixels() const { return totalPixels; }
+
+    // ========================================================================
+    // UTILITY
+    // ========================================================================
+
+    bool isBuilt() const { return built; }
+    int getBands() const { return bands; }
+    int getChannels() const { return channels; }
+    bool hasCrossProducts() const { return crossProducts; }
+    int getHeight() const { return height; }
+    int getWidth() const { return width; }
+
+    /**
+     * @brief Bytes held by the interleaved table
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * @brief Verify region moments against a brute-force sum (for testing)
+     */
+    bool verify(const MultiBandImage& image, const Region& region) const;
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // MULTI_BAND_PREFIX_SUM_H
@@ -0,0 +1,135 @@
+/**
+ * @file PixelLabeler.h
+ * @brief Pixel-resolution connected-component labeling of anomalous pixels
+ *
+ * Leaf-level components (QueryEngine::findConnectedComponents) are limited
+ * to the region tree's leaf size. This module labels the image itself, so
+ * component footprints are exact to the pixel.
+ *
+ * FOREGROUND:
+ *   A pixel p is anomalous when |p - global_mean| / global_stddev > threshold,
+ *   using the global statistics from PrefixSum. Bright (p > mean) and dark
+ *   (p < mean) pixels form separate classes; only pixels of the same class
+ *   are connected (4-connectivity).
+ *
+ * ALGORITHM: Two-pass labeling with union-find (SAUF-style)
+ *
+ *   The image is split into horizontal bands, one per worker.
+ *
+ *   PASS 1 (parallel over bands):
+ *     Raster scan each band. A pixel copies the label of its up or left
+ *     neighbour of the same class, or takes a fresh provisional label.
+ *     When both neighbours match with different labels, their sets are
+ *     united. Provisional labels are pixel index + 1, so every band owns a
+ *     disjoint label range and bands never touch each other's sets.
+ *
+ *   BORDER MERGE (sequential):
+ *     For each band boundary, unite vertically adjacent same-class pixels.
+ *
+ *   FLATTEN (sequential):
+ *     Sets are always rooted at their smallest label, so one ascending pass
+ *     over the equivalence array assigns final labels 1..K in raster order.
+ *
+ *   PASS 2 (parallel over bands):
+ *     Replace provisional labels with final ones and accumulate component
+ *     statistics. Each band owns the components that start in it and
+ *     writes them to one shared array; only components crossing its top
+ *     row get band-private accumulators, merged afterwards.
+ *
+ * COMPLEXITY:
+ *   - Time:  O(H × W × α(H × W)), parallel across bands
+ *   - Space: O(H × W) for the label image and the equivalence array, plus
+ *            O(K + bands × W) for the component statistics
+ */
+
+#ifndef PIXEL_LABELER_H
+#define PIXEL_LABELER_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "QueryEngine.h"
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @struct PixelLabelStats
+ * @brief Summary of the last labeling run
+ */
+struct PixelLabelStats {
+    int64_t foregroundPixels;   // Pixels above threshold
+    int components;             // Distinct components found
+    int bands;                  // Bands scanned in parallel
+    double labelTimeMs;
+
+    PixelLabelStats() : foregroundPixels(0), components(0), bands(0), labelTimeMs(0) {}
+};
+
+/**
+ * @class PixelLabeler
+ * @brief Labels connected anomalous pixels and summarises each component
+ */
+class PixelLabeler {
+private:
+    const Matrix* image;
+    const PrefixSum* prefixSum;
+    double threshold;
+
+    Buffer2D<int32_t> labels;       // 0 = background, 1..K = component label
+    std::vector<int32_t> parent;    // Provisional label equivalences (0 = unused)
+    PixelLabelStats stats;
+
+    /**
+     * @brief Pass 1 over rows [rowBegin, rowEnd)
+     * @param pixelClass Lookup table: 0 = background, 1 = bright, 2 = dark
+     */
+    void scanBand(int rowBegin, int rowEnd, const uint8_t* pixelClass);
+
+    /**
+     * @brief Unite same-class pixels across the boundary above row
+     */
+    void mergeBandBorder(int row, const uint8_t* pixelClass);
+
+    /**
+     * @brief Resolve provisional labels to final labels 1..K
+     * @param bandPixels Pixels per band (bandRows × width)
+     * @param bandFirst Output: first final label owned by each band, plus K + 1
+     * @return Number of components K
+     */
+    int flattenLabels(int64_t bandPixels, std::vector<int32_t>& bandFirst);
+
+public:
+    /**
+     * @brief Constructor
+     * @param threshold Pixel z-score threshold (default 2.0)
+     */
+    explicit PixelLabeler(double threshold = Config::DEFAULT_ANOMALY_THRESHOLD);
+
+    /**
+     * @brief Attach the image and its prefix sums (for global statistics)
+     */
+    void initialize(const Matrix* image, const PrefixSum* prefixSum);
+
+    /**
+     * @brief Label the image and summarise the components
+     * @return Components sorted by area (descending). id is the component's
+     *         label in getLabels(); nodeIndices is left empty.
+     *
+     * maxScore / avgScore are the maximum and mean pixel z-score magnitude,
+     * meanIntensity is the mean pixel value of the component.
+     */
+    std::vector<ConnectedComponent> label();
+
+    /**
+     * @brief Label image from the last label() call
+     */
+    const Buffer2D<int32_t>& getLabels() const { return labels; }
+
+    const PixelLabelStats& getStats() const { return stats; }
+    double getThreshold() const { return threshold; }
+    void setThreshold(double t) { threshold = t; }
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // PIXEL_LABELER_H
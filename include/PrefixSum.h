@@ -29,6 +29,37 @@
  * 
  * EXTENSION: We also maintain prefix sum of squares to enable O(1) variance queries
  * using the formula: Var(X) = E[X²] - (E[X])²
+ * 
+ * COMPACT STORAGE:
+ *   The prefix table is monotone in both directions, so inside a T×T tile every
+ *   value lies between the tile's top-left value and its bottom-right value.
+ *   Compact mode stores that top-left value once per tile (64-bit base) and a
+ *   narrow unsigned offset per cell:
+ *     prefix[i][j] = tileBase[tile(i,j)] + offset[i][j]
+ *   Sums use 32-bit offsets, squares 32 or 48 bits depending on image size.
+ *   Queries stay O(1): one extra base lookup per corner.
+ *   Memory: 8-10 bytes per pixel instead of 16.
+ * 
+ * BLOCKED STORAGE (patch updates):
+ *   A change to one pixel shifts every full-table entry below and to the
+ *   right of it. Blocked mode splits each entry into four parts around the
+ *   top-left corner (IT, JT) of its T×T block (I = i / T, J = j / T):
+ *     prefix[i][j] = blockBase[I][J]              rows [0,IT)  x cols [0,JT)
+ *                  + rowStrip[i][J]               rows [IT,i)  x cols [0,JT)
+ *                  + colStrip[j][I]               rows [0,IT)  x cols [JT,j)
+ *                  + local[i][j]                  rows [IT,i)  x cols [JT,j)
+ *   Only the block grid and the strips span more than one block, so a patch
+ *   of h×w pixels touches O((h+T)(w+T) + (h+T)·W/T + (w+T)·H/T + HW/T²)
+ *   entries instead of the whole lower-right quadrant. Local sums fit 32 bits
+ *   for T <= 256; queries read four values per corner.
+ *   Memory: ~8 bytes per pixel.
+ * 
+ * DIFFERENCE TABLES (change detection):
+ *   buildDifference(before, after) fills the same two tables with
+ *   d = after - before (signed) and d², in one fused pass over both images
+ *   without materializing d. Every query then answers for the difference
+ *   image: mean change, and variance of the change, of any region in O(1).
+ *   Difference tables always use full storage.
  */
 
 #ifndef PREFIX_SUM_H
@@ -38,6 +69,16 @@
 
 namespace SatelliteAnalytics {
 
+/**
+ * @enum PrefixStorage
+ * @brief Memory layout used for the summed-area tables
+ */
+enum class PrefixStorage {
+    Full,       // Two int64 tables: 16 bytes per pixel
+    Compact,    // Tiled 64-bit bases + 32-bit / 32-or-48-bit offsets
+    Blocked     // Block grid + row / column strips + 32-bit in-block sums (cheap updates)
+};
+
 /**
  * @class PrefixSum
  * @brief 2D Prefix Sum data structure for O(1) region queries
@@ -62,9 +103,29 @@ private:
     // Used for variance computation: Var = E[X²] - (E[X])²
     PrefixMatrix prefixSquares;
     
+    // Compact storage (used instead of prefix/prefixSquares in Compact mode)
+    // Tiles cover the padded (height+1) x (width+1) table
+    PrefixStorage storage;
+    int tileShift;                      // Tile side = 1 << tileShift
+    int tileCols;                       // Number of tiles per padded row
+    FlatArray<int64_t> tileBaseSum;     // prefix value at each tile's top-left cell
+    FlatArray<int64_t> tileBaseSq;      // prefixSquares value at each tile's top-left cell
+    Buffer2D<uint32_t> sumOffset;       // prefix - tileBaseSum
+    Buffer2D<uint32_t> sqOffsetLow;     // Low 32 bits of prefixSquares - tileBaseSq
+    Buffer2D<uint16_t> sqOffsetHigh;    // High 16 bits (empty if squares fit in 32 bits)
+    
+    // Blocked storage (tileBaseSum / tileBaseSq are the block grid); see file comment
+    Buffer2D<int64_t> rowStripSum;      // [i][J]: rows [IT,i) x cols [0,JT)
+    Buffer2D<int64_t> rowStripSq;
+    Buffer2D<int64_t> colStripSum;      // [j][I]: rows [0,IT) x cols [JT,j)
+    Buffer2D<int64_t> colStripSq;
+    Buffer2D<uint32_t> localSum;        // [i][j]: rows [IT,i) x cols [JT,j)
+    Buffer2D<uint32_t> localSq;
+    
     int height;
     int width;
     bool built;
+    bool difference;                    // Tables hold after - before (buildDifference)
     
     // Global statistics (computed during build)
     double globalMean;
@@ -72,6 +133,71 @@ private:
     double globalStdDev;
     int64_t totalSum;
     int64_t totalPixels;
+    
+    friend class SceneIndex;    // Attaches the tables to a mapped index file
+    
+    /**
+     * @brief Build the compact tiled tables
+     * 
+     * Streams the image row by row, keeping only two rows of full 64-bit
+     * prefix values alive at a time.
+     * @return false if the image is too large for 32-bit sum offsets
+     */
+    bool buildCompact(const Matrix& image);
+    
+    /**
+     * @brief Build the blocked tables (same row streaming as buildCompact)
+     */
+    void buildBlocked(const Matrix& image);
+    
+    /**
+     * @brief Derive global mean/variance from the bottom-right table entries
+     */
+    void computeGlobalStats();
+    
+    /**
+     * @brief Mean / variance / stddev from region sums (shared by all query paths)
+     */
+    static RegionStats finishStats(int64_t sum, int64_t sumSquares, int64_t area);
+    
+    /**
+     * @brief Answer queries order[begin..end) of a batch (order == nullptr: identity)
+     */
+    void statsBlock(const Region* regions, const uint32_t* order, size_t begin, size_t end,
+                    RegionStats* out) const;
+    
+    /**
+     * @brief Padded-table lookups that hide the storage mode
+     * @param i Padded row index [0, height]
+     * @param j Padded column index [0, width]
+     */
+    int64_t sumAt(int i, int j) const {
+        if (storage == PrefixStorage::Full) return prefix[i][j];
+        int tileRow = i >> tileShift;
+        int tileCol = j >> tileShift;
+        int tile = tileRow * tileCols + tileCol;
+        if (storage == PrefixStorage::Blocked) {
+            return tileBaseSum[tile] + rowStripSum[i][tileCol] + colStripSum[j][tileRow]
+                 + localSum[i][j];
+        }
+        return tileBaseSum[tile] + sumOffset[i][j];
+    }
+    
+    int64_t sumSquaresAt(int i, int j) const {
+        if (storage == PrefixStorage::Full) return prefixSquares[i][j];
+        int tileRow = i >> tileShift;
+        int tileCol = j >> tileShift;
+        int tile = tileRow * tileCols + tileCol;
+        if (storage == PrefixStorage::Blocked) {
+            return tileBaseSq[tile] + rowStripSq[i][tileCol] + colStripSq[j][tileRow]
+                 + localSq[i][j];
+        }
+        uint64_t offset = sqOffsetLow[i][j];
+        if (!sqOffsetHigh.empty()) {
+            offset |= static_cast<uint64_t>(sqOffsetHigh[i][j]) << 32;
+        }
+        return tileBaseSq[tile] + static_cast<int64_t>(offset);
+    }
 
 public:
     PrefixSum();
@@ -87,8 +213,47 @@ public:
      * 
      * TIME COMPLEXITY: O(n²) where n is the image dimension
      * SPACE COMPLEXITY: O(n²) for storing two prefix matrices
+     * 
+     * PARALLEL BUILD: the recurrence is split into a row-scan pass (parallel
+     * across rows, SIMD scan kernel when built with AVX2) and a column pass
+     * (parallel across column blocks) on ThreadPool::shared().
+     * 
+     * @param mode Full (default), Compact or Blocked storage. Compact falls
+     *             back to Full if the image is too large for 32-bit sum offsets.
      */
-    void build(const Matrix& image);
+    void build(const Matrix& image, PrefixStorage mode = PrefixStorage::Full);
+    
+    /**
+     * @brief Build tables of the signed difference of two co-registered images
+     * @param before Earlier scene
+     * @param after Later scene, same dimensions
+     * @return false (with a message) if the images are empty or differ in size
+     * 
+     * Each row scan reads one row of both images and accumulates d and d²
+     * directly; the column pass is the one build() uses. Global statistics
+     * are those of d: the mean change and its spread over the scene.
+     * updateRegion() and verify() do not apply to a difference table.
+     * 
+     * TIME COMPLEXITY: O(n²), one read of each image
+     */
+    bool buildDifference(const Matrix& before, const Matrix& after);
+    
+    /**
+     * @brief Replace the pixels of a rectangle and update the tables in place
+     * @param row Top row of the patch in the image
+     * @param col Left column of the patch in the image
+     * @param patch New pixel values; must lie entirely inside the image
+     * @return false if the tables are not built or the patch does not fit
+     * 
+     * The old pixel values are recovered from the tables themselves, so the
+     * source image is not needed. Afterwards every query (and the global
+     * statistics) equals that of a fresh build over the patched image.
+     * 
+     * TIME COMPLEXITY (h×w patch at (r, c), tile side T):
+     *   Full / Compact: O((height - r) × (width - c)), the lower-right quadrant
+     *   Blocked:        O((h+T)(w+T) + (h+T)·width/T + (w+T)·height/T + height·width/T²)
+     */
+    bool updateRegion(int row, int col, const Matrix& patch);
     
     /**
      * @brief Query the sum of pixels in a rectangular region
@@ -134,6 +299,27 @@ public:
     RegionStats queryStats(const Region& region) const;
     RegionStats queryStats(int r1, int c1, int r2, int c2) const;
     
+    /**
+     * @brief Compute statistics for many regions in one call
+     * @param regions Query rectangles (n elements)
+     * @param n Number of regions
+     * @param out Output, out[i] = queryStats(regions[i]) bit for bit
+     * 
+     * BATCH EXECUTION:
+     *   1. Batches of Config::STATS_BATCH_SORT_MIN or more are visited in
+     *      corner order: a counting sort by the 16-row band of the top-left
+     *      corner, so consecutive queries touch nearby rows and cache lines
+     *      of the tables. Results still land at their own index.
+     *   2. Blocks of Config::STATS_BATCH_BLOCK queries run in parallel on
+     *      ThreadPool::shared().
+     *   3. Each query clamps once and reads its eight corners (both tables)
+     *      directly, without the per-call checks of querySum() and
+     *      querySumSquares().
+     * 
+     * TIME COMPLEXITY: O(n + height / 16)
+     */
+    void queryStatsBatch(const Region* regions, size_t n, RegionStats* out) const;
+    
     /**
      * @brief Query mean pixel value for a region
      * TIME COMPLEXITY: O(1)
@@ -161,8 +347,15 @@ public:
     // ========================================================================
     
     bool isBuilt() const { return built; }
+    bool isDifference() const { return difference; }
     int getHeight() const { return height; }
     int getWidth() const { return width; }
+    PrefixStorage getStorage() const { return storage; }
+    
+    /**
+     * @brief Bytes held by the prefix tables (both sums and squares)
+     */
+    size_t getMemoryBytes() const;
     
     /**
      * @brief Verify prefix sum correctness with brute force (for testing)
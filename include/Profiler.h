@@ -0,0 +1,159 @@
+/**
+ * @file Profiler.h
+ * @brief Low-overhead instrumentation: scoped zones, counters and latency histograms
+ *
+ * The engine stages and queries are instrumented with a fixed set of zones
+ * (ProfileZone) and counters (ProfileCounter). Profiling is off by default;
+ * while it is off every hook is a single relaxed load and branch.
+ *
+ *   ZONES:
+ *     A ProfileScope times its enclosing block with steady_clock. Each
+ *     thread adds the duration to its own per-zone histogram, so recording
+ *     needs no lock and no atomic.
+ *
+ *   HISTOGRAMS:
+ *     Log-linear buckets: four per power of two of nanoseconds, in fixed
+ *     memory however many events are recorded. A p50 or p99 is reported as
+ *     its bucket's upper edge, so it never understates the true value and
+ *     overstates it by less than 25% (the [4, 5) x 2^k buckets).
+ *
+ *   COUNTERS:
+ *     Tree nodes visited and pruned by queries, prefix-table reads, bytes
+ *     loaded from image files: per thread, like the zones. Heap allocations
+ *     are counted by the application's operator new (see main.cpp) through
+ *     countAllocation().
+ *
+ *   EXPORT:
+ *     writeReport() produces JSON with per-zone totals and percentiles,
+ *     merged and per thread, plus the counters. With trace recording on,
+ *     writeChromeTrace() produces the Chrome trace event format
+ *     (chrome://tracing, Perfetto). Export reads the per-thread data
+ *     without locking it, so call it once the instrumented work is done.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @enum ProfileZone
+ * @brief Instrumented code regions
+ */
+enum class ProfileZone {
+    ImageLoad,          // ImageLoader::loadFromPGM
+    PrefixBuild,        // PrefixSum::build
+    PrefixUpdate,       // PrefixSum::updateRegion
+    TreeBuild,          // RegionTree::build
+    Detection,          // AnomalyDetector::detectInTree / detectInRegion
+    TopK,               // QueryEngine::topKAnomalies
+    TopKPruned,         // QueryEngine::topKWithPruning
+    Rectangle,          // QueryEngine::queryRectangle
+    RectangleTopN,      // QueryEngine::topNInRectangle
+    RegionStats,        // QueryEngine::queryRegionStats
+    RegionStatsBatch,   // PrefixSum::queryStatsBatch
+    Components,         // QueryEngine::findConnectedComponents(DFS)
+    Count
+};
+
+/**
+ * @enum ProfileCounter
+ * @brief Event counters
+ */
+enum class ProfileCounter {
+    NodesVisited,       // Tree nodes examined by queries
+    NodesPruned,        // Subtrees skipped by pruned top-K
+    PrefixReads,        // Prefix-table entries read (4 per rectangle sum)
+    BytesLoaded,        // Image file bytes read or mapped
+    Count
+};
+
+/**
+ * @class Profiler
+ * @brief Process-wide profiling state (static interface)
+ */
+class Profiler {
+public:
+    struct ThreadData;      // Per-thread zones and counters (Profiler.cpp)
+
+private:
+    static std::atomic<bool> enabledFlag;
+    static std::atomic<int64_t> allocations;
+
+    /**
+     * @brief Calling thread's data, registered on first use
+     */
+    static ThreadData& local();
+
+public:
+    /**
+     * @brief Turn profiling on
+     * @param recordTrace Also keep every zone event for writeChromeTrace()
+     *                    (bounded per thread by Config::PROFILE_MAX_TRACE_EVENTS)
+     */
+    static void enable(bool recordTrace = false);
+
+    static bool isEnabled() { return enabledFlag.load(std::memory_order_relaxed); }
+
+    static void count(ProfileCounter counter, int64_t n = 1) {
+        if (isEnabled()) addCount(counter, n);
+    }
+
+    /**
+     * @brief Called by the application's operator new; must not allocate
+     */
+    static void countAllocation() {
+        if (isEnabled()) allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Nanoseconds since enable() on a steady clock
+     */
+    static int64_t nowNs();
+
+    static void addCount(ProfileCounter counter, int64_t n);
+    static void record(ProfileZone zone, int64_t startNs, int64_t endNs);
+
+    static const char* zoneName(ProfileZone zone);
+    static const char* counterName(ProfileCounter counter);
+
+    /**
+     * @brief Write the JSON summary
+     * @return false with a message on stderr if the file cannot be written
+     */
+    static bool writeReport(const std::string& path);
+
+    /**
+     * @brief Write recorded zone events in Chrome trace event format
+     */
+    static bool writeChromeTrace(const std::string& path);
+};
+
+/**
+ * @class ProfileScope
+ * @brief Times the enclosing block as one event of a zone
+ */
+class ProfileScope {
+private:
+    ProfileZone zone;
+    int64_t startNs;    // -1 when profiling was off at construction
+
+public:
+    explicit ProfileScope(ProfileZone z)
+        : zone(z), startNs(Profiler::isEnabled() ? Profiler::nowNs() : -1) {}
+
+    ~ProfileScope() {
+        if (startNs >= 0) Profiler::record(zone, startNs, Profiler::nowNs());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // PROFILER_H
@@ -7,21 +7,25 @@
  * 1. TOP-K ANOMALOUS REGIONS (Priority Queue)
  *    - Uses min-heap of size K
  *    - Maintains K highest-scoring regions
- *    - Can prune tree branches if max possible score < min in heap
+ *    - Can prune tree branches if max possible leaf score < min in heap
+ *      (best-first over per-subtree maxLeafScore bounds)
  *    - TIME: O(n log k) where n = number of regions
  *    - SPACE: O(k) for the heap
  * 
  * 2. LARGEST CONNECTED ANOMALOUS REGION (Union-Find / DFS)
- *    - Identifies adjacent anomalous regions
- *    - Merges them using Union-Find with path compression
+ *    - Identifies adjacent anomalous regions with an edge-index sweep
+ *      (leaves bucketed by their edge coordinates, O(n + H + W))
+ *    - Merges them using Union-Find with path halving
  *    - Tracks component sizes to find largest
  *    - TIME: O(n α(n)) ≈ O(n) where α is inverse Ackermann
  *    - SPACE: O(n) for Union-Find arrays
  * 
- * 3. REGION QUERY (Tree Traversal)
+ * 3. REGION QUERY (Leaf Index)
  *    - Find all anomalous regions within a query rectangle
- *    - Prunes tree branches that don't intersect query
- *    - TIME: O(log n + k) where k = number of results
+ *    - A LeafIndex cell grid maps the rectangle straight to one run of
+ *      cells per grid row; no tree walk
+ *    - Top-N within a rectangle keeps a size-N heap instead of sorting
+ *    - TIME: O(log n + c) where c = leaf cells in the rectangle
  */
 
 #ifndef QUERY_ENGINE_H
@@ -31,9 +35,10 @@
 #include "PrefixSum.h"
 #include "RegionTree.h"
 #include "AnomalyDetector.h"
+#include "LeafIndex.h"
 #include <queue>
 #include <vector>
-#include <unordered_map>
+#include <utility>
 
 namespace SatelliteAnalytics {
 
@@ -48,8 +53,21 @@ struct ConnectedComponent {
     int64_t totalArea;             // Total pixel area
     double maxScore;               // Maximum anomaly score in component
     double avgScore;               // Average anomaly score
+    double meanIntensity;          // Area-weighted mean pixel value
     
-    ConnectedComponent() : id(-1), totalArea(0), maxScore(0), avgScore(0) {}
+    ConnectedComponent() : id(-1), totalArea(0), maxScore(0), avgScore(0), meanIntensity(0) {}
+};
+
+/**
+ * @enum AdjacencyMethod
+ * @brief How connected-component queries discover adjacent leaves
+ *
+ * EdgeIndex is the default. Pairwise is the original all-pairs check and is
+ * kept as a reference for benchmarks and cross-checking.
+ */
+enum class AdjacencyMethod {
+    EdgeIndex,  // Bucket leaves by edge coordinate, sweep shared edges: O(n + H + W)
+    Pairwise    // Test every pair with areAdjacent(): O(n²)
 };
 
 /**
@@ -63,21 +81,49 @@ struct QueryResult {
     int nodesPruned;
     
     QueryResult() : queryTimeMs(0), nodesVisited(0), nodesPruned(0) {}
+    
+    /**
+     * @brief Empty the result for reuse; regions keeps its capacity
+     */
+    void reset() {
+        regions.clear();
+        queryTimeMs = 0;
+        nodesVisited = 0;
+        nodesPruned = 0;
+    }
+};
+
+/**
+ * @struct QueryScratch
+ * @brief Reusable working memory for the in-place query overloads
+ * 
+ * The heaps and work lists a query needs live here instead of in per-call
+ * containers. Keep one per thread (queries on a shared engine are
+ * concurrent, a scratch is not) together with a QueryResult: once both have
+ * grown to the largest query seen, further queries allocate nothing.
+ */
+struct QueryScratch {
+    struct Candidate {
+        double bound;   // maxLeafScore of the subtree
+        int index;
+    };
+    
+    std::vector<Candidate> frontier;                // Best-first heap for topKWithPruning
 };
 
 /**
  * @class UnionFind
- * @brief Disjoint Set Union (DSU) with path compression and union by rank
+ * @brief Disjoint Set Union (DSU) with path halving and union by size
  * 
  * ALGORITHM: Union-Find with optimizations
  * 
- * PATH COMPRESSION:
- *   During find(), make all nodes on path point directly to root
- *   This flattens the tree for faster future queries
+ * PATH HALVING:
+ *   During find(), point every other node on the path at its grandparent
+ *   Iterative, so long chains cannot overflow the stack
  * 
- * UNION BY RANK:
- *   Attach smaller tree under larger tree
- *   Keeps tree balanced
+ * UNION BY SIZE:
+ *   Attach the lighter tree under the heavier one
+ *   Size defaults to 1 per element, or any positive weight set via setSize()
  * 
  * TIME COMPLEXITY:
  *   - Find: O(α(n)) amortized, where α = inverse Ackermann (effectively constant)
@@ -87,20 +133,24 @@ struct QueryResult {
 class UnionFind {
 private:
     std::vector<int> parent;
-    std::vector<int> rank;
-    std::vector<int64_t> size;  // Size of each component (in terms of area)
+    std::vector<int64_t> size;  // Weight of each component (element count or area)
     int numComponents;
 
 public:
-    UnionFind(int n);
+    UnionFind(int n = 0);
     
     /**
-     * @brief Find root of element with path compression
+     * @brief Reinitialize to n singleton sets, reusing existing storage
+     */
+    void reset(int n);
+    
+    /**
+     * @brief Find root of element with path halving
      */
     int find(int x);
     
     /**
-     * @brief Union two elements with union by rank
+     * @brief Union two elements with union by size
      * @return true if union occurred (elements were in different sets)
      */
     bool unite(int x, int y);
@@ -124,17 +174,35 @@ public:
      * @brief Get number of distinct components
      */
     int getNumComponents() const { return numComponents; }
+    
+    /**
+     * @brief Assign every element a dense component label
+     * @param labels Output, labels[x] in [0, getNumComponents())
+     * @return Number of components
+     * 
+     * Labels follow the order in which components first appear by element
+     * index, so the result does not depend on the order of unions.
+     */
+    int relabel(std::vector<int>& labels);
 };
 
 /**
  * @class QueryEngine
  * @brief Executes efficient queries on the analyzed region tree
+ * 
+ * THREAD SAFETY:
+ *   Every query is const and keeps its heaps, Union-Find and adjacency lists
+ *   in per-call locals (or in the caller's QueryScratch), so any number of
+ *   threads may query one engine at once. The tree and prefix tables must
+ *   not change meanwhile (scoring with AnomalyDetector::detectInTree() is a
+ *   write). initialize() is not thread-safe.
  */
 class QueryEngine {
 private:
     const RegionTree* regionTree;
     const PrefixSum* prefixSum;
     const AnomalyDetector* detector;
+    LeafIndex leafIndex;                // Cell grid over the tree's leaves
     
     /**
      * @brief Check if two regions are adjacent (share edge or corner)
@@ -150,12 +218,20 @@ private:
      * @brief Compute bounding box of two regions
      */
     Region mergeBounds(const Region& a, const Region& b) const;
+    
+    /**
+     * @brief Collect the anomalous leaves that connected-component queries work on
+     */
+    std::vector<const RegionTreeNode*> getAnomalousLeaves() const;
 
 public:
     QueryEngine();
     
     /**
      * @brief Initialize the query engine
+     * 
+     * Builds the LeafIndex over the tree's leaves (O(leaves)); call again
+     * after the tree is rebuilt. Re-scoring does not need it.
      */
     void initialize(const RegionTree* tree, const PrefixSum* prefix, 
                    const AnomalyDetector* detector);
@@ -175,23 +251,40 @@ public:
      *   2. Traverse tree (can prune if node's max score < heap's min)
      *   3. For each node:
      *      - If heap size < K: push node
-     *      - Else if node.score > heap.top().score: pop top, push node
+     *      - Else if node outranks heap.top(): pop top, push node
+     *        (higher score, or equal score and lower node index)
      *   4. Extract heap contents and sort descending
      * 
      * TIME COMPLEXITY: O(n log k)
      * SPACE COMPLEXITY: O(k)
      */
-    QueryResult topKAnomalies(int k = Config::DEFAULT_TOP_K, bool leafOnly = true);
+    QueryResult topKAnomalies(int k = Config::DEFAULT_TOP_K, bool leafOnly = true) const;
+    
+    /**
+     * @brief topKAnomalies() into a reused result
+     * 
+     * The min-heap is built directly in result.regions and sorted in place,
+     * so no other storage is needed. Same regions in the same order.
+     */
+    void topKAnomalies(int k, bool leafOnly, QueryResult& result) const;
     
     /**
      * @brief Find top-K with pruning optimization
      * 
-     * Enhanced version that prunes tree branches where the maximum
-     * possible anomaly score is less than the current minimum in heap.
+     * Best-first branch and bound: a max-priority queue orders subtrees by
+     * their maxLeafScore bound, and subtrees whose bound cannot beat the
+     * current minimum in the heap are skipped. Returns the same regions in
+     * the same order as topKAnomalies(k, true): both rank equal scores by
+     * node index. Requires AnomalyDetector::detectInTree().
      * 
-     * TIME COMPLEXITY: O(log n + k log k) best case with good pruning
+     * TIME COMPLEXITY: O(k · depth · log n) node visits with good pruning
      */
-    QueryResult topKWithPruning(int k = Config::DEFAULT_TOP_K);
+    QueryResult topKWithPruning(int k = Config::DEFAULT_TOP_K) const;
+    
+    /**
+     * @brief topKWithPruning() into a reused result and scratch
+     */
+    void topKWithPruning(int k, QueryResult& result, QueryScratch& scratch) const;
     
     // ========================================================================
     // CONNECTED COMPONENT QUERIES (UNION-FIND / DFS)
@@ -205,27 +298,43 @@ public:
      *   1. Get all anomalous leaf nodes
      *   2. Initialize Union-Find with n elements
      *   3. For each pair of adjacent anomalous nodes: union them
+     *      (pairs come from findAdjacentPairs)
      *   4. Group nodes by their root to form components
      * 
-     * TIME COMPLEXITY: O(n² × α(n)) for pairwise adjacency, O(n log n) with spatial indexing
-     * SPACE COMPLEXITY: O(n)
+     * TIME COMPLEXITY: O((n + H + W) × α(n)) with the edge index,
+     *                  O(n² × α(n)) with AdjacencyMethod::Pairwise
+     * SPACE COMPLEXITY: O(n + H + W)
      */
-    std::vector<ConnectedComponent> findConnectedComponents();
+    std::vector<ConnectedComponent> findConnectedComponents(
+        AdjacencyMethod method = AdjacencyMethod::EdgeIndex) const;
     
     /**
      * @brief Find the largest connected anomalous region
      * @return The largest component (by area)
      */
-    ConnectedComponent findLargestConnectedRegion();
+    ConnectedComponent findLargestConnectedRegion() const;
+    
+    /**
+     * @brief Find every pair of edge-adjacent regions
+     * @param nodes Disjoint regions (e.g. anomalous leaves, or all leaves)
+     * @param method Edge-index sweep or pairwise reference check
+     * @return Pairs (i, j) of indices into nodes, each pair reported once
+     * 
+     * Only reads the regions' bounds; the engine's tree is not used.
+     */
+    std::vector<std::pair<int, int>> findAdjacentPairs(
+        const std::vector<const RegionTreeNode*>& nodes, AdjacencyMethod method) const;
     
     /**
      * @brief Find connected components using DFS
      * @return Vector of connected components
      * 
      * Alternative to Union-Find approach using graph DFS.
-     * TIME COMPLEXITY: O(n + m) where m = number of edges (adjacencies)
+     * TIME COMPLEXITY: O(n + m) where m = number of edges (adjacencies),
+     *                  plus O(H + W) for the edge index
      */
-    std::vector<ConnectedComponent> findConnectedComponentsDFS();
+    std::vector<ConnectedComponent> findConnectedComponentsDFS(
+        AdjacencyMethod method = AdjacencyMethod::EdgeIndex) const;
     
     // ========================================================================
     // REGION QUERIES (TREE TRAVERSAL WITH PRUNING)
@@ -234,17 +343,56 @@ public:
     /**
      * @brief Find all anomalous regions within a query rectangle
      * @param queryRegion Rectangle to search within
-     * @return QueryResult with matching regions
+     * @return QueryResult with matching regions, highest score first
+     * 
+     * Streams the intersecting leaves from the LeafIndex.
+     * TIME COMPLEXITY: O(log n + c + k log k), c = leaf cells in the
+     *                  rectangle, k = number of results
+     */
+    QueryResult queryRectangle(const Region& queryRegion) const;
+    
+    /**
+     * @brief queryRectangle() into a reused result
+     */
+    void queryRectangle(const Region& queryRegion, QueryResult& result) const;
+    
+    /**
+     * @brief The n highest-scoring anomalous leaves within a rectangle
+     * @param result Reused; up to n regions, highest score first
      * 
-     * Uses tree structure to prune non-intersecting branches.
-     * TIME COMPLEXITY: O(log n + k) where k = number of results
+     * The first n regions of queryRectangle() (up to ties) from a size-n
+     * min-heap, as in topKAnomalies(): no sort of the full match list.
+     * TIME COMPLEXITY: O(log n + c + k log n)
      */
-    QueryResult queryRectangle(const Region& queryRegion);
+    void topNInRectangle(const Region& queryRegion, int n, QueryResult& result) const;
+    
+    /**
+     * @brief The leaves intersecting a rectangle, streamed in place
+     * 
+     *   for (int node : engine.leavesInRectangle(r)) { ... }
+     * 
+     * Yields node indices of every intersecting leaf (anomalous or not),
+     * allocating nothing.
+     */
+    LeafIndex::Range leavesInRectangle(const Region& queryRegion) const {
+        return leafIndex.leavesIn(queryRegion);
+    }
+    
+    const LeafIndex& getLeafIndex() const { return leafIndex; }
     
     /**
      * @brief Get statistics for a query region
      */
-    RegionStats queryRegionStats(const Region& region);
+    RegionStats queryRegionStats(const Region& region) const;
+    
+    /**
+     * @brief Get statistics for many query regions at once
+     * @return stats[i] for regions[i], identical to queryRegionStats(regions[i])
+     * 
+     * Runs PrefixSum::queryStatsBatch(): corner-sorted and multithreaded.
+     * Use it for large lists of areas of interest.
+     */
+    std::vector<RegionStats> queryRegionStatsBatch(const std::vector<Region>& regions) const;
     
     // ========================================================================
     // UTILITY
@@ -0,0 +1,187 @@
+/**
+ * @file QueryServer.h
+ * @brief Long-running query server that keeps analysed scenes resident
+ *
+ * The CLI rebuilds prefix sums and the region tree on every run. The server
+ * builds (or maps, for index files) each scene once and then answers
+ * queries against it, so a query costs microseconds instead of a rebuild.
+ *
+ * PROTOCOL (one request per line, whitespace-separated):
+ *
+ *   load NAME PATH [THRESHOLD]    PGM image or SceneIndex file (detected by magic)
+ *   generate NAME SIZE ANOMALIES [SEED]
+ *   unload NAME
+ *   scenes
+ *   topk NAME K                   Pruned top-K leaves
+ *   rect NAME R1 C1 R2 C2         Anomalous leaves inside a rectangle
+ *   stats NAME R1 C1 R2 C2 [...]  Statistics, any number of rectangles (batched)
+ *   components NAME [MAX]         Connected components, largest first
+ *   ping | quit | shutdown
+ *
+ * Every response starts with "OK <lines> [key=value ...]" followed by that
+ * many data lines, or is the single line "ERR <message>". Responses on one
+ * connection come back in request order even though requests run
+ * concurrently on ThreadPool::shared().
+ *
+ * Transports: a stream pair (stdin / stdout) or TCP on 127.0.0.1, one
+ * reader thread per connection.
+ */
+
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "SceneIndex.h"
+#include <atomic>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @struct ServerConfig
+ * @brief Defaults applied to scenes the server builds
+ */
+struct ServerConfig {
+    double threshold;
+    int minRegionSize;
+    PrefixStorage prefixStorage;
+    TreeLayout treeLayout;
+    int maxInFlight;            // Pipelined requests per connection before reading blocks
+
+    ServerConfig()
+        : threshold(Config::DEFAULT_ANOMALY_THRESHOLD), minRegionSize(Config::MIN_REGION_SIZE),
+          prefixStorage(PrefixStorage::Full), treeLayout(TreeLayout::DepthFirst),
+          maxInFlight(64) {}
+};
+
+/**
+ * @struct Scene
+ * @brief One resident scene: prefix tables, scored tree and its query engine
+ *
+ * Built in place and never moved (the engine points at its members).
+ * Scenes loaded from an index file keep the mapping alive in `index`.
+ * Immutable once published, so requests query it without locking.
+ */
+struct Scene {
+    std::string name;
+    std::string source;
+    double threshold;
+    double loadTimeMs;
+
+    std::unique_ptr<SceneIndex> index;  // Set for index-backed scenes
+    PrefixSum ownedPrefix;              // Used when built from an image
+    RegionTree ownedTree;
+    const PrefixSum* prefixSum;
+    RegionTree* regionTree;
+
+    AnomalyDetector detector;
+    QueryEngine engine;                 // Const queries, safe to run concurrently
+
+    Scene() : threshold(0), loadTimeMs(0), prefixSum(nullptr), regionTree(nullptr) {}
+};
+
+/**
+ * @class QueryServer
+ * @brief Scene registry plus the line protocol on top of it
+ */
+class QueryServer {
+private:
+    ServerConfig config;
+
+    std::map<std::string, std::shared_ptr<Scene>> scenes;
+    mutable std::shared_mutex scenesMutex;     // Guards the map, not the scenes
+
+    std::atomic<bool> stopping;
+    std::atomic<int> listenSocket;
+    std::mutex clientsMutex;
+    std::vector<int> clientSockets;
+
+    std::shared_ptr<Scene> findScene(const std::string& name) const;
+    void publish(const std::shared_ptr<Scene>& scene);
+
+    /**
+     * @brief Score the tree and wire up the engine of a freshly built scene
+     */
+    void finishScene(Scene& scene);
+
+    std::string describeScene(const Scene& scene) const;
+
+    /**
+     * @brief Pipelined request loop shared by every transport
+     * @param readLine Fetch the next request; false at end of input
+     * @param write Send one complete response
+     */
+    void serveLines(const std::function<bool(std::string&)>& readLine,
+                    const std::function<void(const std::string&)>& write);
+
+    void serveClient(int socket);
+
+public:
+    explicit QueryServer(const ServerConfig& cfg = ServerConfig());
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    /**
+     * @brief Load a PGM image or a SceneIndex file as scene `name`
+     * @param threshold Anomaly threshold; negative = server default
+     * @return The scene just published, or nullptr with a message in error
+     *
+     * An existing scene with the same name is replaced once the new one is
+     * ready; queries still running on the old one finish normally. The
+     * returned pointer stays valid even if another connection unloads or
+     * replaces the name right away.
+     */
+    std::shared_ptr<Scene> loadScene(const std::string& name, const std::string& path,
+                                     double threshold, std::string& error);
+
+    /**
+     * @brief Build scene `name` from a synthetic image
+     * @return The scene just published, or nullptr with a message in error
+     */
+    std::shared_ptr<Scene> generateScene(const std::string& name, int size, int anomalies,
+                                         unsigned int seed, std::string& error);
+
+    bool unloadScene(const std::string& name);
+
+    /**
+     * @brief Execute one request line and return the full response
+     *
+     * Thread-safe; responses always end with a newline.
+     */
+    std::string handleRequest(const std::string& line);
+
+    /**
+     * @brief Serve requests from a stream until end of input or shutdown
+     */
+    void serveStream(std::istream& in, std::ostream& out);
+
+    /**
+     * @brief Accept TCP connections on 127.0.0.1:port until shutdown
+     * @return false if the socket cannot be opened (or sockets are unavailable)
+     */
+    bool serveTcp(int port);
+
+    /**
+     * @brief Ask every transport loop to stop
+     */
+    void shutdown();
+
+    bool isStopping() const { return stopping.load(); }
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // QUERY_SERVER_H
@@ -28,6 +28,33 @@
  *   - Natural spatial decomposition for 2D images
  *   - Enables hierarchical pruning in queries
  *   - Coarse-to-fine analysis
+ * 
+ * ADAPTIVE SUBDIVISION (optional):
+ *   With a variance tolerance V > 0, a region also stays a leaf when
+ *     variance(region) <= V  and  both sides <= Config::ADAPTIVE_MAX_LEAF_SIZE
+ *   (variance in O(1) from the prefix sums). Uniform areas such as open
+ *   water end in a few coarse leaves, textured areas still split down to
+ *   MIN_REGION_SIZE, and every full-tree pass shrinks with the node count.
+ * 
+ * EXACT PRE-SIZING:
+ *   With uniform subdivision the split rule depends only on a region's
+ *   height and width, so the number of nodes below any region is a
+ *   function of (h, w). Distinct (h, w) pairs per level are at most four,
+ *   so the full count is a tiny memoized recursion. Adaptive subdivision
+ *   depends on the pixels, so a counting pass applies the same rule first
+ *   (in parallel, one O(1) variance query per node) and keeps the sizes of
+ *   the top-level subtrees the parallel build needs slot offsets for.
+ *   Either way the node array is allocated once at its exact size and
+ *   filled in place (in parallel) without any reallocation.
+ * 
+ * TRAVERSAL PRIMITIVES:
+ *   traverse (breadth-first), traverseDepthFirst, traversePruned and
+ *   traverseLeaves are header templates taking any callable, so visitors
+ *   inline into the loop. Depth-first walks keep their work list in a
+ *   fixed array: each level pops one node and pushes at most four, so
+ *   3 · depth + 1 slots always suffice and MAX_DEPTH bounds every tree
+ *   (each split at least halves the larger side of an int-sized image).
+ *   traverseLeaves scans the leaf bitmask directly, no child links.
  */
 
 #ifndef REGION_TREE_H
@@ -36,11 +63,22 @@
 #include "Utils.h"
 #include "PrefixSum.h"
 #include <vector>
-#include <functional>
 #include <memory>
+#include <map>
+#include <tuple>
+#include <utility>
 
 namespace SatelliteAnalytics {
 
+/**
+ * @enum TreeLayout
+ * @brief Order in which nodes are laid out in the flat node array
+ */
+enum class TreeLayout {
+    DepthFirst,     // Pre-order: every subtree occupies a contiguous index range
+    BreadthFirst    // Level order: every depth occupies a contiguous index range
+};
+
 /**
  * @struct RegionTreeNode
  * @brief A node in the hierarchical region tree
@@ -56,6 +94,7 @@ struct RegionTreeNode {
     Region bounds;              // Region this node represents
     RegionStats stats;          // Pre-computed statistics
     double anomalyScore;        // Deviation from global mean
+    double maxLeafScore;        // Upper bound: max anomalyScore over leaves in this subtree
     bool isAnomaly;             // Flagged as anomalous
     int depth;                  // Depth in tree (root = 0)
     
@@ -69,12 +108,41 @@ struct RegionTreeNode {
                children[2] == -1 && children[3] == -1;
     }
     
-    RegionTreeNode() : id(-1), anomalyScore(0), isAnomaly(false), 
+    RegionTreeNode() : id(-1), anomalyScore(0), maxLeafScore(0), isAnomaly(false), 
                        depth(0), parent(-1) {
         children[0] = children[1] = children[2] = children[3] = -1;
     }
 };
 
+/**
+ * @struct RegionTreeColumns
+ * @brief Structure-of-arrays copy of the per-node fields that full-tree passes read
+ * 
+ * A RegionTreeNode is ~100 bytes, so a scan that only needs one double per
+ * node wastes most of every cache line. These columns hold the hot fields
+ * contiguously (column[i] belongs to node i), letting passes such as anomaly
+ * scoring and top-K stream just what they use and auto-vectorize.
+ * 
+ * The columns are filled by RegionTree::build(). Writers of anomalyScore /
+ * maxLeafScore / isAnomaly (AnomalyDetector) update both the columns and
+ * the nodes.
+ */
+struct RegionTreeColumns {
+    FlatArray<Region> bounds;
+    FlatArray<double> mean;
+    FlatArray<double> variance;
+    FlatArray<double> anomalyScore;
+    FlatArray<double> maxLeafScore;     // Max leaf score in each subtree (pruning bound)
+    FlatArray<uint8_t> isAnomaly;       // 0 / 1
+    FlatArray<uint64_t> leafMask;       // Bit (i % 64) of word (i / 64) set if node i is a leaf
+    
+    size_t size() const { return mean.size(); }
+    
+    bool isLeaf(int index) const {
+        return (leafMask[index >> 6] >> (index & 63)) & 1;
+    }
+};
+
 /**
  * @class RegionTree
  * @brief QuadTree-style hierarchical decomposition of the image
@@ -85,29 +153,126 @@ struct RegionTreeNode {
  * 3. Spatial indexing for region queries
  */
 class RegionTree {
+public:
+    // Deepest tree any build can produce, and the depth-first work list it needs
+    static constexpr int MAX_DEPTH = 32;
+    static constexpr int TRAVERSAL_STACK = 3 * MAX_DEPTH + 1;
+
 private:
-    std::vector<RegionTreeNode> nodes;  // Flat storage for cache efficiency
+    FlatArray<RegionTreeNode> nodes;    // Flat storage for cache efficiency
+    RegionTreeColumns columns;          // SoA mirror of the hot node fields
     const PrefixSum* prefixSum;         // Pointer to prefix sum engine
     int rootIndex;
     int nodeCount;
     int leafCount;
     int maxDepth;
     int minRegionSize;
+    double splitVariance;               // Adaptive tolerance, 0 = uniform subdivision
+    TreeLayout layout;
     
     // Build statistics
     double buildTimeMs;
     
+    // Subtree node counts, filled before a build: keyed by (height, width)
+    // for uniform subdivision, by corners down to the spawn depth for adaptive
+    std::map<std::pair<int, int>, int64_t> subtreeSizes;
+    std::map<std::tuple<int, int, int, int>, int64_t> adaptiveSizes;
+    
+    friend class SceneIndex;    // Attaches the node array and columns to a mapped index file
+    
+    /**
+     * @brief A subtree whose root slot is reserved but not yet filled
+     */
+    struct PendingSubtree {
+        Region region;
+        int depth;
+        int parentIdx;
+        int nodeIdx;
+    };
+    
+    /**
+     * @brief True if a region of this size is a leaf (base case)
+     */
+    bool isLeafSize(int regionHeight, int regionWidth) const {
+        return regionHeight <= minRegionSize || regionWidth <= minRegionSize;
+    }
+    
+    /**
+     * @brief True if a region is a leaf: too small, or uniform enough in adaptive mode
+     * @param variance The region's variance (prefix-sum query)
+     */
+    bool isLeafRegion(const Region& region, double variance) const;
+    
+    /**
+     * @brief Look up a precomputed subtree count (read-only, thread-safe)
+     */
+    int64_t subtreeSize(const Region& region) const;
+    
+    /**
+     * @brief Depth at which the depth-first build hands subtrees to workers (-1 = none)
+     */
+    static int spawnDepthFor(int threads);
+    
+    /**
+     * @brief Nodes an adaptive build creates below (and including) a region
+     */
+    int64_t countAdaptive(const Region& region) const;
+    
+    /**
+     * @brief Count an adaptive build, keeping subtree sizes down to memoDepth
+     * @return Total number of nodes
+     * 
+     * Regions at memoDepth are counted in parallel; their ancestors'
+     * sizes are then summed up into adaptiveSizes.
+     */
+    int64_t countAdaptiveSizes(const Region& fullImage, int memoDepth);
+    
+    /**
+     * @brief Pre-order list of the regions at memoDepth (leaves above it are skipped)
+     */
+    void collectFrontier(const Region& region, int depth, int memoDepth,
+                         std::vector<Region>& frontier) const;
+    
+    /**
+     * @brief Sum frontier counts up to the root, recording every size in adaptiveSizes
+     */
+    int64_t foldAdaptiveSizes(const Region& region, int depth, int memoDepth);
+    
     /**
-     * @brief Recursive divide-and-conquer tree construction
+     * @brief Recursive divide-and-conquer construction into pre-order slots
      * @param region Current region to process
      * @param depth Current depth in tree
      * @param parentIdx Parent node index (-1 for root)
-     * @return Index of the created node
+     * @param nodeIdx Slot reserved for this node; its subtree follows it
+     * @param spawnDepth Depth at which subtrees are deferred instead of built
+     * @param pending Receives deferred subtrees (nullptr = build everything)
+     * @return First slot after this node's subtree
      * 
-     * BASE CASE: Region size <= MIN_REGION_SIZE → create leaf
+     * BASE CASE: Region size <= MIN_REGION_SIZE (or uniform, adaptive) → create leaf
      * RECURSIVE CASE: Split into 4 quadrants → recurse on each
      */
-    int buildRecursive(const Region& region, int depth, int parentIdx);
+    int buildRecursive(const Region& region, int depth, int parentIdx, int nodeIdx,
+                       int spawnDepth, std::vector<PendingSubtree>* pending);
+    
+    /**
+     * @brief Pre-order build: top levels sequential, deeper subtrees in parallel
+     */
+    void buildDepthFirst(const Region& fullImage);
+    
+    /**
+     * @brief Level-order build: each level is filled in parallel
+     */
+    void buildBreadthFirst(const Region& fullImage);
+    
+    /**
+     * @brief Initialise a node slot (bounds, depth, parent, stats)
+     */
+    void initNode(int nodeIdx, const Region& region, int depth, int parentIdx);
+    
+    /**
+     * @brief Fill the SoA columns from the node array
+     */
+    void buildColumns();
     
     /**
      * @brief Split a region into 4 quadrants
@@ -131,26 +296,80 @@ public:
      * 
      * TIME COMPLEXITY: O(n²) - visits each pixel's worth of area O(1) times
      * SPACE COMPLEXITY: O(n²/B²) nodes where B = minRegionSize
+     * 
+     * @param layout Node ordering; both are deterministic regardless of
+     *               the number of threads in ThreadPool::shared()
+     * @param varianceTolerance Adaptive subdivision: regions up to
+     *               Config::ADAPTIVE_MAX_LEAF_SIZE with at most this variance
+     *               are not split further (0 = uniform subdivision)
+     * 
+     * The structure is fixed at build time: refreshRegion() updates node
+     * statistics but does not re-split, so rebuild an adaptive tree after
+     * large changes.
      */
-    void build(const PrefixSum* prefixSum, int minSize = Config::MIN_REGION_SIZE);
+    void build(const PrefixSum* prefixSum, int minSize = Config::MIN_REGION_SIZE,
+               TreeLayout layout = TreeLayout::DepthFirst, double varianceTolerance = 0);
     
     /**
-     * @brief Traverse tree with a visitor function
-     * @param visitor Function called for each node
-     * @param pruneFunc Optional function to prune subtrees
+     * @brief Exact number of nodes a uniform build over a height x width image creates
+     */
+    static int64_t countNodes(int height, int width, int minSize = Config::MIN_REGION_SIZE);
+    
+    /**
+     * @brief Breadth-first traversal
+     * @param visit Callable (const RegionTreeNode& node, bool& descend);
+     *              set descend = false to skip the node's children
+     * @param queue FIFO work list; cleared, only its capacity is kept
      * 
-     * The visitor is called with (node, shouldDescend) where
-     * shouldDescend can be set to false to skip children.
+     * TIME COMPLEXITY: O(number of nodes visited)
+     */
+    template <typename Visitor>
+    void traverse(Visitor&& visit, std::vector<int>& queue) const;
+    
+    /**
+     * @brief Breadth-first traversal with a local work list
+     */
+    template <typename Visitor>
+    void traverse(Visitor&& visit) const {
+        std::vector<int> queue;
+        traverse(std::forward<Visitor>(visit), queue);
+    }
+    
+    /**
+     * @brief Pre-order (NW, NE, SW, SE) traversal on a fixed-size stack
+     * @param visit Callable (const RegionTreeNode& node, bool& descend)
      * 
+     * Allocates nothing. In the depth-first layout nodes come in index order.
      * TIME COMPLEXITY: O(number of nodes visited)
      */
-    void traverse(std::function<void(const RegionTreeNode&, bool&)> visitor) const;
+    template <typename Visitor>
+    void traverseDepthFirst(Visitor&& visit) const;
+    
+    /**
+     * @brief Leaves of every subtree that is not pruned, in pre-order
+     * @param prune Callable (const RegionTreeNode&) -> bool; true skips the subtree
+     * @param visitLeaf Callable (const RegionTreeNode&) for each leaf reached
+     */
+    template <typename Prune, typename Visitor>
+    void traversePruned(Prune&& prune, Visitor&& visitLeaf) const {
+        traverseDepthFirst([&](const RegionTreeNode& node, bool& descend) {
+            if (prune(node)) {
+                descend = false;
+            } else if (node.isLeaf()) {
+                visitLeaf(node);
+            }
+        });
+    }
     
     /**
-     * @brief Traverse only leaf nodes
-     * @param visitor Function called for each leaf
+     * @brief Visit every leaf in index order
+     * @param visit Callable (const RegionTreeNode&)
+     * 
+     * Walks the set bits of the leaf bitmask, skipping internal nodes
+     * 64 at a time.
      */
-    void traverseLeaves(std::function<void(const RegionTreeNode&)> visitor) const;
+    template <typename Visitor>
+    void traverseLeaves(Visitor&& visit) const;
     
     /**
      * @brief Get all leaf nodes
@@ -159,7 +378,9 @@ public:
     std::vector<const RegionTreeNode*> getLeaves() const;
     
     /**
-     * @brief Get all nodes at a specific depth
+     * @brief Get all nodes at a specific depth, in pre-order
+     * 
+     * Stops descending at that depth, so only the levels above it are read.
      */
     std::vector<const RegionTreeNode*> getNodesAtDepth(int depth) const;
     
@@ -170,6 +391,51 @@ public:
      */
     std::vector<const RegionTreeNode*> queryRegion(const Region& queryRegion) const;
     
+    /**
+     * @brief queryRegion() into caller-owned buffers
+     * @param result Cleared, then filled with the same leaves in the same order
+     * @param queue Breadth-first work list; only its capacity is kept
+     * 
+     * Allocates nothing once both vectors have grown to the query's size.
+     */
+    void queryRegion(const Region& queryRegion, std::vector<const RegionTreeNode*>& result,
+                     std::vector<int>& queue) const;
+    
+    /**
+     * @brief Indices of all nodes (internal and leaf) intersecting a region
+     * @return Ascending node indices, so every parent precedes its children
+     * 
+     * The ancestors of an intersecting node intersect too, so this is the
+     * set of nodes whose statistics a change inside the region can affect.
+     * 
+     * TIME COMPLEXITY: O(result size)
+     */
+    std::vector<int> intersectingNodes(const Region& region) const;
+    
+    /**
+     * @brief Recompute the statistics of the nodes a patch can have changed
+     * @param patch Image rectangle whose pixels changed (prefix sums already updated)
+     * @return Number of nodes refreshed
+     * 
+     * Re-reads node.stats and the mean / variance columns from the prefix
+     * sums for intersectingNodes(patch) only; the rest of the tree is left
+     * as is. Scores are refreshed separately by AnomalyDetector::detectInRegion().
+     */
+    int refreshRegion(const Region& patch);
+    
+    /**
+     * @brief Re-read every node's statistics from other prefix sums of the same size
+     * @param prefix Tables to read from now on (e.g. the next scene pair)
+     * @return false (with a message) if the tree is empty or the sizes differ
+     * 
+     * The structure is kept as built, so node indices, the leaf mask and a
+     * LeafIndex over the tree stay valid. Nodes are refreshed in parallel.
+     * Scores are left as they are until the next AnomalyDetector::detectInTree().
+     * 
+     * TIME COMPLEXITY: O(nodes), one O(1) query each
+     */
+    bool refreshStats(const PrefixSum* prefix);
+    
     // ========================================================================
     // ACCESSORS
     // ========================================================================
@@ -181,10 +447,22 @@ public:
     int getNodeCount() const { return nodeCount; }
     int getLeafCount() const { return leafCount; }
     int getMaxDepth() const { return maxDepth; }
+    int getMinRegionSize() const { return minRegionSize; }
+    double getSplitVariance() const { return splitVariance; }
+    bool isAdaptive() const { return splitVariance > 0; }
+    TreeLayout getLayout() const { return layout; }
     double getBuildTimeMs() const { return buildTimeMs; }
     
-    const std::vector<RegionTreeNode>& getAllNodes() const { return nodes; }
-    std::vector<RegionTreeNode>& getAllNodesMutable() { return nodes; }
+    const FlatArray<RegionTreeNode>& getAllNodes() const { return nodes; }
+    FlatArray<RegionTreeNode>& getAllNodesMutable() { return nodes; }
+    
+    const RegionTreeColumns& getColumns() const { return columns; }
+    RegionTreeColumns& getColumnsMutable() { return columns; }
+    
+    /**
+     * @brief Bytes held by the node array and the hot columns
+     */
+    size_t getMemoryBytes() const;
     
     /**
      * @brief Print tree statistics
@@ -192,6 +470,61 @@ public:
     void printStats() const;
 };
 
+// ============================================================================
+// TRAVERSAL TEMPLATES
+// ============================================================================
+
+template <typename Visitor>
+void RegionTree::traverse(Visitor&& visit, std::vector<int>& queue) const {
+    queue.clear();
+    if (rootIndex < 0 || nodes.empty()) return;
+    
+    // FIFO over a flat vector: no per-node allocation
+    queue.push_back(rootIndex);
+    for (size_t head = 0; head < queue.size(); head++) {
+        const RegionTreeNode& node = nodes[queue[head]];
+        bool descend = true;
+        visit(node, descend);
+        if (descend && !node.isLeaf()) {
+            for (int i = 0; i < 4; i++) {
+                if (node.children[i] >= 0) queue.push_back(node.children[i]);
+            }
+        }
+    }
+}
+
+template <typename Visitor>
+void RegionTree::traverseDepthFirst(Visitor&& visit) const {
+    if (rootIndex < 0 || nodes.empty()) return;
+    
+    int stack[TRAVERSAL_STACK];
+    int top = 0;
+    stack[top++] = rootIndex;
+    while (top > 0) {
+        const RegionTreeNode& node = nodes[stack[--top]];
+        bool descend = true;
+        visit(node, descend);
+        if (descend && !node.isLeaf()) {
+            // Pushed in reverse so they pop NW, NE, SW, SE
+            for (int i = 3; i >= 0; i--) {
+                if (node.children[i] >= 0) stack[top++] = node.children[i];
+            }
+        }
+    }
+}
+
+template <typename Visitor>
+void RegionTree::traverseLeaves(Visitor&& visit) const {
+    const size_t words = columns.leafMask.size();
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = columns.leafMask[w];
+        while (bits) {
+            visit(nodes[w * 64 + __builtin_ctzll(bits)]);
+            bits &= bits - 1;
+        }
+    }
+}
+
 } // namespace SatelliteAnalytics
 
 #endif // REGION_TREE_H
@@ -0,0 +1,224 @@
+/**
+ * @file SceneIndex.h
+ * @brief Persistent on-disk index of a scene's prefix tables and region tree
+ *
+ * Building the prefix sums and the region tree is the expensive part of a
+ * run; every query after that only reads them. SceneIndex saves both to a
+ * versioned binary file whose sections are stored exactly as they sit in
+ * memory, so opening an index is a single mmap with no parsing:
+ *
+ *   FILE LAYOUT (version 4):
+ *     SceneIndexHeader           magic, version, ABI checks, scalar state,
+ *                                section table (offset, bytes, shape)
+ *     section 0 .. N-1           raw arrays, each starting on a 64-byte
+ *                                boundary (cache line, Buffer2D row alignment)
+ *
+ *   SECTIONS:
+ *     Prefix tables              Full: prefix / prefixSquares with row padding
+ *                                Compact: tile bases and offset tables
+ *                                Blocked: block grid, strips and local sums
+ *     Region tree                RegionTreeNode array and the SoA columns
+ *
+ * Opening validates the header (magic, version, byte order, struct sizes),
+ * that every section fits the file and has the size its shape implies, and
+ * that the tree's links, depths, bounds and leaf bits are consistent (one
+ * pass over the nodes), so traversals stay in bounds. The other arrays are
+ * not checksummed: reading them all would defeat the cheap open.
+ *
+ * The loaded PrefixSum and RegionTree are views into the mapping, so
+ * QueryEngine runs directly against it. The mapping is copy-on-write: a
+ * re-detection with a different threshold rewrites the score columns in
+ * private pages and the file is never modified.
+ */
+
+#ifndef SCENE_INDEX_H
+#define SCENE_INDEX_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "MappedFile.h"
+#include <string>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @enum IndexSectionId
+ * @brief Position of each array in the section table
+ */
+enum class IndexSectionId : uint32_t {
+    Prefix,
+    PrefixSquares,
+    TileBaseSum,
+    TileBaseSq,
+    SumOffset,
+    SqOffsetLow,
+    SqOffsetHigh,
+    RowStripSum,
+    RowStripSq,
+    ColStripSum,
+    ColStripSq,
+    LocalSum,
+    LocalSq,
+    Nodes,
+    ColumnBounds,
+    ColumnMean,
+    ColumnVariance,
+    ColumnAnomalyScore,
+    ColumnMaxLeafScore,
+    ColumnIsAnomaly,
+    ColumnLeafMask,
+    Count
+};
+
+/**
+ * @struct IndexSection
+ * @brief Location and shape of one array in the file
+ *
+ * rows == 0 marks a 1D array of cols elements; otherwise the section is a
+ * Buffer2D of rows x cols with its padded stride. Unused sections have
+ * bytes == 0.
+ */
+struct IndexSection {
+    uint64_t offset;
+    uint64_t bytes;
+    int32_t rows;
+    int32_t cols;
+};
+
+/**
+ * @struct SceneIndexHeader
+ * @brief Fixed-size header at offset 0 of an index file
+ */
+struct SceneIndexHeader {
+    char magic[8];              // "SKYIDX\0\0"
+    uint32_t version;
+    uint32_t byteOrder;         // BYTE_ORDER_MARK as written by the producer
+    uint32_t headerBytes;       // sizeof(SceneIndexHeader)
+    uint32_t nodeBytes;         // sizeof(RegionTreeNode)
+    uint32_t regionBytes;       // sizeof(Region)
+    uint32_t sectionCount;
+
+    // Prefix sum state
+    int32_t height;
+    int32_t width;
+    int32_t storage;            // PrefixStorage
+    int32_t tileShift;
+    int32_t tileCols;
+    int32_t reserved0;
+    int64_t totalSum;
+    int64_t totalPixels;
+    double globalMean;
+    double globalVariance;
+    double globalStdDev;
+
+    // Region tree state
+    int32_t rootIndex;
+    int32_t nodeCount;
+    int32_t leafCount;
+    int32_t maxDepth;
+    int32_t minRegionSize;
+    int32_t layout;             // TreeLayout
+    double splitVariance;       // Adaptive tolerance, 0 = uniform subdivision
+
+    // Anomaly scores stored in the tree (valid if scored != 0)
+    int32_t scored;
+    int32_t baseline;           // ScoreBaseline the scores were computed against
+    double threshold;
+    double contextScale;        // Ring and guard scales (Local baseline only)
+    double guardScale;
+
+    IndexSection sections[static_cast<uint32_t>(IndexSectionId::Count)];
+};
+
+/**
+ * @class SceneIndex
+ * @brief Writes index files and serves a PrefixSum / RegionTree from a mapped one
+ *
+ * A SceneIndex owns the mapping its PrefixSum and RegionTree point into, so
+ * it cannot be copied and must outlive every QueryEngine built on it.
+ */
+class SceneIndex {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 4;
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+private:
+    MappedFile file;
+    PrefixSum prefixSum;
+    RegionTree regionTree;
+    SceneIndexHeader header;
+    bool loaded;
+    double openTimeMs;
+
+    bool validateHeader(const std::string& filename) const;
+
+    /**
+     * @brief Point prefix and tree arrays into the mapping
+     * @return false if a section has the wrong size for its shape
+     */
+    bool attachSections();
+
+    /**
+     * @brief One O(n) pass over the attached nodes before they are trusted
+     * @return false if a child, parent, depth, bound or leaf bit is out of
+     *         range or disagrees with the rest of the tree
+     */
+    bool validateNodes() const;
+
+public:
+    SceneIndex();
+
+    SceneIndex(const SceneIndex&) = delete;
+    SceneIndex& operator=(const SceneIndex&) = delete;
+
+    /**
+     * @brief Write an index for a built prefix sum and region tree
+     * @param detector The detector the tree's anomaly scores were computed
+     *                 with, or nullptr if the tree is unscored
+     *
+     * The file is written under a temporary name and renamed into place,
+     * so readers never see a partial index.
+     */
+    static bool save(const std::string& filename, const PrefixSum& prefix,
+                     const RegionTree& tree, const AnomalyDetector* detector = nullptr);
+
+    /**
+     * @brief Map an index file and attach the prefix sum and tree to it
+     * @return false (with a message on stderr) if the file is not a valid index
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief True if the file starts with the index magic (nothing else is checked)
+     */
+    static bool isIndexFile(const std::string& filename);
+
+    void close();
+
+    bool isLoaded() const { return loaded; }
+    bool isMapped() const { return file.isMapped(); }
+    size_t getFileBytes() const { return file.size(); }
+    double getOpenTimeMs() const { return openTimeMs; }
+
+    /**
+     * @brief True if the stored anomaly scores are what this detector would compute
+     *
+     * The threshold and the baseline must match, and with the local baseline
+     * also its ring and guard scales.
+     */
+    bool isScoredAt(const AnomalyDetector& detector) const;
+    bool isScored() const { return loaded && header.scored != 0; }
+    double getStoredThreshold() const { return header.threshold; }
+    ScoreBaseline getStoredBaseline() const { return static_cast<ScoreBaseline>(header.baseline); }
+
+    const PrefixSum& getPrefixSum() const { return prefixSum; }
+    const RegionTree& getRegionTree() const { return regionTree; }
+    RegionTree& getRegionTreeMutable() { return regionTree; }
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // SCENE_INDEX_H
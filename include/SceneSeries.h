@@ -0,0 +1,199 @@
+/**
+ * @file SceneSeries.h
+ * @brief Change detection across a series of co-registered scenes
+ *
+ * ALGORITHM: Temporal Z-Scores on a Difference Integral Image
+ *
+ * For consecutive scenes A (before) and B (after) of the same area, with
+ * d = B - A per pixel:
+ *
+ *   D = PrefixSum::buildDifference(A, B)      one fused pass over A and B
+ *   changeScore(R) = |mean_d(R) - mean_d| / stddev_d
+ *
+ * mean_d and stddev_d are taken over the whole scene, so a uniform shift
+ * between the two acquisitions (sun angle, haze) cancels out and a region
+ * counts as changed when it moved much more than the scene as a whole. A
+ * region is flagged when changeScore > threshold, as in AnomalyDetector.
+ *
+ * SHARED STRUCTURES:
+ *   - Each scene's PrefixSum is built once and serves both pairs it belongs
+ *     to (first as "after", then as "before"). The two scene slots swap
+ *     roles, so images and tables keep their allocations.
+ *   - One RegionTree holds the change layout for the whole series. It is
+ *     built over the first difference; later pairs only re-read its node
+ *     statistics (RegionTree::refreshStats), so the node arrays, columns
+ *     and the engine's LeafIndex are reused.
+ *   - Scoring is AnomalyDetector::detectInTree() on the difference tables;
+ *     top-K and connected components are QueryEngine's, on the change tree.
+ *
+ * COMPLEXITY (per added scene of n² pixels, N tree nodes):
+ *   - Scene and difference tables: O(n²)
+ *   - Change tree statistics and scores: O(N)
+ *   - Before / after / change statistics of any region: O(1)
+ */
+
+#ifndef SCENE_SERIES_H
+#define SCENE_SERIES_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @struct SeriesConfig
+ * @brief Change detection parameters applied to every pair of a series
+ */
+struct SeriesConfig {
+    double threshold;
+    int topK;
+    int minRegionSize;
+    TreeLayout treeLayout;
+
+    SeriesConfig()
+        : threshold(Config::DEFAULT_ANOMALY_THRESHOLD), topK(Config::DEFAULT_TOP_K),
+          minRegionSize(Config::MIN_REGION_SIZE), treeLayout(TreeLayout::DepthFirst) {}
+};
+
+/**
+ * @struct RegionChange
+ * @brief Statistics of one region in both scenes of the current pair
+ */
+struct RegionChange {
+    RegionStats before;
+    RegionStats after;
+    RegionStats change;         // Of d = after - before
+    double score;               // Temporal z-score
+
+    RegionChange() : score(0) {}
+};
+
+/**
+ * @struct ChangeSummary
+ * @brief Results for one pair of consecutive scenes (one output row)
+ */
+struct ChangeSummary {
+    std::string before;
+    std::string after;
+    bool ok;
+    std::string error;
+
+    int height;
+    int width;
+    double meanBefore;
+    double meanAfter;
+    double meanChange;                  // Scene-wide mean of d
+    double changeStdDev;                // Scene-wide stddev of d
+    int leaves;
+    int changedLeaves;
+    int components;
+    int64_t largestComponentArea;
+    double maxScore;
+    std::vector<AnomalyRegion> topK;    // Most changed regions, score descending
+    bool treeReused;                    // Layout kept from the previous pair
+
+    double buildMs;                     // Scene + difference tables, tree, scores
+    double queryMs;
+
+    ChangeSummary()
+        : ok(false), height(0), width(0), meanBefore(0), meanAfter(0), meanChange(0),
+          changeStdDev(0), leaves(0), changedLeaves(0), components(0),
+          largestComponentArea(0), maxScore(0), treeReused(false), buildMs(0), queryMs(0) {}
+};
+
+/**
+ * @class SceneSeries
+ * @brief Consecutive scenes of one area with a shared change tree
+ *
+ * Scenes are added in acquisition order; every scene after the first is
+ * compared with the one before it. Not thread-safe: add scenes from one
+ * thread (the stages use ThreadPool::shared() internally).
+ */
+class SceneSeries {
+private:
+    struct Scene {
+        Matrix image;
+        PrefixSum prefix;
+        std::string label;
+    };
+
+    SeriesConfig config;
+    Scene slots[2];
+    int latest;                         // Slot of the most recent scene
+    int sceneCount;
+
+    PrefixSum difference;
+    RegionTree changeTree;
+    bool treeBuilt;
+    AnomalyDetector detector;
+    QueryEngine engine;
+    QueryResult top;
+    QueryScratch scratch;
+    std::vector<ConnectedComponent> components;
+    ChangeSummary lastChange;
+
+    const Scene& previousScene() const { return slots[1 - latest]; }
+
+public:
+    explicit SceneSeries(const SeriesConfig& cfg = SeriesConfig());
+
+    SceneSeries(const SceneSeries&) = delete;
+    SceneSeries& operator=(const SceneSeries&) = delete;
+
+    /**
+     * @brief Append the next scene and score its change against the previous one
+     * @param image The new scene (copied into the series)
+     * @param label Name used in getLastChange() (e.g. the file path)
+     * @return true if the scene was added; for every scene but the first,
+     *         getLastChange() then describes the new pair
+     *
+     * A scene of a different size than the previous one cannot be paired:
+     * the pair is recorded as an error and the series restarts from it.
+     */
+    bool addScene(const Matrix& image, const std::string& label = "");
+
+    /**
+     * @brief True once two scenes of the same size are loaded
+     */
+    bool hasPair() const { return lastChange.ok; }
+    int getSceneCount() const { return sceneCount; }
+
+    /**
+     * @brief Results of the most recent pair
+     */
+    const ChangeSummary& getLastChange() const { return lastChange; }
+
+    /**
+     * @brief How a region changed between the two scenes of the current pair
+     * TIME COMPLEXITY: O(1)
+     */
+    RegionChange queryChange(const Region& region) const;
+
+    /**
+     * @brief Change components of the current pair, largest first
+     */
+    const std::vector<ConnectedComponent>& getComponents() const { return components; }
+
+    const RegionTree& getChangeTree() const { return changeTree; }
+    const PrefixSum& getDifference() const { return difference; }
+    const QueryEngine& getEngine() const { return engine; }
+    const SeriesConfig& getConfig() const { return config; }
+
+    /**
+     * @brief Bytes held by both scene slots, the difference tables and the tree
+     */
+    size_t getMemoryBytes() const;
+
+    static void writeHeader(std::ostream& out);
+    static void writeRow(std::ostream& out, const ChangeSummary& change);
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // SCENE_SERIES_H
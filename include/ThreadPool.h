@@ -0,0 +1,119 @@
+/**
+ * @file ThreadPool.h
+ * @brief Fixed-size worker pool shared by the parallel engine stages
+ *
+ * Provides two primitives:
+ * - submit(): run a task asynchronously and get a std::future for its result
+ * - parallelFor(): split an index range into chunks and block until all are done
+ *
+ * parallelFor() called from inside a worker runs inline on that worker,
+ * so nested parallel sections can never deadlock the pool.
+ *
+ * A process-wide instance is available through ThreadPool::shared(), sized
+ * by setSharedThreadCount() (or std::thread::hardware_concurrency()).
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @class ThreadPool
+ * @brief Simple FIFO task queue served by a fixed set of worker threads
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping;
+
+    /**
+     * @brief Worker loop: pop and run tasks until the pool is destroyed
+     */
+    void workerLoop();
+
+    /**
+     * @brief Enqueue a type-erased task
+     */
+    void enqueue(std::function<void()> task);
+
+public:
+    /**
+     * @brief Create a pool
+     * @param numThreads Total threads taking part in parallelFor, including
+     *                   the calling thread (0 = hardware concurrency)
+     */
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Number of threads available to parallelFor (workers + caller)
+     */
+    int getThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    /**
+     * @brief Run a callable asynchronously on a worker
+     * @return Future holding the callable's result
+     */
+    template <typename F>
+    auto submit(F&& func) -> std::future<typename std::invoke_result<F>::type> {
+        using Result = typename std::invoke_result<F>::type;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+        std::future<Result> future = task->get_future();
+        if (workers.empty()) {
+            (*task)();
+        } else {
+            enqueue([task]() { (*task)(); });
+        }
+        return future;
+    }
+
+    /**
+     * @brief Execute body(chunkBegin, chunkEnd) over [begin, end) in parallel
+     * @param begin First index
+     * @param end One past the last index
+     * @param body Callable receiving a half-open chunk of the range
+     * @param minChunk Smallest chunk worth handing to another thread
+     *
+     * The calling thread processes one chunk itself and returns when every
+     * chunk has finished. Exceptions from chunks are rethrown to the caller.
+     */
+    void parallelFor(int begin, int end, const std::function<void(int, int)>& body,
+                     int minChunk = 1);
+
+    /**
+     * @brief True when the current thread is one of this process's pool workers
+     */
+    static bool inWorkerThread();
+
+    /**
+     * @brief Process-wide pool used by PrefixSum, RegionTree and friends
+     */
+    static ThreadPool& shared();
+
+    /**
+     * @brief Size the shared pool (call before the first use of shared())
+     * @param numThreads Thread count, 0 = hardware concurrency
+     */
+    static void setSharedThreadCount(int numThreads);
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // THREAD_POOL_H
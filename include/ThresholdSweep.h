@@ -0,0 +1,154 @@
+/**
+ * @file ThresholdSweep.h
+ * @brief Incremental re-thresholding of a scored region tree
+ *
+ * Anomaly scores do not depend on the threshold; only the isAnomaly flags
+ * do. After one AnomalyDetector::detectInTree() pass the sweep sorts the
+ * scores once, and every later threshold change touches only the nodes
+ * whose score lies between the old and the new threshold.
+ *
+ * SORTED SCORES:
+ *   byScore lists node indices by descending score. The anomalous nodes at
+ *   threshold t are the prefix of byScore with score > t, so moving from t
+ *   to t' flips exactly byScore[min(p, p') .. max(p, p')), where p and p'
+ *   are the prefix lengths (binary search). Leaves have their own sorted
+ *   list, whose prefix is the anomalous-leaf list.
+ *
+ * COMPONENTS (MERGE TREE):
+ *   Adding leaves in descending score order and uniting each with its
+ *   already-added neighbours replays every threshold at once. Each union is
+ *   recorded as a merge node whose level is the score of the leaf that
+ *   caused it (a Kruskal reconstruction tree). Levels never increase towards
+ *   the root, so at threshold t the connected components are exactly the
+ *   merge nodes with
+ *     level > t >= parent level        (roots: parent level = -inf)
+ *   A threshold change can only alter that test for merge nodes whose level
+ *   or parent level lies between the old and the new threshold: the leaves
+ *   that changed state and the unions they take part in.
+ *
+ * COMPLEXITY:
+ *   initialize():       O(n log n) for n tree nodes
+ *   trackComponents():  O(L log L + H + W) for L leaves
+ *   setThreshold():     O(log n + changed nodes)
+ *   getComponents():    O(A log A) for A anomalous leaves (materialization)
+ */
+
+#ifndef THRESHOLD_SWEEP_H
+#define THRESHOLD_SWEEP_H
+
+#include "Utils.h"
+#include "RegionTree.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @class ThresholdSweep
+ * @brief Keeps flags, counts and components of a scored tree in step with a moving threshold
+ *
+ * Both the tree and the detector are updated in place: after setThreshold()
+ * the tree's flags, the detector's threshold and its AnomalyStats counts
+ * match a fresh detectInTree() at the new threshold, so QueryEngine and the
+ * Visualizer need no changes. Call initialize() again if the tree is
+ * re-scored.
+ */
+class ThresholdSweep {
+private:
+    /**
+     * @brief Node of the leaf merge tree
+     *
+     * Nodes [0, L) are the leaves (by leaf position); later nodes are
+     * unions, created in order, so children always precede their parent.
+     */
+    struct MergeNode {
+        double level;           // Component exists for thresholds below this
+        int parent;             // -1 for roots
+        int children[2];        // -1 for leaves
+        int first;              // Members are memberLeaves[first, first + leafCount)
+        int leafCount;
+    };
+
+    RegionTree* tree;
+    AnomalyDetector* detector;
+    double threshold;
+
+    std::vector<int> byScore;           // All node indices, descending score
+    std::vector<int> leavesByScore;     // Leaf node indices, descending score
+    int anomalousNodes;                 // Length of the flagged prefix of byScore
+    int anomalousLeaves;                // Length of the flagged prefix of leavesByScore
+    double lastUpdateMs;
+
+    // Component tracking (empty until trackComponents())
+    bool tracking;
+    std::vector<MergeNode> merges;
+    std::vector<int> memberLeaves;      // Leaf node indices in merge-tree order
+    std::vector<int> byLevel;           // Merge nodes, descending level
+    std::vector<int> byParentLevel;     // Merge nodes, descending parent level
+    std::vector<int> tops;              // Merge nodes that are components at the threshold
+    std::vector<int> topSlot;           // Position of each merge node in tops, -1 if absent
+
+    double parentLevel(int m) const;
+
+    /**
+     * @brief Add or remove merge node m from tops for the current threshold
+     */
+    void updateTop(int m);
+
+public:
+    ThresholdSweep();
+
+    /**
+     * @brief Sort the scores of a tree already scored by detector
+     * @return false if the tree has not been scored
+     *
+     * The current threshold is the detector's.
+     */
+    bool initialize(RegionTree& tree, AnomalyDetector& detector);
+
+    /**
+     * @brief Build the leaf merge tree and keep components up to date from now on
+     * @param method Adjacency test used once to link neighbouring leaves
+     */
+    void trackComponents(AdjacencyMethod method = AdjacencyMethod::EdgeIndex);
+
+    /**
+     * @brief Move to a new threshold
+     * @return Number of tree nodes whose isAnomaly flag changed
+     *
+     * TIME COMPLEXITY: O(log n + changed nodes)
+     */
+    int setThreshold(double newThreshold);
+
+    double getThreshold() const { return threshold; }
+    double getLastUpdateMs() const { return lastUpdateMs; }
+    bool isTrackingComponents() const { return tracking; }
+
+    /**
+     * @brief Leaf node indices by descending score
+     *
+     * The first getAnomalousLeafCount() entries are the anomalous leaves.
+     */
+    const std::vector<int>& getLeavesByScore() const { return leavesByScore; }
+    int getAnomalousLeafCount() const { return anomalousLeaves; }
+    int getAnomalousNodeCount() const { return anomalousNodes; }
+
+    /**
+     * @brief Number of connected components at the threshold (O(1), needs tracking)
+     */
+    int getComponentCount() const { return static_cast<int>(tops.size()); }
+
+    /**
+     * @brief Components at the current threshold
+     *
+     * Same components, ids, order and statistics as
+     * QueryEngine::findConnectedComponents() on the updated tree.
+     * Requires trackComponents().
+     */
+    std::vector<ConnectedComponent> getComponents() const;
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // THRESHOLD_SWEEP_H
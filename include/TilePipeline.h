@@ -0,0 +1,110 @@
+/**
+ * @file TilePipeline.h
+ * @brief Streaming, tile-at-a-time analytics for scenes larger than RAM
+ *
+ * The regular pipeline keeps the whole image, both prefix tables and the
+ * full region tree in memory. TilePipeline instead works on a memory-mapped
+ * P5 file and only ever materializes one tile:
+ *
+ *   PASS 1 - GLOBAL STATISTICS:
+ *     Stream the scene in row bands and accumulate exact integer sums of
+ *     pixels and squared pixels (no rounding, so the result equals what
+ *     PrefixSum would compute for the whole image).
+ *
+ *   PASS 2 - PER-TILE ANALYTICS:
+ *     For each tile (row-major over the tile grid):
+ *       1. Decode the tile from the mapping into a reused buffer
+ *       2. Build a PrefixSum and RegionTree for the tile
+ *       3. Score the tree against the scene's global mean / stddev
+ *       4. Run pruned top-K and merge into a global size-K min-heap
+ *     Pages of finished tile rows are released back to the OS.
+ *
+ * Peak memory is bounded by the tile size (pixels + prefix tables + tree),
+ * independent of the scene size.
+ *
+ * Regions never cross tile boundaries: each tile has its own quadtree.
+ * Use a tile size that is a power-of-two multiple of the minimum region
+ * size so tile quadtrees align with the leaf grid.
+ */
+
+#ifndef TILE_PIPELINE_H
+#define TILE_PIPELINE_H
+
+#include "Utils.h"
+#include "PrefixSum.h"
+#include "RegionTree.h"
+#include <string>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+/**
+ * @struct StreamingConfig
+ * @brief Parameters of a streaming run
+ */
+struct StreamingConfig {
+    int tileSize;
+    int minRegionSize;
+    double threshold;
+    int topK;
+    PrefixStorage prefixStorage;
+    TreeLayout treeLayout;
+
+    StreamingConfig()
+        : tileSize(Config::STREAM_TILE_SIZE), minRegionSize(Config::MIN_REGION_SIZE),
+          threshold(Config::DEFAULT_ANOMALY_THRESHOLD), topK(Config::DEFAULT_TOP_K),
+          prefixStorage(PrefixStorage::Full), treeLayout(TreeLayout::DepthFirst) {}
+};
+
+/**
+ * @struct StreamingResult
+ * @brief Scene-level results merged over all tiles
+ */
+struct StreamingResult {
+    int width;
+    int height;
+    int tilesProcessed;
+    double globalMean;
+    double globalStdDev;
+
+    int64_t totalRegions;           // Tree nodes over all tiles
+    int64_t anomalousRegions;       // Anomalous leaves over all tiles
+    int64_t anomalousArea;          // Pixels in anomalous leaves
+    std::vector<AnomalyRegion> topK;    // Scene coordinates, score descending, ties by tile
+
+    size_t peakTileBytes;           // Largest tile working set (pixels + prefix + tree)
+    bool memoryMapped;
+    double statsPassMs;
+    double tilePassMs;
+
+    StreamingResult()
+        : width(0), height(0), tilesProcessed(0), globalMean(0), globalStdDev(0),
+          totalRegions(0), anomalousRegions(0), anomalousArea(0), peakTileBytes(0),
+          memoryMapped(false), statsPassMs(0), tilePassMs(0) {}
+};
+
+/**
+ * @class TilePipeline
+ * @brief Runs prefix sums, region trees, detection and top-K tile by tile
+ */
+class TilePipeline {
+private:
+    StreamingConfig config;
+    StreamingResult result;
+
+public:
+    explicit TilePipeline(const StreamingConfig& cfg = StreamingConfig());
+
+    /**
+     * @brief Analyse a binary (P5) PGM file
+     * @return false if the file cannot be opened or is not a valid P5 image
+     */
+    bool run(const std::string& filename);
+
+    const StreamingResult& getResult() const { return result; }
+    const StreamingConfig& getConfig() const { return config; }
+};
+
+} // namespace SatelliteAnalytics
+
+#endif // TILE_PIPELINE_H
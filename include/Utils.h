@@ -3,6 +3,8 @@
  * @brief Common utility functions, types, and constants for the Satellite Image Analytics Engine
  * 
  * This header provides foundational types and utilities used across all components:
+ * - Buffer2D, a contiguous aligned 2D buffer used for images and prefix tables
+ * - FlatArray, a 1D array that owns its elements or views mapped memory
  * - Region struct for defining rectangular image regions
  * - Timer class for performance measurement
  * - Configuration constants for tuning the algorithms
@@ -11,10 +13,15 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <array>
 #include <chrono>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+#include <utility>
 
 namespace SatelliteAnalytics {
 
@@ -22,9 +29,324 @@ namespace SatelliteAnalytics {
 // TYPE DEFINITIONS
 // ============================================================================
 
+/**
+ * @struct AlignedAllocator
+ * @brief Minimal std::allocator replacement returning over-aligned storage
+ * 
+ * Used by Buffer2D so every row starts on a cache-line boundary.
+ */
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+    
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+    
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+    
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+    
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+/**
+ * @class Buffer2D
+ * @brief Contiguous, row-major 2D buffer with cache-line aligned rows
+ * 
+ * All rows live in a single allocation. Each row is padded to a multiple
+ * of CACHE_LINE bytes, so stride() (in elements) can be larger than cols().
+ * 
+ * buffer[r] returns a pointer to row r, so buffer[r][c] indexing works
+ * exactly like the old vector-of-vectors layout, but costs one multiply-add
+ * instead of a dependent pointer load.
+ * 
+ * A buffer can also be a view over external memory with the same layout
+ * (see attach()), e.g. a table inside a memory-mapped index file.
+ */
+template <typename T>
+class Buffer2D {
+public:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+private:
+    std::vector<T, AlignedAllocator<T, CACHE_LINE>> storage;
+    T* base;                // storage.data(), or the viewed memory
+    int numRows;
+    int numCols;
+    std::size_t rowStride;  // Elements between the starts of consecutive rows
+    bool view;
+    
+    // Re-point base at our own storage after it moved (no-op for views)
+    void sync() { if (!view) base = storage.data(); }
+
+public:
+    static std::size_t paddedStride(int cols) {
+        constexpr std::size_t perLine = CACHE_LINE / sizeof(T) > 0 ? CACHE_LINE / sizeof(T) : 1;
+        std::size_t c = static_cast<std::size_t>(std::max(cols, 0));
+        return (c + perLine - 1) / perLine * perLine;
+    }
+    
+    Buffer2D() : base(nullptr), numRows(0), numCols(0), rowStride(0), view(false) {}
+    Buffer2D(int rows, int cols, T value = T())
+        : base(nullptr), numRows(0), numCols(0), rowStride(0), view(false) {
+        assign(rows, cols, value);
+    }
+    
+    Buffer2D(const Buffer2D& other)
+        : storage(other.storage), base(other.base), numRows(other.numRows),
+          numCols(other.numCols), rowStride(other.rowStride), view(other.view) {
+        sync();
+    }
+    
+    Buffer2D(Buffer2D&& other) noexcept
+        : storage(std::move(other.storage)), base(other.base), numRows(other.numRows),
+          numCols(other.numCols), rowStride(other.rowStride), view(other.view) {
+        sync();
+        other.clear();
+    }
+    
+    Buffer2D& operator=(const Buffer2D& other) {
+        if (this != &other) {
+            storage = other.storage;
+            base = other.base;
+            numRows = other.numRows;
+            numCols = other.numCols;
+            rowStride = other.rowStride;
+            view = other.view;
+            sync();
+        }
+        return *this;
+    }
+    
+    Buffer2D& operator=(Buffer2D&& other) noexcept {
+        if (this != &other) {
+            storage = std::move(other.storage);
+            base = other.base;
+            numRows = other.numRows;
+            numCols = other.numCols;
+            rowStride = other.rowStride;
+            view = other.view;
+            sync();
+            other.clear();
+        }
+        return *this;
+    }
+    
+    /**
+     * @brief Resize to rows x cols and fill every element (padding included) with value
+     * 
+     * Always leaves the buffer owning its storage (a view is detached).
+     */
+    void assign(int rows, int cols, T value = T()) {
+        numRows = std::max(rows, 0);
+        numCols = std::max(cols, 0);
+        rowStride = paddedStride(numCols);
+        view = false;
+        storage.assign(static_cast<std::size_t>(numRows) * rowStride, value);
+        sync();
+    }
+    
+    /**
+     * @brief View rows x cols elements laid out with paddedStride(cols)
+     * 
+     * Nothing is copied; memory must hold rows * paddedStride(cols) elements
+     * and outlive the view. Any owned storage is released.
+     */
+    void attach(T* memory, int rows, int cols) {
+        std::vector<T, AlignedAllocator<T, CACHE_LINE>>().swap(storage);
+        numRows = std::max(rows, 0);
+        numCols = std::max(cols, 0);
+        rowStride = paddedStride(numCols);
+        base = memory;
+        view = true;
+    }
+    
+    void fill(T value) { std::fill(base, base + elementCount(), value); }
+    
+    void clear() {
+        storage.clear();
+        storage.shrink_to_fit();
+        numRows = numCols = 0;
+        rowStride = 0;
+        view = false;
+        sync();
+    }
+    
+    T* operator[](int row) { return base + static_cast<std::size_t>(row) * rowStride; }
+    const T* operator[](int row) const { return base + static_cast<std::size_t>(row) * rowStride; }
+    
+    T* row(int r) { return (*this)[r]; }
+    const T* row(int r) const { return (*this)[r]; }
+    
+    T* data() { return base; }
+    const T* data() const { return base; }
+    
+    int rows() const { return numRows; }
+    int cols() const { return numCols; }
+    std::size_t stride() const { return rowStride; }
+    bool empty() const { return numRows == 0 || numCols == 0; }
+    bool isView() const { return view; }
+    
+    /**
+     * @brief Elements in the buffer, row padding included
+     */
+    std::size_t elementCount() const { return static_cast<std::size_t>(numRows) * rowStride; }
+    
+    /**
+     * @brief Bytes actually allocated (including row padding)
+     */
+    std::size_t sizeBytes() const { return elementCount() * sizeof(T); }
+};
+
+/**
+ * @class FlatArray
+ * @brief Contiguous 1D array that owns its elements or views external memory
+ * 
+ * Owning arrays behave like the subset of std::vector the tree code uses.
+ * attach() turns the array into a view over existing memory (for example
+ * a section of a memory-mapped index) without copying. resize(), assign()
+ * and clear() always detach first and work on owned storage, so a view
+ * never grows into memory it does not own.
+ */
+template <typename T>
+class FlatArray {
+private:
+    std::vector<T> storage;
+    T* base;
+    std::size_t count;
+    bool view;
+    
+    void sync() {
+        if (!view) {
+            base = storage.data();
+            count = storage.size();
+        }
+    }
+    
+    void detach() {
+        if (view) {
+            view = false;
+            sync();
+        }
+    }
+
+public:
+    FlatArray() : base(nullptr), count(0), view(false) {}
+    
+    FlatArray(const FlatArray& other)
+        : storage(other.storage), base(other.base), count(other.count), view(other.view) {
+        sync();
+    }
+    
+    FlatArray(FlatArray&& other) noexcept
+        : storage(std::move(other.storage)), base(other.base), count(other.count),
+          view(other.view) {
+        sync();
+        other.clear();
+    }
+    
+    FlatArray& operator=(const FlatArray& other) {
+        if (this != &other) {
+            storage = other.storage;
+            base = other.base;
+            count = other.count;
+            view = other.view;
+            sync();
+        }
+        return *this;
+    }
+    
+    FlatArray& operator=(FlatArray&& other) noexcept {
+        if (this != &other) {
+            storage = std::move(other.storage);
+            base = other.base;
+            count = other.count;
+            view = other.view;
+            sync();
+            other.clear();
+        }
+        return *this;
+    }
+    
+    void resize(std::size_t n) { detach(); storage.resize(n); sync(); }
+    void assign(std::size_t n, const T& value) { detach(); storage.assign(n, value); sync(); }
+    
+    void clear() {
+        view = false;
+        storage.clear();
+        sync();
+    }
+    
+    /**
+     * @brief View n elements at memory (nothing is copied; owned storage is released)
+     */
+    void attach(T* memory, std::size_t n) {
+        std::vector<T>().swap(storage);
+        base = memory;
+        count = n;
+        view = true;
+    }
+    
+    T& operator[](std::size_t i) { return base[i]; }
+    const T& operator[](std::size_t i) const { return base[i]; }
+    
+    T* data() { return base; }
+    const T* data() const { return base; }
+    T* begin() { return base; }
+    T* end() { return base + count; }
+    const T* begin() const { return base; }
+    const T* end() const { return base + count; }
+    
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isView() const { return view; }
+    
+    /**
+     * @brief Elements held without reallocating (size() for a view)
+     */
+    std::size_t capacity() const { return view ? count : storage.capacity(); }
+};
+
 using Pixel = uint8_t;                    // Grayscale pixel value [0-255]
-using Matrix = std::vector<std::vector<Pixel>>;
-using PrefixMatrix = std::vector<std::vector<int64_t>>;  // Larger type to prevent overflow
+using Matrix = Buffer2D<Pixel>;
+using PrefixMatrix = Buffer2D<int64_t>;   // Larger type to prevent overflow
+
+/**
+ * @struct MultiBandImage
+ * @brief N-band image with samples of up to 16 bits, bands interleaved
+ * 
+ * Sample b of pixel (r, c) is data[r][c * bands + b], so one pixel's bands
+ * are adjacent and a row is one contiguous run for all of them.
+ */
+struct MultiBandImage {
+    Buffer2D<uint16_t> data;
+    int bands = 0;
+    int maxVal = 0;                 // Largest valid sample (e.g. 4095, 65535)
+    
+    void assign(int rows, int cols, int numBands, int maxValue) {
+        bands = numBands;
+        maxVal = maxValue;
+        data.assign(rows, cols * numBands, 0);
+    }
+    
+    void clear() { data.clear(); bands = 0; maxVal = 0; }
+    
+    int rows() const { return data.rows(); }
+    int cols() const { return bands > 0 ? data.cols() / bands : 0; }
+    bool empty() const { return bands == 0 || data.empty(); }
+    
+    uint16_t* pixel(int r, int c) { return data[r] + static_cast<std::size_t>(c) * bands; }
+    const uint16_t* pixel(int r, int c) const { return data[r] + static_cast<std::size_t>(c) * bands; }
+};
 
 /**
  * @struct Region
@@ -113,6 +435,10 @@ namespace Config {
     // Smaller = more precise but more nodes, larger = fewer nodes but coarser
     constexpr int MIN_REGION_SIZE = 16;
     
+    // Adaptive subdivision: largest region allowed to stay a leaf because it
+    // is uniform, so small anomalies are never averaged over a huge block
+    constexpr int ADAPTIVE_MAX_LEAF_SIZE = 128;
+    
     // Default anomaly threshold (number of standard deviations from mean)
     constexpr double DEFAULT_ANOMALY_THRESHOLD = 2.0;
     
@@ -124,6 +450,31 @@ namespace Config {
     
     // Default test image size
     constexpr int DEFAULT_IMAGE_SIZE = 512;
+    
+    // Tile side for compact prefix tables (power of two, shrunk automatically
+    // on very large images so 32-bit sum offsets cannot overflow)
+    constexpr int PREFIX_TILE_SIZE = 64;
+    
+    // Tile side for the streaming pipeline (bounds its peak memory)
+    constexpr int STREAM_TILE_SIZE = 2048;
+    
+    // Batched region statistics: queries per parallel task, and the batch
+    // size from which queries are sorted by corner for table locality
+    constexpr int STATS_BATCH_BLOCK = 1024;
+    constexpr int STATS_BATCH_SORT_MIN = 4096;
+    
+    // Zone events kept per thread for a --profile-format chrome trace
+    constexpr int PROFILE_MAX_TRACE_EVENTS = 1 << 20;
+    
+    // Most bands in a multi-band image (per-region scoring uses fixed arrays)
+    constexpr int MAX_BANDS = 8;
+    
+    // Local-baseline scoring: guard band and context ring widths as multiples
+    // of the region's side, and the smallest ring stddev used, as a fraction
+    // of the global one
+    constexpr double LOCAL_GUARD_SCALE = 0.5;
+    constexpr double LOCAL_CONTEXT_SCALE = 1.0;
+    constexpr double LOCAL_MIN_STDDEV_FRACTION = 0.1;
 }
 
 // ============================================================================
@@ -132,7 +483,10 @@ namespace Config {
 
 /**
  * @class Timer
- * @brief High-resolution timer for measuring execution time
+ * @brief Monotonic timer for measuring execution time
+ * 
+ * Uses steady_clock: high_resolution_clock may be the wall clock, which
+ * can jump while a measurement is running.
  * 
  * Usage:
  *   Timer timer;
@@ -143,7 +497,7 @@ namespace Config {
  */
 class Timer {
 private:
-    using Clock = std::chrono::high_resolution_clock;
+    using Clock = std::chrono::steady_clock;
     using TimePoint = Clock::time_point;
     
     TimePoint startTime;
@@ -178,6 +532,54 @@ public:
     }
 };
 
+// ============================================================================
+// COUNTER-BASED RANDOM NUMBERS
+// ============================================================================
+
+/**
+ * @class Philox4x32
+ * @brief Philox4x32-10 counter-based generator (Salmon et al., SC'11)
+ * 
+ * A keyed bijection of a 128-bit counter: the i-th random block is
+ * generate({i, ...}, key) and needs no state from blocks before it. Any
+ * thread can therefore produce any part of a random stream, and the result
+ * depends only on the key (seed) and the counters, never on how work is
+ * split between threads.
+ */
+class Philox4x32 {
+public:
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+    
+    static Counter generate(Counter ctr, Key key) {
+        for (int round = 0; round < 10; round++) {
+            const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+            const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+            ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0)};
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+        return ctr;
+    }
+    
+    /**
+     * @brief Uniform double in (0, 1] from 53 bits of two words (never 0, safe for log)
+     */
+    static double toUnit(uint32_t high, uint32_t low) {
+        const uint64_t bits = (static_cast<uint64_t>(high) << 21) ^ low;
+        return (static_cast<double>(bits & ((1ull << 53) - 1)) + 1.0) * (1.0 / 9007199254740992.0);
+    }
+    
+    /**
+     * @brief Integer in [low, high] from one word (multiply-shift, bias < 2^-32 per value)
+     */
+    static int toRange(uint32_t word, int low, int high) {
+        const uint64_t span = static_cast<uint64_t>(static_cast<int64_t>(high) - low + 1);
+        return low + static_cast<int>((word * span) >> 32);
+    }
+};
+
 // ============================================================================
 // UTILITY FUNCTIONS
 // ============================================================================
@@ -192,6 +594,21 @@ std::string formatNumber(int64_t number);
  */
 std::string formatTime(double milliseconds);
 
+/**
+ * @brief Format a byte count in appropriate units (B, KB, MB, GB)
+ */
+std::string formatBytes(uint64_t bytes);
+
+/**
+ * @brief Quote a CSV field if it contains a separator, quote or newline
+ */
+std::string csvField(const std::string& value);
+
+/**
+ * @brief Regions as "r1 c1 r2 c2 score" entries separated by ';' (one CSV field)
+ */
+std::string formatRegionList(const std::vector<AnomalyRegion>& regions);
+
 /**
  * @brief Print a divider line for console output
  */
@@ -9,12 +9,23 @@
  * 
  * This keeps the focus on algorithms rather than complex graphics,
  * suitable for a Design and Analysis of Algorithms course.
+ * 
+ * RENDERING COST:
+ *   Nothing here scans the image inside a loop over regions or does
+ *   per-pixel work for a downscaled view:
+ *   - ASCII views and previews take block means from the prefix sums,
+ *     O(1) per output character / pixel
+ *   - Overlays read only the anomalous leaves (leaf bitmask plus the
+ *     isAnomaly column) and are drawn by row bands in parallel, straight
+ *     into the output buffer: O(output pixels + anomalous leaves)
+ *   - PGM payloads go out in multi-megabyte writes, not row by row
  */
 
 #ifndef VISUALIZER_H
 #define VISUALIZER_H
 
 #include "Utils.h"
+#include "PrefixSum.h"
 #include "RegionTree.h"
 #include "QueryEngine.h"
 #include <string>
@@ -50,20 +61,25 @@ public:
     
     /**
      * @brief Render image as ASCII art
-     * @param image The source image
+     * @param prefixSum Prefix sums of the source image
      * @param scale Downscale factor (1 = no scale, 2 = half size, etc.)
+     * 
+     * Each character is the mean of its scale x scale block: one O(1)
+     * region sum instead of scale² pixel reads.
      */
-    void renderASCII(const Matrix& image, int scale = 1) const;
+    void renderASCII(const PrefixSum& prefixSum, int scale = 1) const;
     
     /**
      * @brief Render anomaly map as ASCII
-     * @param image Original image
+     * @param prefixSum Prefix sums of the original image
      * @param tree Analyzed region tree
      * @param scale Downscale factor
      * 
-     * Highlights anomalous regions with special characters.
+     * Highlights anomalous regions with special characters. Anomalous
+     * leaves are marked straight onto the character grid, so no
+     * full-resolution mask is built.
      */
-    void renderAnomalyMap(const Matrix& image, const RegionTree& tree, 
+    void renderAnomalyMap(const PrefixSum& prefixSum, const RegionTree& tree,
                           int scale = 1) const;
     
     /**
@@ -89,11 +105,18 @@ public:
     
     /**
      * @brief Create image with highlighted anomalies
-     * @param source Original image
+     * @param source Original image, or a preview of it downscaled by factor
      * @param tree Analyzed region tree
+     * @param factor Downscale of source relative to the tree (1 = full size)
      * @return New image with anomalies highlighted
+     * 
+     * Anomalous leaves are brightened and outlined. At factor > 1 leaf
+     * bounds are divided by factor; leaves that land on the same preview
+     * pixels brighten them once.
+     * TIME COMPLEXITY: O(source pixels + anomalous leaves · threads)
      */
-    Matrix createAnomalyOverlay(const Matrix& source, const RegionTree& tree) const;
+    Matrix createAnomalyOverlay(const Matrix& source, const RegionTree& tree,
+                                int factor = 1) const;
     
     /**
      * @brief Create image with highlighted components
@@ -105,11 +128,35 @@ public:
                                   const ConnectedComponent& component,
                                   const RegionTree& tree) const;
     
+    /**
+     * @brief Downscaled copy of an image, box-filtered from its prefix sums
+     * @param prefixSum Prefix sums of the image
+     * @param factor Block side; the result is ceil(H / factor) x ceil(W / factor)
+     * 
+     * Each pixel is the rounded mean of its block (clipped at the image
+     * edge), one O(1) region sum per output pixel, rows in parallel.
+     */
+    Matrix createPreview(const PrefixSum& prefixSum, int factor) const;
+    
+    /**
+     * @brief Previews at factors 2, 4, 8, ... (level k is downscaled by 2^k)
+     * @param levels Number of levels wanted; stops early after the first
+     *               1 x 1 level
+     * @return levels[k - 1] = createPreview(prefixSum, 2^k)
+     * 
+     * Every level is filtered from the prefix sums, not from the level
+     * above, so rounding does not accumulate.
+     */
+    std::vector<Matrix> buildPreviewPyramid(const PrefixSum& prefixSum, int levels) const;
+    
     /**
      * @brief Save visualization to PGM file
      * @param image Image matrix to save
      * @param filename Output filename
      * @return true if successful
+     * 
+     * Row padding is dropped and the pixels go out in blocks of a few MB
+     * (one write for an unpadded image) rather than one write per row.
      */
     bool savePGM(const Matrix& image, const std::string& filename) const;
     
@@ -127,6 +174,13 @@ public:
      */
     void printComponentSummary(const std::vector<ConnectedComponent>& components) const;
     
+    /**
+     * @brief Print pixel-level components (area, bounding box, mean)
+     * @param maxRows Number of components to list (largest first)
+     */
+    void printPixelComponentSummary(const std::vector<ConnectedComponent>& components,
+                                    int maxRows = 10) const;
+    
     /**
      * @brief Print query result summary
      */
@@ -34,20 +34,31 @@
  */
 
 #include "AnomalyDetector.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace SatelliteAnalytics {
 
 AnomalyDetector::AnomalyDetector(double threshold)
     : prefixSum(nullptr), threshold(threshold),
-      globalMean(0), globalStdDev(0), detectionComplete(false) {
+      globalMean(0), globalStdDev(0), bandPrefix(nullptr), bandScoring(BandScoring::BandZ),
+      baseline(ScoreBaseline::Global), guardScale(Config::LOCAL_GUARD_SCALE),
+      contextScale(Config::LOCAL_CONTEXT_SCALE),
+      totalScore(0), detectionComplete(false) {
     stats = AnomalyStats();
 }
 
 void AnomalyDetector::initialize(const PrefixSum* prefix) {
     prefixSum = prefix;
+    bandPrefix = nullptr;
     
     if (prefixSum && prefixSum->isBuilt()) {
         globalMean = prefixSum->getGlobalMean();
@@ -57,6 +68,117 @@ void AnomalyDetector::initialize(const PrefixSum* prefix) {
     detectionComplete = false;
 }
 
+void AnomalyDetector::setReferenceStats(double mean, double stdDev) {
+    globalMean = mean;
+    globalStdDev = stdDev;
+    detectionComplete = false;
+}
+
+void AnomalyDetector::initializeBands(const MultiBandPrefixSum* bands, BandScoring mode) {
+    /**
+     * WHITENING MATRIX
+     * 
+     * BandZ: W = diag(1 / σ_b). Mahalanobis: Cholesky Σ = L Lᵀ, W = L⁻¹, so
+     * |W Δ|² = Δᵀ Σ⁻¹ Δ. A band whose remaining variance is below 1e-9 of
+     * the mean band variance (flat, or fully explained by the bands before
+     * it) contributes 0, like a flat image in the single-band score.
+     */
+    bandPrefix = nullptr;
+    if (!bands || !bands->isBuilt()) return;
+    
+    const int n = bands->getBands();
+    const std::vector<double>& cov = bands->getGlobalCovariance();
+    bandPrefix = bands;
+    bandScoring = (mode == BandScoring::Mahalanobis && bands->hasCrossProducts())
+                ? BandScoring::Mahalanobis : BandScoring::BandZ;
+    bandMean = bands->getGlobalMean();
+    whitening.assign(static_cast<size_t>(n) * n, 0.0);
+    
+    double trace = 0;
+    for (int b = 0; b < n; b++) trace += cov[b * n + b];
+    const double floor = std::max(1e-10, 1e-9 * trace / n);
+    
+    if (bandScoring == BandScoring::BandZ) {
+        for (int b = 0; b < n; b++) {
+            double sd = std::sqrt(cov[b * n + b]);
+            whitening[b * n + b] = sd < 1e-10 ? 0.0 : 1.0 / sd;
+        }
+    } else {
+        // Cholesky factor L (lower triangle), then W = L⁻¹ by forward substitution
+        std::vector<double> L(static_cast<size_t>(n) * n, 0.0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j <= i; j++) {
+                double sum = cov[i * n + j];
+                for (int k = 0; k < j; k++) sum -= L[i * n + k] * L[j * n + k];
+                if (i == j) {
+                    L[i * n + i] = sum > floor ? std::sqrt(sum) : 0.0;
+                } else {
+                    L[i * n + j] = L[j * n + j] > 0 ? sum / L[j * n + j] : 0.0;
+                }
+            }
+        }
+        for (int col = 0; col < n; col++) {
+            for (int i = col; i < n; i++) {
+                if (L[i * n + i] == 0.0) continue;      // Degenerate direction: row stays 0
+                double sum = i == col ? 1.0 : 0.0;
+                for (int k = col; k < i; k++) sum -= L[i * n + k] * whitening[k * n + col];
+                whitening[i * n + col] = sum / L[i * n + i];
+            }
+        }
+    }
+    
+    detectionComplete = false;
+}
+
+double AnomalyDetector::bandScore(const double* means) const {
+    const int n = bandPrefix->getBands();
+    double deviation[Config::MAX_BANDS];
+    for (int b = 0; b < n; b++) deviation[b] = means[b] - bandMean[b];
+    
+    // |W Δ|², W lower-triangular
+    double norm = 0;
+    for (int i = 0; i < n; i++) {
+        const double* row = &whitening[static_cast<size_t>(i) * n];
+        double y = 0;
+        for (int k = 0; k <= i; k++) y += row[k] * deviation[k];
+        norm += y * y;
+    }
+    return std::sqrt(norm / n);
+}
+
+void AnomalyDetector::setBaseline(ScoreBaseline mode, double scale, double guard) {
+    baseline = scale > 0 ? mode : ScoreBaseline::Global;
+    contextScale = scale;
+    guardScale = std::max(0.0, guard);
+    detectionComplete = false;
+}
+
+Region AnomalyDetector::grownWindow(const Region& region, double scale) const {
+    const int dr = static_cast<int>(std::ceil(scale * (region.row2 - region.row1 + 1)));
+    const int dc = static_cast<int>(std::ceil(scale * (region.col2 - region.col1 + 1)));
+    return Region(std::max(0, region.row1 - dr), std::max(0, region.col1 - dc),
+                  std::min(prefixSum->getHeight() - 1, region.row2 + dr),
+                  std::min(prefixSum->getWidth() - 1, region.col2 + dc));
+}
+
+double AnomalyDetector::localScore(const RegionStats& region, const RegionStats& outer,
+                                   const RegionStats& guard) const {
+    const int64_t ringArea = outer.area - guard.area;
+    if (ringArea <= 0) {
+        // The guard fills the window (e.g. the root): nothing local to compare with
+        return globalStdDev < 1e-10 ? 0.0 : std::abs(region.mean - globalMean) / globalStdDev;
+    }
+    
+    // Ring = outer minus guard; sums of squares recovered as (var + mean²) · area
+    auto sumSquares = [](const RegionStats& s) { return (s.variance + s.mean * s.mean) * s.area; };
+    const double ringMean = static_cast<double>(outer.sum - guard.sum) / ringArea;
+    const double ringVariance = std::max(0.0, (sumSquares(outer) - sumSquares(guard)) / ringArea
+                                              - ringMean * ringMean);
+    const double spread = std::max(std::sqrt(ringVariance),
+                                   Config::LOCAL_MIN_STDDEV_FRACTION * globalStdDev);
+    return spread < 1e-10 ? 0.0 : std::abs(region.mean - ringMean) / spread;
+}
+
 double AnomalyDetector::computeScore(const Region& region) const {
     /**
      * Z-SCORE COMPUTATION:
@@ -73,7 +195,18 @@ double AnomalyDetector::computeScore(const Region& region) const {
      * - global_mean and global_stddev are precomputed
      */
     
+    if (bandPrefix) {
+        double means[Config::MAX_BANDS];
+        bandPrefix->queryMeans(region, means);
+        return bandScore(means);
+    }
+    
     if (!prefixSum || !prefixSum->isBuilt()) return 0.0;
+    if (baseline == ScoreBaseline::Local) {
+        return localScore(prefixSum->queryStats(region),
+                          prefixSum->queryStats(grownWindow(region, guardScale + contextScale)),
+                          prefixSum->queryStats(grownWindow(region, guardScale)));
+    }
     if (globalStdDev < 1e-10) return 0.0;  // Avoid division by zero
     
     double regionMean = prefixSum->queryMean(region);
@@ -90,7 +223,129 @@ bool AnomalyDetector::isAnomalous(double score) const {
     return score > threshold;
 }
 
+BatchScoreSummary AnomalyDetector::scoreBatch(const double* means, size_t n, double* scores,
+                                              uint8_t* mask, const uint64_t* countMask) const {
+    return scoreAgainst(means, n, globalMean, globalStdDev, scores, mask, countMask);
+}
+
+BatchScoreSummary AnomalyDetector::scoreAgainst(const double* means, size_t n, double centre,
+                                                double spread, double* scores, uint8_t* mask,
+                                                const uint64_t* countMask) const {
+    /**
+     * BATCH Z-SCORES
+     * 
+     * score[i] = |mean[i] - centre| / spread   (global mean / stddev for scoreBatch)
+     * mask[i]  = score[i] > threshold
+     * 
+     * The aggregates use "selected" = bit i of countMask. Instead of
+     * branching on it, unselected lanes are blended with neutral values
+     * (+inf for min, -inf for max, 0 for sum).
+     */
+    BatchScoreSummary summary;
+    
+    const bool flat = spread < 1e-10;  // Avoid division by zero: all scores 0
+    const double inf = std::numeric_limits<double>::infinity();
+    double minScore = inf;
+    double maxScore = -inf;
+    double sumScore = 0;
+    int64_t count = 0;
+    int64_t anomalous = 0;
+    size_t i = 0;
+    
+#if defined(__AVX2__)
+    {
+        const __m256d vCentre = _mm256_set1_pd(centre);
+        const __m256d divisor = _mm256_set1_pd(flat ? 1.0 : spread);
+        const __m256d keep = flat ? _mm256_setzero_pd()
+                                  : _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+        const __m256d limit = _mm256_set1_pd(threshold);
+        const __m256i laneBits = _mm256_set_epi64x(8, 4, 2, 1);
+        __m256d vMin = _mm256_set1_pd(inf);
+        __m256d vMax = _mm256_set1_pd(-inf);
+        __m256d vSum = _mm256_setzero_pd();
+        
+        for (; i + 4 <= n; i += 4) {
+            __m256d deviation = _mm256_and_pd(_mm256_sub_pd(_mm256_loadu_pd(means + i), vCentre),
+                                              absMask);
+            __m256d score = _mm256_and_pd(_mm256_div_pd(deviation, divisor), keep);
+            _mm256_storeu_pd(scores + i, score);
+            
+            int above = _mm256_movemask_pd(_mm256_cmp_pd(score, limit, _CMP_GT_OQ));
+            mask[i] = above & 1;
+            mask[i + 1] = (above >> 1) & 1;
+            mask[i + 2] = (above >> 2) & 1;
+            mask[i + 3] = (above >> 3) & 1;
+            
+            int selectedBits = countMask ? static_cast<int>((countMask[i >> 6] >> (i & 63)) & 0xF)
+                                         : 0xF;
+            __m256d selected = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+                _mm256_and_si256(_mm256_set1_epi64x(selectedBits), laneBits), laneBits));
+            
+            vMin = _mm256_min_pd(vMin, _mm256_blendv_pd(_mm256_set1_pd(inf), score, selected));
+            vMax = _mm256_max_pd(vMax, _mm256_blendv_pd(_mm256_set1_pd(-inf), score, selected));
+            vSum = _mm256_add_pd(vSum, _mm256_and_pd(score, selected));
+            count += __builtin_popcount(selectedBits);
+            anomalous += __builtin_popcount(selectedBits & above);
+        }
+        
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, vMin);
+        minScore = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        _mm256_store_pd(lanes, vMax);
+        maxScore = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+        _mm256_store_pd(lanes, vSum);
+        sumScore = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+#endif
+    
+    for (; i < n; i++) {
+        double score = flat ? 0.0 : std::abs(means[i] - centre) / spread;
+        uint8_t above = score > threshold ? 1 : 0;
+        scores[i] = score;
+        mask[i] = above;
+        
+        uint64_t selected = countMask ? (countMask[i >> 6] >> (i & 63)) & 1 : 1;
+        minScore = std::min(minScore, selected ? score : inf);
+        maxScore = std::max(maxScore, selected ? score : -inf);
+        sumScore += selected ? score : 0.0;
+        count += static_cast<int64_t>(selected);
+        anomalous += static_cast<int64_t>(selected & above);
+    }
+    
+    summary.count = static_cast<int>(count);
+    summary.anomalous = static_cast<int>(anomalous);
+    summary.minScore = count > 0 ? minScore : 0;
+    summary.maxScore = count > 0 ? maxScore : 0;
+    summary.sumScore = sumScore;
+    return summary;
+}
+
+BatchScoreSummary AnomalyDetector::scoreRegions(const Region* regions, size_t n, double* scores,
+                                                uint8_t* mask) const {
+    if (bandPrefix || (baseline == ScoreBaseline::Local && prefixSum && prefixSum->isBuilt())) {
+        // Band / local scores are final already: score them against (0, 1)
+        for (size_t i = 0; i < n; i++) scores[i] = computeScore(regions[i]);
+        return scoreAgainst(scores, n, 0.0, 1.0, scores, mask, nullptr);
+    }
+    
+    if (!prefixSum || !prefixSum->isBuilt()) {
+        std::fill(scores, scores + n, 0.0);
+        std::fill(mask, mask + n, 0);
+        return BatchScoreSummary();
+    }
+    
+    // Gather the means into the output buffer, then score it in place
+    for (size_t i = 0; i < n; i++) {
+        int64_t area = regions[i].area();
+        scores[i] = area > 0 ? static_cast<double>(prefixSum->querySum(regions[i])) / area : 0;
+    }
+    
+    return scoreBatch(scores, n, scores, mask);
+}
+
 void AnomalyDetector::detectInTree(RegionTree& tree) {
+    ProfileScope profile(ProfileZone::Detection);
     Timer timer;
     timer.start();
     
@@ -104,28 +359,97 @@ void AnomalyDetector::detectInTree(RegionTree& tree) {
     stats.anomalousRegions = 0;
     stats.minScore = std::numeric_limits<double>::max();
     stats.maxScore = 0;
-    double totalScore = 0;
+    totalScore = 0;
     
-    // Process all nodes in the tree
-    auto& nodes = tree.getAllNodesMutable();
+    /**
+     * COLUMNAR SCORING PASS
+     * 
+     * Node means were cached in the SoA columns at tree build time, so the
+     * score pass streams one contiguous double array instead of ~100-byte
+     * nodes and never goes back through the prefix sums.
+     */
+    RegionTreeColumns& columns = tree.getColumnsMutable();
+    const int n = static_cast<int>(columns.size());
+    double* scores = columns.anomalyScore.data();
+    uint8_t* flags = columns.isAnomaly.data();
     
-    for (auto& node : nodes) {
-        // Compute anomaly score for this node
-        double score = computeScore(node.bounds);
-        node.anomalyScore = score;
-        node.isAnomaly = isAnomalous(score);
+    BatchScoreSummary summary;
+    if (bandPrefix) {
+        // One O(N²) band score per node, written in place and then scored against (0, 1)
+        const Region* regions = columns.bounds.data();
+        ThreadPool::shared().parallelFor(0, n, [&](int begin, int end) {
+            double means[Config::MAX_BANDS];
+            for (int i = begin; i < end; i++) {
+                bandPrefix->queryMeans(regions[i], means);
+                scores[i] = bandScore(means);
+            }
+        }, 4096);
+        summary = scoreAgainst(scores, n, 0.0, 1.0, scores, flags, columns.leafMask.data());
+    } else if (baseline == ScoreBaseline::Local) {
+        /**
+         * LOCAL BASELINE PASS
+         * 
+         * The outer and guard windows of all n nodes go through one
+         * batched, corner-sorted, parallel queryStatsBatch(); each ring then
+         * follows from its two windows and the node's own statistics
+         * cached at build time.
+         */
+        const Region* regions = columns.bounds.data();
+        contextWindows.resize(2 * static_cast<size_t>(n));
+        contextStats.resize(2 * static_cast<size_t>(n));
+        for (int i = 0; i < n; i++) {
+            contextWindows[2 * i] = grownWindow(regions[i], guardScale + contextScale);
+            contextWindows[2 * i + 1] = grownWindow(regions[i], guardScale);
+        }
+        prefixSum->queryStatsBatch(contextWindows.data(), contextWindows.size(), contextStats.data());
         
-        // Update statistics (count only leaf nodes)
-        if (node.isLeaf()) {
-            stats.totalRegions++;
-            totalScore += score;
-            stats.minScore = std::min(stats.minScore, score);
-            stats.maxScore = std::max(stats.maxScore, score);
-            
-            if (node.isAnomaly) {
-                stats.anomalousRegions++;
+        const auto& treeNodes = tree.getAllNodes();
+        ThreadPool::shared().parallelFor(0, n, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                scores[i] = localScore(treeNodes[i].stats, contextStats[2 * i], contextStats[2 * i + 1]);
+            }
+        }, 4096);
+        summary = scoreAgainst(scores, n, 0.0, 1.0, scores, flags, columns.leafMask.data());
+    } else {
+        summary = scoreBatch(columns.mean.data(), n, scores, flags, columns.leafMask.data());
+    }
+    
+    // Statistics cover leaf nodes only
+    stats.totalRegions = summary.count;
+    stats.anomalousRegions = summary.anomalous;
+    if (summary.count > 0) {
+        stats.minScore = summary.minScore;
+        stats.maxScore = summary.maxScore;
+    }
+    totalScore = summary.sumScore;
+    
+    /**
+     * SUBTREE BOUNDS (bottom-up)
+     * 
+     * maxLeafScore = the node's own score for a leaf, else the max over its
+     * children. An internal node's own score is NOT a bound: its mean
+     * averages its children, so a child can deviate more than the parent.
+     * Children always have larger indices than their parent (both layouts),
+     * so one reverse pass sees every child before its parent.
+     * 
+     * The same pass mirrors the results into the node array.
+     */
+    auto& nodes = tree.getAllNodesMutable();
+    double* bounds = columns.maxLeafScore.data();
+    for (int i = n - 1; i >= 0; i--) {
+        RegionTreeNode& node = nodes[i];
+        double bound = scores[i];
+        if (!columns.isLeaf(i)) {
+            bound = 0;
+            for (int c = 0; c < 4; c++) {
+                if (node.children[c] >= 0) bound = std::max(bound, bounds[node.children[c]]);
             }
         }
+        bounds[i] = bound;
+        
+        node.anomalyScore = scores[i];
+        node.maxLeafScore = bound;
+        node.isAnomaly = flags[i] != 0;
     }
     
     // Compute mean score
@@ -136,13 +460,106 @@ void AnomalyDetector::detectInTree(RegionTree& tree) {
     detectionComplete = true;
 }
 
+void AnomalyDetector::detectInRegion(RegionTree& tree, const Region& patch) {
+    ProfileScope profile(ProfileZone::Detection);
+    Timer timer;
+    timer.start();
+    
+    if (!detectionComplete) {
+        std::cerr << "Error: detectInRegion needs a tree scored by detectInTree()" << std::endl;
+        return;
+    }
+    if (bandPrefix) {
+        std::cerr << "Error: detectInRegion is not available with multi-band scoring" << std::endl;
+        return;
+    }
+    if (baseline == ScoreBaseline::Local) {
+        detectInTree(tree);     // Rings of nodes around the patch moved too
+        return;
+    }
+    
+    RegionTreeColumns& columns = tree.getColumnsMutable();
+    auto& nodes = tree.getAllNodesMutable();
+    double* scores = columns.anomalyScore.data();
+    uint8_t* flags = columns.isAnomaly.data();
+    double* bounds = columns.maxLeafScore.data();
+    const std::vector<int> touched = tree.intersectingNodes(patch);
+    
+    /**
+     * RESCORE
+     * 
+     * Same expression as scoreBatch(), so every score is bit-identical to
+     * a full pass. Leaf statistics are adjusted by the difference.
+     */
+    const bool flat = globalStdDev < 1e-10;
+    bool rescanExtremes = false;
+    for (int i : touched) {
+        double oldScore = scores[i];
+        double score = flat ? 0.0 : std::abs(columns.mean[i] - globalMean) / globalStdDev;
+        uint8_t above = score > threshold ? 1 : 0;
+        
+        if (columns.isLeaf(i)) {
+            stats.anomalousRegions += static_cast<int>(above) - static_cast<int>(flags[i]);
+            totalScore += score - oldScore;
+            if (score < stats.minScore) {
+                stats.minScore = score;
+            } else if (oldScore == stats.minScore && score > oldScore) {
+                rescanExtremes = true;
+            }
+            if (score > stats.maxScore) {
+                stats.maxScore = score;
+            } else if (oldScore == stats.maxScore && score < oldScore) {
+                rescanExtremes = true;
+            }
+        }
+        
+        scores[i] = score;
+        flags[i] = above;
+    }
+    
+    // Subtree bounds: touched is in ascending index order, children after
+    // parents, so the reverse walk sees every touched child first
+    for (auto it = touched.rbegin(); it != touched.rend(); ++it) {
+        const int i = *it;
+        RegionTreeNode& node = nodes[i];
+        double bound = scores[i];
+        if (!columns.isLeaf(i)) {
+            bound = 0;
+            for (int c = 0; c < 4; c++) {
+                if (node.children[c] >= 0) bound = std::max(bound, bounds[node.children[c]]);
+            }
+        }
+        bounds[i] = bound;
+        
+        node.anomalyScore = scores[i];
+        node.maxLeafScore = bound;
+        node.isAnomaly = flags[i] != 0;
+    }
+    
+    if (rescanExtremes) {
+        stats.minScore = std::numeric_limits<double>::max();
+        stats.maxScore = 0;
+        const int n = static_cast<int>(columns.size());
+        for (int i = 0; i < n; i++) {
+            if (!columns.isLeaf(i)) continue;
+            stats.minScore = std::min(stats.minScore, scores[i]);
+            stats.maxScore = std::max(stats.maxScore, scores[i]);
+        }
+    }
+    stats.meanScore = (stats.totalRegions > 0) ? totalScore / stats.totalRegions : 0;
+    
+    timer.stop();
+    stats.detectionTimeMs = timer.elapsedMs();
+}
+
 std::vector<AnomalyRegion> AnomalyDetector::getAnomalousRegions(const RegionTree& tree) const {
     std::vector<AnomalyRegion> result;
     
-    auto leaves = tree.getLeaves();
-    for (const auto* node : leaves) {
-        if (node->isAnomaly) {
-            result.emplace_back(node->bounds, node->anomalyScore, node->id);
+    const RegionTreeColumns& columns = tree.getColumns();
+    const int n = static_cast<int>(columns.size());
+    for (int i = 0; i < n; i++) {
+        if (columns.isAnomaly[i] && columns.isLeaf(i)) {
+            result.emplace_back(columns.bounds[i], columns.anomalyScore[i], i);
         }
     }
     
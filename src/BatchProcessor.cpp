@@ -0,0 +1,260 @@
+/**
+ * @file BatchProcessor.cpp
+ * @brief Implementation of multi-scene batch processing
+ */
+
+#include "BatchProcessor.h"
+#include "ImageLoader.h"
+#include "AnomalyDetector.h"
+#include "QueryEngine.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace SatelliteAnalytics {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool hasPgmExtension(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext == ".pgm";
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Everything one scene is built into; reused across scenes
+ */
+struct BatchProcessor::Workspace {
+    ImageLoader loader;
+    PrefixSum prefixSum;
+    RegionTree tree;
+    AnomalyDetector detector;
+    QueryEngine engine;
+    QueryResult top;
+    QueryScratch scratch;
+};
+
+BatchProcessor::BatchProcessor(const BatchConfig& cfg)
+    : config(cfg), workspacesCreated(0), workspaceReuses(0) {}
+
+BatchProcessor::~BatchProcessor() = default;
+
+// ============================================================================
+// INPUTS
+// ============================================================================
+
+bool BatchProcessor::collectInputs(const std::string& source, std::vector<std::string>& files) {
+    files.clear();
+    std::error_code ec;
+
+    if (fs::is_directory(source, ec)) {
+        for (const fs::directory_entry& entry : fs::directory_iterator(source, ec)) {
+            if (entry.is_regular_file(ec) && hasPgmExtension(entry.path())) {
+                files.push_back(entry.path().string());
+            }
+        }
+        if (ec) {
+            std::cerr << "Error: Cannot list directory " << source << ": " << ec.message()
+                      << std::endl;
+            return false;
+        }
+        std::sort(files.begin(), files.end());
+        return true;
+    }
+
+    std::ifstream manifest(source);
+    if (!manifest.is_open()) {
+        std::cerr << "Error: Cannot open batch source " << source << std::endl;
+        return false;
+    }
+
+    const fs::path baseDir = fs::path(source).parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        fs::path path(line.substr(first, last - first + 1));
+        files.push_back(path.is_absolute() ? path.string() : (baseDir / path).string());
+    }
+    return true;
+}
+
+// ============================================================================
+// WORKSPACE POOL
+// ============================================================================
+
+std::unique_ptr<BatchProcessor::Workspace> BatchProcessor::acquireWorkspace() {
+    std::lock_guard<std::mutex> lock(workspaceMutex);
+    if (freeWorkspaces.empty()) {
+        workspacesCreated++;
+        return std::unique_ptr<Workspace>(new Workspace());
+    }
+    std::unique_ptr<Workspace> workspace = std::move(freeWorkspaces.back());
+    freeWorkspaces.pop_back();
+    workspaceReuses++;
+    return workspace;
+}
+
+void BatchProcessor::releaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(workspaceMutex);
+    freeWorkspaces.push_back(std::move(workspace));
+}
+
+// ============================================================================
+// PER-SCENE PIPELINE
+// ============================================================================
+
+SceneSummary BatchProcessor::processScene(const std::string& path) {
+    SceneSummary summary;
+    summary.path = path;
+
+    std::unique_ptr<Workspace> ws = acquireWorkspace();
+    try {
+        Timer timer;
+        timer.start();
+        if (!ws->loader.loadFromPGM(path)) {
+            summary.error = "cannot load image";
+            releaseWorkspace(std::move(ws));
+            return summary;
+        }
+        timer.stop();
+        summary.loadMs = timer.elapsedMs();
+
+        // Rebuilt in place: the tables and node arrays keep their capacity
+        timer.start();
+        ws->prefixSum.build(ws->loader.getImage(), config.prefixStorage);
+        ws->tree.build(&ws->prefixSum, config.minRegionSize, config.treeLayout);
+        ws->detector.setThreshold(config.threshold);
+        ws->detector.initialize(&ws->prefixSum);
+        ws->detector.detectInTree(ws->tree);
+        timer.stop();
+        summary.buildMs = timer.elapsedMs();
+
+        timer.start();
+        ws->engine.initialize(&ws->tree, &ws->prefixSum, &ws->detector);
+        ws->engine.topKWithPruning(config.topK, ws->top, ws->scratch);
+        summary.topK = ws->top.regions;
+        std::vector<ConnectedComponent> components = ws->engine.findConnectedComponents();
+        timer.stop();
+        summary.queryMs = timer.elapsedMs();
+
+        const AnomalyStats& stats = ws->detector.getStats();
+        summary.height = ws->prefixSum.getHeight();
+        summary.width = ws->prefixSum.getWidth();
+        summary.globalMean = ws->prefixSum.getGlobalMean();
+        summary.globalStdDev = ws->prefixSum.getGlobalStdDev();
+        summary.leaves = stats.totalRegions;
+        summary.anomalousLeaves = stats.anomalousRegions;
+        summary.maxScore = stats.maxScore;
+        summary.components = static_cast<int>(components.size());
+        summary.largestComponentArea = components.empty() ? 0 : components[0].totalArea;
+        summary.ok = true;
+    } catch (const std::exception& e) {
+        // e.g. std::bad_alloc on an oversized scene: record it, keep the batch going
+        summary.error = e.what();
+    }
+
+    releaseWorkspace(std::move(ws));
+    return summary;
+}
+
+// ============================================================================
+// BATCH RUN
+// ============================================================================
+
+bool BatchProcessor::run(const std::vector<std::string>& files, std::ostream& out) {
+    result = BatchResult();
+    {
+        std::lock_guard<std::mutex> lock(workspaceMutex);
+        workspacesCreated = 0;
+        workspaceReuses = 0;
+    }
+
+    Timer wall;
+    wall.start();
+
+    ThreadPool& pool = ThreadPool::shared();
+    result.inFlight = config.maxInFlight > 0 ? config.maxInFlight : pool.getThreadCount() + 1;
+
+    /**
+     * ORDERED PIPELINING
+     *
+     * Scenes are submitted in input order and their futures queued. Rows
+     * are written from the front of the queue only, so the output order
+     * never depends on which worker finishes first. A full queue makes the
+     * submitting thread wait for the oldest scene, which bounds both the
+     * queue and the number of live workspaces.
+     */
+    std::deque<std::future<SceneSummary>> inFlight;
+    auto retire = [&]() {
+        SceneSummary scene = inFlight.front().get();
+        inFlight.pop_front();
+        writeRow(out, scene);
+
+        result.scenes++;
+        if (!scene.ok) result.failed++;
+        result.pixels += static_cast<int64_t>(scene.height) * scene.width;
+        result.loadMs += scene.loadMs;
+        result.buildMs += scene.buildMs;
+        result.queryMs += scene.queryMs;
+    };
+
+    writeHeader(out);
+    for (const std::string& file : files) {
+        inFlight.push_back(pool.submit([this, file]() { return processScene(file); }));
+        while (static_cast<int>(inFlight.size()) >= result.inFlight) retire();
+        while (!inFlight.empty() &&
+               inFlight.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            retire();
+        }
+    }
+    while (!inFlight.empty()) retire();
+    out.flush();
+
+    wall.stop();
+    result.wallMs = wall.elapsedMs();
+    {
+        std::lock_guard<std::mutex> lock(workspaceMutex);
+        result.workspacesCreated = workspacesCreated;
+        result.workspaceReuses = workspaceReuses;
+    }
+    return static_cast<bool>(out);
+}
+
+// ============================================================================
+// OUTPUT
+// ============================================================================
+
+void BatchProcessor::writeHeader(std::ostream& out) {
+    out << "scene,status,height,width,mean,stddev,leaves,anomalous,components,"
+        << "largest_component_area,max_score,load_ms,build_ms,query_ms,top_regions,error\n";
+}
+
+void BatchProcessor::writeRow(std::ostream& out, const SceneSummary& scene) {
+    std::ostringstream row;
+    row << csvField(scene.path) << ',' << (scene.ok ? "ok" : "error") << ','
+        << scene.height << ',' << scene.width << ','
+        << std::fixed << std::setprecision(4) << scene.globalMean << ',' << scene.globalStdDev << ','
+        << scene.leaves << ',' << scene.anomalousLeaves << ',' << scene.components << ','
+        << scene.largestComponentArea << ',' << scene.maxScore << ','
+        << std::setprecision(3) << scene.loadMs << ',' << scene.buildMs << ',' << scene.queryMs << ','
+        << formatRegionList(scene.topK) << ',' << csvField(scene.error) << '\n';
+    out << row.str();
+}
+
+} // namespace SatelliteAnalytics
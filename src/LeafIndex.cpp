@@ -0,0 +1,99 @@
+/**
+ * @file LeafIndex.cpp
+ * @brief Implementation of the implicit leaf cell grid
+ */
+
+#include "LeafIndex.h"
+#include "ThreadPool.h"
+
+namespace SatelliteAnalytics {
+
+LeafIndex::LeafIndex() : tree(nullptr), height(0), width(0) {}
+
+void LeafIndex::clear() {
+    tree = nullptr;
+    rowCuts.clear();
+    colCuts.clear();
+    cells.clear();
+    origins.clear();
+    height = width = 0;
+}
+
+void LeafIndex::build(const RegionTree& source) {
+    clear();
+    const RegionTreeColumns& columns = source.getColumns();
+    const int n = static_cast<int>(columns.size());
+    if (n == 0) return;
+
+    const Region& root = source.getRoot().bounds;
+    height = root.row2 + 1;
+    width = root.col2 + 1;
+
+    // Cut lines: every leaf's top row and left column
+    std::vector<int> leaves;
+    leaves.reserve(source.getLeafCount());
+    for (int i = 0; i < n; i++) {
+        if (!columns.isLeaf(i)) continue;
+        leaves.push_back(i);
+        rowCuts.push_back(columns.bounds[i].row1);
+        colCuts.push_back(columns.bounds[i].col1);
+    }
+    std::sort(rowCuts.begin(), rowCuts.end());
+    rowCuts.erase(std::unique(rowCuts.begin(), rowCuts.end()), rowCuts.end());
+    std::sort(colCuts.begin(), colCuts.end());
+    colCuts.erase(std::unique(colCuts.begin(), colCuts.end()), colCuts.end());
+
+    // Each leaf fills its own block of cells: disjoint writes, so in parallel
+    const size_t cols = colCuts.size();
+    cells.assign(rowCuts.size() * cols, -1);
+    origins.assign(rowCuts.size() * cols, 0);
+    ThreadPool::shared().parallelFor(0, static_cast<int>(leaves.size()), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const int leaf = leaves[k];
+            const Region& b = columns.bounds[leaf];
+            const int i0 = bandOf(rowCuts, b.row1);
+            const int i1 = bandOf(rowCuts, b.row2);
+            const int j0 = bandOf(colCuts, b.col1);
+            const int j1 = bandOf(colCuts, b.col2);
+            for (int i = i0; i <= i1; i++) {
+                const size_t row = i * cols;
+                std::fill(cells.begin() + row + j0, cells.begin() + row + j1 + 1, leaf);
+                for (int j = j0; j <= j1; j++) {
+                    origins[row + j] = (i == i0 ? ORIGIN_ROW : 0) | (j == j0 ? ORIGIN_COL : 0);
+                }
+            }
+        }
+    }, 256);
+
+    tree = &source;
+}
+
+size_t LeafIndex::getMemoryBytes() const {
+    return (rowCuts.capacity() + colCuts.capacity() + cells.capacity()) * sizeof(int)
+         + origins.capacity();
+}
+
+int LeafIndex::leafAt(int row, int col) const {
+    if (!tree || row < 0 || col < 0 || row >= height || col >= width) return -1;
+    return cells[static_cast<size_t>(bandOf(rowCuts, row)) * colCuts.size() + bandOf(colCuts, col)];
+}
+
+void LeafIndex::neighbors(int leaf, std::vector<int>& out) const {
+    out.clear();
+    if (!tree) return;
+
+    // A rectangle touching two strips would contain the leaf's own corner,
+    // so the strips never report the same neighbour twice
+    const Region& b = tree->getColumns().bounds[leaf];
+    const Region strips[4] = {
+        Region(b.row1 - 1, b.col1, b.row1 - 1, b.col2),     // Above
+        Region(b.row2 + 1, b.col1, b.row2 + 1, b.col2),     // Below
+        Region(b.row1, b.col1 - 1, b.row2, b.col1 - 1),     // Left
+        Region(b.row1, b.col2 + 1, b.row2, b.col2 + 1)      // Right
+    };
+    for (const Region& strip : strips) {
+        for (int node : leavesIn(strip)) out.push_back(node);
+    }
+}
+
+} // namespace SatelliteAnalytics
@@ -0,0 +1,122 @@
+/**
+ * @file MappedFile.cpp
+ * @brief Implementation of the file mapping
+ */
+
+#include "MappedFile.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SATELLITE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SatelliteAnalytics {
+
+MappedFile::MappedFile() : mappedData(nullptr), mappedSize(0), mapped(false), writable(false) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filename, bool copyOnWrite) {
+    close();
+
+#ifdef SATELLITE_HAVE_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        std::cerr << "Error: Cannot read file " << filename << std::endl;
+        return false;
+    }
+
+    int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* addr = mmap(nullptr, static_cast<size_t>(info.st_size), protection, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // The mapping stays valid after the descriptor is closed
+
+    if (addr != MAP_FAILED) {
+        // Images are decoded front to back; copy-on-write users (indexes)
+        // are read randomly, so leave them with the default readahead
+        if (!copyOnWrite) madvise(addr, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        mappedData = static_cast<const uint8_t*>(addr);
+        mappedSize = static_cast<size_t>(info.st_size);
+        mapped = true;
+        writable = copyOnWrite;
+        return true;
+    }
+    // Not mappable (e.g. a pipe): fall through to a plain read
+#endif
+
+    if (!readWholeFile(filename)) return false;
+    writable = copyOnWrite;  // The in-memory copy is private anyway
+    return true;
+}
+
+bool MappedFile::readWholeFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+
+    std::streamsize length = file.tellg();
+    if (length <= 0) {
+        std::cerr << "Error: Cannot read file " << filename << std::endl;
+        return false;
+    }
+
+    fallback.resize(static_cast<size_t>(length));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(fallback.data()), length)) {
+        std::cerr << "Error: Short read from " << filename << std::endl;
+        fallback.clear();
+        return false;
+    }
+
+    mappedData = fallback.data();
+    mappedSize = fallback.size();
+    mapped = false;
+    return true;
+}
+
+void MappedFile::release(size_t offset, size_t length) const {
+#ifdef SATELLITE_HAVE_MMAP
+    if (!mapped || offset >= mappedSize) return;
+
+    // madvise() needs a page-aligned start; dropping a few extra clean
+    // pages is harmless because they fault back in from the file
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page * page;
+    size_t end = std::min(mappedSize, offset + length);
+    madvise(const_cast<uint8_t*>(mappedData) + begin, end - begin, MADV_DONTNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef SATELLITE_HAVE_MMAP
+    if (mapped && mappedData) {
+        munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+    }
+#endif
+    std::vector<uint8_t>().swap(fallback);
+    mappedData = nullptr;
+    mappedSize = 0;
+    mapped = false;
+    writable = false;
+}
+
+} // namespace SatelliteAnalytics
@@ -0,0 +1,239 @@
+/**
+ * @file MultiBandPrefixSum.cpp
+ * @brief Implementation of interleaved multi-band summed-area tables
+ */
+
+#include "MultiBandPrefixSum.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+// Cells per task in the column pass (each cell is K int64 values)
+constexpr int COLUMN_BLOCK = 64;
+
+inline void addRowAbove(const int64_t* above, int64_t* cur, size_t begin, size_t end) {
+    for (size_t j = begin; j < end; j++) {
+        cur[j] += above[j];
+    }
+}
+
+} // anonymous namespace
+
+MultiBandPrefixSum::MultiBandPrefixSum()
+    : bands(0), channels(0), crossProducts(false), height(0), width(0), built(false),
+      totalPixels(0) {}
+
+// ============================================================================
+// CONSTRUCTION
+// ============================================================================
+
+bool MultiBandPrefixSum::build(const MultiBandImage& image, bool withCrossProducts) {
+    ProfileScope profile(ProfileZone::PrefixBuild);
+    built = false;
+
+    if (image.empty()) {
+        std::cerr << "Error: Cannot build band prefix sums from empty image" << std::endl;
+        return false;
+    }
+    if (image.bands > Config::MAX_BANDS) {
+        std::cerr << "Error: " << image.bands << " bands exceed the supported "
+                  << Config::MAX_BANDS << std::endl;
+        return false;
+    }
+
+    height = image.rows();
+    width = image.cols();
+    bands = image.bands;
+    crossProducts = withCrossProducts;
+    channels = bands + (crossProducts ? bands * (bands + 1) / 2 : bands);
+    totalPixels = static_cast<int64_t>(height) * width;
+
+    // Every channel of the bottom-right cell must fit: maxVal² per pixel
+    const int64_t maxSample = std::max(image.maxVal, 1);
+    if (totalPixels > std::numeric_limits<int64_t>::max() / (maxSample * maxSample)) {
+        std::cerr << "Error: Image too large for 64-bit band product sums" << std::endl;
+        return false;
+    }
+
+    // Channel c of a pixel is samples[first[c]] * samples[second[c]];
+    // sums use a second factor of 1 (slot `bands`)
+    int first[Config::MAX_BANDS * (Config::MAX_BANDS + 3) / 2];
+    int second[Config::MAX_BANDS * (Config::MAX_BANDS + 3) / 2];
+    for (int b = 0; b < bands; b++) {
+        first[b] = b;
+        second[b] = bands;
+    }
+    for (int b = 0; b < bands; b++) {
+        for (int c = b; c < bands; c++) {
+            if (!crossProducts && c != b) continue;
+            first[productChannel(b, c)] = b;
+            second[productChannel(b, c)] = c;
+        }
+    }
+
+    table.assign(height + 1, (width + 1) * channels, 0);
+
+    /**
+     * Same separable recurrence as PrefixSum::build(), on K channels:
+     *
+     *   1. ROW PASS:    running sums of every channel along each row,
+     *                   one read of the pixel's bands per cell
+     *   2. COLUMN PASS: add the row above, over contiguous runs of cells
+     */
+    ThreadPool& pool = ThreadPool::shared();
+    const int K = channels;
+    const int N = bands;
+
+    pool.parallelFor(1, height + 1, [&](int rowBegin, int rowEnd) {
+        int64_t running[Config::MAX_BANDS * (Config::MAX_BANDS + 3) / 2];
+        int64_t factors[Config::MAX_BANDS + 1];
+        factors[N] = 1;
+        for (int i = rowBegin; i < rowEnd; i++) {
+            std::fill(running, running + K, 0);
+            const uint16_t* src = image.data[i - 1];
+            int64_t* out = table[i] + K;        // Cell j = 1
+            for (int j = 0; j < width; j++) {
+                for (int b = 0; b < N; b++) factors[b] = src[b];
+                for (int k = 0; k < K; k++) {
+                    running[k] += factors[first[k]] * factors[second[k]];
+                    out[k] = running[k];
+                }
+                src += N;
+                out += K;
+            }
+        }
+    }, 16);
+
+    const int numBlocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+    pool.parallelFor(0, numBlocks, [&](int blockBegin, int blockEnd) {
+        size_t begin = static_cast<size_t>(1 + blockBegin * COLUMN_BLOCK) * K;
+        size_t end = static_cast<size_t>(std::min(width + 1, 1 + blockEnd * COLUMN_BLOCK)) * K;
+        for (int i = 2; i <= height; i++) {
+            addRowAbove(table[i - 1], table[i], begin, end);
+        }
+    });
+
+    computeGlobalStats();
+    return true;
+}
+
+void MultiBandPrefixSum::computeGlobalStats() {
+    built = true;
+    globalMean.assign(bands, 0.0);
+    globalCovariance.assign(static_cast<size_t>(bands) * bands, 0.0);
+    queryCovariance(Region(0, 0, height - 1, width - 1), globalMean.data(),
+                    globalCovariance.data());
+}
+
+// ============================================================================
+// REGION QUERIES
+// ============================================================================
+
+void MultiBandPrefixSum::queryMoments(const Region& region, int64_t* out) const {
+    std::fill(out, out + channels, 0);
+    if (!built) return;
+
+    const int r1 = std::max(0, region.row1);
+    const int c1 = std::max(0, region.col1);
+    const int r2 = std::min(height - 1, region.row2);
+    const int c2 = std::min(width - 1, region.col2);
+    if (r1 > r2 || c1 > c2) return;
+
+    // Inclusion-exclusion on each channel of the four corner cells
+    Profiler::count(ProfileCounter::PrefixReads, 4 * channels);
+    const int64_t* a = cell(r2 + 1, c2 + 1);
+    const int64_t* b = cell(r1, c2 + 1);
+    const int64_t* c = cell(r2 + 1, c1);
+    const int64_t* d = cell(r1, c1);
+    for (int k = 0; k < channels; k++) {
+        out[k] = a[k] - b[k] - c[k] + d[k];
+    }
+}
+
+void MultiBandPrefixSum::queryMeans(const Region& region, double* means) const {
+    std::fill(means, means + bands, 0.0);
+    if (!built) return;
+
+    const int r1 = std::max(0, region.row1);
+    const int c1 = std::max(0, region.col1);
+    const int r2 = std::min(height - 1, region.row2);
+    const int c2 = std::min(width - 1, region.col2);
+    if (r1 > r2 || c1 > c2) return;
+
+    // Only the N sum channels are read
+    Profiler::count(ProfileCounter::PrefixReads, 4 * bands);
+    const double area = static_cast<double>(r2 - r1 + 1) * (c2 - c1 + 1);
+    const int64_t* a = cell(r2 + 1, c2 + 1);
+    const int64_t* b = cell(r1, c2 + 1);
+    const int64_t* c = cell(r2 + 1, c1);
+    const int64_t* d = cell(r1, c1);
+    for (int k = 0; k < bands; k++) {
+        means[k] = static_cast<double>(a[k] - b[k] - c[k] + d[k]) / area;
+    }
+}
+
+void MultiBandPrefixSum::queryCovariance(const Region& region, double* means,
+                                         double* covariance) const {
+    std::fill(means, means + bands, 0.0);
+    std::fill(covariance, covariance + static_cast<size_t>(bands) * bands, 0.0);
+
+    int64_t moments[Config::MAX_BANDS * (Config::MAX_BANDS + 3) / 2];
+    queryMoments(region, moments);
+    const Region clipped(std::max(0, region.row1), std::max(0, region.col1),
+                         std::min(height - 1, region.row2), std::min(width - 1, region.col2));
+    if (!built || clipped.row1 > clipped.row2 || clipped.col1 > clipped.col2) return;
+    const int64_t area = clipped.area();
+
+    for (int b = 0; b < bands; b++) {
+        means[b] = static_cast<double>(moments[b]) / area;
+    }
+
+    // cov_bc = E[x_b x_c] - mean_b mean_c
+    for (int b = 0; b < bands; b++) {
+        for (int c = b; c < bands; c++) {
+            if (!crossProducts && c != b) continue;
+            double value = static_cast<double>(moments[productChannel(b, c)]) / area
+                         - means[b] * means[c];
+            if (b == c) value = std::max(0.0, value);
+            covariance[b * bands + c] = value;
+            covariance[c * bands + b] = value;
+        }
+    }
+}
+
+// ============================================================================
+// UTILITY
+// ============================================================================
+
+size_t MultiBandPrefixSum::getMemoryBytes() const {
+    return table.sizeBytes();
+}
+
+bool MultiBandPrefixSum::verify(const MultiBandImage& image, const Region& region) const {
+    std::vector<int64_t> brute(channels, 0);
+    for (int r = std::max(0, region.row1); r <= std::min(image.rows() - 1, region.row2); r++) {
+        for (int c = std::max(0, region.col1); c <= std::min(image.cols() - 1, region.col2); c++) {
+            const uint16_t* px = image.pixel(r, c);
+            for (int b = 0; b < bands; b++) {
+                brute[b] += px[b];
+                for (int d = b; d < bands; d++) {
+                    if (!crossProducts && d != b) continue;
+                    brute[productChannel(b, d)] += static_cast<int64_t>(px[b]) * px[d];
+                }
+            }
+        }
+    }
+
+    std::vector<int64_t> moments(channels);
+    queryMoments(region, moments.data());
+    return moments == brute;
+}
+
+} // namespace SatelliteAnalytics
@@ -0,0 +1,339 @@
+/**
+ * @file PixelLabeler.cpp
+ * @brief Implementation of pixel-level connected-component labeling
+ *
+ * LABEL EQUIVALENCE WITH MIN-ROOTED SETS
+ * ======================================
+ *
+ * Provisional labels are the 1-based linear index of the pixel that opened
+ * them. unite() always hangs the larger root under the smaller one and
+ * find() uses path halving, so every parent link points to a smaller label:
+ *
+ *   parent[l] <= l   for every used label l
+ *
+ * This gives three properties for free:
+ *   1. Bands own disjoint label ranges [rowBegin*W + 1, rowEnd*W], so
+ *      pass 1 runs on all bands at once without synchronization.
+ *   2. Flattening is one ascending sweep: by the time label l is visited,
+ *      parent[l] has already been replaced by its final label.
+ *   3. A component's root is its first pixel in raster order, so band b
+ *      owns the contiguous final labels [bandFirst[b], bandFirst[b+1]).
+ *      Any other label in band b belongs to a component that started
+ *      higher up, and with 4-connectivity it must cross the band's top row.
+ *
+ * Pass 2 therefore writes owned labels straight into one array of K
+ * accumulators (the ranges are disjoint, so bands run in parallel) and
+ * keeps private accumulators only for the labels on its top row. Memory is
+ * O(K + bands × W) instead of O(bands × K).
+ */
+
+#include "PixelLabeler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <cmath>
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+constexpr int MIN_BAND_ROWS = 32;
+
+// Pixel classes; only pixels of the same class connect
+constexpr uint8_t BACKGROUND = 0;
+constexpr uint8_t BRIGHT = 1;
+constexpr uint8_t DARK = 2;
+
+/**
+ * @brief Find the root of a provisional label with path halving
+ */
+inline int32_t findRoot(int32_t* parent, int32_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+/**
+ * @brief Merge two label sets, keeping the smaller label as root
+ */
+inline void uniteLabels(int32_t* parent, int32_t a, int32_t b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) parent[b] = a;
+    else if (b < a) parent[a] = b;
+}
+
+/**
+ * @brief Running statistics of one component, or of its pixels in one band
+ */
+struct ComponentAccumulator {
+    int64_t area = 0;
+    int64_t intensitySum = 0;
+    double scoreSum = 0;
+    double maxScore = 0;
+    int row1 = std::numeric_limits<int>::max();
+    int col1 = std::numeric_limits<int>::max();
+    int row2 = -1;
+    int col2 = -1;
+
+    void add(int r, int c, Pixel value, double score) {
+        area++;
+        intensitySum += value;
+        scoreSum += score;
+        maxScore = std::max(maxScore, score);
+        row1 = std::min(row1, r);
+        col1 = std::min(col1, c);
+        row2 = std::max(row2, r);
+        col2 = std::max(col2, c);
+    }
+
+    void merge(const ComponentAccumulator& other) {
+        area += other.area;
+        intensitySum += other.intensitySum;
+        scoreSum += other.scoreSum;
+        maxScore = std::max(maxScore, other.maxScore);
+        row1 = std::min(row1, other.row1);
+        col1 = std::min(col1, other.col1);
+        row2 = std::max(row2, other.row2);
+        col2 = std::max(col2, other.col2);
+    }
+};
+
+} // anonymous namespace
+
+PixelLabeler::PixelLabeler(double threshold)
+    : image(nullptr), prefixSum(nullptr), threshold(threshold) {}
+
+void PixelLabeler::initialize(const Matrix* img, const PrefixSum* prefix) {
+    image = img;
+    prefixSum = prefix;
+    labels.clear();
+    parent.clear();
+    stats = PixelLabelStats();
+}
+
+void PixelLabeler::scanBand(int rowBegin, int rowEnd, const uint8_t* pixelClass) {
+    const int width = image->cols();
+    int32_t* par = parent.data();
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const Pixel* row = (*image)[r];
+        const Pixel* rowUp = r > rowBegin ? (*image)[r - 1] : nullptr;
+        int32_t* lab = labels[r];
+        const int32_t* labUp = r > rowBegin ? labels[r - 1] : nullptr;
+
+        uint8_t leftClass = BACKGROUND;
+        uint8_t upLeftClass = BACKGROUND;
+
+        for (int c = 0; c < width; c++) {
+            uint8_t cls = pixelClass[row[c]];
+            uint8_t upClass = rowUp ? pixelClass[rowUp[c]] : BACKGROUND;
+
+            if (cls == BACKGROUND) {
+                lab[c] = 0;
+            } else if (upClass == cls) {
+                lab[c] = labUp[c];
+                // Left and up are already joined through up-left when it matches too
+                if (leftClass == cls && upLeftClass != cls && lab[c - 1] != labUp[c]) {
+                    uniteLabels(par, lab[c - 1], labUp[c]);
+                }
+            } else if (leftClass == cls) {
+                lab[c] = lab[c - 1];
+            } else {
+                int32_t fresh = static_cast<int32_t>(static_cast<int64_t>(r) * width + c + 1);
+                par[fresh] = fresh;
+                lab[c] = fresh;
+            }
+
+            leftClass = cls;
+            upLeftClass = upClass;
+        }
+    }
+}
+
+void PixelLabeler::mergeBandBorder(int row, const uint8_t* pixelClass) {
+    const int width = image->cols();
+    const Pixel* rowPix = (*image)[row];
+    const Pixel* rowUp = (*image)[row - 1];
+    const int32_t* lab = labels[row];
+    const int32_t* labUp = labels[row - 1];
+
+    for (int c = 0; c < width; c++) {
+        uint8_t cls = pixelClass[rowPix[c]];
+        if (cls != BACKGROUND && pixelClass[rowUp[c]] == cls) {
+            uniteLabels(parent.data(), lab[c], labUp[c]);
+        }
+    }
+}
+
+int PixelLabeler::flattenLabels(int64_t bandPixels, std::vector<int32_t>& bandFirst) {
+    int32_t next = 0;
+    const size_t n = parent.size();
+    bandFirst.clear();
+    size_t bandStart = 1;
+
+    for (size_t l = 1; l < n; l++) {
+        if (l == bandStart) {
+            bandFirst.push_back(next + 1);
+            bandStart += static_cast<size_t>(bandPixels);
+        }
+
+        int32_t p = parent[l];
+        if (p == 0) continue;                       // Label never used
+        if (p == static_cast<int32_t>(l)) {
+            parent[l] = ++next;                     // Root: next final label
+        } else {
+            parent[l] = parent[p];                  // p < l is already final
+        }
+    }
+    bandFirst.push_back(next + 1);
+    return next;
+}
+
+std::vector<ConnectedComponent> PixelLabeler::label() {
+    std::vector<ConnectedComponent> components;
+    stats = PixelLabelStats();
+
+    if (!image || image->empty() || !prefixSum || !prefixSum->isBuilt()) {
+        std::cerr << "Error: PixelLabeler not initialized" << std::endl;
+        return components;
+    }
+
+    const int height = image->rows();
+    const int width = image->cols();
+    const int64_t pixelCount = static_cast<int64_t>(height) * width;
+    if (pixelCount >= std::numeric_limits<int32_t>::max()) {
+        std::cerr << "Error: image too large for 32-bit pixel labels" << std::endl;
+        return components;
+    }
+
+    Timer timer;
+    timer.start();
+
+    // Classify every possible pixel value once
+    const double mean = prefixSum->getGlobalMean();
+    const double stdDev = prefixSum->getGlobalStdDev();
+    uint8_t pixelClass[256];
+    double pixelScore[256];
+    for (int v = 0; v < 256; v++) {
+        double score = stdDev < 1e-10 ? 0.0 : std::abs(v - mean) / stdDev;
+        pixelScore[v] = score;
+        pixelClass[v] = score > threshold ? (v > mean ? BRIGHT : DARK) : BACKGROUND;
+    }
+
+    labels.assign(height, width, 0);
+    parent.assign(static_cast<size_t>(pixelCount) + 1, 0);
+
+    // Split into bands
+    ThreadPool& pool = ThreadPool::shared();
+    int numBands = std::max(1, std::min(pool.getThreadCount(), height / MIN_BAND_ROWS));
+    int bandRows = (height + numBands - 1) / numBands;
+    numBands = (height + bandRows - 1) / bandRows;
+    stats.bands = numBands;
+
+    auto bandBegin = [&](int band) { return band * bandRows; };
+    auto bandEnd = [&](int band) { return std::min(height, (band + 1) * bandRows); };
+
+    // Pass 1: provisional labels, bands in parallel
+    pool.parallelFor(0, numBands, [&](int begin, int end) {
+        for (int band = begin; band < end; band++) {
+            scanBand(bandBegin(band), bandEnd(band), pixelClass);
+        }
+    });
+
+    // Join sets across band boundaries
+    for (int band = 1; band < numBands; band++) {
+        mergeBandBorder(bandBegin(band), pixelClass);
+    }
+
+    std::vector<int32_t> bandFirst;
+    const int numComponents = flattenLabels(static_cast<int64_t>(bandRows) * width, bandFirst);
+
+    // Pass 2: final labels and statistics. Owned labels go to totals; labels
+    // that came down across the top row (property 3) to the band's own list
+    std::vector<ComponentAccumulator> totals(numComponents);
+    std::vector<std::vector<int32_t>> foreignLabels(numBands);
+    std::vector<std::vector<ComponentAccumulator>> foreignStats(numBands);
+    pool.parallelFor(0, numBands, [&](int begin, int end) {
+        for (int band = begin; band < end; band++) {
+            const int32_t owned = bandFirst[band];
+            std::vector<int32_t>& foreign = foreignLabels[band];
+            const int32_t* top = labels[bandBegin(band)];
+            for (int c = 0; c < width; c++) {
+                if (top[c] != 0 && parent[top[c]] < owned) foreign.push_back(parent[top[c]]);
+            }
+            std::sort(foreign.begin(), foreign.end());
+            foreign.erase(std::unique(foreign.begin(), foreign.end()), foreign.end());
+            std::vector<ComponentAccumulator>& acc = foreignStats[band];
+            acc.resize(foreign.size());
+
+            // Foreign pixels come in runs: remember the last slot looked up
+            int32_t lastForeign = 0;
+            ComponentAccumulator* lastSlot = nullptr;
+
+            for (int r = bandBegin(band); r < bandEnd(band); r++) {
+                const Pixel* row = (*image)[r];
+                int32_t* lab = labels[r];
+
+                for (int c = 0; c < width; c++) {
+                    if (lab[c] == 0) continue;
+                    const int32_t final = parent[lab[c]];
+                    lab[c] = final;
+
+                    ComponentAccumulator* a;
+                    if (final >= owned) {
+                        a = &totals[final - 1];
+                    } else {
+                        if (final != lastForeign) {
+                            lastForeign = final;
+                            lastSlot = &acc[std::lower_bound(foreign.begin(), foreign.end(), final) -
+                                            foreign.begin()];
+                        }
+                        a = lastSlot;
+                    }
+                    a->add(r, c, row[c], pixelScore[row[c]]);
+                }
+            }
+        }
+    });
+
+    // Fold the border-crossing parts into their components, in band order
+    for (int band = 1; band < numBands; band++) {
+        for (size_t i = 0; i < foreignLabels[band].size(); i++) {
+            totals[foreignLabels[band][i] - 1].merge(foreignStats[band][i]);
+        }
+    }
+
+    components.resize(numComponents);
+    for (int k = 0; k < numComponents; k++) {
+        const ComponentAccumulator& total = totals[k];
+        ConnectedComponent& comp = components[k];
+        comp.id = k + 1;
+        comp.boundingBox = Region(total.row1, total.col1, total.row2, total.col2);
+        comp.totalArea = total.area;
+        comp.maxScore = total.maxScore;
+        comp.avgScore = total.scoreSum / total.area;
+        comp.meanIntensity = static_cast<double>(total.intensitySum) / total.area;
+        stats.foregroundPixels += total.area;
+    }
+
+    // Largest first; ties keep raster order of the component's first pixel
+    std::stable_sort(components.begin(), components.end(),
+                     [](const ConnectedComponent& a, const ConnectedComponent& b) {
+                         return a.totalArea > b.totalArea;
+                     });
+
+    // The equivalence array is only needed while labeling
+    std::vector<int32_t>().swap(parent);
+
+    timer.stop();
+    stats.components = numComponents;
+    stats.labelTimeMs = timer.elapsedMs();
+
+    return components;
+}
+
+} // namespace SatelliteAnalytics
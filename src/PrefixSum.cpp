@@ -51,30 +51,204 @@
  */
 
 #include "PrefixSum.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace SatelliteAnalytics {
 
+namespace {
+
+// Columns handled per task in the parallel column pass (2 KB of int64 per row)
+constexpr int COLUMN_BLOCK = 256;
+
+// Batched queries are grouped by (top row >> BATCH_BAND_SHIFT)
+constexpr int BATCH_BAND_SHIFT = 4;
+
+#if defined(__AVX2__)
+/**
+ * In-register inclusive scan of four int64 lanes:
+ *   [a, b, c, d] -> [a, a+b, a+b+c, a+b+c+d]
+ */
+inline __m256i inclusiveScan4(__m256i x) {
+    const __m256i zero = _mm256_setzero_si256();
+    // Shift by one lane: [0, a, b, c]
+    __m256i shifted = _mm256_blend_epi32(
+        _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03);
+    x = _mm256_add_epi64(x, shifted);
+    // Shift by two lanes: [0, 0, a, a+b]
+    shifted = _mm256_blend_epi32(
+        _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F);
+    return _mm256_add_epi64(x, shifted);
+}
+#endif
+
+/**
+ * ROW SCAN KERNEL
+ * 
+ * Inclusive prefix scan of one image row, producing the running sum and
+ * the running sum of squares in the same pass:
+ *   sumOut[j] = src[0] + ... + src[j]
+ *   sqOut[j]  = src[0]² + ... + src[j]²
+ * 
+ * With AVX2 four pixels are widened to int64 and scanned in-register,
+ * the carry being broadcast from the last lane. Other targets use the
+ * scalar loop.
+ */
+void scanRow(const Pixel* src, int width, int64_t* sumOut, int64_t* sqOut) {
+    int j = 0;
+    int64_t runSum = 0;
+    int64_t runSq = 0;
+    
+#if defined(__AVX2__)
+    __m256i carrySum = _mm256_setzero_si256();
+    __m256i carrySq = _mm256_setzero_si256();
+    
+    for (; j + 4 <= width; j += 4) {
+        uint32_t packed;
+        std::memcpy(&packed, src + j, sizeof(packed));
+        __m256i values = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(static_cast<int>(packed)));
+        __m256i squares = _mm256_mul_epu32(values, values);
+        
+        values = _mm256_add_epi64(inclusiveScan4(values), carrySum);
+        squares = _mm256_add_epi64(inclusiveScan4(squares), carrySq);
+        
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sumOut + j), values);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sqOut + j), squares);
+        
+        carrySum = _mm256_permute4x64_epi64(values, _MM_SHUFFLE(3, 3, 3, 3));
+        carrySq = _mm256_permute4x64_epi64(squares, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    
+    if (j > 0) {
+        runSum = sumOut[j - 1];
+        runSq = sqOut[j - 1];
+    }
+#endif
+    
+    for (; j < width; j++) {
+        int64_t pixelValue = src[j];
+        runSum += pixelValue;
+        runSq += pixelValue * pixelValue;
+        sumOut[j] = runSum;
+        sqOut[j] = runSq;
+    }
+}
+
+/**
+ * DIFFERENCE ROW SCAN KERNEL
+ * 
+ * scanRow() for d = after[j] - before[j], computed on the fly:
+ *   sumOut[j] = d[0] + ... + d[j]
+ *   sqOut[j]  = d[0]² + ... + d[j]²
+ */
+void scanDifferenceRow(const Pixel* before, const Pixel* after, int width,
+                       int64_t* sumOut, int64_t* sqOut) {
+    int64_t runSum = 0;
+    int64_t runSq = 0;
+    for (int j = 0; j < width; j++) {
+        const int64_t d = static_cast<int64_t>(after[j]) - before[j];
+        runSum += d;
+        runSq += d * d;
+        sumOut[j] = runSum;
+        sqOut[j] = runSq;
+    }
+}
+
+/**
+ * COLUMN PASS KERNEL
+ * 
+ * Adds the (already final) row above into a row-scanned row over [begin, end).
+ * Independent per column, so the loop vectorizes.
+ */
+inline void addRowAbove(const int64_t* above, int64_t* cur, int begin, int end) {
+    for (int j = begin; j < end; j++) {
+        cur[j] += above[j];
+    }
+}
+
+} // anonymous namespace
+
 PrefixSum::PrefixSum() 
-    : height(0), width(0), built(false),
+    : storage(PrefixStorage::Full), tileShift(0), tileCols(0),
+      height(0), width(0), built(false), difference(false),
       globalMean(0), globalVariance(0), globalStdDev(0),
       totalSum(0), totalPixels(0) {}
 
-void PrefixSum::build(const Matrix& image) {
-    if (image.empty() || image[0].empty()) {
+void PrefixSum::build(const Matrix& image, PrefixStorage mode) {
+    ProfileScope profile(ProfileZone::PrefixBuild);
+    if (image.empty()) {
         std::cerr << "Error: Cannot build prefix sum from empty image" << std::endl;
         return;
     }
     
-    height = image.size();
-    width = image[0].size();
+    height = image.rows();
+    width = image.cols();
     totalPixels = static_cast<int64_t>(height) * width;
+    built = false;
+    difference = false;
+    
+    // Release whichever representation is not going to be used. The other
+    // one is overwritten in place, so repeated builds (one per tile in the
+    // streaming pipeline) reuse their allocations instead of churning the heap
+    auto releaseCompact = [this]() {
+        tileBaseSum.clear();
+        tileBaseSq.clear();
+        sumOffset.clear();
+        sqOffsetLow.clear();
+        sqOffsetHigh.clear();
+    };
+    
+    auto releaseBlocked = [this]() {
+        rowStripSum.clear();
+        rowStripSq.clear();
+        colStripSum.clear();
+        colStripSq.clear();
+        localSum.clear();
+        localSq.clear();
+    };
+    
+    storage = PrefixStorage::Full;
+    if (mode == PrefixStorage::Blocked) {
+        prefix.clear();
+        prefixSquares.clear();
+        sumOffset.clear();
+        sqOffsetLow.clear();
+        sqOffsetHigh.clear();
+        buildBlocked(image);
+        storage = PrefixStorage::Blocked;
+        computeGlobalStats();
+        return;
+    }
+    releaseBlocked();
+    
+    if (mode == PrefixStorage::Compact) {
+        prefix.clear();
+        prefixSquares.clear();
+        if (buildCompact(image)) {
+            storage = PrefixStorage::Compact;
+            computeGlobalStats();
+            return;
+        }
+        std::cerr << "Warning: Image too large for compact prefix tables, "
+                  << "using full storage" << std::endl;
+    }
+    releaseCompact();
     
     // Initialize with 1-based indexing (add padding of zeros)
     // This eliminates boundary checks in queries
-    prefix.assign(height + 1, std::vector<int64_t>(width + 1, 0));
-    prefixSquares.assign(height + 1, std::vector<int64_t>(width + 1, 0));
+    prefix.assign(height + 1, width + 1, 0);
+    prefixSquares.assign(height + 1, width + 1, 0);
     
     /**
      * DYNAMIC PROGRAMMING: Build prefix sums
@@ -83,33 +257,475 @@ void PrefixSum::build(const Matrix& image) {
      * 
      * Transition: dp[i][j] = image[i-1][j-1] + dp[i-1][j] + dp[i][j-1] - dp[i-1][j-1]
      * 
-     * The key insight is that each cell contains cumulative information,
-     * and we use previously computed values to avoid redundant work.
+     * The four-term recurrence serializes on both dimensions. It is
+     * equivalent to two separable passes:
+     * 
+     *   1. ROW PASS:    row[i][j] = image[i-1][0] + ... + image[i-1][j-1]
+     *                   (rows are independent -> parallel across rows)
+     *   2. COLUMN PASS: dp[i][j]  = row[i][j] + dp[i-1][j]
+     *                   (columns are independent -> parallel across column blocks)
+     * 
+     * Sums and sums of squares are produced together in both passes.
+     * With a single thread both passes are fused per row to stay in cache.
+     */
+    ThreadPool& pool = ThreadPool::shared();
+    
+    if (pool.getThreadCount() <= 1) {
+        for (int i = 1; i <= height; i++) {
+            scanRow(image[i-1], width, prefix[i] + 1, prefixSquares[i] + 1);
+            addRowAbove(prefix[i-1], prefix[i], 1, width + 1);
+            addRowAbove(prefixSquares[i-1], prefixSquares[i], 1, width + 1);
+        }
+    } else {
+        // Pass 1: row scans, parallel across rows
+        pool.parallelFor(1, height + 1, [&](int rowBegin, int rowEnd) {
+            for (int i = rowBegin; i < rowEnd; i++) {
+                scanRow(image[i-1], width, prefix[i] + 1, prefixSquares[i] + 1);
+            }
+        }, 16);
+        
+        // Pass 2: column accumulation, parallel across column blocks
+        int numBlocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+        pool.parallelFor(0, numBlocks, [&](int blockBegin, int blockEnd) {
+            int colBegin = 1 + blockBegin * COLUMN_BLOCK;
+            int colEnd = std::min(width + 1, 1 + blockEnd * COLUMN_BLOCK);
+            for (int i = 2; i <= height; i++) {
+                addRowAbove(prefix[i-1], prefix[i], colBegin, colEnd);
+                addRowAbove(prefixSquares[i-1], prefixSquares[i], colBegin, colEnd);
+            }
+        });
+    }
+    
+    computeGlobalStats();
+}
+
+bool PrefixSum::buildDifference(const Matrix& before, const Matrix& after) {
+    ProfileScope profile(ProfileZone::PrefixBuild);
+    built = false;
+    if (before.empty() || after.empty() ||
+        before.rows() != after.rows() || before.cols() != after.cols()) {
+        std::cerr << "Error: Difference needs two non-empty images of the same size ("
+                  << before.rows() << "x" << before.cols() << " vs "
+                  << after.rows() << "x" << after.cols() << ")" << std::endl;
+        return false;
+    }
+    
+    height = after.rows();
+    width = after.cols();
+    totalPixels = static_cast<int64_t>(height) * width;
+    difference = true;
+    
+    // Signed values break the unsigned offsets of the compact / blocked layouts
+    storage = PrefixStorage::Full;
+    tileBaseSum.clear();
+    tileBaseSq.clear();
+    sumOffset.clear();
+    sqOffsetLow.clear();
+    sqOffsetHigh.clear();
+    rowStripSum.clear();
+    rowStripSq.clear();
+    colStripSum.clear();
+    colStripSq.clear();
+    localSum.clear();
+    localSq.clear();
+    prefix.assign(height + 1, width + 1, 0);
+    prefixSquares.assign(height + 1, width + 1, 0);
+    
+    // Same two passes as build(), with the difference formed inside the row scan
+    ThreadPool& pool = ThreadPool::shared();
+    if (pool.getThreadCount() <= 1) {
+        for (int i = 1; i <= height; i++) {
+            scanDifferenceRow(before[i-1], after[i-1], width, prefix[i] + 1, prefixSquares[i] + 1);
+            addRowAbove(prefix[i-1], prefix[i], 1, width + 1);
+            addRowAbove(prefixSquares[i-1], prefixSquares[i], 1, width + 1);
+        }
+    } else {
+        pool.parallelFor(1, height + 1, [&](int rowBegin, int rowEnd) {
+            for (int i = rowBegin; i < rowEnd; i++) {
+                scanDifferenceRow(before[i-1], after[i-1], width,
+                                  prefix[i] + 1, prefixSquares[i] + 1);
+            }
+        }, 16);
+        
+        int numBlocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+        pool.parallelFor(0, numBlocks, [&](int blockBegin, int blockEnd) {
+            int colBegin = 1 + blockBegin * COLUMN_BLOCK;
+            int colEnd = std::min(width + 1, 1 + blockEnd * COLUMN_BLOCK);
+            for (int i = 2; i <= height; i++) {
+                addRowAbove(prefix[i-1], prefix[i], colBegin, colEnd);
+                addRowAbove(prefixSquares[i-1], prefixSquares[i], colBegin, colEnd);
+            }
+        });
+    }
+    
+    computeGlobalStats();
+    return true;
+}
+
+bool PrefixSum::buildCompact(const Matrix& image) {
+    /**
+     * TILE SIZE SELECTION:
+     * 
+     * Inside the tile whose top-left padded cell is (i0, j0), the largest
+     * offset is prefix[i0+T-1][j0+T-1] - prefix[i0][j0], i.e. the sum over
+     * an L-shaped band of at most T*(height+width) + T² pixels.
+     * Pick the largest tile whose bound still fits a 32-bit sum offset.
+     */
+    const int64_t maxPixel = std::numeric_limits<Pixel>::max();
+    auto offsetBound = [&](int64_t maxValue, int shift) {
+        int64_t t = int64_t(1) << shift;
+        return maxValue * (t * (height + width + 2) + t * t);
+    };
+    
+    const int64_t max32 = std::numeric_limits<uint32_t>::max();
+    const int64_t max48 = (int64_t(1) << 48) - 1;
+    
+    tileShift = 0;
+    while ((1 << (tileShift + 1)) <= Config::PREFIX_TILE_SIZE) tileShift++;
+    while (tileShift > 3 && offsetBound(maxPixel, tileShift) > max32) tileShift--;
+    
+    if (offsetBound(maxPixel, tileShift) > max32 ||
+        offsetBound(maxPixel * maxPixel, tileShift) > max48) {
+        return false;
+    }
+    bool wideSquares = offsetBound(maxPixel * maxPixel, tileShift) > max32;
+    
+    const int tileSize = 1 << tileShift;
+    const int paddedRows = height + 1;
+    const int paddedCols = width + 1;
+    const int tileRows = (paddedRows + tileSize - 1) >> tileShift;
+    tileCols = (paddedCols + tileSize - 1) >> tileShift;
+    
+    tileBaseSum.assign(static_cast<size_t>(tileRows) * tileCols, 0);
+    tileBaseSq.assign(static_cast<size_t>(tileRows) * tileCols, 0);
+    sumOffset.assign(paddedRows, paddedCols, 0);
+    sqOffsetLow.assign(paddedRows, paddedCols, 0);
+    if (wideSquares) {
+        sqOffsetHigh.assign(paddedRows, paddedCols, 0);
+    } else {
+        sqOffsetHigh.clear();
+    }
+    
+    // Only two rows of full-width 64-bit prefix values are alive at a time
+    std::vector<int64_t> prevSum(paddedCols, 0), curSum(paddedCols, 0);
+    std::vector<int64_t> prevSq(paddedCols, 0), curSq(paddedCols, 0);
+    
+    for (int i = 0; i < paddedRows; i++) {
+        if (i > 0) {
+            // Same separable recurrence as the full build: row scan + row above
+            scanRow(image[i-1], width, curSum.data() + 1, curSq.data() + 1);
+            addRowAbove(prevSum.data(), curSum.data(), 1, paddedCols);
+            addRowAbove(prevSq.data(), curSq.data(), 1, paddedCols);
+        }
+        
+        // First padded row of a tile row: record the bases (tile minimum)
+        int tileRow = i >> tileShift;
+        if ((i & (tileSize - 1)) == 0) {
+            for (int t = 0; t < tileCols; t++) {
+                tileBaseSum[tileRow * tileCols + t] = curSum[t << tileShift];
+                tileBaseSq[tileRow * tileCols + t] = curSq[t << tileShift];
+            }
+        }
+        
+        uint32_t* sumOut = sumOffset[i];
+        uint32_t* sqLowOut = sqOffsetLow[i];
+        uint16_t* sqHighOut = wideSquares ? sqOffsetHigh[i] : nullptr;
+        const int64_t* baseSum = &tileBaseSum[tileRow * tileCols];
+        const int64_t* baseSq = &tileBaseSq[tileRow * tileCols];
+        
+        for (int j = 0; j < paddedCols; j++) {
+            int t = j >> tileShift;
+            sumOut[j] = static_cast<uint32_t>(curSum[j] - baseSum[t]);
+            uint64_t sqOffset = static_cast<uint64_t>(curSq[j] - baseSq[t]);
+            sqLowOut[j] = static_cast<uint32_t>(sqOffset);
+            if (sqHighOut) {
+                sqHighOut[j] = static_cast<uint16_t>(sqOffset >> 32);
+            }
+        }
+        
+        std::swap(prevSum, curSum);
+        std::swap(prevSq, curSq);
+    }
+    
+    return true;
+}
+
+void PrefixSum::buildBlocked(const Matrix& image) {
+    /**
+     * BLOCK SIZE:
+     * 
+     * A local entry covers at most T×T pixels, so it fits 32 bits while
+     * T² × maxPixel² does; strips and bases are 64-bit, so unlike compact
+     * storage the block size does not depend on the image size.
+     */
+    const int64_t maxPixel = std::numeric_limits<Pixel>::max();
+    const int64_t max32 = std::numeric_limits<uint32_t>::max();
+    
+    tileShift = 0;
+    while ((1 << (tileShift + 1)) <= Config::PREFIX_TILE_SIZE) tileShift++;
+    while (tileShift > 0 && (int64_t(1) << (2 * tileShift)) * maxPixel * maxPixel > max32) {
+        tileShift--;
+    }
+    
+    const int tileSize = 1 << tileShift;
+    const int paddedRows = height + 1;
+    const int paddedCols = width + 1;
+    const int tileRows = (paddedRows + tileSize - 1) >> tileShift;
+    tileCols = (paddedCols + tileSize - 1) >> tileShift;
+    
+    tileBaseSum.assign(static_cast<size_t>(tileRows) * tileCols, 0);
+    tileBaseSq.assign(static_cast<size_t>(tileRows) * tileCols, 0);
+    rowStripSum.assign(paddedRows, tileCols, 0);
+    rowStripSq.assign(paddedRows, tileCols, 0);
+    colStripSum.assign(paddedCols, tileRows, 0);
+    colStripSq.assign(paddedCols, tileRows, 0);
+    localSum.assign(paddedRows, paddedCols, 0);
+    localSq.assign(paddedRows, paddedCols, 0);
+    
+    // Current and previous full prefix rows, plus the first row of the
+    // current block row (every part is a difference against it)
+    std::vector<int64_t> prevSum(paddedCols, 0), curSum(paddedCols, 0), topSum(paddedCols, 0);
+    std::vector<int64_t> prevSq(paddedCols, 0), curSq(paddedCols, 0), topSq(paddedCols, 0);
+    
+    for (int i = 0; i < paddedRows; i++) {
+        if (i > 0) {
+            scanRow(image[i-1], width, curSum.data() + 1, curSq.data() + 1);
+            addRowAbove(prevSum.data(), curSum.data(), 1, paddedCols);
+            addRowAbove(prevSq.data(), curSq.data(), 1, paddedCols);
+        }
+        
+        // First padded row of a block row: block grid and column strips
+        int tileRow = i >> tileShift;
+        if ((i & (tileSize - 1)) == 0) {
+            topSum = curSum;
+            topSq = curSq;
+            for (int t = 0; t < tileCols; t++) {
+                tileBaseSum[tileRow * tileCols + t] = curSum[t << tileShift];
+                tileBaseSq[tileRow * tileCols + t] = curSq[t << tileShift];
+            }
+            for (int j = 0; j < paddedCols; j++) {
+                int blockCol = (j >> tileShift) << tileShift;
+                colStripSum[j][tileRow] = curSum[j] - curSum[blockCol];
+                colStripSq[j][tileRow] = curSq[j] - curSq[blockCol];
+            }
+        }
+        
+        for (int t = 0; t < tileCols; t++) {
+            int blockCol = t << tileShift;
+            rowStripSum[i][t] = curSum[blockCol] - topSum[blockCol];
+            rowStripSq[i][t] = curSq[blockCol] - topSq[blockCol];
+        }
+        
+        uint32_t* sumOut = localSum[i];
+        uint32_t* sqOut = localSq[i];
+        for (int j = 0; j < paddedCols; j++) {
+            int blockCol = (j >> tileShift) << tileShift;
+            sumOut[j] = static_cast<uint32_t>(curSum[j] - topSum[j] - curSum[blockCol] + topSum[blockCol]);
+            sqOut[j] = static_cast<uint32_t>(curSq[j] - topSq[j] - curSq[blockCol] + topSq[blockCol]);
+        }
+        
+        std::swap(prevSum, curSum);
+        std::swap(prevSq, curSq);
+    }
+}
+
+// ============================================================================
+// PATCH UPDATES
+// ============================================================================
+
+bool PrefixSum::updateRegion(int row, int col, const Matrix& patch) {
+    ProfileScope profile(ProfileZone::PrefixUpdate);
+    if (!built) {
+        std::cerr << "Error: Cannot update prefix sums that were never built" << std::endl;
+        return false;
+    }
+    if (difference) {
+        std::cerr << "Error: Cannot patch a difference table; rebuild it instead" << std::endl;
+        return false;
+    }
+    
+    const int patchRows = patch.rows();
+    const int patchCols = patch.cols();
+    if (patch.empty() || row < 0 || col < 0 ||
+        row + patchRows > height || col + patchCols > width) {
+        std::cerr << "Error: " << patchRows << "x" << patchCols << " patch at (" << row << ", "
+                  << col << ") does not fit the " << height << "x" << width << " image" << std::endl;
+        return false;
+    }
+    
+    /**
+     * DELTA TABLES
+     * 
+     * d(p, q) = new - old for every patch pixel (and the same for squares),
+     * with the old value recovered from the tables (difference of two
+     * neighbouring row sums).
+     * Summed-area tables of d over the patch give the change of any padded
+     * entry (i, j), which only sees the part of the patch above-left of it:
+     *   S(i, j) = D[clamp(i - row, 0, h)][clamp(j - col, 0, w)]
      */
-    for (int i = 1; i <= height; i++) {
-        for (int j = 1; j <= width; j++) {
-            int64_t pixelValue = image[i-1][j-1];
-            
-            // Prefix sum: classic DP recurrence
-            prefix[i][j] = pixelValue 
-                         + prefix[i-1][j] 
-                         + prefix[i][j-1] 
-                         - prefix[i-1][j-1];
-            
-            // Prefix sum of squares: same recurrence, different values
-            // This enables O(1) variance computation
-            prefixSquares[i][j] = pixelValue * pixelValue 
-                                + prefixSquares[i-1][j] 
-                                + prefixSquares[i][j-1] 
-                                - prefixSquares[i-1][j-1];
-        }
-    }
-    
-    // Compute global statistics
-    totalSum = prefix[height][width];
+    PrefixMatrix deltaSum(patchRows + 1, patchCols + 1, 0);
+    PrefixMatrix deltaSq(patchRows + 1, patchCols + 1, 0);
+    for (int p = 0; p < patchRows; p++) {
+        const int i = row + p;
+        // Running sum of image row i up to column j, so old = difference of neighbours
+        int64_t before = sumAt(i + 1, col) - sumAt(i, col);
+        int64_t runSum = 0;
+        int64_t runSq = 0;
+        for (int q = 0; q < patchCols; q++) {
+            const int j = col + q;
+            int64_t through = sumAt(i + 1, j + 1) - sumAt(i, j + 1);
+            int64_t oldValue = through - before;
+            int64_t newValue = patch[p][q];
+            before = through;
+            runSum += newValue - oldValue;
+            runSq += newValue * newValue - oldValue * oldValue;
+            deltaSum[p + 1][q + 1] = deltaSum[p][q + 1] + runSum;
+            deltaSq[p + 1][q + 1] = deltaSq[p][q + 1] + runSq;
+        }
+    }
+    
+    // S(i, j) = deltaRow(delta, i)[deltaCol[j]]; column 0 of a delta table is 0
+    auto deltaRow = [&](const PrefixMatrix& delta, int i) {
+        return delta[std::min(std::max(i - row, 0), patchRows)];
+    };
+    std::vector<int> deltaCol(width + 1);
+    for (int j = 0; j <= width; j++) deltaCol[j] = std::min(std::max(j - col, 0), patchCols);
+    
+    ThreadPool& pool = ThreadPool::shared();
+    const int tileSize = 1 << tileShift;
+    const int tileRows = (height + 1 + tileSize - 1) >> tileShift;
+    
+    if (storage == PrefixStorage::Full) {
+        // Every entry below and right of the patch corner moves
+        pool.parallelFor(row + 1, height + 1, [&](int rowBegin, int rowEnd) {
+            for (int i = rowBegin; i < rowEnd; i++) {
+                const int64_t* dSum = deltaRow(deltaSum, i);
+                const int64_t* dSq = deltaRow(deltaSq, i);
+                int64_t* sumRow = prefix[i];
+                int64_t* sqRow = prefixSquares[i];
+                for (int j = col + 1; j <= width; j++) {
+                    sumRow[j] += dSum[deltaCol[j]];
+                    sqRow[j] += dSq[deltaCol[j]];
+                }
+            }
+        }, 16);
+    } else if (storage == PrefixStorage::Compact) {
+        /**
+         * Same quadrant, split into tile bases and offsets:
+         *   base(I, J)  += S(IT, JT)
+         *   offset(i,j) += S(i, j) - S(IT, JT)
+         * Offsets and bases of rows or columns not past the patch corner see
+         * S = 0. Offsets wrap modulo their width, which is exact because
+         * the updated values fit again.
+         */
+        for (int t = (row >> tileShift) + 1; t < tileRows; t++) {
+            const int64_t* dSum = deltaRow(deltaSum, t << tileShift);
+            const int64_t* dSq = deltaRow(deltaSq, t << tileShift);
+            for (int u = (col >> tileShift) + 1; u < tileCols; u++) {
+                tileBaseSum[t * tileCols + u] += dSum[deltaCol[u << tileShift]];
+                tileBaseSq[t * tileCols + u] += dSq[deltaCol[u << tileShift]];
+            }
+        }
+        
+        const bool wideSquares = !sqOffsetHigh.empty();
+        pool.parallelFor(row + 1, height + 1, [&](int rowBegin, int rowEnd) {
+            for (int i = rowBegin; i < rowEnd; i++) {
+                const int tileTop = (i >> tileShift) << tileShift;
+                const int64_t* dSum = deltaRow(deltaSum, i);
+                const int64_t* dSq = deltaRow(deltaSq, i);
+                const int64_t* topSum = deltaRow(deltaSum, tileTop);
+                const int64_t* topSq = deltaRow(deltaSq, tileTop);
+                uint32_t* sumOut = sumOffset[i];
+                uint32_t* sqLowOut = sqOffsetLow[i];
+                uint16_t* sqHighOut = wideSquares ? sqOffsetHigh[i] : nullptr;
+                
+                for (int j = col + 1; j <= width; j++) {
+                    const int q = deltaCol[j];
+                    const int q0 = deltaCol[(j >> tileShift) << tileShift];
+                    sumOut[j] += static_cast<uint32_t>(dSum[q] - topSum[q0]);
+                    uint64_t sq = sqLowOut[j];
+                    if (sqHighOut) sq |= static_cast<uint64_t>(sqHighOut[j]) << 32;
+                    sq += static_cast<uint64_t>(dSq[q] - topSq[q0]);
+                    sqLowOut[j] = static_cast<uint32_t>(sq);
+                    if (sqHighOut) sqHighOut[j] = static_cast<uint16_t>(sq >> 32);
+                }
+            }
+        }, 16);
+    } else {
+        /**
+         * BLOCKED UPDATE
+         * 
+         * Each part changes by the patch delta over its own rectangle
+         * (terms at row or column 0 vanish):
+         *   local(i, j)     S(i,j) - S(IT,j) - S(i,JT) + S(IT,JT)   blocks the patch overlaps
+         *   rowStrip(i, J)  S(i,JT) - S(IT,JT)                       block rows of the patch
+         *   colStrip(j, I)  S(IT,j) - S(IT,JT)                       block columns of the patch
+         *   base(I, J)      S(IT,JT)                                 below and right of the corner
+         */
+        const int lastRow = row + patchRows - 1;
+        const int lastCol = col + patchCols - 1;
+        // Padded rows / columns whose block starts at or before the patch end
+        const int rowEnd = std::min(height, (((lastRow >> tileShift) + 1) << tileShift) - 1);
+        const int colEnd = std::min(width, (((lastCol >> tileShift) + 1) << tileShift) - 1);
+        const int firstTileRow = (row >> tileShift) + 1;
+        const int firstTileCol = (col >> tileShift) + 1;
+        
+        pool.parallelFor(row + 1, rowEnd + 1, [&](int rowBegin, int rowStop) {
+            for (int i = rowBegin; i < rowStop; i++) {
+                const int blockTop = (i >> tileShift) << tileShift;
+                const int64_t* dSum = deltaRow(deltaSum, i);
+                const int64_t* dSq = deltaRow(deltaSq, i);
+                const int64_t* topSum = deltaRow(deltaSum, blockTop);
+                const int64_t* topSq = deltaRow(deltaSq, blockTop);
+                uint32_t* sumOut = localSum[i];
+                uint32_t* sqOut = localSq[i];
+                
+                for (int j = col + 1; j <= colEnd; j++) {
+                    const int q = deltaCol[j];
+                    const int q0 = deltaCol[(j >> tileShift) << tileShift];
+                    sumOut[j] += static_cast<uint32_t>(dSum[q] - topSum[q] - dSum[q0] + topSum[q0]);
+                    sqOut[j] += static_cast<uint32_t>(dSq[q] - topSq[q] - dSq[q0] + topSq[q0]);
+                }
+                for (int u = firstTileCol; u < tileCols; u++) {
+                    const int q0 = deltaCol[u << tileShift];
+                    rowStripSum[i][u] += dSum[q0] - topSum[q0];
+                    rowStripSq[i][u] += dSq[q0] - topSq[q0];
+                }
+            }
+        }, 16);
+        
+        for (int j = col + 1; j <= colEnd; j++) {
+            const int q = deltaCol[j];
+            const int q0 = deltaCol[(j >> tileShift) << tileShift];
+            int64_t* sumOut = colStripSum[j];
+            int64_t* sqOut = colStripSq[j];
+            for (int t = firstTileRow; t < tileRows; t++) {
+                const int64_t* topSum = deltaRow(deltaSum, t << tileShift);
+                const int64_t* topSq = deltaRow(deltaSq, t << tileShift);
+                sumOut[t] += topSum[q] - topSum[q0];
+                sqOut[t] += topSq[q] - topSq[q0];
+            }
+        }
+        
+        for (int t = firstTileRow; t < tileRows; t++) {
+            const int64_t* topSum = deltaRow(deltaSum, t << tileShift);
+            const int64_t* topSq = deltaRow(deltaSq, t << tileShift);
+            for (int u = firstTileCol; u < tileCols; u++) {
+                tileBaseSum[t * tileCols + u] += topSum[deltaCol[u << tileShift]];
+                tileBaseSq[t * tileCols + u] += topSq[deltaCol[u << tileShift]];
+            }
+        }
+    }
+    
+    computeGlobalStats();
+    return true;
+}
+
+void PrefixSum::computeGlobalStats() {
+    totalSum = sumAt(height, width);
     globalMean = static_cast<double>(totalSum) / totalPixels;
     
-    int64_t sumSquares = prefixSquares[height][width];
+    int64_t sumSquares = sumSquaresAt(height, width);
     double meanOfSquares = static_cast<double>(sumSquares) / totalPixels;
     
     // Variance = E[X²] - (E[X])²
@@ -119,6 +735,19 @@ void PrefixSum::build(const Matrix& image) {
     built = true;
 }
 
+size_t PrefixSum::getMemoryBytes() const {
+    if (storage == PrefixStorage::Full) {
+        return prefix.sizeBytes() + prefixSquares.sizeBytes();
+    }
+    size_t bases = (tileBaseSum.size() + tileBaseSq.size()) * sizeof(int64_t);
+    if (storage == PrefixStorage::Blocked) {
+        return bases + rowStripSum.sizeBytes() + rowStripSq.sizeBytes()
+             + colStripSum.sizeBytes() + colStripSq.sizeBytes()
+             + localSum.sizeBytes() + localSq.sizeBytes();
+    }
+    return bases + sumOffset.sizeBytes() + sqOffsetLow.sizeBytes() + sqOffsetHigh.sizeBytes();
+}
+
 int64_t PrefixSum::querySum(const Region& region) const {
     return querySum(region.row1, region.col1, region.row2, region.col2);
 }
@@ -147,10 +776,11 @@ int64_t PrefixSum::querySum(int r1, int c1, int r2, int c2) const {
      * This is a classic application of the inclusion-exclusion principle
      * that gives us O(1) query time!
      */
-    return prefix[r2+1][c2+1] 
-         - prefix[r1][c2+1] 
-         - prefix[r2+1][c1] 
-         + prefix[r1][c1];
+    Profiler::count(ProfileCounter::PrefixReads, 4);
+    return sumAt(r2+1, c2+1) 
+         - sumAt(r1, c2+1) 
+         - sumAt(r2+1, c1) 
+         + sumAt(r1, c1);
 }
 
 int64_t PrefixSum::querySumSquares(const Region& region) const {
@@ -168,10 +798,11 @@ int64_t PrefixSum::querySumSquares(int r1, int c1, int r2, int c2) const {
     if (r1 > r2 || c1 > c2) return 0;
     
     // Same inclusion-exclusion formula as querySum
-    return prefixSquares[r2+1][c2+1] 
-         - prefixSquares[r1][c2+1] 
-         - prefixSquares[r2+1][c1] 
-         + prefixSquares[r1][c1];
+    Profiler::count(ProfileCounter::PrefixReads, 4);
+    return sumSquaresAt(r2+1, c2+1) 
+         - sumSquaresAt(r1, c2+1) 
+         - sumSquaresAt(r2+1, c1) 
+         + sumSquaresAt(r1, c1);
 }
 
 RegionStats PrefixSum::queryStats(const Region& region) const {
@@ -179,16 +810,20 @@ RegionStats PrefixSum::queryStats(const Region& region) const {
 }
 
 RegionStats PrefixSum::queryStats(int r1, int c1, int r2, int c2) const {
-    RegionStats stats;
-    
-    if (!built || r1 > r2 || c1 > c2) return stats;
+    if (!built || r1 > r2 || c1 > c2) return RegionStats();
     
-    stats.sum = querySum(r1, c1, r2, c2);
-    stats.area = static_cast<int64_t>(r2 - r1 + 1) * (c2 - c1 + 1);
+    int64_t area = static_cast<int64_t>(r2 - r1 + 1) * (c2 - c1 + 1);
+    return finishStats(querySum(r1, c1, r2, c2), querySumSquares(r1, c1, r2, c2), area);
+}
+
+RegionStats PrefixSum::finishStats(int64_t sum, int64_t sumSquares, int64_t area) {
+    RegionStats stats;
+    stats.sum = sum;
+    stats.area = area;
     
-    if (stats.area == 0) return stats;
+    if (area == 0) return stats;
     
-    stats.mean = static_cast<double>(stats.sum) / stats.area;
+    stats.mean = static_cast<double>(sum) / area;
     
     /**
      * VARIANCE COMPUTATION using the formula:
@@ -201,8 +836,7 @@ RegionStats PrefixSum::queryStats(int r1, int c1, int r2, int c2) const {
      * 
      * This avoids the need for a second pass over the data!
      */
-    int64_t sumSquares = querySumSquares(r1, c1, r2, c2);
-    double meanOfSquares = static_cast<double>(sumSquares) / stats.area;
+    double meanOfSquares = static_cast<double>(sumSquares) / area;
     
     stats.variance = meanOfSquares - stats.mean * stats.mean;
     // Numerical stability: variance can be slightly negative due to floating point
@@ -212,6 +846,93 @@ RegionStats PrefixSum::queryStats(int r1, int c1, int r2, int c2) const {
     return stats;
 }
 
+// ============================================================================
+// BATCHED REGION STATISTICS
+// ============================================================================
+
+void PrefixSum::queryStatsBatch(const Region* regions, size_t n, RegionStats* out) const {
+    if (n == 0) return;
+    ProfileScope profile(ProfileZone::RegionStatsBatch);
+    Profiler::count(ProfileCounter::PrefixReads, 8 * static_cast<int64_t>(n));
+    if (!built) {
+        std::fill(out, out + n, RegionStats());
+        return;
+    }
+    
+    // Visit large batches in corner order: a counting sort by the band of
+    // the top-left row (stable, so queries in a band keep their order)
+    std::vector<uint32_t> order;
+    if (n >= static_cast<size_t>(Config::STATS_BATCH_SORT_MIN) &&
+        n <= std::numeric_limits<uint32_t>::max()) {
+        const int bands = (height >> BATCH_BAND_SHIFT) + 1;
+        auto bandOf = [&](const Region& q) {
+            return std::min(std::max(q.row1, 0), height) >> BATCH_BAND_SHIFT;
+        };
+        
+        std::vector<uint32_t> offsets(bands + 1, 0);
+        for (size_t i = 0; i < n; i++) offsets[bandOf(regions[i]) + 1]++;
+        for (int b = 0; b < bands; b++) offsets[b + 1] += offsets[b];
+        
+        order.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            order[offsets[bandOf(regions[i])]++] = static_cast<uint32_t>(i);
+        }
+    }
+    const uint32_t* visit = order.empty() ? nullptr : order.data();
+    
+    const size_t block = Config::STATS_BATCH_BLOCK;
+    const size_t numBlocks = (n + block - 1) / block;
+    if (numBlocks == 1 || numBlocks > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        statsBlock(regions, visit, 0, n, out);
+        return;
+    }
+    
+    ThreadPool::shared().parallelFor(0, static_cast<int>(numBlocks), [&](int begin, int end) {
+        statsBlock(regions, visit, begin * block, std::min(n, end * block), out);
+    });
+}
+
+void PrefixSum::statsBlock(const Region* regions, const uint32_t* order, size_t begin, size_t end,
+                           RegionStats* out) const {
+    /**
+     * Each query becomes four padded-table corners:
+     *   tl = (r1, c1)   tr = (r1, c2+1)   bl = (r2+1, c1)   br = (r2+1, c2+1)
+     * after clamping to the image. A query whose clamped rectangle is empty
+     * gets all four corners at (0, 0), so its sums come out as 0. Area uses
+     * the unclamped bounds, exactly as queryStats() does.
+     */
+    struct Corners {
+        int top, left, bottom, right;   // Padded-table rows / columns
+    };
+    auto corners = [this](const Region& q) {
+        int r1 = std::max(0, q.row1);
+        int c1 = std::max(0, q.col1);
+        int r2 = std::min(height - 1, q.row2);
+        int c2 = std::min(width - 1, q.col2);
+        if (r1 > r2 || c1 > c2) return Corners{0, 0, 0, 0};
+        return Corners{r1, c1, r2 + 1, c2 + 1};
+    };
+    
+    // Queries are independent, so the out-of-order core overlaps the
+    // corner loads of consecutive iterations
+    for (size_t i = begin; i < end; i++) {
+        const size_t index = order ? order[i] : i;
+        const Region& q = regions[index];
+        if (q.row1 > q.row2 || q.col1 > q.col2) {
+            out[index] = RegionStats();
+            continue;
+        }
+        
+        Corners c = corners(q);
+        int64_t sum = sumAt(c.bottom, c.right) - sumAt(c.top, c.right)
+                    - sumAt(c.bottom, c.left) + sumAt(c.top, c.left);
+        int64_t sumSquares = sumSquaresAt(c.bottom, c.right) - sumSquaresAt(c.top, c.right)
+                           - sumSquaresAt(c.bottom, c.left) + sumSquaresAt(c.top, c.left);
+        int64_t area = static_cast<int64_t>(q.row2 - q.row1 + 1) * (q.col2 - q.col1 + 1);
+        out[index] = finishStats(sum, sumSquares, area);
+    }
+}
+
 double PrefixSum::queryMean(const Region& region) const {
     if (!built) return 0;
     
@@ -232,8 +953,8 @@ bool PrefixSum::verify(const Matrix& image, const Region& region) const {
     
     for (int r = region.row1; r <= region.row2; r++) {
         for (int c = region.col1; c <= region.col2; c++) {
-            if (r >= 0 && r < static_cast<int>(image.size()) &&
-                c >= 0 && c < static_cast<int>(image[0].size())) {
+            if (r >= 0 && r < image.rows() &&
+                c >= 0 && c < image.cols()) {
                 int64_t val = image[r][c];
                 bruteSum += val;
                 bruteSumSquares += val * val;
@@ -0,0 +1,314 @@
+/**
+ * @file Profiler.cpp
+ * @brief Implementation of zones, counters, histograms and their export
+ */
+
+#include "Profiler.h"
+#include "Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+constexpr int ZONE_COUNT = static_cast<int>(ProfileZone::Count);
+constexpr int COUNTER_COUNT = static_cast<int>(ProfileCounter::Count);
+
+// Four buckets per power of two; 64-bit durations need fewer than 256
+constexpr int HISTOGRAM_BUCKETS = 256;
+
+const char* const ZONE_NAMES[ZONE_COUNT] = {
+    "image.load", "prefix.build", "prefix.update", "tree.build", "detect",
+    "query.topk", "query.topk_pruned", "query.rect", "query.rect_topn", "query.stats",
+    "query.stats_batch", "query.components"
+};
+
+const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+    "nodes_visited", "nodes_pruned", "prefix_reads", "bytes_loaded"
+};
+
+/**
+ * @brief Histogram bucket of a duration
+ *
+ * Values below 4 ns have a bucket each. Above that, v in [2^e, 2^(e+1))
+ * lands in one of four equal sub-buckets selected by the two bits after
+ * the leading one.
+ */
+int bucketOf(int64_t ns) {
+    if (ns < 4) return ns < 0 ? 0 : static_cast<int>(ns);
+    const int e = 63 - __builtin_clzll(static_cast<unsigned long long>(ns));
+    const int sub = static_cast<int>((ns >> (e - 2)) & 3);
+    return 4 * (e - 1) + sub;
+}
+
+/**
+ * @brief Exclusive upper edge of a bucket, in nanoseconds
+ */
+int64_t bucketUpper(int bucket) {
+    if (bucket < 4) return bucket + 1;
+    const int e = bucket / 4 + 1;
+    const int sub = bucket % 4;
+    return static_cast<int64_t>(4 + sub + 1) << (e - 2);
+}
+
+struct ZoneHistogram {
+    int64_t count = 0;
+    int64_t totalNs = 0;
+    int64_t maxNs = 0;
+    int64_t buckets[HISTOGRAM_BUCKETS] = {};
+
+    void add(int64_t ns) {
+        count++;
+        totalNs += ns;
+        maxNs = std::max(maxNs, ns);
+        buckets[bucketOf(ns)]++;
+    }
+
+    void merge(const ZoneHistogram& other) {
+        count += other.count;
+        totalNs += other.totalNs;
+        maxNs = std::max(maxNs, other.maxNs);
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) buckets[b] += other.buckets[b];
+    }
+
+    /**
+     * @brief Upper bucket edge of quantile q, capped at the maximum seen
+     */
+    int64_t quantileNs(double q) const {
+        if (count == 0) return 0;
+        const int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(q * count + 0.5));
+        int64_t seen = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen >= rank) return std::min(bucketUpper(b), maxNs);
+        }
+        return maxNs;
+    }
+};
+
+struct TraceEvent {
+    int64_t startNs;
+    int64_t durationNs;
+    ProfileZone zone;
+};
+
+void writeZone(std::ostream& out, const char* name, const ZoneHistogram& h) {
+    out << "\"" << name << "\": {\"count\": " << h.count
+        << ", \"total_ms\": " << h.totalNs / 1e6
+        << ", \"mean_us\": " << (h.count > 0 ? h.totalNs / 1e3 / h.count : 0.0)
+        << ", \"p50_us\": " << h.quantileNs(0.50) / 1e3
+        << ", \"p99_us\": " << h.quantileNs(0.99) / 1e3
+        << ", \"max_us\": " << h.maxNs / 1e3 << "}";
+}
+
+/**
+ * @brief Zones with at least one event, as a JSON object
+ */
+void writeZones(std::ostream& out, const ZoneHistogram* zones, const std::string& indent) {
+    out << "{";
+    bool first = true;
+    for (int z = 0; z < ZONE_COUNT; z++) {
+        if (zones[z].count == 0) continue;
+        out << (first ? "\n" : ",\n") << indent << "  ";
+        writeZone(out, ZONE_NAMES[z], zones[z]);
+        first = false;
+    }
+    out << (first ? "}" : "\n" + indent + "}");
+}
+
+} // anonymous namespace
+
+struct Profiler::ThreadData {
+    int index;
+    int64_t counters[COUNTER_COUNT] = {};
+    ZoneHistogram zones[ZONE_COUNT];
+    std::vector<TraceEvent> events;
+    int64_t droppedEvents = 0;
+};
+
+namespace {
+
+/**
+ * @brief Registered threads and global settings
+ *
+ * Thread data is owned here rather than by the thread, so the numbers of
+ * pool workers (or finished threads) are still there at export time.
+ */
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Profiler::ThreadData>> threads;
+    std::atomic<bool> recordTrace{false};
+    std::atomic<int64_t> epochNs{0};    // steady_clock time of enable()
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+std::atomic<bool> Profiler::enabledFlag{false};
+std::atomic<int64_t> Profiler::allocations{0};
+
+// ============================================================================
+// RECORDING
+// ============================================================================
+
+void Profiler::enable(bool recordTrace) {
+    Registry& reg = registry();
+    reg.recordTrace.store(recordTrace, std::memory_order_relaxed);
+    reg.epochNs.store(steadyNs(), std::memory_order_relaxed);
+    enabledFlag.store(true, std::memory_order_release);
+}
+
+Profiler::ThreadData& Profiler::local() {
+    thread_local ThreadData* data = nullptr;
+    if (!data) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::unique_ptr<ThreadData>(new ThreadData()));
+        data = reg.threads.back().get();
+        data->index = static_cast<int>(reg.threads.size()) - 1;
+    }
+    return *data;
+}
+
+int64_t Profiler::nowNs() {
+    return steadyNs() - registry().epochNs.load(std::memory_order_relaxed);
+}
+
+void Profiler::addCount(ProfileCounter counter, int64_t n) {
+    local().counters[static_cast<int>(counter)] += n;
+}
+
+void Profiler::record(ProfileZone zone, int64_t startNs, int64_t endNs) {
+    ThreadData& data = local();
+    const int64_t duration = endNs - startNs;
+    data.zones[static_cast<int>(zone)].add(duration);
+
+    if (registry().recordTrace.load(std::memory_order_relaxed)) {
+        if (data.events.size() < static_cast<size_t>(Config::PROFILE_MAX_TRACE_EVENTS)) {
+            data.events.push_back({startNs, duration, zone});
+        } else {
+            data.droppedEvents++;
+        }
+    }
+}
+
+const char* Profiler::zoneName(ProfileZone zone) {
+    return ZONE_NAMES[static_cast<int>(zone)];
+}
+
+const char* Profiler::counterName(ProfileCounter counter) {
+    return COUNTER_NAMES[static_cast<int>(counter)];
+}
+
+// ============================================================================
+// EXPORT
+// ============================================================================
+
+bool Profiler::writeReport(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write profile " << path << std::endl;
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    ZoneHistogram zones[ZONE_COUNT];
+    int64_t counters[COUNTER_COUNT] = {};
+    for (const auto& data : reg.threads) {
+        for (int z = 0; z < ZONE_COUNT; z++) zones[z].merge(data->zones[z]);
+        for (int c = 0; c < COUNTER_COUNT; c++) counters[c] += data->counters[c];
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"wall_ms\": " << (isEnabled() ? nowNs() / 1e6 : 0.0) << ",\n";
+
+    out << "  \"counters\": {";
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        out << "\"" << COUNTER_NAMES[c] << "\": " << counters[c] << ", ";
+    }
+    out << "\"heap_allocations\": " << allocations.load(std::memory_order_relaxed) << "},\n";
+
+    out << "  \"zones\": ";
+    writeZones(out, zones, "  ");
+    out << ",\n";
+
+    out << "  \"threads\": [";
+    bool firstThread = true;
+    for (const auto& data : reg.threads) {
+        out << (firstThread ? "\n" : ",\n");
+        firstThread = false;
+        out << "    {\"thread\": " << data->index << ", \"counters\": {";
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            out << (c > 0 ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << data->counters[c];
+        }
+        out << "},\n     \"zones\": ";
+        writeZones(out, data->zones, "     ");
+        out << "}";
+    }
+    out << (firstThread ? "]\n" : "\n  ]\n") << "}\n";
+
+    if (!out) {
+        std::cerr << "Error: Failed writing profile " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write trace " << path << std::endl;
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    // Complete ("X") events, timestamps and durations in microseconds
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    int64_t dropped = 0;
+    for (const auto& data : reg.threads) {
+        out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+            << data->index << ", \"args\": {\"name\": \"thread " << data->index << "\"}}";
+        first = false;
+        for (const TraceEvent& e : data->events) {
+            out << ",\n{\"name\": \"" << ZONE_NAMES[static_cast<int>(e.zone)]
+                << "\", \"cat\": \"skymatrix\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << data->index
+                << ", \"ts\": " << e.startNs / 1e3 << ", \"dur\": " << e.durationNs / 1e3 << "}";
+        }
+        dropped += data->droppedEvents;
+    }
+    out << "\n], \"otherData\": {\"dropped_events\": \"" << dropped << "\"}}\n";
+
+    if (dropped > 0) {
+        std::cerr << "Warning: trace kept the first " << Config::PROFILE_MAX_TRACE_EVENTS
+                  << " events per thread, " << dropped << " dropped" << std::endl;
+    }
+    if (!out) {
+        std::cerr << "Error: Failed writing trace " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace SatelliteAnalytics
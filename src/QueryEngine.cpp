@@ -11,6 +11,7 @@
  */
 
 #include "QueryEngine.h"
+#include "Profiler.h"
 #include <algorithm>
 #include <queue>
 #include <stack>
@@ -20,6 +21,30 @@
 
 namespace SatelliteAnalytics {
 
+namespace {
+
+/**
+ * @brief Add a query's node visits and prunes to the profile counters
+ */
+void countTraversal(const QueryResult& result) {
+    Profiler::count(ProfileCounter::NodesVisited, result.nodesVisited);
+    Profiler::count(ProfileCounter::NodesPruned, result.nodesPruned);
+}
+
+/**
+ * @brief Top-K ranking: higher score first, equal scores by lower node index
+ *
+ * Used as the heap comparison of both top-K queries, so the K-th place is
+ * decided the same way however the candidates arrive. The heap front is
+ * the candidate ranked last, and std::sort_heap leaves best-first order.
+ */
+inline bool ranksBefore(const AnomalyRegion& a, const AnomalyRegion& b) {
+    return a.anomalyScore > b.anomalyScore ||
+           (a.anomalyScore == b.anomalyScore && a.nodeId < b.nodeId);
+}
+
+} // anonymous namespace
+
 // ============================================================================
 // UNION-FIND (DISJOINT SET UNION) IMPLEMENTATION
 // ============================================================================
@@ -35,16 +60,18 @@ namespace SatelliteAnalytics {
  * 
  * OPTIMIZATIONS IMPLEMENTED:
  * 
- * 1. PATH COMPRESSION (in find):
- *    When finding the root, make every node on the path point directly to root.
- *    This flattens the tree structure for faster future queries.
+ * 1. PATH HALVING (in find):
+ *    While walking to the root, point every other node at its grandparent.
+ *    One pass, no recursion, and it flattens the tree about as well as
+ *    full path compression.
  * 
- *    Before: a -> b -> c -> d (root)
- *    After:  a -> d, b -> d, c -> d (all point to root)
+ *    Before: a -> b -> c -> d -> e (root)
+ *    After:  a -> c -> e, b -> c, d -> e
  * 
- * 2. UNION BY RANK:
- *    When merging two trees, attach the smaller tree under the larger one.
- *    This keeps trees balanced and limits height to O(log n).
+ * 2. UNION BY SIZE:
+ *    When merging two trees, attach the lighter tree under the heavier one.
+ *    A node only gets deeper when the weight of its set at least doubles,
+ *    so height stays O(log(total / minimum weight)) even for area weights.
  * 
  * COMPLEXITY with both optimizations:
  *    - Single operation: O(α(n)) amortized, where α is inverse Ackermann
@@ -52,10 +79,14 @@ namespace SatelliteAnalytics {
  *    - Effectively O(1) amortized per operation
  */
 
-UnionFind::UnionFind(int n) : numComponents(n) {
+UnionFind::UnionFind(int n) : numComponents(0) {
+    reset(n);
+}
+
+void UnionFind::reset(int n) {
     parent.resize(n);
-    rank.resize(n, 0);
-    size.resize(n, 1);
+    size.assign(n, 1);
+    numComponents = n;
     
     // Initially, each element is its own parent (self-loop)
     for (int i = 0; i < n; i++) {
@@ -65,29 +96,24 @@ UnionFind::UnionFind(int n) : numComponents(n) {
 
 int UnionFind::find(int x) {
     /**
-     * PATH COMPRESSION:
+     * PATH HALVING:
      * 
-     * Recursively find the root, then make x point directly to it.
-     * This flattens the tree structure, making future finds O(1).
-     * 
-     * Iterative version with path compression:
+     * Each step links x to its grandparent and moves there, halving the
+     * path length on every call without a second pass or recursion.
      */
-    if (parent[x] != x) {
-        parent[x] = find(parent[x]);  // Path compression: point to root
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
     }
-    return parent[x];
+    return x;
 }
 
 bool UnionFind::unite(int x, int y) {
     /**
-     * UNION BY RANK:
-     * 
-     * Always attach the tree with lower rank under the tree with higher rank.
-     * Rank is an upper bound on tree height.
+     * UNION BY SIZE:
      * 
-     * This keeps trees balanced:
-     * - If ranks differ: attach smaller under larger, keep larger rank
-     * - If ranks equal: arbitrary choice, but increment winner's rank
+     * Always attach the lighter tree under the heavier one and add the
+     * weights. Ties go to rootX.
      */
     int rootX = find(x);
     int rootY = find(y);
@@ -96,18 +122,11 @@ bool UnionFind::unite(int x, int y) {
         return false;  // Already in same set
     }
     
-    // Union by rank: attach smaller tree under larger
-    if (rank[rootX] < rank[rootY]) {
-        parent[rootX] = rootY;
-        size[rootY] += size[rootX];
-    } else if (rank[rootX] > rank[rootY]) {
-        parent[rootY] = rootX;
-        size[rootX] += size[rootY];
-    } else {
-        parent[rootY] = rootX;
-        size[rootX] += size[rootY];
-        rank[rootX]++;
+    if (size[rootX] < size[rootY]) {
+        std::swap(rootX, rootY);
     }
+    parent[rootY] = rootX;
+    size[rootX] += size[rootY];
     
     numComponents--;
     return true;
@@ -125,6 +144,21 @@ int64_t UnionFind::getSize(int x) {
     return size[find(x)];
 }
 
+int UnionFind::relabel(std::vector<int>& labels) {
+    const int n = static_cast<int>(parent.size());
+    labels.assign(n, -1);
+    
+    // labels[root] doubles as the root -> label map: a root is labelled the
+    // first time any member is seen, which is never after the root itself
+    int next = 0;
+    for (int i = 0; i < n; i++) {
+        int root = find(i);
+        if (labels[root] < 0) labels[root] = next++;
+        labels[i] = labels[root];
+    }
+    return next;
+}
+
 // ============================================================================
 // QUERY ENGINE IMPLEMENTATION
 // ============================================================================
@@ -137,6 +171,9 @@ void QueryEngine::initialize(const RegionTree* tree, const PrefixSum* prefix,
     regionTree = tree;
     prefixSum = prefix;
     detector = det;
+    
+    leafIndex.clear();
+    if (tree) leafIndex.build(*tree);
 }
 
 bool QueryEngine::areAdjacent(const Region& a, const Region& b) const {
@@ -171,11 +208,151 @@ Region QueryEngine::mergeBounds(const Region& a, const Region& b) const {
     );
 }
 
+// ============================================================================
+// ADJACENCY DISCOVERY (EDGE INDEX)
+// ============================================================================
+
+namespace {
+
+/**
+ * @brief Stable counting sort of indices into buckets [0, numKeys)
+ *
+ * Produces CSR-style output: bucket b holds items[offsets[b] .. offsets[b+1]),
+ * in the same relative order as they appear in order.
+ */
+template <typename KeyFn>
+void bucketByKey(const std::vector<int>& order, int numKeys, KeyFn key,
+                 std::vector<int>& offsets, std::vector<int>& items) {
+    offsets.assign(numKeys + 1, 0);
+    for (int idx : order) offsets[key(idx) + 1]++;
+    for (int b = 0; b < numKeys; b++) offsets[b + 1] += offsets[b];
+
+    items.resize(order.size());
+    std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+    for (int idx : order) items[cursor[key(idx)]++] = idx;
+}
+
+/**
+ * @brief Report all pairs sharing an edge perpendicular to one axis
+ *
+ * For acrossColumns == true the shared edges are vertical: region a lies
+ * left of region b when a.col2 + 1 == b.col1 and their row spans overlap.
+ * Otherwise the roles of rows and columns are swapped.
+ *
+ * Leaves are disjoint, so all regions whose far edge ends at the same line
+ * occupy disjoint spans, and likewise for regions starting at that line.
+ * With both lists sorted by span start, a two-pointer merge emits each
+ * overlapping pair exactly once.
+ */
+void sweepSharedEdges(const std::vector<const RegionTreeNode*>& nodes, bool acrossColumns,
+                      int lineCount, int spanCount,
+                      std::vector<std::pair<int, int>>& edges) {
+    auto spanStart = [&](int i) {
+        return acrossColumns ? nodes[i]->bounds.row1 : nodes[i]->bounds.col1;
+    };
+    auto spanEnd = [&](int i) {
+        return acrossColumns ? nodes[i]->bounds.row2 : nodes[i]->bounds.col2;
+    };
+    auto nearLine = [&](int i) {
+        return acrossColumns ? nodes[i]->bounds.col1 : nodes[i]->bounds.row1;
+    };
+    auto farLine = [&](int i) {
+        return acrossColumns ? nodes[i]->bounds.col2 + 1 : nodes[i]->bounds.row2 + 1;
+    };
+
+    std::vector<int> identity(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) identity[i] = static_cast<int>(i);
+
+    // Order by span start once; the stable bucket passes preserve it
+    std::vector<int> spanOffsets, bySpan;
+    bucketByKey(identity, spanCount, spanStart, spanOffsets, bySpan);
+
+    std::vector<int> farOffsets, farItems, nearOffsets, nearItems;
+    bucketByKey(bySpan, lineCount + 1, farLine, farOffsets, farItems);
+    bucketByKey(bySpan, lineCount + 1, nearLine, nearOffsets, nearItems);
+
+    for (int line = 1; line < lineCount; line++) {
+        int a = farOffsets[line], aEnd = farOffsets[line + 1];
+        int b = nearOffsets[line], bEnd = nearOffsets[line + 1];
+
+        while (a < aEnd && b < bEnd) {
+            int u = farItems[a], v = nearItems[b];
+            if (spanStart(u) <= spanEnd(v) && spanStart(v) <= spanEnd(u)) {
+                edges.emplace_back(std::min(u, v), std::max(u, v));
+            }
+            // Advance whichever span finishes first
+            if (spanEnd(u) < spanEnd(v)) a++;
+            else b++;
+        }
+    }
+}
+
+} // anonymous namespace
+
+std::vector<const RegionTreeNode*> QueryEngine::getAnomalousLeaves() const {
+    std::vector<const RegionTreeNode*> anomalousNodes;
+    if (!regionTree) return anomalousNodes;
+
+    regionTree->traverseLeaves([&](const RegionTreeNode& leaf) {
+        if (leaf.isAnomaly) anomalousNodes.push_back(&leaf);
+    });
+    return anomalousNodes;
+}
+
+std::vector<std::pair<int, int>> QueryEngine::findAdjacentPairs(
+    const std::vector<const RegionTreeNode*>& nodes, AdjacencyMethod method) const {
+    /**
+     * EDGE-INDEX ADJACENCY
+     * ====================
+     *
+     * Two disjoint regions are adjacent exactly when one's far edge line
+     * (col2 + 1 or row2 + 1) equals the other's near edge line (col1 or row1)
+     * and their spans along that line overlap.
+     *
+     * ALGORITHM (per axis):
+     * 1. Counting-sort regions by span start         - O(n + H)
+     * 2. Stable-bucket by far line and by near line  - O(n + W)
+     * 3. For every line, merge the two sorted lists  - O(n) total
+     *
+     * TIME COMPLEXITY: O(n + H + W), versus O(n²) for the pairwise check.
+     */
+
+    std::vector<std::pair<int, int>> edges;
+    int n = nodes.size();
+
+    if (method == AdjacencyMethod::Pairwise) {
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                if (areAdjacent(nodes[i]->bounds, nodes[j]->bounds)) {
+                    edges.emplace_back(i, j);
+                }
+            }
+        }
+        return edges;
+    }
+
+    int height = 0, width = 0;
+    for (const auto* node : nodes) {
+        height = std::max(height, node->bounds.row2 + 1);
+        width = std::max(width, node->bounds.col2 + 1);
+    }
+
+    sweepSharedEdges(nodes, true, width, height, edges);
+    sweepSharedEdges(nodes, false, height, width, edges);
+    return edges;
+}
+
 // ============================================================================
 // TOP-K QUERIES (PRIORITY QUEUE / HEAP)
 // ============================================================================
 
-QueryResult QueryEngine::topKAnomalies(int k, bool leafOnly) {
+QueryResult QueryEngine::topKAnomalies(int k, bool leafOnly) const {
+    QueryResult result;
+    topKAnomalies(k, leafOnly, result);
+    return result;
+}
+
+void QueryEngine::topKAnomalies(int k, bool leafOnly, QueryResult& result) const {
     /**
      * TOP-K ALGORITHM using MIN-HEAP
      * ==============================
@@ -205,141 +382,178 @@ QueryResult QueryEngine::topKAnomalies(int k, bool leafOnly) {
      *   - Much better than O(n log n) when k << n
      * 
      * SPACE COMPLEXITY: O(k)
+     * 
+     * IN-PLACE HEAP:
+     *   The min-heap is kept in result.regions itself with std::push_heap /
+     *   std::pop_heap (the operations std::priority_queue performs), and
+     *   std::sort_heap then leaves it in descending score order with no
+     *   extra storage. Equal scores rank by node index (ranksBefore).
      */
     
+    ProfileScope profile(ProfileZone::TopK);
     Timer timer;
     timer.start();
     
-    QueryResult result;
-    if (!regionTree) return result;
+    result.reset();
+    if (!regionTree || k <= 0) return;
     
-    // Min-heap: smallest score at top
-    // Using std::greater for min-heap behavior
-    std::priority_queue<AnomalyRegion, std::vector<AnomalyRegion>,
-                       std::greater<AnomalyRegion>> minHeap;
+    // Min-heap: lowest-ranked region at top
+    std::vector<AnomalyRegion>& minHeap = result.regions;
+    minHeap.reserve(std::min(k, regionTree->getNodeCount()));
     
-    const auto& nodes = regionTree->getAllNodes();
+    // Stream the score column; bounds are only read for heap candidates
+    const RegionTreeColumns& columns = regionTree->getColumns();
+    const int n = static_cast<int>(columns.size());
+    const double* scores = columns.anomalyScore.data();
     
-    for (const auto& node : nodes) {
+    for (int i = 0; i < n; i++) {
         // Skip non-leaf nodes if requested
-        if (leafOnly && !node.isLeaf()) continue;
+        if (leafOnly && !columns.isLeaf(i)) continue;
         
         result.nodesVisited++;
         
-        AnomalyRegion ar(node.bounds, node.anomalyScore, node.id);
-        
+        AnomalyRegion candidate(columns.bounds[i], scores[i], i);
         if (static_cast<int>(minHeap.size()) < k) {
             // Heap not full yet, just push
-            minHeap.push(ar);
-        } else if (ar.anomalyScore > minHeap.top().anomalyScore) {
-            // New region has higher score than current minimum in top-K
-            minHeap.pop();
-            minHeap.push(ar);
+            minHeap.push_back(candidate);
+            std::push_heap(minHeap.begin(), minHeap.end(), ranksBefore);
+        } else if (ranksBefore(candidate, minHeap.front())) {
+            // New region outranks the current minimum in top-K
+            std::pop_heap(minHeap.begin(), minHeap.end(), ranksBefore);
+            minHeap.back() = candidate;
+            std::push_heap(minHeap.begin(), minHeap.end(), ranksBefore);
         }
         // Else: skip this region (not in top-K)
     }
     
-    // Extract results from heap (will be in ascending order)
-    while (!minHeap.empty()) {
-        result.regions.push_back(minHeap.top());
-        minHeap.pop();
-    }
-    
-    // Reverse to get descending order (highest score first)
-    std::reverse(result.regions.begin(), result.regions.end());
+    // Descending score order (highest score first)
+    std::sort_heap(minHeap.begin(), minHeap.end(), ranksBefore);
     
     timer.stop();
     result.queryTimeMs = timer.elapsedMs();
-    
+    countTraversal(result);
+}
+
+QueryResult QueryEngine::topKWithPruning(int k) const {
+    QueryResult result;
+    QueryScratch scratch;
+    topKWithPruning(k, result, scratch);
     return result;
 }
 
-QueryResult QueryEngine::topKWithPruning(int k) {
+void QueryEngine::topKWithPruning(int k, QueryResult& result, QueryScratch& scratch) const {
     /**
-     * TOP-K WITH TREE PRUNING
-     * =======================
+     * TOP-K WITH TREE PRUNING (BEST-FIRST BRANCH AND BOUND)
+     * =====================================================
      * 
-     * Enhancement: Use tree structure to skip entire subtrees.
+     * Every node carries maxLeafScore, an upper bound on the score of any
+     * leaf in its subtree (computed bottom-up by AnomalyDetector).
      * 
-     * If a subtree's maximum possible score is less than the current
-     * minimum in our top-K heap, we can skip the entire subtree.
+     * ALGORITHM:
+     * 1. Max-priority queue of frontier nodes keyed by their bound
+     * 2. Pop the most promising node:
+     *    - Leaf: offer it to the size-K min-heap of results
+     *    - Internal: push children whose bound can still beat the heap minimum
+     * 3. Stop as soon as the heap is full and the best remaining bound
+     *    cannot beat the heap minimum: no unexplored leaf can enter top-K.
      * 
-     * This is similar to branch-and-bound optimization.
+     * The bound is exact (never underestimates), so the result equals the
+     * full scan. Best-first order fills the heap with strong candidates
+     * early, which tightens the cut-off quickly.
      * 
-     * BEST CASE: O(k log k) if we can prune most of the tree
-     * WORST CASE: O(n log k) if no pruning possible
+     * TIES: results rank as in topKAnomalies() (ranksBefore). Descendants
+     * always have larger indices than their ancestors in both layouts, so
+     * (bound, node index) ranks no worse than any leaf below the node. A
+     * subtree is cut when that key does not outrank the heap minimum, and
+     * the frontier pops equal bounds lowest index first.
+     * 
+     * BEST CASE: O(k · depth · log n) node visits
+     * WORST CASE: O(n log n) if no pruning possible
      */
     
+    ProfileScope profile(ProfileZone::TopKPruned);
     Timer timer;
     timer.start();
     
-    QueryResult result;
-    if (!regionTree) return result;
+    result.reset();
+    if (!regionTree || k <= 0 || regionTree->getNodeCount() == 0) return;
     
-    std::priority_queue<AnomalyRegion, std::vector<AnomalyRegion>,
-                       std::greater<AnomalyRegion>> minHeap;
+    // Both heaps live in reused storage (see topKAnomalies)
+    std::vector<AnomalyRegion>& minHeap = result.regions;
+    minHeap.reserve(std::min(k, regionTree->getLeafCount()));
     
-    std::queue<int> toVisit;
-    toVisit.push(0);  // Start from root
+    std::vector<QueryScratch::Candidate>& frontier = scratch.frontier;  // Max-heap on bound
+    frontier.clear();
+    auto byBound = [](const QueryScratch::Candidate& a, const QueryScratch::Candidate& b) {
+        return a.bound < b.bound || (a.bound == b.bound && a.index > b.index);
+    };
     
+    const RegionTreeColumns& columns = regionTree->getColumns();
     const auto& nodes = regionTree->getAllNodes();
+    const double* bounds = columns.maxLeafScore.data();
     
-    while (!toVisit.empty()) {
-        int idx = toVisit.front();
-        toVisit.pop();
+    auto heapFull = [&]() { return static_cast<int>(minHeap.size()) >= k; };
+    // Can a subtree rooted at idx with this bound still enter the full heap?
+    auto canEnter = [&](double bound, int idx) {
+        const AnomalyRegion& worst = minHeap.front();
+        return bound > worst.anomalyScore || (bound == worst.anomalyScore && idx < worst.nodeId);
+    };
+    
+    frontier.push_back({bounds[0], 0});  // Start from root
+    
+    while (!frontier.empty()) {
+        QueryScratch::Candidate best = frontier.front();
         
-        if (idx < 0 || idx >= static_cast<int>(nodes.size())) continue;
+        // Nothing left in the frontier can beat the current K-th score
+        if (heapFull() && !canEnter(best.bound, best.index)) {
+            result.nodesPruned += static_cast<int>(frontier.size());
+            break;
+        }
         
-        const auto& node = nodes[idx];
+        std::pop_heap(frontier.begin(), frontier.end(), byBound);
+        frontier.pop_back();
         result.nodesVisited++;
         
-        // Pruning condition: if heap is full and this node's score
-        // is less than the minimum in heap, skip subtree
-        bool canPrune = static_cast<int>(minHeap.size()) >= k && 
-                       node.anomalyScore < minHeap.top().anomalyScore;
-        
-        if (canPrune && !node.isLeaf()) {
-            result.nodesPruned++;
-            continue;  // Skip this subtree
+        int idx = best.index;
+        if (columns.isLeaf(idx)) {
+            AnomalyRegion candidate(columns.bounds[idx], columns.anomalyScore[idx], idx);
+            if (!heapFull()) {
+                minHeap.push_back(candidate);
+                std::push_heap(minHeap.begin(), minHeap.end(), ranksBefore);
+            } else if (ranksBefore(candidate, minHeap.front())) {
+                std::pop_heap(minHeap.begin(), minHeap.end(), ranksBefore);
+                minHeap.back() = candidate;
+                std::push_heap(minHeap.begin(), minHeap.end(), ranksBefore);
+            }
+            continue;
         }
         
-        if (node.isLeaf()) {
-            AnomalyRegion ar(node.bounds, node.anomalyScore, node.id);
+        for (int i = 0; i < 4; i++) {
+            int child = nodes[idx].children[i];
+            if (child < 0) continue;
             
-            if (static_cast<int>(minHeap.size()) < k) {
-                minHeap.push(ar);
-            } else if (ar.anomalyScore > minHeap.top().anomalyScore) {
-                minHeap.pop();
-                minHeap.push(ar);
-            }
-        } else {
-            // Add children to visit queue
-            for (int i = 0; i < 4; i++) {
-                if (node.children[i] >= 0) {
-                    toVisit.push(node.children[i]);
-                }
+            if (heapFull() && !canEnter(bounds[child], child)) {
+                result.nodesPruned++;  // Skip this subtree
+            } else {
+                frontier.push_back({bounds[child], child});
+                std::push_heap(frontier.begin(), frontier.end(), byBound);
             }
         }
     }
     
-    // Extract and reverse results
-    while (!minHeap.empty()) {
-        result.regions.push_back(minHeap.top());
-        minHeap.pop();
-    }
-    std::reverse(result.regions.begin(), result.regions.end());
+    // Descending score order
+    std::sort_heap(minHeap.begin(), minHeap.end(), ranksBefore);
     
     timer.stop();
     result.queryTimeMs = timer.elapsedMs();
-    
-    return result;
+    countTraversal(result);
 }
 
 // ============================================================================
 // CONNECTED COMPONENT DETECTION (UNION-FIND)
 // ============================================================================
 
-std::vector<ConnectedComponent> QueryEngine::findConnectedComponents() {
+std::vector<ConnectedComponent> QueryEngine::findConnectedComponents(AdjacencyMethod method) const {
     /**
      * CONNECTED COMPONENTS using UNION-FIND
      * =====================================
@@ -352,27 +566,21 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponents() {
      * 1. Get all anomalous leaf nodes
      * 2. Create Union-Find with n elements (one per anomalous node)
      * 3. For each pair of adjacent anomalous nodes: UNION them
-     * 4. Group nodes by their FIND (root) to form components
+     * 4. Relabel roots densely and counting-sort nodes into components
      * 
-     * TIME COMPLEXITY: O(n² × α(n)) for pairwise adjacency check
+     * TIME COMPLEXITY: O((n + H + W) × α(n)) using the edge index
      *   - The α(n) factor is from Union-Find operations
      *   - α(n) is effectively constant (< 5 for any practical n)
-     * 
-     * Could be optimized to O(n log n) using spatial indexing.
+     *   - AdjacencyMethod::Pairwise keeps the original O(n²) check
      */
     
+    ProfileScope profile(ProfileZone::Components);
+    
     std::vector<ConnectedComponent> components;
     if (!regionTree) return components;
     
     // Get all anomalous leaf nodes
-    std::vector<const RegionTreeNode*> anomalousNodes;
-    auto leaves = regionTree->getLeaves();
-    
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) {
-            anomalousNodes.push_back(leaf);
-        }
-    }
+    std::vector<const RegionTreeNode*> anomalousNodes = getAnomalousLeaves();
     
     int n = anomalousNodes.size();
     if (n == 0) return components;
@@ -385,64 +593,73 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponents() {
         uf.setSize(i, anomalousNodes[i]->bounds.area());
     }
     
-    // Check all pairs for adjacency - O(n²)
+    // Merge every adjacent pair (sizes are summed in unite())
+    for (const auto& [i, j] : findAdjacentPairs(anomalousNodes, method)) {
+        uf.unite(i, j);
+    }
+    
+    // Group nodes by component with a counting sort: one flat member array
+    // plus per-component offsets, no per-group containers
+    std::vector<int> label;
+    int numComponents = uf.relabel(label);
+    
+    std::vector<int> offsets(numComponents + 1, 0);
     for (int i = 0; i < n; i++) {
-        for (int j = i + 1; j < n; j++) {
-            if (areAdjacent(anomalousNodes[i]->bounds, anomalousNodes[j]->bounds)) {
-                // Merge these two regions into the same component
-                if (uf.unite(i, j)) {
-                    // Update the size to be sum of areas
-                    int root = uf.find(i);
-                    // Size is already updated in unite()
-                }
-            }
-        }
+        offsets[label[i] + 1]++;
+    }
+    for (int c = 0; c < numComponents; c++) {
+        offsets[c + 1] += offsets[c];
     }
     
-    // Group nodes by their root
-    std::unordered_map<int, std::vector<int>> rootToNodes;
+    std::vector<int> members(n);
+    std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
     for (int i = 0; i < n; i++) {
-        int root = uf.find(i);
-        rootToNodes[root].push_back(i);
+        members[cursor[label[i]]++] = i;
     }
     
     // Build component structures
-    int componentId = 0;
-    for (const auto& [root, nodeIndices] : rootToNodes) {
-        ConnectedComponent comp;
-        comp.id = componentId++;
+    components.resize(numComponents);
+    for (int c = 0; c < numComponents; c++) {
+        ConnectedComponent& comp = components[c];
+        comp.id = c;
         comp.totalArea = 0;
         comp.maxScore = 0;
         double scoreSum = 0;
+        double intensitySum = 0;
+        
+        const int first = offsets[c];
+        const int last = offsets[c + 1];
         
         // Initialize bounding box
-        comp.boundingBox = anomalousNodes[nodeIndices[0]]->bounds;
+        comp.boundingBox = anomalousNodes[members[first]]->bounds;
+        comp.nodeIndices.reserve(last - first);
         
-        for (int idx : nodeIndices) {
-            const auto* node = anomalousNodes[idx];
+        for (int m = first; m < last; m++) {
+            const auto* node = anomalousNodes[members[m]];
             comp.nodeIndices.push_back(node->id);
             comp.totalArea += node->bounds.area();
             comp.maxScore = std::max(comp.maxScore, node->anomalyScore);
             scoreSum += node->anomalyScore;
+            intensitySum += node->stats.mean * node->bounds.area();
             
             // Expand bounding box
             comp.boundingBox = mergeBounds(comp.boundingBox, node->bounds);
         }
         
-        comp.avgScore = scoreSum / nodeIndices.size();
-        components.push_back(comp);
+        comp.avgScore = scoreSum / (last - first);
+        comp.meanIntensity = intensitySum / comp.totalArea;
     }
     
-    // Sort by total area (descending)
-    std::sort(components.begin(), components.end(),
-              [](const ConnectedComponent& a, const ConnectedComponent& b) {
-                  return a.totalArea > b.totalArea;
-              });
+    // Sort by total area (descending); ties keep component id order
+    std::stable_sort(components.begin(), components.end(),
+                     [](const ConnectedComponent& a, const ConnectedComponent& b) {
+                         return a.totalArea > b.totalArea;
+                     });
     
     return components;
 }
 
-ConnectedComponent QueryEngine::findLargestConnectedRegion() {
+ConnectedComponent QueryEngine::findLargestConnectedRegion() const {
     auto components = findConnectedComponents();
     
     if (components.empty()) {
@@ -453,7 +670,7 @@ ConnectedComponent QueryEngine::findLargestConnectedRegion() {
     return components[0];
 }
 
-std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
+std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS(AdjacencyMethod method) const {
     /**
      * ALTERNATIVE: DFS-based Connected Components
      * ===========================================
@@ -465,34 +682,26 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
      * 2. For each unvisited node, run DFS to explore component
      * 3. All nodes reached in one DFS form a component
      * 
-     * TIME COMPLEXITY: O(n + m) where m = number of edges (adjacencies)
-     * SPACE COMPLEXITY: O(n) for visited array and stack
+     * TIME COMPLEXITY: O(n + m) where m = number of edges (adjacencies),
+     *   plus O(H + W) to build the edge index
+     * SPACE COMPLEXITY: O(n + m) for adjacency lists, visited array and stack
      */
     
+    ProfileScope profile(ProfileZone::Components);
+    
     std::vector<ConnectedComponent> components;
     if (!regionTree) return components;
     
-    std::vector<const RegionTreeNode*> anomalousNodes;
-    auto leaves = regionTree->getLeaves();
-    
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) {
-            anomalousNodes.push_back(leaf);
-        }
-    }
+    std::vector<const RegionTreeNode*> anomalousNodes = getAnomalousLeaves();
     
     int n = anomalousNodes.size();
     if (n == 0) return components;
     
     // Build adjacency list
     std::vector<std::vector<int>> adj(n);
-    for (int i = 0; i < n; i++) {
-        for (int j = i + 1; j < n; j++) {
-            if (areAdjacent(anomalousNodes[i]->bounds, anomalousNodes[j]->bounds)) {
-                adj[i].push_back(j);
-                adj[j].push_back(i);
-            }
-        }
+    for (const auto& [i, j] : findAdjacentPairs(anomalousNodes, method)) {
+        adj[i].push_back(j);
+        adj[j].push_back(i);
     }
     
     // DFS to find components
@@ -508,6 +717,7 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
         comp.totalArea = 0;
         comp.maxScore = 0;
         double scoreSum = 0;
+        double intensitySum = 0;
         
         std::stack<int> stack;
         stack.push(start);
@@ -526,6 +736,7 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
             comp.totalArea += node->bounds.area();
             comp.maxScore = std::max(comp.maxScore, node->anomalyScore);
             scoreSum += node->anomalyScore;
+            intensitySum += node->stats.mean * node->bounds.area();
             
             if (first) {
                 comp.boundingBox = node->bounds;
@@ -543,6 +754,7 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
         }
         
         comp.avgScore = scoreSum / comp.nodeIndices.size();
+        comp.meanIntensity = intensitySum / comp.totalArea;
         components.push_back(comp);
     }
     
@@ -559,19 +771,26 @@ std::vector<ConnectedComponent> QueryEngine::findConnectedComponentsDFS() {
 // REGION QUERIES
 // ============================================================================
 
-QueryResult QueryEngine::queryRectangle(const Region& queryRegion) {
+QueryResult QueryEngine::queryRectangle(const Region& queryRegion) const {
+    QueryResult result;
+    queryRectangle(queryRegion, result);
+    return result;
+}
+
+void QueryEngine::queryRectangle(const Region& queryRegion, QueryResult& result) const {
+    ProfileScope profile(ProfileZone::Rectangle);
     Timer timer;
     timer.start();
     
-    QueryResult result;
-    if (!regionTree) return result;
-    
-    auto matchingNodes = regionTree->queryRegion(queryRegion);
+    result.reset();
+    if (!regionTree) return;
     
-    for (const auto* node : matchingNodes) {
+    // Intersecting leaves straight from the cell grid; only hits touch bounds
+    const RegionTreeColumns& columns = regionTree->getColumns();
+    for (int idx : leafIndex.leavesIn(queryRegion)) {
         result.nodesVisited++;
-        if (node->isAnomaly) {
-            result.regions.emplace_back(node->bounds, node->anomalyScore, node->id);
+        if (columns.isAnomaly[idx]) {
+            result.regions.emplace_back(columns.bounds[idx], columns.anomalyScore[idx], idx);
         }
     }
     
@@ -583,22 +802,64 @@ QueryResult QueryEngine::queryRectangle(const Region& queryRegion) {
     
     timer.stop();
     result.queryTimeMs = timer.elapsedMs();
+    countTraversal(result);
+}
+
+void QueryEngine::topNInRectangle(const Region& queryRegion, int n, QueryResult& result) const {
+    ProfileScope profile(ProfileZone::RectangleTopN);
+    Timer timer;
+    timer.start();
     
-    return result;
+    result.reset();
+    if (!regionTree || n <= 0) return;
+    
+    // Same in-place min-heap as topKAnomalies(), fed by the leaf index
+    const RegionTreeColumns& columns = regionTree->getColumns();
+    std::vector<AnomalyRegion>& minHeap = result.regions;
+    for (int idx : leafIndex.leavesIn(queryRegion)) {
+        result.nodesVisited++;
+        if (!columns.isAnomaly[idx]) continue;
+        
+        const double score = columns.anomalyScore[idx];
+        if (static_cast<int>(minHeap.size()) < n) {
+            minHeap.emplace_back(columns.bounds[idx], score, idx);
+            std::push_heap(minHeap.begin(), minHeap.end());
+        } else if (score > minHeap.front().anomalyScore) {
+            std::pop_heap(minHeap.begin(), minHeap.end());
+            minHeap.back() = AnomalyRegion(columns.bounds[idx], score, idx);
+            std::push_heap(minHeap.begin(), minHeap.end());
+        }
+    }
+    std::sort_heap(minHeap.begin(), minHeap.end());
+    
+    timer.stop();
+    result.queryTimeMs = timer.elapsedMs();
+    countTraversal(result);
 }
 
-RegionStats QueryEngine::queryRegionStats(const Region& region) {
+RegionStats QueryEngine::queryRegionStats(const Region& region) const {
     if (!prefixSum) return RegionStats();
+    ProfileScope profile(ProfileZone::RegionStats);
     return prefixSum->queryStats(region);
 }
 
+std::vector<RegionStats> QueryEngine::queryRegionStatsBatch(const std::vector<Region>& regions) const {
+    std::vector<RegionStats> stats(regions.size());
+    if (prefixSum) {
+        prefixSum->queryStatsBatch(regions.data(), regions.size(), stats.data());
+    }
+    return stats;
+}
+
 int QueryEngine::countAnomalousRegions() const {
     if (!regionTree) return 0;
     
+    const RegionTreeColumns& columns = regionTree->getColumns();
+    const int n = static_cast<int>(columns.size());
+    
     int count = 0;
-    auto leaves = regionTree->getLeaves();
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) count++;
+    for (int i = 0; i < n; i++) {
+        if (columns.isAnomaly[i] && columns.isLeaf(i)) count++;
     }
     return count;
 }
@@ -606,11 +867,13 @@ int QueryEngine::countAnomalousRegions() const {
 int64_t QueryEngine::getTotalAnomalousArea() const {
     if (!regionTree) return 0;
     
+    const RegionTreeColumns& columns = regionTree->getColumns();
+    const int n = static_cast<int>(columns.size());
+    
     int64_t total = 0;
-    auto leaves = regionTree->getLeaves();
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) {
-            total += leaf->bounds.area();
+    for (int i = 0; i < n; i++) {
+        if (columns.isAnomaly[i] && columns.isLeaf(i)) {
+            total += columns.bounds[i].area();
         }
     }
     return total;
@@ -0,0 +1,559 @@
+/**
+ * @file QueryServer.cpp
+ * @brief Implementation of the resident-scene query server
+ */
+
+#include "QueryServer.h"
+#include "ImageLoader.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SATELLITE_HAVE_SOCKETS 1
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+/**
+ * @brief Query result and scratch of the calling thread
+ *
+ * Requests run on pool workers; reusing one set per thread keeps top-K and
+ * rectangle queries free of heap allocation once the buffers have grown.
+ */
+struct QueryBuffers {
+    QueryResult result;
+    QueryScratch scratch;
+};
+
+QueryBuffers& threadQueryBuffers() {
+    thread_local QueryBuffers buffers;
+    return buffers;
+}
+
+std::vector<std::string> splitWords(const std::string& line) {
+    std::vector<std::string> words;
+    std::istringstream in(line);
+    std::string word;
+    while (in >> word) words.push_back(word);
+    return words;
+}
+
+/**
+ * @brief Strict integer parse (no exceptions, no trailing characters)
+ */
+bool parseInt(const std::string& text, int& value) {
+    errno = 0;
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str() || *end != '\0' ||
+        parsed < std::numeric_limits<int>::min() || parsed > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool parseDouble(const std::string& text, double& value) {
+    errno = 0;
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return errno == 0 && end != text.c_str() && *end == '\0';
+}
+
+std::string errorResponse(const std::string& message) {
+    return "ERR " + message + "\n";
+}
+
+/**
+ * @brief "OK <lines> [extra]" header followed by the data lines
+ */
+std::string okResponse(const std::vector<std::string>& lines, const std::string& extra = "") {
+    std::ostringstream out;
+    out << "OK " << lines.size();
+    if (!extra.empty()) out << " " << extra;
+    out << "\n";
+    for (const std::string& line : lines) out << line << "\n";
+    return out.str();
+}
+
+std::string formatRegion(const AnomalyRegion& region) {
+    std::ostringstream out;
+    out << region.region.row1 << " " << region.region.col1 << " "
+        << region.region.row2 << " " << region.region.col2 << " "
+        << std::setprecision(10) << region.anomalyScore << " " << region.region.area();
+    return out.str();
+}
+
+} // anonymous namespace
+
+QueryServer::QueryServer(const ServerConfig& cfg)
+    : config(cfg), stopping(false), listenSocket(-1) {}
+
+QueryServer::~QueryServer() {
+    shutdown();
+}
+
+// ============================================================================
+// SCENE REGISTRY
+// ============================================================================
+
+std::shared_ptr<Scene> QueryServer::findScene(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(scenesMutex);
+    auto it = scenes.find(name);
+    return it == scenes.end() ? nullptr : it->second;
+}
+
+void QueryServer::publish(const std::shared_ptr<Scene>& scene) {
+    std::unique_lock<std::shared_mutex> lock(scenesMutex);
+    scenes[scene->name] = scene;
+}
+
+bool QueryServer::unloadScene(const std::string& name) {
+    std::unique_lock<std::shared_mutex> lock(scenesMutex);
+    return scenes.erase(name) > 0;
+}
+
+void QueryServer::finishScene(Scene& scene) {
+    scene.detector = AnomalyDetector(scene.threshold);
+    scene.detector.initialize(scene.prefixSum);
+    if (!scene.index || !scene.index->isScoredAt(scene.detector)) {
+        scene.detector.detectInTree(*scene.regionTree);
+    }
+    scene.engine.initialize(scene.regionTree, scene.prefixSum, &scene.detector);
+}
+
+std::shared_ptr<Scene> QueryServer::loadScene(const std::string& name, const std::string& path,
+                                              double threshold, std::string& error) {
+    Timer timer;
+    timer.start();
+
+    auto scene = std::make_shared<Scene>();
+    scene->name = name;
+    scene->source = path;
+    scene->threshold = threshold >= 0 ? threshold : config.threshold;
+
+    if (SceneIndex::isIndexFile(path)) {
+        scene->index.reset(new SceneIndex());
+        if (!scene->index->open(path)) {
+            error = "cannot open index " + path;
+            return nullptr;
+        }
+        scene->prefixSum = &scene->index->getPrefixSum();
+        scene->regionTree = &scene->index->getRegionTreeMutable();
+    } else {
+        // The image is only needed to build the tables; it is freed on return
+        ImageLoader loader;
+        if (!loader.loadFromPGM(path)) {
+            error = "cannot load image " + path;
+            return nullptr;
+        }
+        scene->ownedPrefix.build(loader.getImage(), config.prefixStorage);
+        scene->ownedTree.build(&scene->ownedPrefix, config.minRegionSize, config.treeLayout);
+        scene->prefixSum = &scene->ownedPrefix;
+        scene->regionTree = &scene->ownedTree;
+    }
+
+    finishScene(*scene);
+    timer.stop();
+    scene->loadTimeMs = timer.elapsedMs();
+    publish(scene);
+    return scene;
+}
+
+std::shared_ptr<Scene> QueryServer::generateScene(const std::string& name, int size,
+                                                  int anomalies, unsigned int seed,
+                                                  std::string& error) {
+    if (size < 2 || anomalies < 0) {
+        error = "invalid scene size or anomaly count";
+        return nullptr;
+    }
+
+    Timer timer;
+    timer.start();
+
+    auto scene = std::make_shared<Scene>();
+    scene->name = name;
+    scene->source = "synthetic:" + std::to_string(size) + "x" + std::to_string(size);
+    scene->threshold = config.threshold;
+    {
+        ImageLoader loader;
+        loader.generateSyntheticImage(size, anomalies, seed);
+        scene->ownedPrefix.build(loader.getImage(), config.prefixStorage);
+    }
+    scene->ownedTree.build(&scene->ownedPrefix, config.minRegionSize, config.treeLayout);
+    scene->prefixSum = &scene->ownedPrefix;
+    scene->regionTree = &scene->ownedTree;
+
+    finishScene(*scene);
+    timer.stop();
+    scene->loadTimeMs = timer.elapsedMs();
+    publish(scene);
+    return scene;
+}
+
+std::string QueryServer::describeScene(const Scene& scene) const {
+    std::ostringstream out;
+    out << scene.name << " " << scene.prefixSum->getHeight() << "x" << scene.prefixSum->getWidth()
+        << " nodes=" << scene.regionTree->getNodeCount()
+        << " leaves=" << scene.regionTree->getLeafCount()
+        << " threshold=" << scene.threshold
+        << " mapped=" << (scene.index ? 1 : 0)
+        << " load_ms=" << std::fixed << std::setprecision(3) << scene.loadTimeMs
+        << " source=" << scene.source;
+    return out.str();
+}
+
+// ============================================================================
+// REQUEST HANDLING
+// ============================================================================
+
+std::string QueryServer::handleRequest(const std::string& line) {
+    std::vector<std::string> words = splitWords(line);
+    if (words.empty()) return errorResponse("empty request");
+
+    const std::string& command = words[0];
+    const size_t argc = words.size() - 1;
+
+    if (command == "ping" || command == "quit") return okResponse({});
+    if (command == "shutdown") {
+        shutdown();
+        return okResponse({});
+    }
+
+    if (command == "scenes") {
+        std::vector<std::shared_ptr<Scene>> snapshot;
+        {
+            std::shared_lock<std::shared_mutex> lock(scenesMutex);
+            for (const auto& entry : scenes) snapshot.push_back(entry.second);
+        }
+        std::vector<std::string> lines;
+        for (const auto& scene : snapshot) lines.push_back(describeScene(*scene));
+        return okResponse(lines);
+    }
+
+    if (command == "load") {
+        double threshold = -1;
+        if ((argc != 2 && argc != 3) || (argc == 3 && !parseDouble(words[3], threshold))) {
+            return errorResponse("usage: load NAME PATH [THRESHOLD]");
+        }
+        std::string error;
+        std::shared_ptr<Scene> scene = loadScene(words[1], words[2], threshold, error);
+        if (!scene) return errorResponse(error);
+        return okResponse({describeScene(*scene)});
+    }
+
+    if (command == "generate") {
+        int size = 0, anomalies = 0, seed = 42;
+        if ((argc != 3 && argc != 4) || !parseInt(words[2], size) ||
+            !parseInt(words[3], anomalies) || (argc == 4 && !parseInt(words[4], seed))) {
+            return errorResponse("usage: generate NAME SIZE ANOMALIES [SEED]");
+        }
+        std::string error;
+        std::shared_ptr<Scene> scene =
+            generateScene(words[1], size, anomalies, static_cast<unsigned int>(seed), error);
+        if (!scene) return errorResponse(error);
+        return okResponse({describeScene(*scene)});
+    }
+
+    if (command == "unload") {
+        if (argc != 1) return errorResponse("usage: unload NAME");
+        if (!unloadScene(words[1])) return errorResponse("no scene named " + words[1]);
+        return okResponse({});
+    }
+
+    // Everything below queries a loaded scene
+    if (command != "topk" && command != "rect" && command != "stats" && command != "components") {
+        return errorResponse("unknown command " + command);
+    }
+    if (argc < 1) return errorResponse("usage: " + command + " NAME ...");
+
+    std::shared_ptr<Scene> scene = findScene(words[1]);
+    if (!scene) return errorResponse("no scene named " + words[1]);
+
+    auto parseRegion = [&](size_t first, Region& region) {
+        return parseInt(words[first], region.row1) && parseInt(words[first + 1], region.col1) &&
+               parseInt(words[first + 2], region.row2) && parseInt(words[first + 3], region.col2);
+    };
+
+    if (command == "topk") {
+        int k = 0;
+        if (argc != 2 || !parseInt(words[2], k) || k <= 0) return errorResponse("usage: topk NAME K");
+
+        QueryBuffers& buffers = threadQueryBuffers();
+        const QueryResult& result = buffers.result;
+        scene->engine.topKWithPruning(k, buffers.result, buffers.scratch);
+        std::vector<std::string> lines;
+        for (const AnomalyRegion& region : result.regions) lines.push_back(formatRegion(region));
+        return okResponse(lines, "visited=" + std::to_string(result.nodesVisited) +
+                                 " pruned=" + std::to_string(result.nodesPruned));
+    }
+
+    if (command == "rect") {
+        Region query;
+        if (argc != 5 || !parseRegion(2, query)) return errorResponse("usage: rect NAME R1 C1 R2 C2");
+
+        QueryBuffers& buffers = threadQueryBuffers();
+        const QueryResult& result = buffers.result;
+        scene->engine.queryRectangle(query, buffers.result);
+        std::vector<std::string> lines;
+        for (const AnomalyRegion& region : result.regions) lines.push_back(formatRegion(region));
+        return okResponse(lines);
+    }
+
+    if (command == "stats") {
+        if (argc < 5 || (argc - 1) % 4 != 0) {
+            return errorResponse("usage: stats NAME R1 C1 R2 C2 [R1 C1 R2 C2 ...]");
+        }
+        std::vector<Region> queries((argc - 1) / 4);
+        for (size_t q = 0; q < queries.size(); q++) {
+            if (!parseRegion(2 + 4 * q, queries[q])) return errorResponse("invalid rectangle");
+        }
+
+        std::vector<RegionStats> stats(queries.size());
+        scene->prefixSum->queryStatsBatch(queries.data(), queries.size(), stats.data());
+
+        std::vector<std::string> lines;
+        for (const RegionStats& s : stats) {
+            std::ostringstream out;
+            out << s.sum << " " << s.area << " " << std::setprecision(10)
+                << s.mean << " " << s.variance << " " << s.stdDev;
+            lines.push_back(out.str());
+        }
+        return okResponse(lines);
+    }
+
+    // components
+    int maxRows = 20;
+    if (argc > 2 || (argc == 2 && (!parseInt(words[2], maxRows) || maxRows < 0))) {
+        return errorResponse("usage: components NAME [MAX]");
+    }
+    std::vector<ConnectedComponent> components = scene->engine.findConnectedComponents();
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < components.size() && static_cast<int>(i) < maxRows; i++) {
+        const ConnectedComponent& comp = components[i];
+        std::ostringstream out;
+        out << comp.id << " " << comp.nodeIndices.size() << " " << comp.totalArea << " "
+            << comp.boundingBox.row1 << " " << comp.boundingBox.col1 << " "
+            << comp.boundingBox.row2 << " " << comp.boundingBox.col2 << " "
+            << std::setprecision(10) << comp.maxScore << " " << comp.avgScore;
+        lines.push_back(out.str());
+    }
+    return okResponse(lines, "total=" + std::to_string(components.size()));
+}
+
+// ============================================================================
+// TRANSPORTS
+// ============================================================================
+
+void QueryServer::serveLines(const std::function<bool(std::string&)>& readLine,
+                             const std::function<void(const std::string&)>& write) {
+    /**
+     * PIPELINING
+     *
+     * Requests are submitted to the shared pool as soon as they are read,
+     * and their futures queued in arrival order. Finished responses are
+     * written from the front of the queue only, so clients always see
+     * responses in request order. At most maxInFlight requests are queued
+     * per connection; beyond that, reading waits for the oldest one.
+     *
+     * Commands that change the scene set (load, generate, unload) are
+     * barriers: earlier requests finish first, and later ones are only
+     * read once the change is visible, so "generate a ..." followed by
+     * "topk a 5" on one connection always finds scene a.
+     */
+    ThreadPool& pool = ThreadPool::shared();
+    std::deque<std::future<std::string>> inFlight;
+
+    auto flush = [&](bool wait) {
+        while (!inFlight.empty()) {
+            std::future<std::string>& front = inFlight.front();
+            if (!wait && front.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+            write(front.get());
+            inFlight.pop_front();
+        }
+    };
+
+    std::string line;
+    while (!stopping.load() && readLine(line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+        std::vector<std::string> words = splitWords(line);
+        if (words[0] == "quit" || words[0] == "shutdown") {
+            // Answer everything before this request, then stop reading
+            flush(true);
+            write(handleRequest(line));
+            return;
+        }
+        if (words[0] == "load" || words[0] == "generate" || words[0] == "unload") {
+            // Run on this thread so scene builds can still use the whole pool
+            flush(true);
+            write(handleRequest(line));
+            continue;
+        }
+
+        inFlight.push_back(pool.submit([this, line]() { return handleRequest(line); }));
+        while (static_cast<int>(inFlight.size()) >= config.maxInFlight) {
+            write(inFlight.front().get());
+            inFlight.pop_front();
+        }
+        flush(false);
+    }
+    flush(true);
+}
+
+void QueryServer::serveStream(std::istream& in, std::ostream& out) {
+    serveLines([&](std::string& line) { return static_cast<bool>(std::getline(in, line)); },
+               [&](const std::string& response) { out << response << std::flush; });
+}
+
+#ifdef SATELLITE_HAVE_SOCKETS
+
+void QueryServer::serveClient(int socket) {
+    std::string buffer;
+    size_t scanned = 0;
+
+    auto readLine = [&](std::string& line) {
+        for (;;) {
+            size_t newline = buffer.find('\n', scanned);
+            if (newline != std::string::npos) {
+                line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                scanned = 0;
+                return true;
+            }
+            scanned = buffer.size();
+
+            char chunk[4096];
+            ssize_t received = recv(socket, chunk, sizeof(chunk), 0);
+            if (received <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(received));
+        }
+    };
+    auto write = [&](const std::string& response) {
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = send(socket, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += static_cast<size_t>(n);
+        }
+    };
+
+    serveLines(readLine, write);
+}
+
+bool QueryServer::serveTcp(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot create socket" << std::endl;
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(fd, 16) != 0) {
+        std::cerr << "Error: Cannot listen on 127.0.0.1:" << port << std::endl;
+        ::close(fd);
+        return false;
+    }
+    listenSocket.store(fd);
+    std::cerr << "Listening on 127.0.0.1:" << port << std::endl;
+
+    // Each connection flags itself done when its thread is about to exit;
+    // finished threads are joined on the next accept, so a long-running
+    // server holds one thread per live connection, not per connection served
+    struct Connection {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<Connection> connections;
+    auto reapFinished = [&connections]() {
+        auto finished = std::partition(connections.begin(), connections.end(),
+                                       [](const Connection& c) { return !c.done->load(); });
+        for (auto it = finished; it != connections.end(); ++it) it->thread.join();
+        connections.erase(finished, connections.end());
+    };
+
+    while (!stopping.load()) {
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;  // Listening socket shut down
+        }
+        reapFinished();
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clientSockets.push_back(client);
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        connections.push_back({std::thread([this, client, done]() {
+            serveClient(client);
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                clientSockets.erase(std::remove(clientSockets.begin(), clientSockets.end(), client),
+                                    clientSockets.end());
+            }
+            ::close(client);
+            // A client asking for shutdown stops the accept loop too
+            if (stopping.load()) shutdown();
+            done->store(true);
+        }), done});
+    }
+
+    for (Connection& connection : connections) connection.thread.join();
+    int listening = listenSocket.exchange(-1);
+    if (listening >= 0) ::close(listening);
+    return true;
+}
+
+void QueryServer::shutdown() {
+    stopping.store(true);
+
+    // Wake accept() and blocked recv() calls; descriptors are closed by their
+    // owners. Clients keep their write side so pending responses still go out.
+    int listening = listenSocket.load();
+    if (listening >= 0) ::shutdown(listening, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    for (int client : clientSockets) ::shutdown(client, SHUT_RD);
+}
+
+#else
+
+void QueryServer::serveClient(int) {}
+
+bool QueryServer::serveTcp(int) {
+    std::cerr << "Error: TCP serving is not supported on this platform" << std::endl;
+    return false;
+}
+
+void QueryServer::shutdown() {
+    stopping.store(true);
+}
+
+#endif
+
+} // namespace SatelliteAnalytics
@@ -14,6 +14,7 @@
  * 3. COMBINE: Each internal node aggregates information from its children
  * 
  * Base Case: When region size <= MIN_REGION_SIZE, create a leaf node
+ *            (adaptive mode: also when the region's variance is within tolerance)
  * 
  * COMPLEXITY ANALYSIS:
  * ====================
@@ -30,23 +31,59 @@
  * Build Time: O(n²/B²) - proportional to number of nodes
  *             Each node does O(1) work using prefix sums
  * 
- * Space: O(n²/B²) for storing all nodes
+ * Space: O(n²/B²) for storing all nodes (an upper bound in adaptive mode)
  * 
  * Query Traversal: O(result size + log n) with pruning
  */
 
 #include "RegionTree.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
 #include <iostream>
 #include <iomanip>
-#include <queue>
 #include <algorithm>
 
 namespace SatelliteAnalytics {
 
+namespace {
+
+/**
+ * EXACT NODE COUNT (memoized divide and conquer)
+ * 
+ * splitRegion() gives the top quadrants ceil(h/2) rows and the bottom ones
+ * floor(h/2) rows (same for columns), independent of the region's position.
+ * So count(h, w) = 1 + count of the four (h', w') children, and only a
+ * handful of distinct sizes ever occur per level.
+ */
+int64_t countSubtreeNodes(int regionHeight, int regionWidth, int minSize,
+                          std::map<std::pair<int, int>, int64_t>& memo) {
+    auto key = std::make_pair(regionHeight, regionWidth);
+    auto it = memo.find(key);
+    if (it != memo.end()) return it->second;
+    
+    int64_t count = 1;
+    if (regionHeight > minSize && regionWidth > minSize) {
+        int topRows = (regionHeight + 1) / 2;
+        int bottomRows = regionHeight / 2;
+        int leftCols = (regionWidth + 1) / 2;
+        int rightCols = regionWidth / 2;
+        
+        count += countSubtreeNodes(topRows, leftCols, minSize, memo);
+        count += countSubtreeNodes(topRows, rightCols, minSize, memo);
+        count += countSubtreeNodes(bottomRows, leftCols, minSize, memo);
+        count += countSubtreeNodes(bottomRows, rightCols, minSize, memo);
+    }
+    
+    memo.emplace(key, count);
+    return count;
+}
+
+} // anonymous namespace
+
 RegionTree::RegionTree() 
     : prefixSum(nullptr), rootIndex(-1), nodeCount(0), 
-      leafCount(0), maxDepth(0), minRegionSize(Config::MIN_REGION_SIZE),
-      buildTimeMs(0) {}
+      leafCount(0), maxDepth(0), minRegionSize(Config::MIN_REGION_SIZE), splitVariance(0),
+      layout(TreeLayout::DepthFirst), buildTimeMs(0) {}
 
 void RegionTree::splitRegion(const Region& region, Region quadrants[4]) const {
     int midRow = (region.row1 + region.row2) / 2;
@@ -72,7 +109,115 @@ void RegionTree::computeNodeStats(RegionTreeNode& node) {
     node.stats = prefixSum->queryStats(node.bounds);
 }
 
-int RegionTree::buildRecursive(const Region& region, int depth, int parentIdx) {
+void RegionTree::initNode(int nodeIdx, const Region& region, int depth, int parentIdx) {
+    RegionTreeNode& node = nodes[nodeIdx];
+    
+    node.id = nodeIdx;
+    node.bounds = region;
+    node.depth = depth;
+    node.parent = parentIdx;
+    node.children[0] = node.children[1] = node.children[2] = node.children[3] = -1;
+    
+    // Compute statistics using O(1) prefix sum queries
+    computeNodeStats(node);
+}
+
+bool RegionTree::isLeafRegion(const Region& region, double variance) const {
+    int regionHeight = region.row2 - region.row1 + 1;
+    int regionWidth = region.col2 - region.col1 + 1;
+    if (isLeafSize(regionHeight, regionWidth)) return true;
+    
+    // Adaptive: a uniform region stays whole unless it is too coarse
+    return splitVariance > 0 && variance <= splitVariance &&
+           regionHeight <= Config::ADAPTIVE_MAX_LEAF_SIZE &&
+           regionWidth <= Config::ADAPTIVE_MAX_LEAF_SIZE;
+}
+
+int64_t RegionTree::subtreeSize(const Region& region) const {
+    if (splitVariance > 0) {
+        auto it = adaptiveSizes.find(std::make_tuple(region.row1, region.col1,
+                                                     region.row2, region.col2));
+        return it != adaptiveSizes.end() ? it->second : 0;
+    }
+    auto it = subtreeSizes.find(std::make_pair(region.row2 - region.row1 + 1,
+                                               region.col2 - region.col1 + 1));
+    return it != subtreeSizes.end() ? it->second : 0;
+}
+
+int RegionTree::spawnDepthFor(int threads) {
+    if (threads <= 1) return -1;
+    
+    // ~4 subtrees per thread
+    int spawnDepth = 1;
+    while ((int64_t(1) << (2 * spawnDepth)) < 4 * threads) spawnDepth++;
+    return spawnDepth;
+}
+
+// ============================================================================
+// ADAPTIVE NODE COUNT
+// ============================================================================
+
+int64_t RegionTree::countAdaptive(const Region& region) const {
+    // Same split rule and the same variance (queryStats) as the build
+    if (isLeafRegion(region, prefixSum->queryVariance(region))) return 1;
+    
+    Region quadrants[4];
+    splitRegion(region, quadrants);
+    int64_t count = 1;
+    for (int i = 0; i < 4; i++) count += countAdaptive(quadrants[i]);
+    return count;
+}
+
+void RegionTree::collectFrontier(const Region& region, int depth, int memoDepth,
+                                 std::vector<Region>& frontier) const {
+    if (depth == memoDepth) {
+        frontier.push_back(region);
+        return;
+    }
+    if (isLeafRegion(region, prefixSum->queryVariance(region))) return;
+    
+    Region quadrants[4];
+    splitRegion(region, quadrants);
+    for (int i = 0; i < 4; i++) collectFrontier(quadrants[i], depth + 1, memoDepth, frontier);
+}
+
+int64_t RegionTree::foldAdaptiveSizes(const Region& region, int depth, int memoDepth) {
+    auto key = std::make_tuple(region.row1, region.col1, region.row2, region.col2);
+    if (depth == memoDepth) return adaptiveSizes.at(key);
+    
+    int64_t count = 1;
+    if (!isLeafRegion(region, prefixSum->queryVariance(region))) {
+        Region quadrants[4];
+        splitRegion(region, quadrants);
+        for (int i = 0; i < 4; i++) count += foldAdaptiveSizes(quadrants[i], depth + 1, memoDepth);
+    }
+    adaptiveSizes[key] = count;
+    return count;
+}
+
+int64_t RegionTree::countAdaptiveSizes(const Region& fullImage, int memoDepth) {
+    std::vector<Region> frontier;
+    collectFrontier(fullImage, 0, memoDepth, frontier);
+    
+    std::vector<int64_t> counts(frontier.size());
+    ThreadPool::shared().parallelFor(0, static_cast<int>(frontier.size()), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) counts[k] = countAdaptive(frontier[k]);
+    });
+    
+    adaptiveSizes.clear();
+    for (size_t k = 0; k < frontier.size(); k++) {
+        const Region& r = frontier[k];
+        adaptiveSizes[std::make_tuple(r.row1, r.col1, r.row2, r.col2)] = counts[k];
+    }
+    return foldAdaptiveSizes(fullImage, 0, memoDepth);
+}
+
+// ============================================================================
+// CONSTRUCTION
+// ============================================================================
+
+int RegionTree::buildRecursive(const Region& region, int depth, int parentIdx, int nodeIdx,
+                                int spawnDepth, std::vector<PendingSubtree>* pending) {
     /**
      * DIVIDE AND CONQUER: Recursive tree construction
      * 
@@ -86,50 +231,146 @@ int RegionTree::buildRecursive(const Region& region, int depth, int parentIdx) {
      *    - Divide the region into NW, NE, SW, SE
      *    - Recursively build subtrees for each valid quadrant
      *    - The parent-child relationships form the tree structure
+     * 
+     * Slots are pre-order: this node at nodeIdx, then child 0's entire
+     * subtree, then child 1's, ... A built child returns where its subtree
+     * ends; a deferred one reserves its precomputed subtree size, so
+     * every child's slot is known before any deferred child is built.
      */
     
-    // Create new node
-    int nodeIdx = nodes.size();
-    nodes.emplace_back();
-    RegionTreeNode& node = nodes[nodeIdx];
-    
-    node.id = nodeIdx;
-    node.bounds = region;
-    node.depth = depth;
-    node.parent = parentIdx;
-    node.children[0] = node.children[1] = node.children[2] = node.children[3] = -1;
-    
-    // Compute statistics using O(1) prefix sum queries
-    computeNodeStats(node);
+    // Defer this subtree to a worker (its slot range is already reserved)
+    if (pending && depth == spawnDepth) {
+        pending->push_back({region, depth, parentIdx, nodeIdx});
+        return nodeIdx + static_cast<int>(subtreeSize(region));
+    }
     
-    // Track maximum depth
-    maxDepth = std::max(maxDepth, depth);
-    nodeCount++;
+    initNode(nodeIdx, region, depth, parentIdx);
     
-    // BASE CASE: Region is small enough to be a leaf
-    int regionHeight = region.row2 - region.row1 + 1;
-    int regionWidth = region.col2 - region.col1 + 1;
-    
-    if (regionHeight <= minRegionSize || regionWidth <= minRegionSize) {
-        leafCount++;
-        return nodeIdx;
+    // BASE CASE: Region is small (or uniform) enough to be a leaf
+    if (isLeafRegion(region, nodes[nodeIdx].stats.variance)) {
+        return nodeIdx + 1;
     }
     
     // DIVIDE: Split current region into 4 quadrants
     Region quadrants[4];
     splitRegion(region, quadrants);
     
-    // CONQUER: Recursively build subtrees for each valid quadrant
+    // CONQUER: Recursively build subtrees for each quadrant
+    int childIdx = nodeIdx + 1;
     for (int i = 0; i < 4; i++) {
-        if (quadrants[i].isValid()) {
-            node.children[i] = buildRecursive(quadrants[i], depth + 1, nodeIdx);
+        nodes[nodeIdx].children[i] = childIdx;
+        childIdx = buildRecursive(quadrants[i], depth + 1, nodeIdx, childIdx, spawnDepth, pending);
+    }
+    return childIdx;
+}
+
+void RegionTree::buildDepthFirst(const Region& fullImage) {
+    ThreadPool& pool = ThreadPool::shared();
+    int spawnDepth = spawnDepthFor(pool.getThreadCount());
+    
+    if (spawnDepth < 0) {
+        buildRecursive(fullImage, 0, -1, 0, -1, nullptr);
+        return;
+    }
+    
+    // Build the top levels sequentially until there are ~4 subtrees per
+    // thread, then fill those disjoint slot ranges in parallel
+    std::vector<PendingSubtree> pending;
+    buildRecursive(fullImage, 0, -1, 0, spawnDepth, &pending);
+    
+    pool.parallelFor(0, static_cast<int>(pending.size()), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const PendingSubtree& task = pending[k];
+            buildRecursive(task.region, task.depth, task.parentIdx, task.nodeIdx, -1, nullptr);
         }
+    });
+}
+
+void RegionTree::buildBreadthFirst(const Region& fullImage) {
+    /**
+     * LEVEL-ORDER BUILD
+     * 
+     * Level L occupies [levelBegin, levelEnd). Internal nodes always have
+     * four children, so an exclusive scan over "is internal" gives each
+     * node its first child slot in level L+1. The nodes of a level are then
+     * split and their children initialised in parallel.
+     */
+    ThreadPool& pool = ThreadPool::shared();
+    
+    initNode(0, fullImage, 0, -1);
+    
+    int levelBegin = 0;
+    int levelEnd = 1;
+    std::vector<int> firstChild;
+    
+    while (levelBegin < levelEnd) {
+        firstChild.resize(levelEnd - levelBegin);
+        int cursor = levelEnd;
+        for (int idx = levelBegin; idx < levelEnd; idx++) {
+            firstChild[idx - levelBegin] = cursor;
+            if (!isLeafRegion(nodes[idx].bounds, nodes[idx].stats.variance)) {
+                cursor += 4;
+            }
+        }
+        
+        pool.parallelFor(levelBegin, levelEnd, [&](int begin, int end) {
+            for (int idx = begin; idx < end; idx++) {
+                const Region bounds = nodes[idx].bounds;
+                if (isLeafRegion(bounds, nodes[idx].stats.variance)) {
+                    continue;
+                }
+                
+                Region quadrants[4];
+                splitRegion(bounds, quadrants);
+                
+                int childIdx = firstChild[idx - levelBegin];
+                int childDepth = nodes[idx].depth + 1;
+                for (int i = 0; i < 4; i++) {
+                    nodes[idx].children[i] = childIdx + i;
+                    initNode(childIdx + i, quadrants[i], childDepth, idx);
+                }
+            }
+        }, 64);
+        
+        levelBegin = levelEnd;
+        levelEnd = cursor;
     }
+}
+
+void RegionTree::buildColumns() {
+    size_t n = nodes.size();
     
-    return nodeIdx;
+    columns.bounds.resize(n);
+    columns.mean.resize(n);
+    columns.variance.resize(n);
+    columns.anomalyScore.assign(n, 0.0);
+    columns.maxLeafScore.assign(n, 0.0);
+    columns.isAnomaly.assign(n, 0);
+    columns.leafMask.assign((n + 63) / 64, 0);
+    
+    for (size_t i = 0; i < n; i++) {
+        const RegionTreeNode& node = nodes[i];
+        columns.bounds[i] = node.bounds;
+        columns.mean[i] = node.stats.mean;
+        columns.variance[i] = node.stats.variance;
+        columns.anomalyScore[i] = node.anomalyScore;
+        columns.maxLeafScore[i] = node.maxLeafScore;
+        columns.isAnomaly[i] = node.isAnomaly ? 1 : 0;
+        if (node.isLeaf()) {
+            columns.leafMask[i >> 6] |= uint64_t(1) << (i & 63);
+        }
+    }
+}
+
+int64_t RegionTree::countNodes(int height, int width, int minSize) {
+    if (height <= 0 || width <= 0) return 0;
+    std::map<std::pair<int, int>, int64_t> memo;
+    return countSubtreeNodes(height, width, std::max(1, minSize), memo);
 }
 
-void RegionTree::build(const PrefixSum* prefix, int minSize) {
+void RegionTree::build(const PrefixSum* prefix, int minSize, TreeLayout treeLayout,
+                       double varianceTolerance) {
+    ProfileScope profile(ProfileZone::TreeBuild);
     if (!prefix || !prefix->isBuilt()) {
         std::cerr << "Error: PrefixSum not initialized" << std::endl;
         return;
@@ -139,98 +380,77 @@ void RegionTree::build(const PrefixSum* prefix, int minSize) {
     timer.start();
     
     prefixSum = prefix;
-    minRegionSize = minSize;
+    minRegionSize = std::max(1, minSize);
+    splitVariance = std::max(0.0, varianceTolerance);
+    layout = treeLayout;
     
-    // Clear any existing tree
+    // Size the node array exactly: no reallocation during the build
+    Region fullImage(0, 0, prefixSum->getHeight() - 1, prefixSum->getWidth() - 1);
+    subtreeSizes.clear();
+    adaptiveSizes.clear();
+    int64_t totalNodes;
+    if (splitVariance > 0) {
+        int memoDepth = std::max(0, spawnDepthFor(ThreadPool::shared().getThreadCount()));
+        totalNodes = countAdaptiveSizes(fullImage, memoDepth);
+    } else {
+        totalNodes = countSubtreeNodes(prefixSum->getHeight(), prefixSum->getWidth(),
+                                       minRegionSize, subtreeSizes);
+    }
     nodes.clear();
-    nodeCount = 0;
+    nodes.resize(totalNodes);
+    
+    // Build the entire tree from root
+    if (layout == TreeLayout::BreadthFirst) {
+        buildBreadthFirst(fullImage);
+    } else {
+        buildDepthFirst(fullImage);
+    }
+    rootIndex = 0;
+    
+    // Tally summary statistics in one pass (the parallel fill does not share counters)
+    nodeCount = static_cast<int>(totalNodes);
     leafCount = 0;
     maxDepth = 0;
+    for (const auto& node : nodes) {
+        if (node.isLeaf()) leafCount++;
+        maxDepth = std::max(maxDepth, node.depth);
+    }
     
-    // Reserve estimated space (optimization for large images)
-    int estimatedNodes = (prefixSum->getHeight() / minRegionSize + 1) *
-                         (prefixSum->getWidth() / minRegionSize + 1) * 2;
-    nodes.reserve(estimatedNodes);
-    
-    // Build the entire tree from root
-    Region fullImage(0, 0, prefixSum->getHeight() - 1, prefixSum->getWidth() - 1);
-    rootIndex = buildRecursive(fullImage, 0, -1);
+    buildColumns();
     
     timer.stop();
     buildTimeMs = timer.elapsedMs();
 }
 
-void RegionTree::traverse(std::function<void(const RegionTreeNode&, bool&)> visitor) const {
-    if (rootIndex < 0 || nodes.empty()) return;
-    
-    std::queue<int> queue;
-    queue.push(rootIndex);
-    
-    while (!queue.empty()) {
-        int idx = queue.front();
-        queue.pop();
-        
-        const RegionTreeNode& node = nodes[idx];
-        bool shouldDescend = true;
-        
-        visitor(node, shouldDescend);
-        
-        if (shouldDescend && !node.isLeaf()) {
-            for (int i = 0; i < 4; i++) {
-                if (node.children[i] >= 0) {
-                    queue.push(node.children[i]);
-                }
-            }
-        }
-    }
-}
-
-void RegionTree::traverseLeaves(std::function<void(const RegionTreeNode&)> visitor) const {
-    for (const auto& node : nodes) {
-        if (node.isLeaf()) {
-            visitor(node);
-        }
-    }
-}
-
 std::vector<const RegionTreeNode*> RegionTree::getLeaves() const {
     std::vector<const RegionTreeNode*> leaves;
     leaves.reserve(leafCount);
-    
-    for (const auto& node : nodes) {
-        if (node.isLeaf()) {
-            leaves.push_back(&node);
-        }
-    }
-    
+    traverseLeaves([&](const RegionTreeNode& leaf) { leaves.push_back(&leaf); });
     return leaves;
 }
 
 std::vector<const RegionTreeNode*> RegionTree::getNodesAtDepth(int depth) const {
     std::vector<const RegionTreeNode*> result;
-    
-    for (const auto& node : nodes) {
+    traverseDepthFirst([&](const RegionTreeNode& node, bool& descend) {
         if (node.depth == depth) {
             result.push_back(&node);
+            descend = false;
         }
-    }
-    
+    });
     return result;
 }
 
 std::vector<const RegionTreeNode*> RegionTree::queryRegion(const Region& queryRegion) const {
     std::vector<const RegionTreeNode*> result;
-    
-    if (rootIndex < 0) return result;
-    
-    std::queue<int> queue;
-    queue.push(rootIndex);
-    
-    while (!queue.empty()) {
-        int idx = queue.front();
-        queue.pop();
-        
-        const RegionTreeNode& node = nodes[idx];
+    std::vector<int> queue;
+    this->queryRegion(queryRegion, result, queue);
+    return result;
+}
+
+void RegionTree::queryRegion(const Region& queryRegion, std::vector<const RegionTreeNode*>& result,
+                             std::vector<int>& queue) const {
+    result.clear();
+    traverse([&](const RegionTreeNode& node, bool& descend) {
         const Region& bounds = node.bounds;
         
         // Check for intersection with query region
@@ -239,22 +459,78 @@ std::vector<const RegionTreeNode*> RegionTree::queryRegion(const Region& queryRe
                            bounds.col2 < queryRegion.col1 || 
                            bounds.col1 > queryRegion.col2);
         
-        if (!intersects) continue;  // Prune this branch
-        
-        if (node.isLeaf()) {
+        if (!intersects) {
+            descend = false;    // Prune this branch
+        } else if (node.isLeaf()) {
             result.push_back(&node);
-        } else {
-            for (int i = 0; i < 4; i++) {
-                if (node.children[i] >= 0) {
-                    queue.push(node.children[i]);
-                }
-            }
         }
-    }
+    }, queue);
+}
+
+std::vector<int> RegionTree::intersectingNodes(const Region& region) const {
+    std::vector<int> result;
+    traverseDepthFirst([&](const RegionTreeNode& node, bool& descend) {
+        const Region& bounds = node.bounds;
+        if (bounds.row2 < region.row1 || bounds.row1 > region.row2 ||
+            bounds.col2 < region.col1 || bounds.col1 > region.col2) {
+            descend = false;
+            return;
+        }
+        result.push_back(node.id);
+    });
     
+    // Pre-order is already ascending in the depth-first layout
+    if (layout == TreeLayout::BreadthFirst) std::sort(result.begin(), result.end());
     return result;
 }
 
+int RegionTree::refreshRegion(const Region& patch) {
+    if (!prefixSum || !prefixSum->isBuilt()) return 0;
+    
+    const std::vector<int> touched = intersectingNodes(patch);
+    for (int idx : touched) {
+        RegionTreeNode& node = nodes[idx];
+        computeNodeStats(node);
+        columns.mean[idx] = node.stats.mean;
+        columns.variance[idx] = node.stats.variance;
+    }
+    return static_cast<int>(touched.size());
+}
+
+bool RegionTree::refreshStats(const PrefixSum* prefix) {
+    if (!prefix || !prefix->isBuilt() || nodes.empty()) {
+        std::cerr << "Error: Cannot refresh an empty tree or from unbuilt prefix sums" << std::endl;
+        return false;
+    }
+    const Region& root = nodes[rootIndex].bounds;
+    if (prefix->getHeight() != root.row2 + 1 || prefix->getWidth() != root.col2 + 1) {
+        std::cerr << "Error: " << prefix->getHeight() << "x" << prefix->getWidth()
+                  << " prefix sums do not match the " << root.row2 + 1 << "x" << root.col2 + 1
+                  << " tree" << std::endl;
+        return false;
+    }
+    
+    prefixSum = prefix;
+    ThreadPool::shared().parallelFor(0, nodeCount, [&](int begin, int end) {
+        for (int idx = begin; idx < end; idx++) {
+            RegionTreeNode& node = nodes[idx];
+            computeNodeStats(node);
+            columns.mean[idx] = node.stats.mean;
+            columns.variance[idx] = node.stats.variance;
+        }
+    }, 1024);
+    return true;
+}
+
+size_t RegionTree::getMemoryBytes() const {
+    return nodes.capacity() * sizeof(RegionTreeNode)
+         + columns.bounds.capacity() * sizeof(Region)
+         + (columns.mean.capacity() + columns.variance.capacity() +
+            columns.anomalyScore.capacity() + columns.maxLeafScore.capacity()) * sizeof(double)
+         + columns.isAnomaly.capacity()
+         + columns.leafMask.capacity() * sizeof(uint64_t);
+}
+
 void RegionTree::printStats() const {
     std::cout << "\n--- Region Tree Statistics ---\n";
     std::cout << "Total nodes: " << formatNumber(nodeCount) << "\n";
@@ -262,6 +538,12 @@ void RegionTree::printStats() const {
     std::cout << "Internal nodes: " << formatNumber(nodeCount - leafCount) << "\n";
     std::cout << "Maximum depth: " << maxDepth << "\n";
     std::cout << "Min region size: " << minRegionSize << "x" << minRegionSize << "\n";
+    if (splitVariance > 0) {
+        std::cout << "Subdivision: adaptive (variance <= " << splitVariance << ", leaves up to "
+                  << Config::ADAPTIVE_MAX_LEAF_SIZE << "x" << Config::ADAPTIVE_MAX_LEAF_SIZE << ")\n";
+    }
+    std::cout << "Node layout: "
+              << (layout == TreeLayout::BreadthFirst ? "breadth-first" : "depth-first") << "\n";
     std::cout << "Build time: " << formatTime(buildTimeMs) << "\n";
 }
 
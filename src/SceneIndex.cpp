@@ -0,0 +1,488 @@
+/**
+ * @file SceneIndex.cpp
+ * @brief Implementation of the persistent scene index
+ */
+
+#include "SceneIndex.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace SatelliteAnalytics {
+
+static_assert(std::is_trivially_copyable<RegionTreeNode>::value,
+              "RegionTreeNode is stored in index files as raw bytes");
+static_assert(std::is_trivially_copyable<Region>::value,
+              "Region is stored in index files as raw bytes");
+static_assert(std::is_trivially_copyable<SceneIndexHeader>::value,
+              "SceneIndexHeader is stored in index files as raw bytes");
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'S', 'K', 'Y', 'I', 'D', 'X', '\0', '\0'};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief Bytes and shape of an array about to be written
+ */
+struct PendingSection {
+    const void* data = nullptr;
+    uint64_t bytes = 0;
+    int32_t rows = 0;
+    int32_t cols = 0;
+};
+
+template <typename T>
+PendingSection describe(const Buffer2D<T>& table) {
+    PendingSection s;
+    if (table.empty()) return s;
+    s.data = table.data();
+    s.bytes = table.sizeBytes();
+    s.rows = table.rows();
+    s.cols = table.cols();
+    return s;
+}
+
+template <typename T>
+PendingSection describe(const FlatArray<T>& array) {
+    PendingSection s;
+    if (array.empty()) return s;
+    s.data = array.data();
+    s.bytes = array.size() * sizeof(T);
+    s.cols = static_cast<int32_t>(array.size());
+    return s;
+}
+
+/**
+ * @brief Attach a Buffer2D to a section, checking its size against its shape
+ */
+template <typename T>
+bool attachTable(Buffer2D<T>& table, const IndexSection& section, uint8_t* base) {
+    if (section.bytes == 0) {
+        table.clear();
+        return true;
+    }
+    if (section.rows <= 0 || section.cols <= 0) return false;
+    uint64_t expected = static_cast<uint64_t>(section.rows) *
+                        Buffer2D<T>::paddedStride(section.cols) * sizeof(T);
+    if (section.bytes != expected) return false;
+    table.attach(reinterpret_cast<T*>(base + section.offset), section.rows, section.cols);
+    return true;
+}
+
+template <typename T>
+bool attachArray(FlatArray<T>& array, const IndexSection& section, uint8_t* base) {
+    if (section.bytes == 0) {
+        array.clear();
+        return section.cols == 0;
+    }
+    if (section.rows != 0 || section.cols <= 0) return false;
+    if (section.bytes != static_cast<uint64_t>(section.cols) * sizeof(T)) return false;
+    array.attach(reinterpret_cast<T*>(base + section.offset), static_cast<size_t>(section.cols));
+    return true;
+}
+
+template <typename T>
+bool hasShape(const Buffer2D<T>& table, int rows, int cols) {
+    return table.rows() == rows && table.cols() == cols;
+}
+
+} // anonymous namespace
+
+SceneIndex::SceneIndex() : loaded(false), openTimeMs(0) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+// ============================================================================
+// WRITING
+// ============================================================================
+
+bool SceneIndex::save(const std::string& filename, const PrefixSum& prefix,
+                      const RegionTree& tree, const AnomalyDetector* detector) {
+    if (!prefix.isBuilt() || tree.getNodeCount() == 0) {
+        std::cerr << "Error: Cannot save an index before the prefix sum and tree are built"
+                  << std::endl;
+        return false;
+    }
+
+    SceneIndexHeader head;
+    std::memset(&head, 0, sizeof(head));
+    std::memcpy(head.magic, INDEX_MAGIC, sizeof(head.magic));
+    head.version = FORMAT_VERSION;
+    head.byteOrder = BYTE_ORDER_MARK;
+    head.headerBytes = sizeof(SceneIndexHeader);
+    head.nodeBytes = sizeof(RegionTreeNode);
+    head.regionBytes = sizeof(Region);
+    head.sectionCount = static_cast<uint32_t>(IndexSectionId::Count);
+
+    head.height = prefix.height;
+    head.width = prefix.width;
+    head.storage = static_cast<int32_t>(prefix.storage);
+    head.tileShift = prefix.tileShift;
+    head.tileCols = prefix.tileCols;
+    head.totalSum = prefix.totalSum;
+    head.totalPixels = prefix.totalPixels;
+    head.globalMean = prefix.globalMean;
+    head.globalVariance = prefix.globalVariance;
+    head.globalStdDev = prefix.globalStdDev;
+
+    head.rootIndex = tree.rootIndex;
+    head.nodeCount = tree.nodeCount;
+    head.leafCount = tree.leafCount;
+    head.maxDepth = tree.maxDepth;
+    head.minRegionSize = tree.minRegionSize;
+    head.layout = static_cast<int32_t>(tree.layout);
+    head.splitVariance = tree.splitVariance;
+    if (detector) {
+        head.scored = 1;
+        head.baseline = static_cast<int32_t>(detector->getBaseline());
+        head.threshold = detector->getThreshold();
+        if (detector->getBaseline() == ScoreBaseline::Local) {
+            head.contextScale = detector->getContextScale();
+            head.guardScale = detector->getGuardScale();
+        }
+    }
+
+    const RegionTreeColumns& columns = tree.columns;
+    PendingSection pending[static_cast<uint32_t>(IndexSectionId::Count)];
+    auto at = [&](IndexSectionId id) -> PendingSection& {
+        return pending[static_cast<uint32_t>(id)];
+    };
+
+    if (prefix.storage == PrefixStorage::Full) {
+        at(IndexSectionId::Prefix) = describe(prefix.prefix);
+        at(IndexSectionId::PrefixSquares) = describe(prefix.prefixSquares);
+    } else if (prefix.storage == PrefixStorage::Blocked) {
+        at(IndexSectionId::TileBaseSum) = describe(prefix.tileBaseSum);
+        at(IndexSectionId::TileBaseSq) = describe(prefix.tileBaseSq);
+        at(IndexSectionId::RowStripSum) = describe(prefix.rowStripSum);
+        at(IndexSectionId::RowStripSq) = describe(prefix.rowStripSq);
+        at(IndexSectionId::ColStripSum) = describe(prefix.colStripSum);
+        at(IndexSectionId::ColStripSq) = describe(prefix.colStripSq);
+        at(IndexSectionId::LocalSum) = describe(prefix.localSum);
+        at(IndexSectionId::LocalSq) = describe(prefix.localSq);
+    } else {
+        at(IndexSectionId::TileBaseSum) = describe(prefix.tileBaseSum);
+        at(IndexSectionId::TileBaseSq) = describe(prefix.tileBaseSq);
+        at(IndexSectionId::SumOffset) = describe(prefix.sumOffset);
+        at(IndexSectionId::SqOffsetLow) = describe(prefix.sqOffsetLow);
+        at(IndexSectionId::SqOffsetHigh) = describe(prefix.sqOffsetHigh);
+    }
+    at(IndexSectionId::Nodes) = describe(tree.nodes);
+    at(IndexSectionId::ColumnBounds) = describe(columns.bounds);
+    at(IndexSectionId::ColumnMean) = describe(columns.mean);
+    at(IndexSectionId::ColumnVariance) = describe(columns.variance);
+    at(IndexSectionId::ColumnAnomalyScore) = describe(columns.anomalyScore);
+    at(IndexSectionId::ColumnMaxLeafScore) = describe(columns.maxLeafScore);
+    at(IndexSectionId::ColumnIsAnomaly) = describe(columns.isAnomaly);
+    at(IndexSectionId::ColumnLeafMask) = describe(columns.leafMask);
+
+    // Lay sections out back to back on aligned offsets
+    uint64_t offset = alignUp(sizeof(SceneIndexHeader), SECTION_ALIGNMENT);
+    for (uint32_t i = 0; i < head.sectionCount; i++) {
+        IndexSection& section = head.sections[i];
+        section.rows = pending[i].rows;
+        section.cols = pending[i].cols;
+        section.bytes = pending[i].bytes;
+        section.offset = pending[i].bytes > 0 ? offset : 0;
+        offset = alignUp(offset + pending[i].bytes, SECTION_ALIGNMENT);
+    }
+
+    const std::string tempName = filename + ".tmp";
+    std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot create index file " << tempName << std::endl;
+        return false;
+    }
+
+    const char zeros[SECTION_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto writeBytes = [&](const void* data, uint64_t bytes) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        written += bytes;
+    };
+
+    writeBytes(&head, sizeof(head));
+    for (uint32_t i = 0; i < head.sectionCount; i++) {
+        if (pending[i].bytes == 0) continue;
+        while (written < head.sections[i].offset) {
+            writeBytes(zeros, std::min<uint64_t>(SECTION_ALIGNMENT,
+                                                 head.sections[i].offset - written));
+        }
+        writeBytes(pending[i].data, pending[i].bytes);
+    }
+    out.close();
+
+    if (!out) {
+        std::cerr << "Error: Failed writing index file " << tempName << std::endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Error: Cannot move index into place at " << filename << std::endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// LOADING
+// ============================================================================
+
+bool SceneIndex::open(const std::string& filename) {
+    close();
+
+    Timer timer;
+    timer.start();
+
+    // Copy-on-write, so re-scoring the tree never touches the file
+    if (!file.open(filename, true)) return false;
+
+    if (file.size() < sizeof(SceneIndexHeader)) {
+        std::cerr << "Error: " << filename << " is too small to be an index" << std::endl;
+        close();
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (!validateHeader(filename)) {
+        close();
+        return false;
+    }
+    if (!attachSections()) {
+        std::cerr << "Error: " << filename << " has inconsistent index sections" << std::endl;
+        close();
+        return false;
+    }
+
+    loaded = true;
+    timer.stop();
+    openTimeMs = timer.elapsedMs();
+    return true;
+}
+
+bool SceneIndex::isIndexFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[sizeof(INDEX_MAGIC)] = {};
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0;
+}
+
+bool SceneIndex::validateHeader(const std::string& filename) const {
+    if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Error: " << filename << " is not a scene index" << std::endl;
+        return false;
+    }
+    if (header.version != FORMAT_VERSION) {
+        std::cerr << "Error: " << filename << " has index version " << header.version
+                  << " (expected " << FORMAT_VERSION << ")" << std::endl;
+        return false;
+    }
+    if (header.byteOrder != BYTE_ORDER_MARK || header.headerBytes != sizeof(SceneIndexHeader) ||
+        header.nodeBytes != sizeof(RegionTreeNode) || header.regionBytes != sizeof(Region) ||
+        header.sectionCount != static_cast<uint32_t>(IndexSectionId::Count)) {
+        std::cerr << "Error: " << filename << " was written by an incompatible build"
+                  << std::endl;
+        return false;
+    }
+    if (header.height <= 0 || header.width <= 0 ||
+        header.nodeCount <= 0 || header.rootIndex < 0 || header.rootIndex >= header.nodeCount ||
+        header.maxDepth < 0 || header.maxDepth >= RegionTree::MAX_DEPTH ||
+        !(header.splitVariance >= 0) ||
+        (header.storage != static_cast<int32_t>(PrefixStorage::Full) &&
+         header.storage != static_cast<int32_t>(PrefixStorage::Compact) &&
+         header.storage != static_cast<int32_t>(PrefixStorage::Blocked)) ||
+        (header.layout != static_cast<int32_t>(TreeLayout::DepthFirst) &&
+         header.layout != static_cast<int32_t>(TreeLayout::BreadthFirst)) ||
+        (header.baseline != static_cast<int32_t>(ScoreBaseline::Global) &&
+         header.baseline != static_cast<int32_t>(ScoreBaseline::Local))) {
+        std::cerr << "Error: " << filename << " has an invalid index header" << std::endl;
+        return false;
+    }
+
+    for (const IndexSection& section : header.sections) {
+        if (section.bytes == 0) continue;
+        if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > file.size() ||
+            section.bytes > file.size() - section.offset) {
+            std::cerr << "Error: " << filename << " is truncated or corrupt" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SceneIndex::attachSections() {
+    uint8_t* base = file.writableData();
+    auto section = [&](IndexSectionId id) -> const IndexSection& {
+        return header.sections[static_cast<uint32_t>(id)];
+    };
+
+    // Prefix sum
+    PrefixSum& ps = prefixSum;
+    ps.height = header.height;
+    ps.width = header.width;
+    ps.storage = static_cast<PrefixStorage>(header.storage);
+    ps.tileShift = header.tileShift;
+    ps.tileCols = header.tileCols;
+    ps.totalSum = header.totalSum;
+    ps.totalPixels = header.totalPixels;
+    ps.globalMean = header.globalMean;
+    ps.globalVariance = header.globalVariance;
+    ps.globalStdDev = header.globalStdDev;
+
+    const int paddedRows = header.height + 1;
+    const int paddedCols = header.width + 1;
+
+    if (ps.storage == PrefixStorage::Full) {
+        if (!attachTable(ps.prefix, section(IndexSectionId::Prefix), base) ||
+            !attachTable(ps.prefixSquares, section(IndexSectionId::PrefixSquares), base) ||
+            !hasShape(ps.prefix, paddedRows, paddedCols) ||
+            !hasShape(ps.prefixSquares, paddedRows, paddedCols)) {
+            return false;
+        }
+    } else {
+        if (header.tileShift <= 0 || header.tileShift > 30 || header.tileCols <= 0) return false;
+        const int tileRows = (paddedRows + (1 << header.tileShift) - 1) >> header.tileShift;
+        const size_t tiles = static_cast<size_t>(tileRows) * header.tileCols;
+
+        if (!attachArray(ps.tileBaseSum, section(IndexSectionId::TileBaseSum), base) ||
+            !attachArray(ps.tileBaseSq, section(IndexSectionId::TileBaseSq), base) ||
+            ps.tileBaseSum.size() != tiles || ps.tileBaseSq.size() != tiles) {
+            return false;
+        }
+
+        if (ps.storage == PrefixStorage::Blocked) {
+            if (!attachTable(ps.rowStripSum, section(IndexSectionId::RowStripSum), base) ||
+                !attachTable(ps.rowStripSq, section(IndexSectionId::RowStripSq), base) ||
+                !attachTable(ps.colStripSum, section(IndexSectionId::ColStripSum), base) ||
+                !attachTable(ps.colStripSq, section(IndexSectionId::ColStripSq), base) ||
+                !attachTable(ps.localSum, section(IndexSectionId::LocalSum), base) ||
+                !attachTable(ps.localSq, section(IndexSectionId::LocalSq), base) ||
+                !hasShape(ps.rowStripSum, paddedRows, header.tileCols) ||
+                !hasShape(ps.rowStripSq, paddedRows, header.tileCols) ||
+                !hasShape(ps.colStripSum, paddedCols, tileRows) ||
+                !hasShape(ps.colStripSq, paddedCols, tileRows) ||
+                !hasShape(ps.localSum, paddedRows, paddedCols) ||
+                !hasShape(ps.localSq, paddedRows, paddedCols)) {
+                return false;
+            }
+        } else if (!attachTable(ps.sumOffset, section(IndexSectionId::SumOffset), base) ||
+                   !attachTable(ps.sqOffsetLow, section(IndexSectionId::SqOffsetLow), base) ||
+                   !attachTable(ps.sqOffsetHigh, section(IndexSectionId::SqOffsetHigh), base) ||
+                   !hasShape(ps.sumOffset, paddedRows, paddedCols) ||
+                   !hasShape(ps.sqOffsetLow, paddedRows, paddedCols) ||
+                   (!ps.sqOffsetHigh.empty() &&
+                    !hasShape(ps.sqOffsetHigh, paddedRows, paddedCols))) {
+            return false;
+        }
+    }
+    ps.difference = false;
+    ps.built = true;
+
+    // Region tree
+    RegionTree& tree = regionTree;
+    RegionTreeColumns& columns = tree.columns;
+    const size_t n = static_cast<size_t>(header.nodeCount);
+
+    if (!attachArray(tree.nodes, section(IndexSectionId::Nodes), base) ||
+        !attachArray(columns.bounds, section(IndexSectionId::ColumnBounds), base) ||
+        !attachArray(columns.mean, section(IndexSectionId::ColumnMean), base) ||
+        !attachArray(columns.variance, section(IndexSectionId::ColumnVariance), base) ||
+        !attachArray(columns.anomalyScore, section(IndexSectionId::ColumnAnomalyScore), base) ||
+        !attachArray(columns.maxLeafScore, section(IndexSectionId::ColumnMaxLeafScore), base) ||
+        !attachArray(columns.isAnomaly, section(IndexSectionId::ColumnIsAnomaly), base) ||
+        !attachArray(columns.leafMask, section(IndexSectionId::ColumnLeafMask), base)) {
+        return false;
+    }
+    if (tree.nodes.size() != n || columns.bounds.size() != n || columns.mean.size() != n ||
+        columns.variance.size() != n || columns.anomalyScore.size() != n ||
+        columns.maxLeafScore.size() != n || columns.isAnomaly.size() != n ||
+        columns.leafMask.size() != (n + 63) / 64) {
+        return false;
+    }
+
+    tree.prefixSum = &prefixSum;
+    tree.rootIndex = header.rootIndex;
+    tree.nodeCount = header.nodeCount;
+    tree.leafCount = header.leafCount;
+    tree.maxDepth = header.maxDepth;
+    tree.minRegionSize = header.minRegionSize;
+    tree.layout = static_cast<TreeLayout>(header.layout);
+    tree.splitVariance = header.splitVariance;
+    tree.buildTimeMs = 0;
+    return validateNodes();
+}
+
+bool SceneIndex::validateNodes() const {
+    /**
+     * Traversals index nodes by child / parent links, size their stacks by
+     * depth and test leaves through leafMask, so each of those is checked.
+     * Children always have larger indices than their parent (both layouts),
+     * which also rules out cycles.
+     */
+    const RegionTree& tree = regionTree;
+    const int n = header.nodeCount;
+    int leaves = 0;
+
+    for (int i = 0; i < n; i++) {
+        const RegionTreeNode& node = tree.nodes[i];
+        const Region& b = node.bounds;
+        if (node.id != i || node.depth < 0 || node.depth > header.maxDepth ||
+            b.row1 < 0 || b.col1 < 0 || b.row1 > b.row2 || b.col1 > b.col2 ||
+            b.row2 >= header.height || b.col2 >= header.width) {
+            return false;
+        }
+
+        const Region& column = tree.columns.bounds[i];
+        if (column.row1 != b.row1 || column.col1 != b.col1 ||
+            column.row2 != b.row2 || column.col2 != b.col2) {
+            return false;
+        }
+
+        if (i == header.rootIndex) {
+            if (node.parent != -1 || node.depth != 0) return false;
+        } else if (node.parent < 0 || node.parent >= i) {
+            return false;
+        }
+
+        for (int child : node.children) {
+            if (child == -1) continue;
+            if (child <= i || child >= n || tree.nodes[child].parent != i ||
+                tree.nodes[child].depth != node.depth + 1) {
+                return false;
+            }
+        }
+
+        const bool leaf = node.isLeaf();
+        if (leaf != tree.columns.isLeaf(i)) return false;
+        if (leaf) leaves++;
+    }
+    return leaves == header.leafCount;
+}
+
+void SceneIndex::close() {
+    // Drop the views before the memory behind them goes away
+    regionTree = RegionTree();
+    prefixSum = PrefixSum();
+    file.close();
+    std::memset(&header, 0, sizeof(header));
+    loaded = false;
+    openTimeMs = 0;
+}
+
+bool SceneIndex::isScoredAt(const AnomalyDetector& detector) const {
+    if (!loaded || header.scored == 0 || header.threshold != detector.getThreshold() ||
+        header.baseline != static_cast<int32_t>(detector.getBaseline())) {
+        return false;
+    }
+    return detector.getBaseline() != ScoreBaseline::Local ||
+           (header.contextScale == detector.getContextScale() &&
+            header.guardScale == detector.getGuardScale());
+}
+
+} // namespace SatelliteAnalytics
@@ -0,0 +1,147 @@
+/**
+ * @file SceneSeries.cpp
+ * @brief Implementation of change detection across a scene series
+ */
+
+#include "SceneSeries.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace SatelliteAnalytics {
+
+SceneSeries::SceneSeries(const SeriesConfig& cfg)
+    : config(cfg), latest(1), sceneCount(0), treeBuilt(false) {}
+
+// ============================================================================
+// ADDING SCENES
+// ============================================================================
+
+bool SceneSeries::addScene(const Matrix& image, const std::string& label) {
+    if (image.rows() <= 0 || image.cols() <= 0) {
+        std::cerr << "Error: Cannot add an empty scene to the series" << std::endl;
+        return false;
+    }
+
+    // The new scene overwrites the older slot; the newer one becomes "before"
+    Timer timer;
+    timer.start();
+    const int slot = 1 - latest;
+    Scene& scene = slots[slot];
+    scene.image = image;
+    scene.label = label;
+    scene.prefix.build(scene.image);
+
+    const bool first = sceneCount == 0;
+    const Scene& prev = slots[latest];
+    latest = slot;
+    sceneCount++;
+    components.clear();
+    lastChange = ChangeSummary();
+    if (first) return true;
+
+    ChangeSummary& change = lastChange;
+    change.before = prev.label;
+    change.after = scene.label;
+    change.height = image.rows();
+    change.width = image.cols();
+    if (prev.image.rows() != image.rows() || prev.image.cols() != image.cols()) {
+        // Not comparable: start a new run from this scene
+        std::ostringstream error;
+        error << "size " << image.rows() << "x" << image.cols() << " differs from previous "
+              << prev.image.rows() << "x" << prev.image.cols();
+        change.error = error.str();
+        treeBuilt = false;
+        return true;
+    }
+    if (!difference.buildDifference(prev.image, scene.image)) {
+        change.error = "cannot build difference tables";
+        return true;
+    }
+
+    // A uniform layout depends only on the scene size, so one tree serves
+    // every pair of the run; only its statistics follow the new difference
+    change.treeReused = treeBuilt && changeTree.refreshStats(&difference);
+    if (!change.treeReused) {
+        changeTree.build(&difference, config.minRegionSize, config.treeLayout);
+        treeBuilt = true;
+    }
+    detector.setThreshold(config.threshold);
+    detector.initialize(&difference);
+    detector.detectInTree(changeTree);
+    timer.stop();
+    change.buildMs = timer.elapsedMs();
+
+    // The leaf index only depends on the layout: rebuilt with the tree
+    timer.start();
+    if (!change.treeReused) engine.initialize(&changeTree, &difference, &detector);
+    engine.topKWithPruning(config.topK, top, scratch);
+    change.topK = top.regions;
+    components = engine.findConnectedComponents();
+    timer.stop();
+    change.queryMs = timer.elapsedMs();
+
+    const AnomalyStats& stats = detector.getStats();
+    change.meanBefore = prev.prefix.getGlobalMean();
+    change.meanAfter = scene.prefix.getGlobalMean();
+    change.meanChange = difference.getGlobalMean();
+    change.changeStdDev = difference.getGlobalStdDev();
+    change.leaves = stats.totalRegions;
+    change.changedLeaves = stats.anomalousRegions;
+    change.maxScore = stats.maxScore;
+    change.components = static_cast<int>(components.size());
+    change.largestComponentArea = components.empty() ? 0 : components[0].totalArea;
+    change.ok = true;
+    return true;
+}
+
+// ============================================================================
+// QUERIES
+// ============================================================================
+
+RegionChange SceneSeries::queryChange(const Region& region) const {
+    RegionChange result;
+    if (!lastChange.ok) return result;
+
+    result.before = previousScene().prefix.queryStats(region);
+    result.after = slots[latest].prefix.queryStats(region);
+    result.change = difference.queryStats(region);
+    result.score = detector.computeScore(region);
+    return result;
+}
+
+size_t SceneSeries::getMemoryBytes() const {
+    size_t bytes = difference.getMemoryBytes() + changeTree.getMemoryBytes()
+                 + engine.getLeafIndex().getMemoryBytes();
+    for (const Scene& scene : slots) {
+        bytes += static_cast<size_t>(scene.image.rows()) * scene.image.cols() * sizeof(Pixel)
+               + scene.prefix.getMemoryBytes();
+    }
+    return bytes;
+}
+
+// ============================================================================
+// OUTPUT
+// ============================================================================
+
+void SceneSeries::writeHeader(std::ostream& out) {
+    out << "before,after,status,height,width,mean_before,mean_after,mean_change,change_stddev,"
+        << "leaves,changed,components,largest_component_area,max_score,tree_reused,"
+        << "build_ms,query_ms,top_regions,error\n";
+}
+
+void SceneSeries::writeRow(std::ostream& out, const ChangeSummary& change) {
+    std::ostringstream row;
+    row << csvField(change.before) << ',' << csvField(change.after) << ','
+        << (change.ok ? "ok" : "error") << ',' << change.height << ',' << change.width << ','
+        << std::fixed << std::setprecision(4) << change.meanBefore << ',' << change.meanAfter << ','
+        << change.meanChange << ',' << change.changeStdDev << ','
+        << change.leaves << ',' << change.changedLeaves << ',' << change.components << ','
+        << change.largestComponentArea << ',' << change.maxScore << ','
+        << (change.treeReused ? 1 : 0) << ','
+        << std::setprecision(3) << change.buildMs << ',' << change.queryMs << ','
+        << formatRegionList(change.topK) << ',' << csvField(change.error) << '\n';
+    out << row.str();
+}
+
+} // namespace SatelliteAnalytics
@@ -0,0 +1,134 @@
+/**
+ * @file ThreadPool.cpp
+ * @brief Implementation of the shared worker pool
+ */
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+
+namespace SatelliteAnalytics {
+
+namespace {
+    thread_local bool isPoolWorker = false;
+    int sharedThreadCount = 0;
+}
+
+ThreadPool::ThreadPool(int numThreads) : stopping(false) {
+    if (numThreads <= 0) {
+        numThreads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    numThreads = std::max(1, numThreads);
+
+    // The calling thread always takes part in parallelFor, so spawn one fewer
+    workers.reserve(numThreads - 1);
+    for (int i = 0; i < numThreads - 1; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    isPoolWorker = true;
+
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        tasks.push(std::move(task));
+    }
+    queueCondition.notify_one();
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)>& body,
+                             int minChunk) {
+    if (end <= begin) return;
+
+    int total = end - begin;
+    minChunk = std::max(1, minChunk);
+    int numChunks = std::min(getThreadCount(), (total + minChunk - 1) / minChunk);
+
+    // Nested or trivially small sections run inline
+    if (numChunks <= 1 || inWorkerThread()) {
+        body(begin, end);
+        return;
+    }
+
+    int chunkSize = (total + numChunks - 1) / numChunks;
+
+    int remaining = numChunks - 1;
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::exception_ptr firstError;
+
+    for (int chunk = 1; chunk < numChunks; chunk++) {
+        int chunkBegin = begin + chunk * chunkSize;
+        int chunkEnd = std::min(end, chunkBegin + chunkSize);
+
+        enqueue([&, chunkBegin, chunkEnd]() {
+            try {
+                if (chunkBegin < chunkEnd) body(chunkBegin, chunkEnd);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (!firstError) firstError = std::current_exception();
+            }
+            // Decrement under the lock: once the caller sees zero it may
+            // destroy these stack objects, so nothing may touch them after
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0) doneCondition.notify_one();
+        });
+    }
+
+    // Caller handles the first chunk
+    try {
+        body(begin, std::min(end, begin + chunkSize));
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (!firstError) firstError = std::current_exception();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return remaining == 0; });
+    }
+
+    if (firstError) std::rethrow_exception(firstError);
+}
+
+bool ThreadPool::inWorkerThread() {
+    return isPoolWorker;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(sharedThreadCount);
+    return pool;
+}
+
+void ThreadPool::setSharedThreadCount(int numThreads) {
+    sharedThreadCount = numThreads;
+}
+
+} // namespace SatelliteAnalytics
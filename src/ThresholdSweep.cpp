@@ -0,0 +1,337 @@
+/**
+ * @file ThresholdSweep.cpp
+ * @brief Implementation of incremental re-thresholding
+ */
+
+#include "ThresholdSweep.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+/**
+ * @brief Length of the prefix of order whose key is above t (order is descending)
+ */
+template <typename Key>
+int countAbove(const std::vector<int>& order, double t, Key key) {
+    auto end = std::partition_point(order.begin(), order.end(),
+                                    [&](int i) { return key(i) > t; });
+    return static_cast<int>(end - order.begin());
+}
+
+/**
+ * @brief Sort indices by descending key; ties by index so the order is deterministic
+ */
+template <typename Key>
+void sortDescending(std::vector<int>& order, Key key) {
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        double ka = key(a), kb = key(b);
+        return ka > kb || (ka == kb && a < b);
+    });
+}
+
+} // anonymous namespace
+
+ThresholdSweep::ThresholdSweep()
+    : tree(nullptr), detector(nullptr), threshold(0), anomalousNodes(0),
+      anomalousLeaves(0), lastUpdateMs(0), tracking(false) {}
+
+bool ThresholdSweep::initialize(RegionTree& regionTree, AnomalyDetector& anomalyDetector) {
+    tree = &regionTree;
+    detector = &anomalyDetector;
+    threshold = detector->getThreshold();
+    tracking = false;
+    merges.clear();
+    memberLeaves.clear();
+    byLevel.clear();
+    byParentLevel.clear();
+    tops.clear();
+    topSlot.clear();
+
+    if (!detector->detectionComplete) {
+        std::cerr << "Error: ThresholdSweep needs a tree scored by detectInTree()" << std::endl;
+        return false;
+    }
+
+    const RegionTreeColumns& columns = tree->getColumns();
+    const int n = static_cast<int>(columns.size());
+    const double* scores = columns.anomalyScore.data();
+    auto score = [scores](int i) { return scores[i]; };
+
+    byScore.resize(n);
+    leavesByScore.clear();
+    leavesByScore.reserve(tree->getLeafCount());
+    for (int i = 0; i < n; i++) {
+        byScore[i] = i;
+        if (columns.isLeaf(i)) leavesByScore.push_back(i);
+    }
+    sortDescending(byScore, score);
+    sortDescending(leavesByScore, score);
+
+    // detectInTree() used the same "score > threshold" test, so the flags
+    // are exactly these prefixes
+    anomalousNodes = countAbove(byScore, threshold, score);
+    anomalousLeaves = countAbove(leavesByScore, threshold, score);
+    return true;
+}
+
+// ============================================================================
+// THRESHOLD CHANGES
+// ============================================================================
+
+int ThresholdSweep::setThreshold(double newThreshold) {
+    Timer timer;
+    timer.start();
+
+    if (!tree) return 0;
+
+    RegionTreeColumns& columns = tree->getColumnsMutable();
+    auto& nodes = tree->getAllNodesMutable();
+    const double* scores = columns.anomalyScore.data();
+    auto score = [scores](int i) { return scores[i]; };
+
+    /**
+     * FLIP THE CHANGED RANGE
+     *
+     * Lowering the threshold extends the flagged prefix of byScore,
+     * raising it shortens it. Either way only the entries between the old
+     * and the new prefix end change state.
+     */
+    const int newNodes = countAbove(byScore, newThreshold, score);
+    const bool raise = newNodes > anomalousNodes;
+    const int first = std::min(newNodes, anomalousNodes);
+    const int last = std::max(newNodes, anomalousNodes);
+    for (int k = first; k < last; k++) {
+        int i = byScore[k];
+        columns.isAnomaly[i] = raise ? 1 : 0;
+        nodes[i].isAnomaly = raise;
+    }
+    const int changed = last - first;
+
+    const double low = std::min(threshold, newThreshold);
+    const double high = std::max(threshold, newThreshold);
+    threshold = newThreshold;
+    anomalousNodes = newNodes;
+    anomalousLeaves = countAbove(leavesByScore, newThreshold, score);
+
+    // Keep the detector consistent with a fresh detectInTree() at newThreshold
+    detector->setThreshold(newThreshold);
+    detector->stats.anomalousRegions = anomalousLeaves;
+
+    /**
+     * COMPONENTS
+     *
+     * A merge node's top test (level > t >= parent level) can only change
+     * if its level or its parent level lies in (low, high].
+     */
+    if (tracking && changed > 0) {
+        auto level = [this](int m) { return merges[m].level; };
+        auto upper = [this](int m) { return parentLevel(m); };
+
+        const int levelFrom = countAbove(byLevel, high, level);
+        const int levelTo = countAbove(byLevel, low, level);
+        for (int k = levelFrom; k < levelTo; k++) updateTop(byLevel[k]);
+
+        const int parentFrom = countAbove(byParentLevel, high, upper);
+        const int parentTo = countAbove(byParentLevel, low, upper);
+        for (int k = parentFrom; k < parentTo; k++) updateTop(byParentLevel[k]);
+    }
+
+    timer.stop();
+    lastUpdateMs = timer.elapsedMs();
+    return changed;
+}
+
+// ============================================================================
+// COMPONENT TRACKING
+// ============================================================================
+
+double ThresholdSweep::parentLevel(int m) const {
+    int parent = merges[m].parent;
+    return parent < 0 ? -std::numeric_limits<double>::infinity() : merges[parent].level;
+}
+
+void ThresholdSweep::updateTop(int m) {
+    bool top = merges[m].level > threshold && parentLevel(m) <= threshold;
+    int slot = topSlot[m];
+    if (top && slot < 0) {
+        topSlot[m] = static_cast<int>(tops.size());
+        tops.push_back(m);
+    } else if (!top && slot >= 0) {
+        // Swap-remove
+        int moved = tops.back();
+        tops[slot] = moved;
+        topSlot[moved] = slot;
+        tops.pop_back();
+        topSlot[m] = -1;
+    }
+}
+
+void ThresholdSweep::trackComponents(AdjacencyMethod method) {
+    if (!tree) return;
+
+    const std::vector<const RegionTreeNode*> leaves = tree->getLeaves();
+    const int numLeaves = static_cast<int>(leaves.size());
+    const RegionTreeColumns& columns = tree->getColumns();
+
+    std::vector<int> leafPos(columns.size(), -1);
+    for (int p = 0; p < numLeaves; p++) leafPos[leaves[p]->id] = p;
+
+    // Leaf adjacency (CSR), computed once for every leaf
+    QueryEngine adjacency;
+    const auto pairs = adjacency.findAdjacentPairs(leaves, method);
+
+    std::vector<int> offsets(numLeaves + 1, 0);
+    for (const auto& [a, b] : pairs) {
+        offsets[a + 1]++;
+        offsets[b + 1]++;
+    }
+    for (int p = 0; p < numLeaves; p++) offsets[p + 1] += offsets[p];
+    std::vector<int> neighbours(offsets[numLeaves]);
+    {
+        std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+        for (const auto& [a, b] : pairs) {
+            neighbours[cursor[a]++] = b;
+            neighbours[cursor[b]++] = a;
+        }
+    }
+
+    /**
+     * MERGE TREE CONSTRUCTION
+     *
+     * Activate leaves by descending score. Each union of two different
+     * components becomes a new merge node at the activating leaf's score.
+     */
+    merges.assign(numLeaves, MergeNode());
+    for (int p = 0; p < numLeaves; p++) {
+        MergeNode& leaf = merges[p];
+        leaf.level = columns.anomalyScore[leaves[p]->id];
+        leaf.parent = -1;
+        leaf.children[0] = leaf.children[1] = -1;
+        leaf.leafCount = 1;
+    }
+    merges.reserve(2 * static_cast<size_t>(numLeaves));
+
+    UnionFind uf(numLeaves);
+    std::vector<int> rootNode(numLeaves);       // Merge node of each union-find root
+    for (int p = 0; p < numLeaves; p++) rootNode[p] = p;
+    std::vector<uint8_t> active(numLeaves, 0);
+
+    for (int leafIndex : leavesByScore) {
+        const int p = leafPos[leafIndex];
+        const double level = merges[p].level;
+        active[p] = 1;
+
+        for (int e = offsets[p]; e < offsets[p + 1]; e++) {
+            const int q = neighbours[e];
+            if (!active[q]) continue;
+            int a = uf.find(p);
+            int b = uf.find(q);
+            if (a == b) continue;
+
+            MergeNode node;
+            node.level = level;
+            node.parent = -1;
+            node.children[0] = rootNode[a];
+            node.children[1] = rootNode[b];
+            node.leafCount = merges[rootNode[a]].leafCount + merges[rootNode[b]].leafCount;
+            const int m = static_cast<int>(merges.size());
+            merges[rootNode[a]].parent = m;
+            merges[rootNode[b]].parent = m;
+            merges.push_back(node);
+
+            uf.unite(a, b);
+            rootNode[uf.find(p)] = m;
+        }
+    }
+
+    // Member ranges top-down: parents come after their children, so a
+    // reverse pass assigns every parent's range before its children's
+    const int numMerges = static_cast<int>(merges.size());
+    int next = 0;
+    for (int m = numMerges - 1; m >= 0; m--) {
+        MergeNode& node = merges[m];
+        if (node.parent < 0) {
+            node.first = next;
+            next += node.leafCount;
+        }
+        if (node.children[0] >= 0) {
+            merges[node.children[0]].first = node.first;
+            merges[node.children[1]].first = node.first + merges[node.children[0]].leafCount;
+        }
+    }
+    memberLeaves.resize(numLeaves);
+    for (int p = 0; p < numLeaves; p++) memberLeaves[merges[p].first] = leaves[p]->id;
+
+    byLevel.resize(numMerges);
+    for (int m = 0; m < numMerges; m++) byLevel[m] = m;
+    byParentLevel = byLevel;
+    sortDescending(byLevel, [this](int m) { return merges[m].level; });
+    sortDescending(byParentLevel, [this](int m) { return parentLevel(m); });
+
+    tops.clear();
+    topSlot.assign(numMerges, -1);
+    for (int m = 0; m < numMerges; m++) updateTop(m);
+    tracking = true;
+}
+
+std::vector<ConnectedComponent> ThresholdSweep::getComponents() const {
+    std::vector<ConnectedComponent> components;
+    if (!tracking) return components;
+
+    /**
+     * MATERIALIZATION
+     *
+     * QueryEngine numbers components by their first leaf in node order and
+     * accumulates members in node order; doing the same here makes the
+     * results (floating-point sums included) identical.
+     */
+    std::vector<std::vector<int>> members(tops.size());
+    for (size_t c = 0; c < tops.size(); c++) {
+        const MergeNode& node = merges[tops[c]];
+        members[c].assign(memberLeaves.begin() + node.first,
+                          memberLeaves.begin() + node.first + node.leafCount);
+        std::sort(members[c].begin(), members[c].end());
+    }
+    std::sort(members.begin(), members.end(),
+              [](const std::vector<int>& a, const std::vector<int>& b) { return a[0] < b[0]; });
+
+    const auto& nodes = tree->getAllNodes();
+    components.resize(members.size());
+    for (size_t c = 0; c < members.size(); c++) {
+        ConnectedComponent& comp = components[c];
+        comp.id = static_cast<int>(c);
+        comp.totalArea = 0;
+        comp.maxScore = 0;
+        comp.boundingBox = nodes[members[c][0]].bounds;
+        comp.nodeIndices = std::move(members[c]);
+        double scoreSum = 0;
+        double intensitySum = 0;
+
+        for (int index : comp.nodeIndices) {
+            const RegionTreeNode& node = nodes[index];
+            comp.totalArea += node.bounds.area();
+            comp.maxScore = std::max(comp.maxScore, node.anomalyScore);
+            scoreSum += node.anomalyScore;
+            intensitySum += node.stats.mean * node.bounds.area();
+
+            Region& box = comp.boundingBox;
+            box = Region(std::min(box.row1, node.bounds.row1), std::min(box.col1, node.bounds.col1),
+                         std::max(box.row2, node.bounds.row2), std::max(box.col2, node.bounds.col2));
+        }
+
+        comp.avgScore = scoreSum / comp.nodeIndices.size();
+        comp.meanIntensity = intensitySum / comp.totalArea;
+    }
+
+    std::stable_sort(components.begin(), components.end(),
+                     [](const ConnectedComponent& a, const ConnectedComponent& b) {
+                         return a.totalArea > b.totalArea;
+                     });
+    return components;
+}
+
+} // namespace SatelliteAnalytics
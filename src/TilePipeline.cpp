@@ -0,0 +1,238 @@
+/**
+ * @file TilePipeline.cpp
+ * @brief Implementation of the streaming tile pipeline
+ */
+
+#include "TilePipeline.h"
+#include "AnomalyDetector.h"
+#include "ImageLoader.h"
+#include "MappedFile.h"
+#include "QueryEngine.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <queue>
+
+namespace SatelliteAnalytics {
+
+namespace {
+
+/**
+ * @brief A tile's top-K entry with the key that breaks score ties
+ *
+ * The node index is dropped from the output (the tile's tree is discarded),
+ * so ties rank by tile (row-major), then by node index within the tile, as
+ * in QueryEngine. With a single tile this is the in-memory order.
+ */
+struct TileCandidate {
+    AnomalyRegion region;
+    int tileIndex;
+    int nodeIndex;
+};
+
+inline bool ranksBefore(const TileCandidate& a, const TileCandidate& b) {
+    if (a.region.anomalyScore != b.region.anomalyScore) {
+        return a.region.anomalyScore > b.region.anomalyScore;
+    }
+    return a.tileIndex < b.tileIndex || (a.tileIndex == b.tileIndex && a.nodeIndex < b.nodeIndex);
+}
+
+struct RanksBefore {
+    bool operator()(const TileCandidate& a, const TileCandidate& b) const {
+        return ranksBefore(a, b);
+    }
+};
+
+} // anonymous namespace
+
+TilePipeline::TilePipeline(const StreamingConfig& cfg) : config(cfg) {}
+
+bool TilePipeline::run(const std::string& filename) {
+    result = StreamingResult();
+
+    if (config.tileSize < std::max(1, config.minRegionSize)) {
+        std::cerr << "Error: tile size must be at least the minimum region size" << std::endl;
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+
+    PGMHeader header;
+    if (!ImageLoader::parsePGMHeader(file.data(), file.size(), header)) {
+        std::cerr << "Error: Invalid PGM format" << std::endl;
+        return false;
+    }
+    if (!header.binary) {
+        std::cerr << "Error: streaming mode needs a binary (P5) PGM file" << std::endl;
+        return false;
+    }
+
+    const int width = header.width;
+    const int height = header.height;
+    const size_t bytesPerSample = header.maxVal > 255 ? 2 : 1;
+    const size_t rowBytes = static_cast<size_t>(width) * bytesPerSample;
+
+    if ((file.size() - header.dataOffset) / rowBytes < static_cast<size_t>(height)) {
+        std::cerr << "Error: PGM file is truncated" << std::endl;
+        return false;
+    }
+
+    if (!file.isMapped()) {
+        std::cerr << "Warning: file could not be memory-mapped; it was read into memory"
+                  << std::endl;
+    }
+
+    result.width = width;
+    result.height = height;
+    result.memoryMapped = file.isMapped();
+
+    const uint8_t* samples = file.data() + header.dataOffset;
+    const std::vector<Pixel> scale = ImageLoader::makeScaleTable(header.maxVal);
+    const int tileSize = config.tileSize;
+    ThreadPool& pool = ThreadPool::shared();
+
+    // ========================================================================
+    // PASS 1: GLOBAL MEAN AND STANDARD DEVIATION
+    // ========================================================================
+
+    Timer timer;
+    timer.start();
+
+    int64_t totalSum = 0;
+    int64_t totalSumSquares = 0;
+    std::mutex sumMutex;
+
+    for (int bandBegin = 0; bandBegin < height; bandBegin += tileSize) {
+        const int bandEnd = std::min(height, bandBegin + tileSize);
+
+        pool.parallelFor(bandBegin, bandEnd, [&](int rowBegin, int rowEnd) {
+            std::vector<Pixel> row(width);
+            int64_t sum = 0;
+            int64_t sumSquares = 0;
+
+            for (int r = rowBegin; r < rowEnd; r++) {
+                ImageLoader::decodeBinarySamples(samples + static_cast<size_t>(r) * rowBytes,
+                                                 row.data(), width, header, scale);
+                int64_t rowSum = 0;
+                int64_t rowSumSquares = 0;
+                for (int c = 0; c < width; c++) {
+                    rowSum += row[c];
+                    rowSumSquares += static_cast<int64_t>(row[c]) * row[c];
+                }
+                sum += rowSum;
+                sumSquares += rowSumSquares;
+            }
+
+            std::lock_guard<std::mutex> lock(sumMutex);
+            totalSum += sum;
+            totalSumSquares += sumSquares;
+        }, 16);
+
+        file.release(header.dataOffset + static_cast<size_t>(bandBegin) * rowBytes,
+                     static_cast<size_t>(bandEnd - bandBegin) * rowBytes);
+    }
+
+    // Same formula as PrefixSum::computeGlobalStats
+    const double totalPixels = static_cast<double>(width) * height;
+    result.globalMean = static_cast<double>(totalSum) / totalPixels;
+    double variance = static_cast<double>(totalSumSquares) / totalPixels
+                    - result.globalMean * result.globalMean;
+    result.globalStdDev = std::sqrt(std::max(0.0, variance));
+
+    timer.stop();
+    result.statsPassMs = timer.elapsedMs();
+
+    // ========================================================================
+    // PASS 2: PER-TILE PREFIX SUMS, REGION TREES, DETECTION AND TOP-K
+    // ========================================================================
+
+    timer.start();
+
+    // Reused for every tile so the working set stays one tile's worth
+    Buffer2D<Pixel> tile;
+    PrefixSum prefixSum;
+    RegionTree tree;
+    AnomalyDetector detector(config.threshold);
+    QueryEngine engine;
+    QueryResult tileTop;
+    QueryScratch scratch;
+
+    // Global top-K: size-K heap whose top is the lowest-ranked entry
+    std::priority_queue<TileCandidate, std::vector<TileCandidate>, RanksBefore> topHeap;
+
+    for (int tileRow = 0; tileRow < height; tileRow += tileSize) {
+        const int tileHeight = std::min(tileSize, height - tileRow);
+
+        for (int tileCol = 0; tileCol < width; tileCol += tileSize) {
+            const int tileWidth = std::min(tileSize, width - tileCol);
+
+            tile.assign(tileHeight, tileWidth);
+            pool.parallelFor(0, tileHeight, [&](int rowBegin, int rowEnd) {
+                for (int r = rowBegin; r < rowEnd; r++) {
+                    const uint8_t* src = samples + static_cast<size_t>(tileRow + r) * rowBytes
+                                       + static_cast<size_t>(tileCol) * bytesPerSample;
+                    ImageLoader::decodeBinarySamples(src, tile[r], tileWidth, header, scale);
+                }
+            }, 16);
+
+            prefixSum.build(tile, config.prefixStorage);
+            tree.build(&prefixSum, config.minRegionSize, config.treeLayout);
+
+            detector.initialize(&prefixSum);
+            detector.setReferenceStats(result.globalMean, result.globalStdDev);
+            detector.detectInTree(tree);
+
+            engine.initialize(&tree, &prefixSum, &detector);
+
+            if (config.topK > 0) {
+                engine.topKWithPruning(config.topK, tileTop, scratch);
+                for (const AnomalyRegion& region : tileTop.regions) {
+                    TileCandidate candidate{region, result.tilesProcessed, region.nodeId};
+                    if (static_cast<int>(topHeap.size()) == config.topK &&
+                        !ranksBefore(candidate, topHeap.top())) {
+                        break;  // Tile results are in rank order, nothing further can enter
+                    }
+
+                    // Tile-local to scene coordinates; the tile's tree is discarded
+                    candidate.region.region.row1 += tileRow;
+                    candidate.region.region.row2 += tileRow;
+                    candidate.region.region.col1 += tileCol;
+                    candidate.region.region.col2 += tileCol;
+                    candidate.region.nodeId = -1;
+
+                    topHeap.push(candidate);
+                    if (static_cast<int>(topHeap.size()) > config.topK) topHeap.pop();
+                }
+            }
+
+            result.tilesProcessed++;
+            result.totalRegions += tree.getNodeCount();
+            result.anomalousRegions += engine.countAnomalousRegions();
+            result.anomalousArea += engine.getTotalAnomalousArea();
+            result.peakTileBytes = std::max(result.peakTileBytes,
+                tile.sizeBytes() + prefixSum.getMemoryBytes() + tree.getMemoryBytes());
+        }
+
+        file.release(header.dataOffset + static_cast<size_t>(tileRow) * rowBytes,
+                     static_cast<size_t>(tileHeight) * rowBytes);
+    }
+
+    // Extract heap into rank order
+    result.topK.resize(topHeap.size());
+    for (size_t i = topHeap.size(); i-- > 0;) {
+        result.topK[i] = topHeap.top().region;
+        topHeap.pop();
+    }
+
+    timer.stop();
+    result.tilePassMs = timer.elapsedMs();
+
+    return true;
+}
+
+} // namespace SatelliteAnalytics
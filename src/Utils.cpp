@@ -77,6 +77,45 @@ std::string formatTime(double milliseconds) {
     return oss.str();
 }
 
+std::string formatBytes(uint64_t bytes) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2);
+    
+    if (bytes < 1024) {
+        oss << bytes << " B";
+    } else if (bytes < 1024ULL * 1024) {
+        oss << (bytes / 1024.0) << " KB";
+    } else if (bytes < 1024ULL * 1024 * 1024) {
+        oss << (bytes / (1024.0 * 1024.0)) << " MB";
+    } else {
+        oss << (bytes / (1024.0 * 1024.0 * 1024.0)) << " GB";
+    }
+    
+    return oss.str();
+}
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) return value;
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+std::string formatRegionList(const std::vector<AnomalyRegion>& regions) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < regions.size(); i++) {
+        const AnomalyRegion& r = regions[i];
+        if (i > 0) oss << ';';
+        oss << r.region.row1 << ' ' << r.region.col1 << ' ' << r.region.row2 << ' '
+            << r.region.col2 << ' ' << r.anomalyScore;
+    }
+    return oss.str();
+}
+
 void printDivider(char ch, int length) {
     std::cout << std::string(length, ch) << std::endl;
 }
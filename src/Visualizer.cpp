@@ -4,6 +4,7 @@
  */
 
 #include "Visualizer.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -11,6 +12,86 @@
 
 namespace SatelliteAnalytics {
 
+namespace {
+
+// Output rows per task in the overlay and preview passes
+constexpr int RENDER_ROW_CHUNK = 64;
+
+// Staging buffer for packing padded PGM rows
+constexpr int PGM_WRITE_BYTES = 4 << 20;
+
+/**
+ * @brief Bounds of the anomalous leaves, in node order
+ * 
+ * Walks the set bits of the leaf bitmask and reads only the isAnomaly and
+ * bounds columns: no node records, no list of every leaf.
+ */
+std::vector<Region> anomalousLeafBounds(const RegionTree& tree) {
+    std::vector<Region> anomalous;
+    const RegionTreeColumns& columns = tree.getColumns();
+    const size_t words = columns.leafMask.size();
+    for (size_t w = 0; w < words; w++) {
+        uint64_t bits = columns.leafMask[w];
+        while (bits) {
+            const size_t i = w * 64 + __builtin_ctzll(bits);
+            if (columns.isAnomaly[i]) anomalous.push_back(columns.bounds[i]);
+            bits &= bits - 1;
+        }
+    }
+    return anomalous;
+}
+
+/**
+ * @brief Truncated mean of block (r, c) of side scale, clipped at the image edge
+ */
+Pixel blockMean(const PrefixSum& prefixSum, int r, int c, int scale) {
+    const int r1 = r * scale;
+    const int c1 = c * scale;
+    const int r2 = std::min(prefixSum.getHeight() - 1, r1 + scale - 1);
+    const int c2 = std::min(prefixSum.getWidth() - 1, c1 + scale - 1);
+    const int64_t count = static_cast<int64_t>(r2 - r1 + 1) * (c2 - c1 + 1);
+    return static_cast<Pixel>(prefixSum.querySum(r1, c1, r2, c2) / count);
+}
+
+/**
+ * @brief image = min(255, source + amount) over a box, rows [rowBegin, rowEnd) only
+ * 
+ * Reads the source, so brightening a pixel twice has no extra effect.
+ */
+void brightenBox(const Matrix& source, Matrix& image, const Region& box, int amount,
+                 int rowBegin, int rowEnd) {
+    const int r1 = std::max(box.row1, rowBegin);
+    const int r2 = std::min(box.row2, rowEnd - 1);
+    const int c1 = std::max(box.col1, 0);
+    const int c2 = std::min(box.col2, image.cols() - 1);
+    for (int r = r1; r <= r2; r++) {
+        const Pixel* in = source[r];
+        Pixel* out = image[r];
+        for (int c = c1; c <= c2; c++) {
+            out[c] = static_cast<Pixel>(std::min(255, in[c] + amount));
+        }
+    }
+}
+
+/**
+ * @brief One-pixel white outline of a box, rows [rowBegin, rowEnd) only
+ */
+void outlineBox(Matrix& image, const Region& box, int rowBegin, int rowEnd) {
+    const int width = image.cols();
+    for (int r = std::max(box.row1, rowBegin); r <= std::min(box.row2, rowEnd - 1); r++) {
+        if (box.col1 >= 0 && box.col1 < width) image[r][box.col1] = 255;
+        if (box.col2 >= 0 && box.col2 < width) image[r][box.col2] = 255;
+    }
+    const int c1 = std::max(box.col1, 0);
+    const int c2 = std::min(box.col2, width - 1);
+    if (c1 > c2) return;
+    for (int r : {box.row1, box.row2}) {
+        if (r >= rowBegin && r < rowEnd) std::fill(image[r] + c1, image[r] + c2 + 1, 255);
+    }
+}
+
+} // anonymous namespace
+
 Visualizer::Visualizer(int width, int height) 
     : consoleWidth(width), consoleHeight(height) {}
 
@@ -26,88 +107,64 @@ char Visualizer::pixelToChar(Pixel value) const {
     return valueToChar(value / 255.0);
 }
 
-void Visualizer::renderASCII(const Matrix& image, int scale) const {
-    if (image.empty()) return;
+void Visualizer::renderASCII(const PrefixSum& prefixSum, int scale) const {
+    if (!prefixSum.isBuilt()) return;
+    scale = std::max(1, scale);
     
-    int height = image.size();
-    int width = image[0].size();
+    int height = prefixSum.getHeight();
+    int width = prefixSum.getWidth();
     
     int outHeight = std::min(consoleHeight, height / scale);
     int outWidth = std::min(consoleWidth, width / scale);
     
     std::cout << "\n";
+    std::string line;
     for (int r = 0; r < outHeight; r++) {
+        line.clear();
         for (int c = 0; c < outWidth; c++) {
-            // Average pixel values in the block
-            int avgVal = 0;
-            int count = 0;
-            
-            for (int dr = 0; dr < scale && r * scale + dr < height; dr++) {
-                for (int dc = 0; dc < scale && c * scale + dc < width; dc++) {
-                    avgVal += image[r * scale + dr][c * scale + dc];
-                    count++;
-                }
-            }
-            
-            avgVal = count > 0 ? avgVal / count : 0;
-            std::cout << pixelToChar(avgVal);
+            line += pixelToChar(blockMean(prefixSum, r, c, scale));
         }
-        std::cout << "\n";
+        std::cout << line << "\n";
     }
 }
 
-void Visualizer::renderAnomalyMap(const Matrix& image, const RegionTree& tree,
+void Visualizer::renderAnomalyMap(const PrefixSum& prefixSum, const RegionTree& tree,
                                    int scale) const {
-    if (image.empty()) return;
+    if (!prefixSum.isBuilt()) return;
+    scale = std::max(1, scale);
     
-    int height = image.size();
-    int width = image[0].size();
+    int height = prefixSum.getHeight();
+    int width = prefixSum.getWidth();
     
-    // Create a mask for anomalies
-    std::vector<std::vector<bool>> anomalyMask(height, std::vector<bool>(width, false));
+    int outHeight = std::min(consoleHeight, height / scale);
+    int outWidth = std::min(consoleWidth, width / scale);
     
-    auto leaves = tree.getLeaves();
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) {
-            for (int r = leaf->bounds.row1; r <= leaf->bounds.row2 && r < height; r++) {
-                for (int c = leaf->bounds.col1; c <= leaf->bounds.col2 && c < width; c++) {
-                    anomalyMask[r][c] = true;
-                }
+    // A character is anomalous if any pixel of its block is: mark the
+    // blocks each anomalous leaf touches
+    std::vector<uint8_t> marked(static_cast<size_t>(std::max(0, outHeight)) * std::max(0, outWidth), 0);
+    for (const Region& leaf : anomalousLeafBounds(tree)) {
+        const int r2 = std::min(outHeight - 1, leaf.row2 / scale);
+        const int c2 = std::min(outWidth - 1, leaf.col2 / scale);
+        for (int r = leaf.row1 / scale; r <= r2; r++) {
+            for (int c = leaf.col1 / scale; c <= c2; c++) {
+                marked[static_cast<size_t>(r) * outWidth + c] = 1;
             }
         }
     }
     
-    int outHeight = std::min(consoleHeight, height / scale);
-    int outWidth = std::min(consoleWidth, width / scale);
-    
     std::cout << "\n";
+    std::string line;
     for (int r = 0; r < outHeight; r++) {
+        line.clear();
         for (int c = 0; c < outWidth; c++) {
-            // Check if any pixel in this block is anomalous
-            bool isAnomaly = false;
-            int avgVal = 0;
-            int count = 0;
-            
-            for (int dr = 0; dr < scale && r * scale + dr < height; dr++) {
-                for (int dc = 0; dc < scale && c * scale + dc < width; dc++) {
-                    int row = r * scale + dr;
-                    int col = c * scale + dc;
-                    avgVal += image[row][col];
-                    count++;
-                    if (anomalyMask[row][col]) isAnomaly = true;
-                }
-            }
-            
-            avgVal = count > 0 ? avgVal / count : 0;
-            
-            if (isAnomaly) {
+            if (marked[static_cast<size_t>(r) * outWidth + c]) {
                 // Highlight anomalies with special character
-                std::cout << 'X';
+                line += 'X';
             } else {
-                std::cout << pixelToChar(avgVal);
+                line += pixelToChar(blockMean(prefixSum, r, c, scale));
             }
         }
-        std::cout << "\n";
+        std::cout << line << "\n";
     }
     
     std::cout << "\nLegend: 'X' = Anomalous region\n";
@@ -118,11 +175,11 @@ void Visualizer::renderComponents(const Matrix& image,
                                   int scale) const {
     if (image.empty()) return;
     
-    int height = image.size();
-    int width = image[0].size();
+    int height = image.rows();
+    int width = image.cols();
     
     // Create component ID map
-    std::vector<std::vector<int>> componentMap(height, std::vector<int>(width, -1));
+    Buffer2D<int> componentMap(height, width, -1);
     
     for (size_t i = 0; i < components.size() && i < 9; i++) {
         const auto& comp = components[i];
@@ -174,59 +231,45 @@ void Visualizer::renderTreeStructure(const RegionTree& tree, int maxDepth) const
     std::cout << "Root: [" << root.bounds.row1 << "," << root.bounds.col1 
               << "]-[" << root.bounds.row2 << "," << root.bounds.col2 << "]\n";
     
+    // One pass over the top levels, counting nodes per depth
+    std::vector<size_t> levelSizes(std::max(0, maxDepth) + 1, 0);
+    tree.traverseDepthFirst([&](const RegionTreeNode& node, bool& descend) {
+        levelSizes[node.depth]++;
+        descend = node.depth < maxDepth;
+    });
     for (int d = 1; d <= maxDepth; d++) {
-        auto nodesAtDepth = tree.getNodesAtDepth(d);
-        std::cout << "Level " << d << ": " << nodesAtDepth.size() << " nodes\n";
+        std::cout << "Level " << d << ": " << levelSizes[d] << " nodes\n";
     }
 }
 
-Matrix Visualizer::createAnomalyOverlay(const Matrix& source, 
-                                        const RegionTree& tree) const {
-    Matrix result = source;
+Matrix Visualizer::createAnomalyOverlay(const Matrix& source, const RegionTree& tree,
+                                        int factor) const {
+    if (source.empty()) return Matrix();
+    factor = std::max(1, factor);
+    
+    // Leaf bounds in source pixels
+    std::vector<Region> boxes = anomalousLeafBounds(tree);
+    for (Region& box : boxes) {
+        box = Region(box.row1 / factor, box.col1 / factor, box.row2 / factor, box.col2 / factor);
+    }
     
-    auto leaves = tree.getLeaves();
-    for (const auto* leaf : leaves) {
-        if (leaf->isAnomaly) {
-            // Highlight by setting to bright
-            for (int r = leaf->bounds.row1; r <= leaf->bounds.row2; r++) {
-                for (int c = leaf->bounds.col1; c <= leaf->bounds.col2; c++) {
-                    if (r >= 0 && r < static_cast<int>(result.size()) &&
-                        c >= 0 && c < static_cast<int>(result[0].size())) {
-                        // Brighten the pixel
-                        int val = result[r][c];
-                        val = std::min(255, val + 100);
-                        result[r][c] = static_cast<Pixel>(val);
-                    }
-                }
-            }
-            
-            // Draw border
-            for (int r = leaf->bounds.row1; r <= leaf->bounds.row2; r++) {
-                if (r >= 0 && r < static_cast<int>(result.size())) {
-                    if (leaf->bounds.col1 >= 0 && 
-                        leaf->bounds.col1 < static_cast<int>(result[0].size())) {
-                        result[r][leaf->bounds.col1] = 255;
-                    }
-                    if (leaf->bounds.col2 >= 0 && 
-                        leaf->bounds.col2 < static_cast<int>(result[0].size())) {
-                        result[r][leaf->bounds.col2] = 255;
-                    }
-                }
-            }
-            for (int c = leaf->bounds.col1; c <= leaf->bounds.col2; c++) {
-                if (c >= 0 && c < static_cast<int>(result[0].size())) {
-                    if (leaf->bounds.row1 >= 0 && 
-                        leaf->bounds.row1 < static_cast<int>(result.size())) {
-                        result[leaf->bounds.row1][c] = 255;
-                    }
-                    if (leaf->bounds.row2 >= 0 && 
-                        leaf->bounds.row2 < static_cast<int>(result.size())) {
-                        result[leaf->bounds.row2][c] = 255;
-                    }
-                }
-            }
+    /**
+     * One block copy, then each task owns a band of output rows and draws
+     * every box crossing it. Full-size leaves are disjoint, so each box is
+     * outlined while it is still in cache; preview boxes can share pixels,
+     * so there all fills go first and no fill paints over an outline.
+     */
+    Matrix result = source;
+    ThreadPool::shared().parallelFor(0, source.rows(), [&](int rowBegin, int rowEnd) {
+        for (const Region& box : boxes) {
+            brightenBox(source, result, box, 100, rowBegin, rowEnd);
+            if (factor == 1) outlineBox(result, box, rowBegin, rowEnd);
         }
-    }
+        if (factor == 1) return;
+        for (const Region& box : boxes) {
+            outlineBox(result, box, rowBegin, rowEnd);
+        }
+    }, RENDER_ROW_CHUNK);
     
     return result;
 }
@@ -234,53 +277,61 @@ Matrix Visualizer::createAnomalyOverlay(const Matrix& source,
 Matrix Visualizer::createComponentOverlay(const Matrix& source,
                                           const ConnectedComponent& component,
                                           const RegionTree& tree) const {
-    Matrix result = source;
+    if (source.empty()) return Matrix();
     
-    // Highlight the bounding box
+    // Highlight the bounding box, then a two-pixel border
     const auto& bb = component.boundingBox;
-    
-    // Fill with highlight
-    for (int r = bb.row1; r <= bb.row2; r++) {
-        for (int c = bb.col1; c <= bb.col2; c++) {
-            if (r >= 0 && r < static_cast<int>(result.size()) &&
-                c >= 0 && c < static_cast<int>(result[0].size())) {
-                int val = result[r][c];
-                val = std::min(255, val + 80);
-                result[r][c] = static_cast<Pixel>(val);
-            }
+    Matrix result = source;
+    ThreadPool::shared().parallelFor(0, source.rows(), [&](int rowBegin, int rowEnd) {
+        brightenBox(source, result, bb, 80, rowBegin, rowEnd);
+        for (int i = 0; i < 2; i++) {
+            outlineBox(result, Region(bb.row1 + i, bb.col1 + i, bb.row2 - i, bb.col2 - i),
+                       rowBegin, rowEnd);
         }
-    }
+    }, RENDER_ROW_CHUNK);
     
-    // Draw thick border
-    for (int i = 0; i < 2; i++) {
-        int r1 = bb.row1 + i;
-        int r2 = bb.row2 - i;
-        int c1 = bb.col1 + i;
-        int c2 = bb.col2 - i;
-        
-        for (int r = r1; r <= r2; r++) {
-            if (r >= 0 && r < static_cast<int>(result.size())) {
-                if (c1 >= 0 && c1 < static_cast<int>(result[0].size())) {
-                    result[r][c1] = 255;
-                }
-                if (c2 >= 0 && c2 < static_cast<int>(result[0].size())) {
-                    result[r][c2] = 255;
-                }
-            }
-        }
-        for (int c = c1; c <= c2; c++) {
-            if (c >= 0 && c < static_cast<int>(result[0].size())) {
-                if (r1 >= 0 && r1 < static_cast<int>(result.size())) {
-                    result[r1][c] = 255;
-                }
-                if (r2 >= 0 && r2 < static_cast<int>(result.size())) {
-                    result[r2][c] = 255;
-                }
+    return result;
+}
+
+Matrix Visualizer::createPreview(const PrefixSum& prefixSum, int factor) const {
+    if (!prefixSum.isBuilt()) return Matrix();
+    
+    const int height = prefixSum.getHeight();
+    const int width = prefixSum.getWidth();
+    factor = std::clamp(factor, 1, std::max(height, width));
+    const int outHeight = (height + factor - 1) / factor;
+    const int outWidth = (width + factor - 1) / factor;
+    
+    // Box filter: rounded mean of each block, edge blocks clipped
+    Matrix preview(outHeight, outWidth);
+    ThreadPool::shared().parallelFor(0, outHeight, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            const int r1 = r * factor;
+            const int r2 = std::min(height - 1, r1 + factor - 1);
+            Pixel* out = preview[r];
+            for (int c = 0; c < outWidth; c++) {
+                const int c1 = c * factor;
+                const int c2 = std::min(width - 1, c1 + factor - 1);
+                const int64_t area = static_cast<int64_t>(r2 - r1 + 1) * (c2 - c1 + 1);
+                out[c] = static_cast<Pixel>((prefixSum.querySum(r1, c1, r2, c2) + area / 2) / area);
             }
         }
-    }
+    }, RENDER_ROW_CHUNK);
     
-    return result;
+    return preview;
+}
+
+std::vector<Matrix> Visualizer::buildPreviewPyramid(const PrefixSum& prefixSum,
+                                                    int levels) const {
+    std::vector<Matrix> pyramid;
+    if (!prefixSum.isBuilt()) return pyramid;
+    
+    const int largest = std::max(prefixSum.getHeight(), prefixSum.getWidth());
+    for (int level = 1, factor = 2; level <= levels; level++, factor *= 2) {
+        pyramid.push_back(createPreview(prefixSum, factor));
+        if (factor >= largest) break;       // 1 x 1
+    }
+    return pyramid;
 }
 
 bool Visualizer::savePGM(const Matrix& image, const std::string& filename) const {
@@ -289,18 +340,28 @@ bool Visualizer::savePGM(const Matrix& image, const std::string& filename) const
     std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) return false;
     
-    int height = image.size();
-    int width = image[0].size();
+    int height = image.rows();
+    int width = image.cols();
     
     file << "P5\n" << width << " " << height << "\n255\n";
     
-    for (const auto& row : image) {
-        for (Pixel p : row) {
-            file.put(static_cast<char>(p));
+    // Unpadded rows are one block; padded rows are packed a few MB at a time
+    if (image.stride() == static_cast<size_t>(width)) {
+        file.write(reinterpret_cast<const char*>(image.data()),
+                   static_cast<std::streamsize>(width) * height);
+        return static_cast<bool>(file);
+    }
+    const int rowsPerWrite = std::max(1, PGM_WRITE_BYTES / width);
+    std::vector<char> packed(static_cast<size_t>(std::min(rowsPerWrite, height)) * width);
+    for (int r = 0; r < height; r += rowsPerWrite) {
+        const int rows = std::min(rowsPerWrite, height - r);
+        for (int i = 0; i < rows; i++) {
+            std::copy(image[r + i], image[r + i] + width, packed.begin() + static_cast<size_t>(i) * width);
         }
+        file.write(packed.data(), static_cast<std::streamsize>(rows) * width);
     }
     
-    return true;
+    return static_cast<bool>(file);
 }
 
 void Visualizer::printAnomalySummary(const std::vector<AnomalyRegion>& regions) const {
@@ -352,6 +413,39 @@ void Visualizer::printComponentSummary(
     printDivider('-', 70);
 }
 
+void Visualizer::printPixelComponentSummary(
+    const std::vector<ConnectedComponent>& components, int maxRows) const {
+    
+    std::cout << "\n";
+    printDivider('-', 70);
+    std::cout << std::left << std::setw(8) << "Label"
+              << std::setw(12) << "Area"
+              << std::setw(26) << "Bounding Box"
+              << std::setw(10) << "Mean"
+              << std::setw(10) << "Max Z" << "\n";
+    printDivider('-', 70);
+    
+    int shown = std::min(static_cast<int>(components.size()), maxRows);
+    for (int i = 0; i < shown; i++) {
+        const auto& comp = components[i];
+        const Region& box = comp.boundingBox;
+        std::string bounds = "[" + std::to_string(box.row1) + "," + std::to_string(box.col1) +
+                             "]-[" + std::to_string(box.row2) + "," + std::to_string(box.col2) + "]";
+        std::cout << std::left << std::setw(8) << comp.id
+                  << std::setw(12) << formatNumber(comp.totalArea)
+                  << std::setw(26) << bounds
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << comp.meanIntensity
+                  << std::setprecision(3)
+                  << std::setw(10) << comp.maxScore << "\n";
+    }
+    
+    if (static_cast<int>(components.size()) > shown) {
+        std::cout << "... " << formatNumber(components.size() - shown) << " more\n";
+    }
+    printDivider('-', 70);
+}
+
 void Visualizer::printQueryResult(const QueryResult& result, 
                                   const std::string& queryName) const {
     std::cout << "\n";
@@ -27,14 +27,28 @@
 #include <iomanip>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <vector>
 
 #include "Utils.h"
 #include "ImageLoader.h"
 #include "PrefixSum.h"
+#include "MultiBandPrefixSum.h"
 #include "RegionTree.h"
 #include "AnomalyDetector.h"
 #include "QueryEngine.h"
 #include "Visualizer.h"
+#include "ThreadPool.h"
+#include "PixelLabeler.h"
+#include "TilePipeline.h"
+#include "SceneIndex.h"
+#include "QueryServer.h"
+#include "ThresholdSweep.h"
+#include "BatchProcessor.h"
+#include "SceneSeries.h"
+#include "Profiler.h"
 
 using namespace SatelliteAnalytics;
 
@@ -49,11 +63,64 @@ struct AppConfig {
     double threshold = 2.0;
     bool verbose = true;
     bool showVisualization = true;
+    PrefixStorage prefixStorage = PrefixStorage::Full;
+    int numThreads = 0;                 // 0 = hardware concurrency
+    TreeLayout treeLayout = TreeLayout::DepthFirst;
+    bool pixelComponents = false;
+    bool streaming = false;
+    int tileSize = Config::STREAM_TILE_SIZE;
+    std::string saveIndexFile = "";
+    std::string loadIndexFile = "";
+    std::vector<double> sweepThresholds;  // --sweep: re-threshold incrementally after detection
+    std::string patchFile = "";         // --patch: replace a rectangle after detection
+    int patchRow = 0;
+    int patchCol = 0;
+    std::string batchSource = "";       // --batch: directory or manifest of scenes
+    std::string batchOutput = "batch_results.csv";
+    std::string seriesSource = "";      // --series: scenes of one area in acquisition order
+    std::string seriesOutput = "series_changes.csv";
+    double localBaseline = 0;           // --local-baseline: ring scale, 0 = global baseline
+    double adaptiveTree = 0;            // --adaptive-tree: split variance tolerance, 0 = uniform
+    int bands = 0;                      // --bands: generate an N-band scene
+    BandScoring bandScoring = BandScoring::Mahalanobis;
+    std::string profileFile = "";       // --profile: write timings and counters here at exit
+    bool profileTrace = false;          // --profile-format chrome
+    bool serve = false;
+    int servePort = 0;                  // 0 = serve stdin / stdout
     int visualScale = 8;
     std::string inputFile = "";
     std::string outputFile = "output_anomalies.pgm";
+    int previewLevels = 0;              // --preview-levels: also save 1/2, 1/4, ... overlays
 };
 
+/**
+ * @brief Multi-band runs: --bands, or an --input file with the .pam extension
+ */
+bool isMultiBand(const AppConfig& cfg) {
+    const std::string& in = cfg.inputFile;
+    return cfg.bands > 0 || (in.size() > 4 && in.compare(in.size() - 4, 4, ".pam") == 0);
+}
+
+/**
+ * @brief Output name of a downscaled preview: "out.pgm" -> "out_4x.pgm"
+ */
+std::string previewFileName(const std::string& outputFile, int factor) {
+    const size_t dot = outputFile.find_last_of('.');
+    const size_t slash = outputFile.find_last_of('/');
+    const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    const std::string suffix = "_" + std::to_string(factor) + "x";
+    return hasExtension ? outputFile.substr(0, dot) + suffix + outputFile.substr(dot)
+                        : outputFile + suffix;
+}
+
+const char* storageName(PrefixStorage storage) {
+    switch (storage) {
+        case PrefixStorage::Compact: return "compact";
+        case PrefixStorage::Blocked: return "blocked";
+        default: return "full";
+    }
+}
+
 void printUsage(const char* progName) {
     std::cout << "Usage: " << progName << " [options]\n\n";
     std::cout << "Options:\n";
@@ -61,8 +128,33 @@ void printUsage(const char* progName) {
     std::cout << "  --anomalies N   Number of anomalies to generate (default: 8)\n";
     std::cout << "  --topk N        Top-K regions to find (default: 10)\n";
     std::cout << "  --threshold T   Anomaly threshold (default: 2.0 std devs)\n";
-    std::cout << "  --input FILE    Load PGM image instead of generating\n";
+    std::cout << "  --input FILE    Load PGM image instead of generating (.pam: multi-band)\n";
+    std::cout << "  --local-baseline F Score regions against the ring F x their size around them\n";
+    std::cout << "  --bands N       Generate an N-band 12-bit scene and score all bands\n";
+    std::cout << "  --band-score S  Combine bands: z or mahalanobis (default: mahalanobis)\n";
     std::cout << "  --output FILE   Output file for visualization (default: output_anomalies.pgm)\n";
+    std::cout << "  --preview-levels N Also save the overlay at 1/2, 1/4, .. 1/2^N size\n";
+    std::cout << "  --threads N     Worker threads for parallel stages (default: all cores)\n";
+    std::cout << "  --compact-prefix Use tiled compact prefix tables (less memory)\n";
+    std::cout << "  --blocked-prefix Use blocked prefix tables (cheap --patch updates)\n";
+    std::cout << "  --tree-layout L Region tree node order: dfs or bfs (default: dfs)\n";
+    std::cout << "  --adaptive-tree V Stop splitting regions whose variance is at most V\n";
+    std::cout << "  --pixel-components Also label anomalous pixels at full resolution\n";
+    std::cout << "  --stream        Process --input tile by tile (P5 only, bounded memory)\n";
+    std::cout << "  --tile-size N   Tile side for --stream (default: " << Config::STREAM_TILE_SIZE << ")\n";
+    std::cout << "  --save-index FILE Write prefix tables and region tree to an index file\n";
+    std::cout << "  --load-index FILE Query a saved index instead of loading an image\n";
+    std::cout << "  --sweep T1,T2.. Re-threshold incrementally at each T after detection\n";
+    std::cout << "  --patch FILE    Replace part of the scene with a PGM patch after detection\n";
+    std::cout << "  --patch-origin R,C Top-left pixel of --patch in the scene (default: 0,0)\n";
+    std::cout << "  --batch PATH    Analyse every PGM in a directory or manifest in one run\n";
+    std::cout << "  --batch-output FILE CSV with one row per scene (default: batch_results.csv)\n";
+    std::cout << "  --series PATH   Detect changes between consecutive scenes of a directory or manifest\n";
+    std::cout << "  --series-output FILE CSV with one row per scene pair (default: series_changes.csv)\n";
+    std::cout << "  --profile FILE  Write stage / query latencies and counters at exit\n";
+    std::cout << "  --profile-format F json summary or chrome trace events (default: json)\n";
+    std::cout << "  --serve         Answer line-protocol queries on stdin / stdout\n";
+    std::cout << "  --port N        With --serve, listen on 127.0.0.1:N instead\n";
     std::cout << "  --no-visual     Disable ASCII visualization\n";
     std::cout << "  --quiet         Reduce output verbosity\n";
     std::cout << "  --help          Show this help message\n";
@@ -87,6 +179,67 @@ AppConfig parseArgs(int argc, char* argv[]) {
             cfg.inputFile = argv[++i];
         } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             cfg.outputFile = argv[++i];
+        } else if (strcmp(argv[i], "--preview-levels") == 0 && i + 1 < argc) {
+            cfg.previewLevels = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            cfg.numThreads = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tree-layout") == 0 && i + 1 < argc) {
+            ++i;
+            cfg.treeLayout = strcmp(argv[i], "bfs") == 0 ? TreeLayout::BreadthFirst
+                                                         : TreeLayout::DepthFirst;
+        } else if (strcmp(argv[i], "--adaptive-tree") == 0 && i + 1 < argc) {
+            cfg.adaptiveTree = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--compact-prefix") == 0) {
+            cfg.prefixStorage = PrefixStorage::Compact;
+        } else if (strcmp(argv[i], "--blocked-prefix") == 0) {
+            cfg.prefixStorage = PrefixStorage::Blocked;
+        } else if (strcmp(argv[i], "--pixel-components") == 0) {
+            cfg.pixelComponents = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            cfg.streaming = true;
+        } else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc) {
+            cfg.tileSize = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--save-index") == 0 && i + 1 < argc) {
+            cfg.saveIndexFile = argv[++i];
+        } else if (strcmp(argv[i], "--load-index") == 0 && i + 1 < argc) {
+            cfg.loadIndexFile = argv[++i];
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            const char* list = argv[++i];
+            char* end = nullptr;
+            for (double t = std::strtod(list, &end); end != list; t = std::strtod(list, &end)) {
+                cfg.sweepThresholds.push_back(t);
+                list = (*end == ',') ? end + 1 : end;
+            }
+        } else if (strcmp(argv[i], "--patch") == 0 && i + 1 < argc) {
+            cfg.patchFile = argv[++i];
+        } else if (strcmp(argv[i], "--patch-origin") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            cfg.patchRow = static_cast<int>(std::strtol(argv[++i], &end, 10));
+            cfg.patchCol = (*end == ',') ? static_cast<int>(std::strtol(end + 1, nullptr, 10)) : 0;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            cfg.batchSource = argv[++i];
+        } else if (strcmp(argv[i], "--batch-output") == 0 && i + 1 < argc) {
+            cfg.batchOutput = argv[++i];
+        } else if (strcmp(argv[i], "--series") == 0 && i + 1 < argc) {
+            cfg.seriesSource = argv[++i];
+        } else if (strcmp(argv[i], "--series-output") == 0 && i + 1 < argc) {
+            cfg.seriesOutput = argv[++i];
+        } else if (strcmp(argv[i], "--local-baseline") == 0 && i + 1 < argc) {
+            cfg.localBaseline = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--bands") == 0 && i + 1 < argc) {
+            cfg.bands = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--band-score") == 0 && i + 1 < argc) {
+            i++;
+            cfg.bandScoring = strcmp(argv[i], "z") == 0 ? BandScoring::BandZ
+                                                        : BandScoring::Mahalanobis;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            cfg.profileFile = argv[++i];
+        } else if (strcmp(argv[i], "--profile-format") == 0 && i + 1 < argc) {
+            cfg.profileTrace = strcmp(argv[++i], "chrome") == 0;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            cfg.serve = true;
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            cfg.servePort = std::stoi(argv[++i]);
         } else if (strcmp(argv[i], "--no-visual") == 0) {
             cfg.showVisualization = false;
         } else if (strcmp(argv[i], "--quiet") == 0) {
@@ -97,12 +250,492 @@ AppConfig parseArgs(int argc, char* argv[]) {
     return cfg;
 }
 
+// ============================================================================
+// STREAMING MODE
+// ============================================================================
+
+/**
+ * @brief Run the tile-at-a-time pipeline on cfg.inputFile
+ */
+int runStreaming(const AppConfig& cfg) {
+    printHeader("STREAMING TILE PIPELINE");
+    
+    if (cfg.inputFile.empty()) {
+        std::cerr << "Error: --stream requires --input FILE\n";
+        return 1;
+    }
+    
+    StreamingConfig streamCfg;
+    streamCfg.tileSize = cfg.tileSize;
+    streamCfg.threshold = cfg.threshold;
+    streamCfg.topK = cfg.topK;
+    streamCfg.prefixStorage = cfg.prefixStorage;
+    streamCfg.treeLayout = cfg.treeLayout;
+    
+    std::cout << "Input: " << cfg.inputFile << "\n";
+    std::cout << "Tile size: " << streamCfg.tileSize << "x" << streamCfg.tileSize << "\n";
+    std::cout << "Threads: " << ThreadPool::shared().getThreadCount() << "\n";
+    
+    TilePipeline pipeline(streamCfg);
+    if (!pipeline.run(cfg.inputFile)) {
+        std::cerr << "Error: Streaming run failed\n";
+        return 1;
+    }
+    
+    const StreamingResult& res = pipeline.getResult();
+    std::cout << "\nScene dimensions: " << res.height << " x " << res.width << "\n";
+    std::cout << "Tiles processed: " << formatNumber(res.tilesProcessed) << "\n";
+    std::cout << "Global mean: " << std::fixed << std::setprecision(2) << res.globalMean << "\n";
+    std::cout << "Global std dev: " << std::fixed << std::setprecision(2) << res.globalStdDev << "\n";
+    std::cout << "Statistics pass time: " << formatTime(res.statsPassMs) << "\n";
+    std::cout << "Tile pass time: " << formatTime(res.tilePassMs) << "\n";
+    std::cout << "Peak tile working set: " << formatBytes(res.peakTileBytes) << "\n";
+    
+    std::cout << "\nTotal regions: " << formatNumber(res.totalRegions) << "\n";
+    std::cout << "Anomalous regions: " << formatNumber(res.anomalousRegions) << "\n";
+    std::cout << "Anomalous area: " << formatNumber(res.anomalousArea) << " pixels\n";
+    
+    std::cout << "\n--- Top-" << cfg.topK << " Anomalous Regions (scene-wide) ---\n";
+    Visualizer visualizer;
+    visualizer.printAnomalySummary(res.topK);
+    
+    return 0;
+}
+
+// ============================================================================
+// INDEXED QUERY MODE
+// ============================================================================
+
+/**
+ * @brief Run the queries against a saved scene index (no image, no rebuild)
+ */
+int runFromIndex(const AppConfig& cfg) {
+    printHeader("INDEXED QUERY MODE");
+    
+    SceneIndex index;
+    if (!index.open(cfg.loadIndexFile)) {
+        std::cerr << "Error: Failed to open index\n";
+        return 1;
+    }
+    
+    const PrefixSum& prefixSum = index.getPrefixSum();
+    const RegionTree& regionTree = index.getRegionTree();
+    
+    std::cout << "Index: " << cfg.loadIndexFile << " (" << formatBytes(index.getFileBytes())
+              << (index.isMapped() ? ", memory-mapped" : ", read into memory") << ")\n";
+    std::cout << "Open time: " << formatTime(index.getOpenTimeMs()) << "\n";
+    std::cout << "Scene dimensions: " << prefixSum.getHeight() << " x " << prefixSum.getWidth() << "\n";
+    std::cout << "Prefix tables: " << storageName(prefixSum.getStorage()) << "\n";
+    std::cout << "Tree nodes: " << formatNumber(regionTree.getNodeCount())
+              << " (" << formatNumber(regionTree.getLeafCount()) << " leaves)\n";
+    std::cout << "Global mean: " << std::fixed << std::setprecision(2) << prefixSum.getGlobalMean() << "\n";
+    std::cout << "Global std dev: " << prefixSum.getGlobalStdDev() << "\n";
+    
+    // Scores saved with the index are reused when the threshold matches
+    AnomalyDetector detector(cfg.threshold);
+    detector.initialize(&prefixSum);
+    if (cfg.localBaseline > 0) {
+        detector.setBaseline(ScoreBaseline::Local, cfg.localBaseline);
+    }
+    if (index.isScoredAt(detector)) {
+        std::cout << "Anomaly scores: stored (threshold " << cfg.threshold
+                  << (cfg.localBaseline > 0 ? ", local baseline" : "") << ")\n";
+    } else {
+        detector.detectInTree(index.getRegionTreeMutable());
+        std::cout << "Anomaly scores: recomputed for threshold " << cfg.threshold
+                  << " in " << formatTime(detector.getStats().detectionTimeMs) << "\n";
+    }
+    
+    QueryEngine queryEngine;
+    queryEngine.initialize(&regionTree, &prefixSum, &detector);
+    Visualizer visualizer;
+    
+    std::cout << "\nAnomalous regions: " << formatNumber(queryEngine.countAnomalousRegions()) << "\n";
+    std::cout << "Anomalous area: " << formatNumber(queryEngine.getTotalAnomalousArea()) << " pixels\n";
+    
+    std::cout << "\n--- Top-" << cfg.topK << " Anomalous Regions ---\n";
+    auto prunedResult = queryEngine.topKWithPruning(cfg.topK);
+    visualizer.printQueryResult(prunedResult, "Top-K with Pruning");
+    visualizer.printAnomalySummary(prunedResult.regions);
+    
+    std::cout << "\n--- Connected Components (Union-Find) ---\n";
+    Timer queryTimer;
+    queryTimer.start();
+    auto components = queryEngine.findConnectedComponents();
+    queryTimer.stop();
+    
+    std::cout << "Connected components found: " << components.size() << "\n";
+    std::cout << "Query time: " << formatTime(queryTimer.elapsedMs()) << "\n";
+    if (!components.empty()) {
+        visualizer.printComponentSummary(components);
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// BATCH MODE
+// ============================================================================
+
+/**
+ * @brief Analyse every scene of cfg.batchSource in one process
+ * @return 1 if the inputs or the output cannot be opened, or a scene failed
+ */
+int runBatch(const AppConfig& cfg) {
+    printHeader("BATCH PROCESSING");
+    
+    std::vector<std::string> files;
+    if (!BatchProcessor::collectInputs(cfg.batchSource, files)) return 1;
+    if (files.empty()) {
+        std::cerr << "Error: No scenes found in " << cfg.batchSource << "\n";
+        return 1;
+    }
+    
+    std::ofstream out(cfg.batchOutput);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot create " << cfg.batchOutput << "\n";
+        return 1;
+    }
+    
+    BatchConfig batchCfg;
+    batchCfg.threshold = cfg.threshold;
+    batchCfg.topK = cfg.topK;
+    batchCfg.prefixStorage = cfg.prefixStorage;
+    batchCfg.treeLayout = cfg.treeLayout;
+    
+    BatchProcessor batch(batchCfg);
+    std::cout << "Scenes: " << formatNumber(static_cast<int64_t>(files.size()))
+              << " from " << cfg.batchSource << "\n";
+    std::cout << "Threads: " << ThreadPool::shared().getThreadCount() << "\n";
+    
+    bool written = batch.run(files, out);
+    const BatchResult& result = batch.getResult();
+    double seconds = result.wallMs / 1000.0;
+    
+    std::cout << "Scenes in flight: " << result.inFlight << "\n";
+    std::cout << "\nProcessed: " << formatNumber(result.scenes) << " scenes ("
+              << result.failed << " failed), " << formatNumber(result.pixels) << " pixels\n";
+    std::cout << "Wall time: " << formatTime(result.wallMs) << "\n";
+    if (seconds > 0) {
+        std::cout << "Throughput: " << std::fixed << std::setprecision(1)
+                  << result.scenes / seconds << " scenes/s, "
+                  << result.pixels / seconds / 1e6 << " Mpixel/s\n";
+    }
+    std::cout << "Stage time over all scenes: load " << formatTime(result.loadMs)
+              << ", build " << formatTime(result.buildMs)
+              << ", query " << formatTime(result.queryMs) << "\n";
+    std::cout << "Workspaces: " << result.workspacesCreated << " created, reused "
+              << formatNumber(result.workspaceReuses) << " times\n";
+    
+    if (!written) {
+        std::cerr << "Error: Failed writing " << cfg.batchOutput << "\n";
+        return 1;
+    }
+    std::cout << "Results: " << cfg.batchOutput << "\n";
+    return result.failed > 0 ? 1 : 0;
+}
+
+// ============================================================================
+// SERIES MODE
+// ============================================================================
+
+/**
+ * @brief Score the change between each pair of consecutive scenes of cfg.seriesSource
+ * @return 1 if the inputs or the output cannot be opened, or a pair failed
+ */
+int runSeries(const AppConfig& cfg) {
+    printHeader("CHANGE DETECTION");
+    
+    std::vector<std::string> files;
+    if (!BatchProcessor::collectInputs(cfg.seriesSource, files)) return 1;
+    if (files.size() < 2) {
+        std::cerr << "Error: A series needs at least two scenes, found " << files.size()
+                  << " in " << cfg.seriesSource << "\n";
+        return 1;
+    }
+    
+    std::ofstream out(cfg.seriesOutput);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot create " << cfg.seriesOutput << "\n";
+        return 1;
+    }
+    
+    SeriesConfig seriesCfg;
+    seriesCfg.threshold = cfg.threshold;
+    seriesCfg.topK = cfg.topK;
+    seriesCfg.treeLayout = cfg.treeLayout;
+    
+    SceneSeries series(seriesCfg);
+    std::cout << "Scenes: " << formatNumber(static_cast<int64_t>(files.size()))
+              << " from " << cfg.seriesSource << "\n";
+    std::cout << "Threads: " << ThreadPool::shared().getThreadCount() << "\n\n";
+    
+    Timer wall;
+    wall.start();
+    ImageLoader loader;
+    int pairs = 0;
+    int failed = 0;
+    double loadMs = 0;
+    double buildMs = 0;
+    double queryMs = 0;
+    SceneSeries::writeHeader(out);
+    for (const std::string& file : files) {
+        Timer timer;
+        timer.start();
+        const bool loaded = loader.loadFromPGM(file);
+        timer.stop();
+        loadMs += timer.elapsedMs();
+        
+        // An unreadable scene is reported and skipped: the next one is
+        // compared with the last scene that did load
+        if (!loaded || !series.addScene(loader.getImage(), file)) {
+            ChangeSummary change;
+            change.after = file;
+            change.error = "cannot load image";
+            SceneSeries::writeRow(out, change);
+            std::cout << "  " << file << ": " << change.error << "\n";
+            pairs++;
+            failed++;
+            continue;
+        }
+        if (series.getSceneCount() < 2) continue;
+        
+        const ChangeSummary& change = series.getLastChange();
+        SceneSeries::writeRow(out, change);
+        pairs++;
+        buildMs += change.buildMs;
+        queryMs += change.queryMs;
+        if (!change.ok) {
+            failed++;
+            std::cout << "  " << change.after << ": " << change.error << "\n";
+            continue;
+        }
+        if (cfg.verbose) {
+            std::cout << "  " << change.after << ": mean change " << std::fixed
+                      << std::setprecision(2) << change.meanChange << " (stddev "
+                      << change.changeStdDev << "), " << formatNumber(change.changedLeaves)
+                      << " changed leaves in " << change.components << " components"
+                      << (change.treeReused ? "" : ", tree built") << "\n";
+        }
+    }
+    out.flush();
+    wall.stop();
+    
+    std::cout << "\nPairs: " << pairs << " (" << failed << " failed)\n";
+    std::cout << "Wall time: " << formatTime(wall.elapsedMs()) << "\n";
+    std::cout << "Stage time over all pairs: load " << formatTime(loadMs)
+              << ", build " << formatTime(buildMs) << ", query " << formatTime(queryMs) << "\n";
+    std::cout << "Series memory: " << formatBytes(series.getMemoryBytes()) << "\n";
+    
+    if (!out) {
+        std::cerr << "Error: Failed writing " << cfg.seriesOutput << "\n";
+        return 1;
+    }
+    std::cout << "Results: " << cfg.seriesOutput << "\n";
+    return failed > 0 ? 1 : 0;
+}
+
+// ============================================================================
+// SERVER MODE
+// ============================================================================
+
+/**
+ * @brief Keep scenes resident and answer queries until quit / shutdown
+ * 
+ * --load-index or --input is preloaded as scene "default". Diagnostics go to
+ * stderr so that stdout carries only protocol responses.
+ */
+int runServer(const AppConfig& cfg) {
+    ServerConfig serverCfg;
+    serverCfg.threshold = cfg.threshold;
+    serverCfg.prefixStorage = cfg.prefixStorage;
+    serverCfg.treeLayout = cfg.treeLayout;
+    
+    QueryServer server(serverCfg);
+    
+    std::string preload = !cfg.loadIndexFile.empty() ? cfg.loadIndexFile : cfg.inputFile;
+    if (!preload.empty()) {
+        std::string error;
+        if (!server.loadScene("default", preload, cfg.threshold, error)) {
+            std::cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        std::cerr << "Loaded scene 'default' from " << preload << "\n";
+    }
+    std::cerr << "Threads: " << ThreadPool::shared().getThreadCount() << "\n";
+    
+    if (cfg.servePort > 0) {
+        return server.serveTcp(cfg.servePort) ? 0 : 1;
+    }
+    server.serveStream(std::cin, std::cout);
+    return 0;
+}
+
+// ============================================================================
+// PATCH UPDATE
+// ============================================================================
+
+/**
+ * @brief Replace a rectangle of the scene with cfg.patchFile, updating in place
+ *
+ * Prefix tables, node statistics and scores are updated for the patch
+ * only; scores keep the scene's original reference statistics.
+ */
+bool applyPatch(const AppConfig& cfg, Matrix& image, PrefixSum& prefixSum,
+                RegionTree& regionTree, AnomalyDetector& detector) {
+    ImageLoader patchLoader;
+    if (!patchLoader.loadFromPGM(cfg.patchFile)) {
+        std::cerr << "Error: Failed to load patch\n";
+        return false;
+    }
+    const Matrix& patch = patchLoader.getImage();
+    
+    Timer timer;
+    timer.start();
+    if (!prefixSum.updateRegion(cfg.patchRow, cfg.patchCol, patch)) return false;
+    timer.stop();
+    double prefixMs = timer.elapsedMs();
+    
+    Region bounds(cfg.patchRow, cfg.patchCol,
+                  cfg.patchRow + patch.rows() - 1, cfg.patchCol + patch.cols() - 1);
+    timer.start();
+    int refreshed = regionTree.refreshRegion(bounds);
+    timer.stop();
+    double treeMs = timer.elapsedMs();
+    
+    detector.detectInRegion(regionTree, bounds);
+    
+    // Keep the pixels in step for pixel labeling and the visualizations
+    for (int r = 0; r < patch.rows(); r++) {
+        std::copy(patch[r], patch[r] + patch.cols(), image[bounds.row1 + r] + bounds.col1);
+    }
+    
+    const auto& stats = detector.getStats();
+    std::cout << "\nPatch update: " << patch.rows() << "x" << patch.cols() << " at ("
+              << bounds.row1 << ", " << bounds.col1 << ") from " << cfg.patchFile << "\n";
+    std::cout << "  Prefix table update: " << formatTime(prefixMs)
+              << " (" << storageName(prefixSum.getStorage()) << ")\n";
+    std::cout << "  Region tree refresh: " << formatNumber(refreshed) << " of "
+              << formatNumber(regionTree.getNodeCount()) << " nodes in " << formatTime(treeMs) << "\n";
+    std::cout << "  Re-scoring time: " << formatTime(stats.detectionTimeMs) << "\n";
+    std::cout << "  Anomalous regions: " << formatNumber(stats.anomalousRegions) << "\n";
+    return true;
+}
+
+// ============================================================================
+// PROFILING
+// ============================================================================
+
+/**
+ * Global allocation functions, replaced here (not in the library, whose
+ * objects benchmarks link with their own) so --profile can count heap
+ * allocations. Every form is replaced, array and nothrow included, so the
+ * count is complete and each allocation is released by its own free().
+ * With profiling off the only extra work is one relaxed load.
+ */
+namespace {
+
+void* countedAlloc(std::size_t size) noexcept {
+    Profiler::countAllocation();
+    return std::malloc(size ? size : 1);
+}
+
+void* countedAlignedAlloc(std::size_t size, std::align_val_t alignment) noexcept {
+    Profiler::countAllocation();
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    // aligned_alloc needs a size that is a multiple of the alignment
+    const std::size_t rounded = ((size ? size : 1) + align - 1) / align * align;
+    return std::aligned_alloc(align, rounded);
+}
+
+} // anonymous namespace
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAlignedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAlignedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+/**
+ * @brief Enables profiling for its lifetime and writes the report on every exit path
+ */
+class ProfileSession {
+private:
+    std::string path;
+    bool trace;
+
+public:
+    explicit ProfileSession(const AppConfig& cfg) : path(cfg.profileFile), trace(cfg.profileTrace) {
+        if (!path.empty()) Profiler::enable(trace);
+    }
+
+    ~ProfileSession() {
+        if (path.empty()) return;
+        // stderr: in --serve mode stdout carries the protocol
+        bool ok = trace ? Profiler::writeChromeTrace(path) : Profiler::writeReport(path);
+        if (ok) std::cerr << "Profile written to " << path << "\n";
+    }
+
+    ProfileSession(const ProfileSession&) = delete;
+    ProfileSession& operator=(const ProfileSession&) = delete;
+};
+
 // ============================================================================
 // MAIN PROGRAM
 // ============================================================================
 
 int main(int argc, char* argv[]) {
     AppConfig cfg = parseArgs(argc, argv);
+    ThreadPool::setSharedThreadCount(cfg.numThreads);
+    ProfileSession profile(cfg);
+    
+    if (cfg.serve) {
+        return runServer(cfg);
+    }
     
     // Print banner
     printHeader("SKYMATRIX: SATELLITE ANALYTICS ENGINE");
@@ -110,6 +743,25 @@ int main(int argc, char* argv[]) {
     std::cout << "Demonstrating: Dynamic Programming, Divide & Conquer,\n";
     std::cout << "               Priority Queues, and Graph Algorithms\n\n";
     
+    if (cfg.streaming) {
+        return runStreaming(cfg);
+    }
+    if (!cfg.batchSource.empty()) {
+        return runBatch(cfg);
+    }
+    if (!cfg.seriesSource.empty()) {
+        return runSeries(cfg);
+    }
+    if (!cfg.loadIndexFile.empty()) {
+        return runFromIndex(cfg);
+    }
+    
+    const bool multiBand = isMultiBand(cfg);
+    if (multiBand && (!cfg.patchFile.empty() || !cfg.saveIndexFile.empty())) {
+        std::cerr << "Error: --patch and --save-index work on single-band scenes only\n";
+        return 1;
+    }
+    
     Timer totalTimer;
     totalTimer.start();
     
@@ -125,22 +777,41 @@ int main(int argc, char* argv[]) {
     if (!cfg.inputFile.empty()) {
         std::cout << "Loading image from: " << cfg.inputFile << "\n";
         stageTimer.start();
-        if (!loader.loadFromPGM(cfg.inputFile)) {
+        if (!(multiBand ? loader.loadMultiBand(cfg.inputFile) : loader.loadFromPGM(cfg.inputFile))) {
             std::cerr << "Error: Failed to load image\n";
             return 1;
         }
         stageTimer.stop();
+        
+        const LoadStats& loadStats = loader.getLoadStats();
+        std::cout << "  Format: " << loadStats.format << ", maxVal " << loadStats.maxVal
+                  << ", " << formatBytes(loadStats.fileBytes) << "\n";
+        std::cout << "  File " << (loadStats.memoryMapped ? "mapping" : "read") << ": "
+                  << formatTime(loadStats.readMs) << "\n";
+        std::cout << "  Pixel decode: " << formatTime(loadStats.decodeMs)
+                  << " (" << loadStats.decodeChunks << " chunks)\n";
     } else {
         std::cout << "Generating synthetic satellite image...\n";
         std::cout << "  Size: " << cfg.imageSize << "x" << cfg.imageSize << "\n";
         std::cout << "  Anomalies: " << cfg.numAnomalies << "\n";
         
+        if (multiBand) std::cout << "  Bands: " << cfg.bands << "\n";
+        
         stageTimer.start();
-        loader.generateSyntheticImage(cfg.imageSize, cfg.numAnomalies, 42);
+        if (multiBand) {
+            loader.generateSyntheticMultiBand(cfg.imageSize, cfg.bands, cfg.numAnomalies, 42);
+        } else {
+            loader.generateSyntheticImage(cfg.imageSize, cfg.numAnomalies, 42);
+        }
         stageTimer.stop();
     }
+    if (multiBand) {
+        const MultiBandImage& bands = loader.getBands();
+        std::cout << "  Multi-band: " << bands.bands << " bands, maxVal " << bands.maxVal
+                  << " (composite of the bands drives the region tree)\n";
+    }
     
-    const Matrix& image = loader.getImage();
+    Matrix& image = loader.getImageMutable();
     std::cout << "\nImage dimensions: " << loader.getHeight() << " x " 
               << loader.getWidth() << "\n";
     std::cout << "Total pixels: " << formatNumber(
@@ -154,13 +825,16 @@ int main(int argc, char* argv[]) {
     printHeader("STAGE 2: PREFIX SUM CONSTRUCTION");
     std::cout << "\nBuilding 2D prefix sum matrices using Dynamic Programming...\n";
     std::cout << "This enables O(1) region sum and variance queries.\n";
+    std::cout << "Threads: " << ThreadPool::shared().getThreadCount() << "\n";
     
     PrefixSum prefixSum;
     stageTimer.start();
-    prefixSum.build(image);
+    prefixSum.build(image, cfg.prefixStorage);
     stageTimer.stop();
     
     std::cout << "\nPrefix sum build time: " << formatTime(stageTimer.elapsedMs()) << "\n";
+    std::cout << "Prefix table memory: " << formatBytes(prefixSum.getMemoryBytes())
+              << " (" << storageName(prefixSum.getStorage()) << ")\n";
     std::cout << "Global statistics:\n";
     std::cout << "  Mean: " << std::fixed << std::setprecision(2) 
               << prefixSum.getGlobalMean() << "\n";
@@ -173,6 +847,29 @@ int main(int argc, char* argv[]) {
         std::cout << "  Verification: " << (correct ? "PASSED" : "FAILED") << "\n";
     }
     
+    // Band sums and cross-products, one interleaved table
+    MultiBandPrefixSum bandPrefix;
+    if (multiBand) {
+        const MultiBandImage& bands = loader.getBands();
+        stageTimer.start();
+        bool builtBands = bandPrefix.build(bands, cfg.bandScoring == BandScoring::Mahalanobis);
+        stageTimer.stop();
+        if (!builtBands) return 1;
+        
+        std::cout << "\nBand tables: " << bandPrefix.getChannels() << " channels ("
+                  << bands.bands << " sums + "
+                  << (bandPrefix.hasCrossProducts() ? "cross-products" : "squares") << ")\n";
+        std::cout << "  Build time: " << formatTime(stageTimer.elapsedMs()) << "\n";
+        std::cout << "  Memory: " << formatBytes(bandPrefix.getMemoryBytes()) << "\n";
+        std::cout << "  Band means:";
+        for (double m : bandPrefix.getGlobalMean()) std::cout << " " << std::setprecision(1) << m;
+        std::cout << "\n" << std::setprecision(2);
+        if (cfg.verbose) {
+            bool correct = bandPrefix.verify(bands, Region(0, 0, 31, 31));
+            std::cout << "  Verification: " << (correct ? "PASSED" : "FAILED") << "\n";
+        }
+    }
+    
     // ========================================================================
     // STAGE 3: REGION TREE CONSTRUCTION (DIVIDE AND CONQUER)
     // ========================================================================
@@ -183,7 +880,8 @@ int main(int argc, char* argv[]) {
     
     RegionTree regionTree;
     stageTimer.start();
-    regionTree.build(&prefixSum, SatelliteAnalytics::Config::MIN_REGION_SIZE);
+    regionTree.build(&prefixSum, SatelliteAnalytics::Config::MIN_REGION_SIZE, cfg.treeLayout,
+                     cfg.adaptiveTree);
     stageTimer.stop();
     
     regionTree.printStats();
@@ -198,6 +896,18 @@ int main(int argc, char* argv[]) {
     
     AnomalyDetector detector(cfg.threshold);
     detector.initialize(&prefixSum);
+    if (cfg.localBaseline > 0 && !multiBand) {
+        detector.setBaseline(ScoreBaseline::Local, cfg.localBaseline);
+        std::cout << "Baseline: local ring " << cfg.localBaseline << "x the region size, beyond a "
+                  << Config::LOCAL_GUARD_SCALE << "x guard band\n";
+    }
+    if (multiBand) {
+        detector.initializeBands(&bandPrefix, cfg.bandScoring);
+        std::cout << "Combining " << bandPrefix.getBands() << " bands: "
+                  << (detector.getBandScoring() == BandScoring::Mahalanobis
+                      ? "Mahalanobis distance (global band covariance)"
+                      : "RMS of per-band z-scores") << "\n";
+    }
     
     stageTimer.start();
     detector.detectInTree(regionTree);
@@ -213,6 +923,20 @@ int main(int argc, char* argv[]) {
               << ", " << stats.maxScore << "]\n";
     std::cout << "  Detection time: " << formatTime(stats.detectionTimeMs) << "\n";
     
+    if (!cfg.patchFile.empty() && !applyPatch(cfg, image, prefixSum, regionTree, detector)) {
+        return 1;
+    }
+    
+    if (!cfg.saveIndexFile.empty()) {
+        stageTimer.start();
+        bool saved = SceneIndex::save(cfg.saveIndexFile, prefixSum, regionTree, &detector);
+        stageTimer.stop();
+        if (saved) {
+            std::cout << "  Saved scene index to: " << cfg.saveIndexFile
+                      << " (" << formatTime(stageTimer.elapsedMs()) << ")\n";
+        }
+    }
+    
     // ========================================================================
     // STAGE 5: QUERY EXECUTION
     // ========================================================================
@@ -247,7 +971,7 @@ int main(int argc, char* argv[]) {
     // --- CONNECTED COMPONENTS (Union-Find) ---
     std::cout << "\n--- Query 3: Connected Components (Union-Find) ---\n";
     std::cout << "Finding connected anomalous regions using Union-Find.\n";
-    std::cout << "Uses path compression and union by rank.\n";
+    std::cout << "Uses path halving and union by size.\n";
     std::cout << "Time complexity: O(n × α(n)) ≈ O(n)\n";
     
     stageTimer.start();
@@ -295,6 +1019,57 @@ int main(int argc, char* argv[]) {
     auto rectResult = queryEngine.queryRectangle(queryRegion);
     visualizer.printQueryResult(rectResult, "Rectangle Query");
     
+    // --- PIXEL-LEVEL COMPONENTS ---
+    if (cfg.pixelComponents) {
+        std::cout << "\n--- Query 7: Pixel-Level Connected Components ---\n";
+        std::cout << "Labeling anomalous pixels (|z| > threshold) with two-pass union-find.\n";
+        std::cout << "Time complexity: O(H × W × α) in parallel bands\n";
+        
+        PixelLabeler labeler(cfg.threshold);
+        labeler.initialize(&image, &prefixSum);
+        auto pixelComponents = labeler.label();
+        const PixelLabelStats& labelStats = labeler.getStats();
+        
+        std::cout << "\nPixel components found: " << formatNumber(labelStats.components) << "\n";
+        std::cout << "Anomalous pixels: " << formatNumber(labelStats.foregroundPixels) << "\n";
+        std::cout << "Bands: " << labelStats.bands << "\n";
+        std::cout << "Query time: " << formatTime(labelStats.labelTimeMs) << "\n";
+        
+        if (!pixelComponents.empty()) {
+            visualizer.printPixelComponentSummary(pixelComponents);
+        }
+    }
+    
+    // --- THRESHOLD SWEEP ---
+    if (!cfg.sweepThresholds.empty()) {
+        std::cout << "\n--- Query 8: Incremental Threshold Sweep ---\n";
+        std::cout << "Sorted scores + leaf merge tree: only nodes whose score lies\n";
+        std::cout << "between the old and new threshold are touched.\n";
+        
+        ThresholdSweep sweep;
+        stageTimer.start();
+        sweep.initialize(regionTree, detector);
+        sweep.trackComponents();
+        stageTimer.stop();
+        std::cout << "Setup time (sort + merge tree): " << formatTime(stageTimer.elapsedMs()) << "\n\n";
+        
+        std::cout << std::left << std::setw(12) << "Threshold" << std::setw(12) << "Flipped"
+                  << std::setw(12) << "Anomalous" << std::setw(12) << "Components"
+                  << "Update time\n";
+        for (double t : cfg.sweepThresholds) {
+            int flipped = sweep.setThreshold(t);
+            std::cout << std::left << std::setw(12) << std::setprecision(3) << t
+                      << std::setw(12) << flipped
+                      << std::setw(12) << sweep.getAnomalousLeafCount()
+                      << std::setw(12) << sweep.getComponentCount()
+                      << formatTime(sweep.getLastUpdateMs()) << "\n";
+        }
+        std::cout << std::right;
+        
+        // Later stages report the configured threshold
+        sweep.setThreshold(cfg.threshold);
+    }
+    
     // ========================================================================
     // STAGE 6: VISUALIZATION
     // ========================================================================
@@ -306,10 +1081,10 @@ int main(int argc, char* argv[]) {
         int scale = std::max(1, cfg.imageSize / 64);
         
         std::cout << "\n--- Original Image (scaled) ---\n";
-        visualizer.renderASCII(image, scale);
+        visualizer.renderASCII(prefixSum, scale);
         
         std::cout << "\n--- Anomaly Map ---\n";
-        visualizer.renderAnomalyMap(image, regionTree, scale);
+        visualizer.renderAnomalyMap(prefixSum, regionTree, scale);
         
         if (!components.empty()) {
             std::cout << "\n--- Connected Components ---\n";
@@ -321,6 +1096,18 @@ int main(int argc, char* argv[]) {
         if (visualizer.savePGM(overlayImage, cfg.outputFile)) {
             std::cout << "\nSaved anomaly overlay to: " << cfg.outputFile << "\n";
         }
+        
+        // Downscaled overlays, each box-filtered straight from the prefix sums
+        std::vector<Matrix> pyramid = visualizer.buildPreviewPyramid(prefixSum, cfg.previewLevels);
+        for (size_t level = 0; level < pyramid.size(); level++) {
+            const int factor = 2 << level;
+            const std::string previewFile = previewFileName(cfg.outputFile, factor);
+            Matrix preview = visualizer.createAnomalyOverlay(pyramid[level], regionTree, factor);
+            if (visualizer.savePGM(preview, previewFile)) {
+                std::cout << "Saved " << preview.cols() << "x" << preview.rows()
+                          << " preview to: " << previewFile << "\n";
+            }
+        }
     }
     
     // ========================================================================
@@ -365,7 +1152,7 @@ int main(int argc, char* argv[]) {
 | Region tree build         | O(n²/B²)      | O(n²/B²)      |
 | Anomaly detection         | O(n²/B²)      | O(1)          |
 | Top-K query               | O(m log k)    | O(k)          |
-| Connected components (UF) | O(m² α(m))    | O(m)          |
+| Connected components (UF) | O((m+n) α(m)) | O(m + n)      |
 | Connected components (DFS)| O(m + edges)  | O(m)          |
 | Region query              | O(log n + r)  | O(r)          |
 +---------------------------+---------------+---------------+